@@ -0,0 +1,326 @@
+#include "async_frame_sink.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "util/log.h"
+
+/** Downcast frame_sink to sc_async_frame_sink */
+#define DOWNCAST(SINK) container_of(SINK, struct sc_async_frame_sink, frame_sink)
+
+// Must be called with the mutex locked
+static void
+sc_async_frame_sink_release_frame(struct sc_async_frame_sink *async,
+                                  AVFrame *frame) {
+    av_frame_unref(frame);
+    assert(async->free_count <= async->capacity);
+    async->free_frames[async->free_count++] = frame;
+}
+
+static int
+run_async_frame_sink(void *data) {
+    struct sc_async_frame_sink *async = data;
+    struct sc_frame_sink *target = async->target;
+
+    for (;;) {
+        sc_mutex_lock(&async->mutex);
+        while (!async->stopped && sc_vecdeque_is_empty(&async->queue)) {
+            sc_cond_wait(&async->cond, &async->mutex);
+        }
+
+        if (async->stopped) {
+            sc_mutex_unlock(&async->mutex);
+            break;
+        }
+
+        struct sc_async_frame_sink_item item = sc_vecdeque_pop(&async->queue);
+        sc_mutex_unlock(&async->mutex);
+
+        bool ok = true;
+        if (item.has_session && target->ops->push_session) {
+            ok = target->ops->push_session(target, &item.session);
+        }
+        if (ok) {
+            ok = target->ops->push(target, item.frame);
+        }
+
+        sc_mutex_lock(&async->mutex);
+        sc_async_frame_sink_release_frame(async, item.frame);
+        if (!ok) {
+            // Report the error to the source on the next push
+            async->failed = true;
+        }
+        sc_mutex_unlock(&async->mutex);
+
+        if (!ok) {
+            LOGE("Async frame sink '%s': sink error", async->name);
+            break;
+        }
+    }
+
+    LOGD("Async frame sink '%s': thread ended", async->name);
+
+    return 0;
+}
+
+static void
+sc_async_frame_sink_free_frames(struct sc_async_frame_sink *async) {
+    for (unsigned i = 0; i < async->free_count; ++i) {
+        av_frame_free(&async->free_frames[i]);
+    }
+    free(async->free_frames);
+}
+
+static bool
+sc_async_frame_sink_open(struct sc_async_frame_sink *async,
+                         const AVCodecContext *ctx,
+                         const struct sc_stream_session *session) {
+    // One more frame than the capacity for the frame being consumed
+    unsigned frame_count = async->capacity + 1;
+    async->free_frames = malloc(frame_count * sizeof(*async->free_frames));
+    if (!async->free_frames) {
+        LOG_OOM();
+        return false;
+    }
+
+    for (async->free_count = 0; async->free_count < frame_count;
+            ++async->free_count) {
+        AVFrame *frame = av_frame_alloc();
+        if (!frame) {
+            LOG_OOM();
+            goto error_free_frames;
+        }
+        async->free_frames[async->free_count] = frame;
+    }
+
+    sc_vecdeque_init(&async->queue);
+    bool ok = sc_vecdeque_reserve(&async->queue, async->capacity);
+    if (!ok) {
+        LOG_OOM();
+        goto error_free_frames;
+    }
+
+    ok = sc_mutex_init(&async->mutex);
+    if (!ok) {
+        goto error_destroy_queue;
+    }
+
+    ok = sc_cond_init(&async->cond);
+    if (!ok) {
+        goto error_mutex_destroy;
+    }
+
+    async->has_pending_session = false;
+    async->stopped = false;
+    async->failed = false;
+
+    struct sc_frame_sink *target = async->target;
+    ok = target->ops->open(target, ctx, session);
+    if (!ok) {
+        goto error_cond_destroy;
+    }
+
+    LOGD("Async frame sink '%s': starting thread", async->name);
+    ok = sc_thread_create(&async->thread, run_async_frame_sink,
+                          "scrcpy-async", async);
+    if (!ok) {
+        LOGE("Async frame sink '%s': could not start thread", async->name);
+        goto error_close_target;
+    }
+
+    return true;
+
+error_close_target:
+    target->ops->close(target);
+error_cond_destroy:
+    sc_cond_destroy(&async->cond);
+error_mutex_destroy:
+    sc_mutex_destroy(&async->mutex);
+error_destroy_queue:
+    sc_vecdeque_destroy(&async->queue);
+error_free_frames:
+    sc_async_frame_sink_free_frames(async);
+
+    return false;
+}
+
+static void
+sc_async_frame_sink_close(struct sc_async_frame_sink *async) {
+    sc_mutex_lock(&async->mutex);
+    async->stopped = true;
+    sc_cond_signal(&async->cond);
+    sc_mutex_unlock(&async->mutex);
+
+    sc_thread_join(&async->thread, NULL);
+
+    // The frames not consumed yet are dropped
+    while (!sc_vecdeque_is_empty(&async->queue)) {
+        struct sc_async_frame_sink_item *item =
+            sc_vecdeque_popref(&async->queue);
+        sc_async_frame_sink_release_frame(async, item->frame);
+    }
+
+    if (async->dropped) {
+        LOGD("Async frame sink '%s': %" PRIu64 "/%" PRIu64 " frames dropped",
+             async->name, async->dropped, async->pushed);
+    }
+
+    async->target->ops->close(async->target);
+
+    sc_cond_destroy(&async->cond);
+    sc_mutex_destroy(&async->mutex);
+    sc_vecdeque_destroy(&async->queue);
+    sc_async_frame_sink_free_frames(async);
+}
+
+// Must be called with the mutex locked
+static void
+sc_async_frame_sink_drop_oldest(struct sc_async_frame_sink *async) {
+    struct sc_async_frame_sink_item *item = sc_vecdeque_popref(&async->queue);
+
+    if (item->has_session && !async->has_pending_session) {
+        // The session must still be delivered before the next frame
+        if (!sc_vecdeque_is_empty(&async->queue)) {
+            struct sc_async_frame_sink_item *next =
+                &async->queue.data[async->queue.origin];
+            if (!next->has_session) {
+                next->has_session = true;
+                next->session = item->session;
+            }
+        } else {
+            async->has_pending_session = true;
+            async->pending_session = item->session;
+        }
+    }
+
+    sc_async_frame_sink_release_frame(async, item->frame);
+    ++async->dropped;
+}
+
+static bool
+sc_async_frame_sink_push(struct sc_async_frame_sink *async,
+                         const AVFrame *frame) {
+    sc_mutex_lock(&async->mutex);
+
+    if (async->failed) {
+        sc_mutex_unlock(&async->mutex);
+        return false;
+    }
+
+    ++async->pushed;
+
+    if (sc_vecdeque_size(&async->queue) >= async->capacity) {
+        // Never block the source
+        sc_async_frame_sink_drop_oldest(async);
+    }
+
+    assert(async->free_count);
+    AVFrame *ref = async->free_frames[--async->free_count];
+    if (av_frame_ref(ref, frame)) {
+        async->free_frames[async->free_count++] = ref;
+        sc_mutex_unlock(&async->mutex);
+        LOG_OOM();
+        return false;
+    }
+
+    struct sc_async_frame_sink_item item = {
+        .frame = ref,
+        .has_session = async->has_pending_session,
+    };
+    if (async->has_pending_session) {
+        item.session = async->pending_session;
+        async->has_pending_session = false;
+    }
+
+    sc_vecdeque_push_noresize(&async->queue, item);
+    sc_cond_signal(&async->cond);
+
+    sc_mutex_unlock(&async->mutex);
+
+    return true;
+}
+
+static bool
+sc_async_frame_sink_push_session(struct sc_async_frame_sink *async,
+                                 const struct sc_stream_session *session) {
+    sc_mutex_lock(&async->mutex);
+    // Delivered with the next frame
+    async->has_pending_session = true;
+    async->pending_session = *session;
+    sc_mutex_unlock(&async->mutex);
+
+    return true;
+}
+
+static bool
+sc_async_frame_sink_frame_sink_open(struct sc_frame_sink *sink,
+                                    const AVCodecContext *ctx,
+                                    const struct sc_stream_session *session) {
+    struct sc_async_frame_sink *async = DOWNCAST(sink);
+    return sc_async_frame_sink_open(async, ctx, session);
+}
+
+static void
+sc_async_frame_sink_frame_sink_close(struct sc_frame_sink *sink) {
+    struct sc_async_frame_sink *async = DOWNCAST(sink);
+    sc_async_frame_sink_close(async);
+}
+
+static bool
+sc_async_frame_sink_frame_sink_push(struct sc_frame_sink *sink,
+                                    const AVFrame *frame) {
+    struct sc_async_frame_sink *async = DOWNCAST(sink);
+    return sc_async_frame_sink_push(async, frame);
+}
+
+static bool
+sc_async_frame_sink_frame_sink_push_session(struct sc_frame_sink *sink,
+                                    const struct sc_stream_session *session) {
+    struct sc_async_frame_sink *async = DOWNCAST(sink);
+    return sc_async_frame_sink_push_session(async, session);
+}
+
+void
+sc_async_frame_sink_init(struct sc_async_frame_sink *async, const char *name,
+                         struct sc_frame_sink *target,
+                         enum sc_async_frame_sink_policy policy,
+                         unsigned capacity) {
+    assert(target && target->ops);
+    assert(policy == SC_ASYNC_FRAME_SINK_POLICY_LATEST || capacity);
+
+    async->name = name; // statically allocated
+    async->target = target;
+    async->policy = policy;
+    async->capacity = policy == SC_ASYNC_FRAME_SINK_POLICY_LATEST ? 1
+                                                                  : capacity;
+    async->pushed = 0;
+    async->dropped = 0;
+
+    // The frames are forwarded as is, so the adapter accepts hardware frames
+    // only if the wrapped sink does
+    static const struct sc_frame_sink_ops ops = {
+        .open = sc_async_frame_sink_frame_sink_open,
+        .close = sc_async_frame_sink_frame_sink_close,
+        .push = sc_async_frame_sink_frame_sink_push,
+        .push_session = sc_async_frame_sink_frame_sink_push_session,
+    };
+    static const struct sc_frame_sink_ops hw_ops = {
+        .open = sc_async_frame_sink_frame_sink_open,
+        .close = sc_async_frame_sink_frame_sink_close,
+        .push = sc_async_frame_sink_frame_sink_push,
+        .push_session = sc_async_frame_sink_frame_sink_push_session,
+        .accept_hw_frames = true,
+    };
+
+    async->frame_sink.ops = target->ops->accept_hw_frames ? &hw_ops : &ops;
+}
+
+void
+sc_async_frame_sink_get_stats(struct sc_async_frame_sink *async,
+                              uint64_t *pushed, uint64_t *dropped) {
+    sc_mutex_lock(&async->mutex);
+    *pushed = async->pushed;
+    *dropped = async->dropped;
+    sc_mutex_unlock(&async->mutex);
+}
@@ -0,0 +1,93 @@
+#ifndef SC_ASYNC_FRAME_SINK_H
+#define SC_ASYNC_FRAME_SINK_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <libavutil/frame.h>
+
+#include "trait/frame_sink.h"
+#include "util/thread.h"
+#include "util/vecdeque.h"
+
+/**
+ * Asynchronous frame sink adapter
+ *
+ * Wrap a frame sink so that its push() is called from a separate thread: the
+ * source (typically the decoder) only takes a new reference to each frame, so
+ * a slow sink never delays the other sinks of the same source.
+ *
+ * The frames waiting to be consumed are bounded. When the queue is full, the
+ * oldest frame is dropped (and counted), the source is never blocked.
+ *
+ * The wrapped sink is opened and closed from the caller thread (on open and
+ * close of the adapter). A new session is delivered (from the adapter
+ * thread) just before the first frame following it.
+ */
+enum sc_async_frame_sink_policy {
+    // Keep only the most recent frame (e.g. for a display or an encoder)
+    SC_ASYNC_FRAME_SINK_POLICY_LATEST,
+    // Keep up to `capacity` frames, in order (e.g. for a consumer which must
+    // see most frames, but may be late temporarily)
+    SC_ASYNC_FRAME_SINK_POLICY_FIFO,
+};
+
+struct sc_async_frame_sink_item {
+    AVFrame *frame;
+    // The session to push before the frame
+    bool has_session;
+    struct sc_stream_session session;
+};
+
+struct sc_async_frame_sink {
+    struct sc_frame_sink frame_sink; // frame sink trait
+
+    const char *name; // must be statically allocated (e.g. a string literal)
+    struct sc_frame_sink *target; // the wrapped sink
+    enum sc_async_frame_sink_policy policy;
+    unsigned capacity; // max queued frames (1 for POLICY_LATEST)
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+
+    struct SC_VECDEQUE(struct sc_async_frame_sink_item) queue;
+    // Unused frames, to avoid an allocation per frame
+    AVFrame **free_frames;
+    unsigned free_count;
+
+    // Session received, to attach to the next frame
+    bool has_pending_session;
+    struct sc_stream_session pending_session;
+
+    bool stopped;
+    bool failed; // the wrapped sink returned an error
+
+    // Counters (protected by the mutex)
+    uint64_t pushed;
+    uint64_t dropped;
+};
+
+/**
+ * Initialize an adapter forwarding the frames to `target`
+ *
+ * The name must be statically allocated (e.g. a string literal). The capacity
+ * is ignored for SC_ASYNC_FRAME_SINK_POLICY_LATEST.
+ */
+void
+sc_async_frame_sink_init(struct sc_async_frame_sink *async, const char *name,
+                         struct sc_frame_sink *target,
+                         enum sc_async_frame_sink_policy policy,
+                         unsigned capacity);
+
+/**
+ * Get the number of frames received and dropped
+ *
+ * It may be called from any thread while the sink is open.
+ */
+void
+sc_async_frame_sink_get_stats(struct sc_async_frame_sink *async,
+                              uint64_t *pushed, uint64_t *dropped);
+
+#endif
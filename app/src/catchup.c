@@ -0,0 +1,239 @@
+#include "catchup.h"
+
+#include <assert.h>
+#include <inttypes.h>
+
+#include "util/log.h"
+#include "util/trace.h"
+
+#define SC_CATCHUP_AVERAGE_RANGE 32
+
+// Do not request key frames more often (the device may take some time to
+// produce one)
+#define SC_CATCHUP_KEY_FRAME_REQUEST_INTERVAL SC_TICK_FROM_SEC(1)
+
+// Ignore the long intervals between packets when the screen content does not
+// change, to convert the pending bytes to a duration
+#define SC_CATCHUP_MAX_PACKET_INTERVAL SC_TICK_FROM_MS(100)
+
+void
+sc_catchup_init(struct sc_catchup *catchup, sc_tick threshold,
+                const struct sc_catchup_callbacks *cbs, void *cbs_userdata) {
+    assert(threshold > 0);
+    assert(!cbs || cbs->on_request_key_frame);
+
+    catchup->threshold = threshold;
+    catchup->state = SC_CATCHUP_STATE_NORMAL;
+    catchup->state_since = 0;
+    catchup->last_request = 0;
+
+    sc_clock_init(&catchup->clock);
+
+    catchup->has_pending = false;
+    catchup->pending = 0;
+
+    sc_average_init(&catchup->packet_size, SC_CATCHUP_AVERAGE_RANGE);
+    sc_average_init(&catchup->packet_interval, SC_CATCHUP_AVERAGE_RANGE);
+    catchup->last_pts = -1;
+    catchup->last_push = 0;
+    catchup->last_dropped = false;
+
+    catchup->stats.ref_only = 0;
+    catchup->stats.drops = 0;
+    catchup->stats.dropped_packets = 0;
+    catchup->stats.key_frame_requests = 0;
+
+    catchup->cbs = cbs;
+    catchup->cbs_userdata = cbs_userdata;
+}
+
+void
+sc_catchup_destroy(struct sc_catchup *catchup) {
+    const struct sc_catchup_stats *stats = &catchup->stats;
+    if (stats->ref_only) {
+        LOGI("Video catch-up: triggered %" PRIu64 " times (%" PRIu64
+             " times until a key frame, %" PRIu64 " packets dropped, %"
+             PRIu64 " key frames requested)", stats->ref_only, stats->drops,
+             stats->dropped_packets, stats->key_frame_requests);
+    }
+}
+
+void
+sc_catchup_set_pending(struct sc_catchup *catchup, uint64_t bytes) {
+    catchup->has_pending = true;
+    catchup->pending = bytes;
+}
+
+static void
+sc_catchup_reset_clock(struct sc_catchup *catchup, int64_t pts, sc_tick now) {
+    sc_clock_init(&catchup->clock);
+    sc_clock_update(&catchup->clock, now, pts);
+}
+
+// Return the lag of a packet received now
+static sc_tick
+sc_catchup_compute_lag(struct sc_catchup *catchup, int64_t pts, sc_tick now) {
+    if (!catchup->clock.range) {
+        sc_clock_update(&catchup->clock, now, pts);
+        return 0;
+    }
+
+    sc_tick lag = now - sc_clock_to_system_time(&catchup->clock, pts);
+
+    if (lag > catchup->threshold && catchup->has_pending
+            && !catchup->pending) {
+        // Nothing is waiting to be decoded: the packets are late on the
+        // network (or the path changed), dropping frames would not help
+        sc_catchup_reset_clock(catchup, pts, now);
+        return 0;
+    }
+
+    // Only the packets received on time update the clock, otherwise it would
+    // absorb a growing backlog
+    if (lag <= catchup->threshold / 4) {
+        sc_clock_update(&catchup->clock, now, pts);
+    }
+
+    return lag;
+}
+
+// Return the time needed to play the pending bytes
+static sc_tick
+sc_catchup_compute_pending_duration(struct sc_catchup *catchup, int64_t pts,
+                                    size_t size) {
+    sc_average_push(&catchup->packet_size, size);
+    if (catchup->last_pts != -1 && pts > catchup->last_pts) {
+        sc_tick interval = pts - catchup->last_pts;
+        if (interval > SC_CATCHUP_MAX_PACKET_INTERVAL) {
+            interval = SC_CATCHUP_MAX_PACKET_INTERVAL;
+        }
+        sc_average_push(&catchup->packet_interval, interval);
+    }
+    catchup->last_pts = pts;
+
+    if (!catchup->pending || !catchup->packet_interval.count) {
+        return 0;
+    }
+
+    float packets = catchup->pending / sc_average_get(&catchup->packet_size);
+    return packets * sc_average_get(&catchup->packet_interval);
+}
+
+static void
+sc_catchup_request_key_frame(struct sc_catchup *catchup, sc_tick now) {
+    if (!catchup->cbs) {
+        // The next key frame will be produced on the device i-frame interval
+        return;
+    }
+
+    if (catchup->last_request
+            && now - catchup->last_request
+                    < SC_CATCHUP_KEY_FRAME_REQUEST_INTERVAL) {
+        return;
+    }
+
+    LOGD("Video catch-up: requesting a key frame");
+    catchup->last_request = now;
+    ++catchup->stats.key_frame_requests;
+    catchup->cbs->on_request_key_frame(catchup, catchup->cbs_userdata);
+}
+
+static enum sc_catchup_action
+sc_catchup_decide(struct sc_catchup *catchup, int64_t pts, size_t size,
+                  bool key_frame, sc_tick now) {
+    // The dropped packets are consumed immediately: if the previous one was
+    // dropped and this one came later than half its stream interval, nothing
+    // was queued locally, the demuxer had to wait for it
+    bool waited = catchup->last_dropped && pts > catchup->last_pts
+               && now - catchup->last_push >= (pts - catchup->last_pts) / 2;
+
+    sc_tick lag = sc_catchup_compute_lag(catchup, pts, now);
+    sc_tick pending = sc_catchup_compute_pending_duration(catchup, pts, size);
+    sc_tick backlog = lag > pending ? lag : pending;
+
+    sc_trace_counter("video backlog (ms)", backlog / 1000);
+
+    sc_tick threshold = catchup->threshold;
+
+    switch (catchup->state) {
+        case SC_CATCHUP_STATE_NORMAL:
+            if (backlog <= threshold) {
+                return SC_CATCHUP_ACTION_DECODE;
+            }
+
+            LOGW("Video decoding is %" PRItick " ms behind, skipping "
+                 "non-reference frames", backlog / 1000);
+            catchup->state = SC_CATCHUP_STATE_REF_ONLY;
+            catchup->state_since = now;
+            ++catchup->stats.ref_only;
+            return SC_CATCHUP_ACTION_DECODE_REF_ONLY;
+
+        case SC_CATCHUP_STATE_REF_ONLY:
+            if (backlog < threshold / 2) {
+                LOGI("Video decoding caught up");
+                catchup->state = SC_CATCHUP_STATE_NORMAL;
+                return SC_CATCHUP_ACTION_DECODE;
+            }
+
+            if (backlog <= 2 * threshold
+                    && now - catchup->state_since < threshold) {
+                return SC_CATCHUP_ACTION_DECODE_REF_ONLY;
+            }
+
+            // Skipping the non-reference frames is not sufficient (typically,
+            // all the frames are references)
+            LOGW("Video decoding is %" PRItick " ms behind, dropping until "
+                 "the next key frame", backlog / 1000);
+            catchup->state = SC_CATCHUP_STATE_DROP;
+            catchup->state_since = now;
+            ++catchup->stats.drops;
+            // fall through
+
+        case SC_CATCHUP_STATE_DROP:
+            if (key_frame) {
+                // The decoder can restart from this packet
+                catchup->state_since = now;
+                if (backlog < threshold / 2) {
+                    LOGI("Video decoding caught up");
+                    catchup->state = SC_CATCHUP_STATE_NORMAL;
+                    return SC_CATCHUP_ACTION_DECODE;
+                }
+
+                if (waited && pending < threshold / 2) {
+                    // Still late without any backlog: the network delay
+                    // increased, dropping frames does not help
+                    LOGI("Video stream delayed by %" PRItick " ms on the "
+                         "network, not by the decoding", lag / 1000);
+                    sc_catchup_reset_clock(catchup, pts, now);
+                    catchup->state = SC_CATCHUP_STATE_NORMAL;
+                    return SC_CATCHUP_ACTION_DECODE;
+                }
+
+                // This key frame was already late, keep catching up
+                catchup->state = SC_CATCHUP_STATE_REF_ONLY;
+                return SC_CATCHUP_ACTION_DECODE_REF_ONLY;
+            }
+
+            sc_catchup_request_key_frame(catchup, now);
+            ++catchup->stats.dropped_packets;
+            return SC_CATCHUP_ACTION_DROP;
+
+        default:
+            assert(!"unexpected catch-up state");
+            return SC_CATCHUP_ACTION_DECODE;
+    }
+}
+
+enum sc_catchup_action
+sc_catchup_push(struct sc_catchup *catchup, int64_t pts, size_t size,
+                bool key_frame, sc_tick now) {
+    assert(pts >= 0);
+
+    enum sc_catchup_action action =
+        sc_catchup_decide(catchup, pts, size, key_frame, now);
+
+    catchup->last_push = now;
+    catchup->last_dropped = action == SC_CATCHUP_ACTION_DROP;
+
+    return action;
+}
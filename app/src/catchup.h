@@ -0,0 +1,116 @@
+#ifndef SC_CATCHUP_H
+#define SC_CATCHUP_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "clock.h"
+#include "util/average.h"
+#include "util/tick.h"
+
+enum sc_catchup_action {
+    // Decode the packet
+    SC_CATCHUP_ACTION_DECODE,
+    // Decode the packet, but skip the frames which are not used as references
+    // (AVDISCARD_NONREF)
+    SC_CATCHUP_ACTION_DECODE_REF_ONLY,
+    // Do not decode the packet (waiting for the next key frame)
+    SC_CATCHUP_ACTION_DROP,
+};
+
+struct sc_catchup_stats {
+    uint64_t ref_only; // number of times non-reference frames were skipped
+    uint64_t drops; // number of times packets were dropped until a key frame
+    uint64_t dropped_packets;
+    uint64_t key_frame_requests;
+};
+
+struct sc_catchup;
+
+struct sc_catchup_callbacks {
+    // Called from the thread pushing the packets to the decoder
+    void (*on_request_key_frame)(struct sc_catchup *catchup, void *userdata);
+};
+
+/**
+ * Catch-up policy of a video decoder falling behind the stream
+ *
+ * If the decoder (or the whole host) stalls, the packets back up in the
+ * socket, and the latency never recovers. The backlog is estimated from:
+ *  - the lag of the packets relative to the clock (estimated from the packets
+ *    received on time);
+ *  - the bytes waiting in the socket (reported by the demuxer).
+ *
+ * When the backlog exceeds the threshold, the non-reference frames are
+ * skipped. If this is not sufficient, all the packets are dropped until the
+ * next key frame, which is requested from the device (if possible).
+ *
+ * If the bytes waiting are unknown (reactor mode or replay), a lasting increase
+ * of the network delay cannot be distinguished from a backlog until the
+ * packets are dropped: a key frame which is still late although it had to be
+ * waited for resets the clock.
+ *
+ * It is not thread-safe: all the functions must be called from the thread
+ * pushing the packets (the demuxer thread or its strand jobs).
+ */
+struct sc_catchup {
+    sc_tick threshold;
+
+    enum {
+        SC_CATCHUP_STATE_NORMAL,
+        SC_CATCHUP_STATE_REF_ONLY,
+        SC_CATCHUP_STATE_DROP,
+    } state;
+    sc_tick state_since;
+    sc_tick last_request; // 0 if no key frame has been requested
+
+    // Stream time to arrival time of the packets which are not late
+    struct sc_clock clock;
+
+    // Bytes waiting to be demuxed (only if reported by the demuxer)
+    bool has_pending;
+    uint64_t pending;
+
+    // To convert the pending bytes to a duration
+    struct sc_average packet_size;
+    struct sc_average packet_interval;
+    int64_t last_pts; // -1 if no packet has been pushed
+    sc_tick last_push; // time of the last push
+    bool last_dropped; // the last packet pushed has not been decoded
+
+    struct sc_catchup_stats stats;
+
+    const struct sc_catchup_callbacks *cbs; // NULL if key frames cannot be
+                                            // requested
+    void *cbs_userdata;
+};
+
+/**
+ * Initialize the catch-up policy
+ *
+ * The threshold is the backlog (in stream time) above which the decoder
+ * catches up.
+ */
+void
+sc_catchup_init(struct sc_catchup *catchup, sc_tick threshold,
+                const struct sc_catchup_callbacks *cbs, void *cbs_userdata);
+
+// Log the number of times it has been triggered
+void
+sc_catchup_destroy(struct sc_catchup *catchup);
+
+// Report the bytes received but not demuxed yet (in the socket or buffered)
+void
+sc_catchup_set_pending(struct sc_catchup *catchup, uint64_t bytes);
+
+/**
+ * Decide how to decode the next (non-config) packet
+ */
+enum sc_catchup_action
+sc_catchup_push(struct sc_catchup *catchup, int64_t pts, size_t size,
+                bool key_frame, sc_tick now);
+
+#endif
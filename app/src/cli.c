@@ -102,11 +102,22 @@ enum {
     OPT_NO_VD_SYSTEM_DECORATIONS,
     OPT_NO_VD_DESTROY_CONTENT,
     OPT_DISPLAY_IME_POLICY,
+    OPT_VIDEO_DECODER_THREADS,
+    OPT_VIDEO_DECODER_THREAD_TYPE,
+    OPT_VIDEO_DECODER_HWACCEL,
     OPT_LINKANDROID_SERVER,
     OPT_LINKANDROID_PANEL_SHOW,
     OPT_LINKANDROID_PREVIEW_INTERVAL,
     OPT_LINKANDROID_PREVIEW_RATIO,
+    OPT_LINKANDROID_PREVIEW_TRANSPORT,
+    OPT_LINKANDROID_PREVIEW_FORMAT,
+    OPT_LINKANDROID_PREVIEW_QUALITY,
+    OPT_LINKANDROID_PREVIEW_TILES,
+    OPT_LINKANDROID_PREVIEW_KEYFRAME_INTERVAL,
+    OPT_LINKANDROID_PREVIEW_MAX_STALENESS,
+    OPT_LINKANDROID_COALESCE_WINDOW,
     OPT_LINKANDROID_SKIP_TASKBAR,
+    OPT_LINKANDROID_HOST,
     OPT_CAMERA_TORCH,
     OPT_CAMERA_ZOOM,
     OPT_MIN_SIZE_ALIGNMENT,
@@ -116,6 +127,17 @@ enum {
     OPT_RENDER_FIT,
     OPT_IGNORE_VIDEO_ENCODER_CONSTRAINTS,
     OPT_NO_TERMINAL_TITLE,
+    OPT_REPLAY_BUFFER,
+    OPT_REPLAY_BUFFER_SIZE,
+    OPT_RECORD_SEGMENT_TIME,
+    OPT_RECORD_FRAGMENTED,
+    OPT_VIDEO_BUFFER_RANGE,
+    OPT_CAPTURE_STREAM,
+    OPT_REPLAY_STREAM,
+    OPT_REPLAY_STREAM_MAX_SPEED,
+    OPT_LATENCY_STATS,
+    OPT_TRACE_FILE,
+    OPT_VIDEO_CATCH_UP,
 };
 
 struct sc_option
@@ -346,6 +368,17 @@ static const struct sc_option options[] = {
                 "initial device orientation.\n"
                 "Default is 0.",
     },
+    {
+        .longopt_id = OPT_CAPTURE_STREAM,
+        .longopt = "capture-stream",
+        .argdesc = "dir",
+        .text = "Write the exact bytes received on the video and audio "
+                "sockets, with their arrival times, to video.capture and "
+                "audio.capture in the given directory (created if needed).\n"
+                "The session can then be replayed without device by "
+                "--replay-stream, for example to profile the decoding or the "
+                "previews.",
+    },
     {
         .longopt_id = OPT_CROP,
         .longopt = "crop",
@@ -482,6 +515,19 @@ static const struct sc_option options[] = {
         .longopt = "kill-adb-on-close",
         .text = "Kill adb when scrcpy terminates.",
     },
+    {
+        .longopt_id = OPT_LATENCY_STATS,
+        .longopt = "latency-stats",
+        .argdesc = "seconds",
+        .optional_arg = true,
+        .text = "Measure the latency of each stage of the video pipeline "
+                "(network jitter, decoding, frame buffer and rendering), and "
+                "print the percentiles to the console periodically.\n"
+                "The statistics since the start are also available via the "
+                "\"stats\" WebSocket request (see --linkandroid-server).\n"
+                "Passing 0 disables the periodic printing.\n"
+                "Default is 10 (seconds).",
+    },
     {
         .longopt_id = OPT_LEGACY_PASTE,
         .longopt = "legacy-paste",
@@ -799,6 +845,14 @@ static const struct sc_option options[] = {
         .text = "Force recording format (mp4, mkv, m4a, mka, opus, aac, flac "
                 "or wav).",
     },
+    {
+        .longopt_id = OPT_RECORD_FRAGMENTED,
+        .longopt = "record-fragmented",
+        .text = "Record MP4 files as fragmented MP4 (a fragment per video key "
+                "frame), so that they remain playable if the recording is "
+                "interrupted, and can be read while they are written.\n"
+                "Only supported for mp4, m4a and aac recording formats.",
+    },
     {
         .longopt_id = OPT_RECORD_ORIENTATION,
         .longopt = "record-orientation",
@@ -808,6 +862,18 @@ static const struct sc_option options[] = {
                 "the clockwise rotation in degrees.\n"
                 "Default is 0.",
     },
+    {
+        .longopt_id = OPT_RECORD_SEGMENT_TIME,
+        .longopt = "record-segment-time",
+        .argdesc = "seconds",
+        .text = "Split the recording into several files of (at least) the "
+                "given duration, without restarting the stream.\n"
+                "A new file is started on the first video key frame once the "
+                "duration is reached. The segment index is inserted before "
+                "the file extension: --record=file.mp4 writes file-000.mp4, "
+                "file-001.mp4, etc.\n"
+                "Default is 0 (disabled).",
+    },
     {
         .longopt_id = OPT_RENDER_DRIVER,
         .longopt = "render-driver",
@@ -835,6 +901,44 @@ static const struct sc_option options[] = {
                 "Default is \"letterbox\", unless --flex-display is set, in "
                 "which case it is \"unscaled\".",
     },
+    {
+        .longopt_id = OPT_REPLAY_BUFFER,
+        .longopt = "replay-buffer",
+        .argdesc = "seconds",
+        .text = "Keep the last encoded video and audio packets in memory, "
+                "so that at least the given duration can be written to a "
+                "file on demand by a \"replay\" WebSocket request (requires "
+                "--linkandroid-server).\n"
+                "The window starts on a video key frame. The file format "
+                "(mp4 or mkv) is determined by the file extension.\n"
+                "See --replay-buffer-size and --record-orientation.",
+    },
+    {
+        .longopt_id = OPT_REPLAY_BUFFER_SIZE,
+        .longopt = "replay-buffer-size",
+        .argdesc = "MiB",
+        .text = "Set the maximum memory used by the replay buffer. The "
+                "oldest packets are dropped when it is exceeded, even if "
+                "the window is shorter than --replay-buffer.\n"
+                "Default is 128.",
+    },
+    {
+        .longopt_id = OPT_REPLAY_STREAM,
+        .longopt = "replay-stream",
+        .argdesc = "dir",
+        .text = "Read the video and audio streams from the files written by "
+                "--capture-stream in the given directory, instead of a "
+                "device, at their original pace (or as fast as possible with "
+                "--replay-stream-max-speed).\n"
+                "No device is used: adb is not executed and control is "
+                "disabled. Scrcpy exits at the end of the replay.",
+    },
+    {
+        .longopt_id = OPT_REPLAY_STREAM_MAX_SPEED,
+        .longopt = "replay-stream-max-speed",
+        .text = "Replay the streams (see --replay-stream) as fast as they are "
+                "consumed, ignoring the original arrival times.",
+    },
     {
         .longopt_id = OPT_REQUIRE_AUDIO,
         .longopt = "require-audio",
@@ -916,6 +1020,16 @@ static const struct sc_option options[] = {
         .argdesc = "seconds",
         .text = "Set the maximum mirroring time, in seconds.",
     },
+    {
+        .longopt_id = OPT_TRACE_FILE,
+        .longopt = "trace-file",
+        .argdesc = "file.json",
+        .text = "Record a timeline of the work done by the client threads "
+                "(receiving, decoding, rendering, previews, WebSocket and "
+                "control messages), and write it on exit to a file in the "
+                "Chrome trace event format, which can be opened in Perfetto "
+                "(https://ui.perfetto.dev) or chrome://tracing.",
+    },
     {
         .longopt_id = OPT_TUNNEL_HOST,
         .longopt = "tunnel-host",
@@ -976,8 +1090,31 @@ static const struct sc_option options[] = {
         .text = "Add a buffering delay (in milliseconds) before displaying "
                 "video frames.\n"
                 "This increases latency to compensate for jitter.\n"
+                "If \"auto\" is given, the delay is adjusted continuously to "
+                "the measured jitter, within --video-buffer-range.\n"
                 "Default is 0 (no buffering).",
     },
+    {
+        .longopt_id = OPT_VIDEO_BUFFER_RANGE,
+        .longopt = "video-buffer-range",
+        .argdesc = "min:max",
+        .text = "Set the bounds (in milliseconds) of the delay for "
+                "--video-buffer=auto.\n"
+                "Default is 0:500.",
+    },
+    {
+        .longopt_id = OPT_VIDEO_CATCH_UP,
+        .longopt = "video-catch-up",
+        .argdesc = "ms",
+        .optional_arg = true,
+        .text = "Catch up when the video decoding falls behind the stream by "
+                "more than the given delay (in milliseconds), for example if "
+                "the computer is overloaded: the non-reference frames are "
+                "skipped, then the packets are dropped until the next key "
+                "frame, which is requested from the device (if control is "
+                "enabled).\n"
+                "Default is 300 (milliseconds).",
+    },
     {
         .longopt_id = OPT_VIDEO_CODEC,
         .longopt = "video-codec",
@@ -997,6 +1134,37 @@ static const struct sc_option options[] = {
                 "Android documentation: "
                 "<https://d.android.com/reference/android/media/MediaFormat>",
     },
+    {
+        .longopt_id = OPT_VIDEO_DECODER_HWACCEL,
+        .longopt = "video-decoder-hwaccel",
+        .argdesc = "type",
+        .text = "Decode the video using a hardware accelerator.\n"
+                "Possible values are \"none\", \"auto\" or a FFmpeg hardware "
+                "device type (e.g. \"vaapi\" or \"vdpau\").\n"
+                "If the device or the codec is not supported, the video is "
+                "decoded in software.\n"
+                "Default is none.",
+    },
+    {
+        .longopt_id = OPT_VIDEO_DECODER_THREAD_TYPE,
+        .longopt = "video-decoder-thread-type",
+        .argdesc = "type",
+        .text = "Select the video decoder threading method (slice or "
+                "frame).\n"
+                "Slice threading does not add latency, but only helps if the "
+                "stream contains several slices (or tiles) per frame.\n"
+                "Frame threading always helps, but adds one frame of latency "
+                "per additional thread.\n"
+                "Default is slice.",
+    },
+    {
+        .longopt_id = OPT_VIDEO_DECODER_THREADS,
+        .longopt = "video-decoder-threads",
+        .argdesc = "value",
+        .text = "Set the number of video decoder threads.\n"
+                "Default is 0 (automatic, depending on the number of CPU "
+                "cores).",
+    },
     {
         .longopt_id = OPT_VIDEO_ENCODER,
         .longopt = "video-encoder",
@@ -1078,6 +1246,8 @@ static const struct sc_option options[] = {
         .text = "Capture and send video frame screenshots to WebSocket\n"
                 "server at the specified interval (in milliseconds).\n"
                 "Requires --linkandroid-server. Set to 0 to disable.\n"
+                "With --no-window, previews are produced headless (no\n"
+                "window, no renderer).\n"
                 "Example: --linkandroid-preview-interval 1000",
     },
     {
@@ -1090,12 +1260,98 @@ static const struct sc_option options[] = {
                 "Default: 100 (original resolution).\n"
                 "Example: --linkandroid-preview-ratio 50",
     },
+    {
+        .longopt_id = OPT_LINKANDROID_PREVIEW_TRANSPORT,
+        .longopt = "linkandroid-preview-transport",
+        .argdesc = "value",
+        .text = "Select how previews are sent to the WebSocket server.\n"
+                "Possible values are \"text\" (JSON message with a base64\n"
+                "data URL) and \"binary\" (binary message: 20-byte header\n"
+                "followed by the raw image bytes).\n"
+                "Default is text.",
+    },
+    {
+        .longopt_id = OPT_LINKANDROID_PREVIEW_FORMAT,
+        .longopt = "linkandroid-preview-format",
+        .argdesc = "format",
+        .text = "Select the preview image format.\n"
+                "Possible values are \"png\", \"jpeg\" and \"webp\".\n"
+                "JPEG and WebP are encoded directly from the decoded YUV\n"
+                "frames and are much smaller and faster than PNG. WebP\n"
+                "requires FFmpeg built with libwebp (otherwise PNG is used).\n"
+                "Default is png.",
+    },
+    {
+        .longopt_id = OPT_LINKANDROID_PREVIEW_QUALITY,
+        .longopt = "linkandroid-preview-quality",
+        .argdesc = "value",
+        .text = "Set the JPEG/WebP preview quality (1-100).\n"
+                "Ignored for PNG.\n"
+                "Default is 80.",
+    },
+    {
+        .longopt_id = OPT_LINKANDROID_PREVIEW_TILES,
+        .longopt = "linkandroid-preview-tiles",
+        .text = "Only send the parts of the previews which changed.\n"
+                "The preview is split into 64x64 tiles, and only the tiles\n"
+                "which changed since the previous previews are sent, packed\n"
+                "in a single image (see --linkandroid-preview-transport).\n"
+                "A full image is sent first, then periodically (see\n"
+                "--linkandroid-preview-keyframe-interval). Unchanged\n"
+                "previews are not sent at all.",
+    },
+    {
+        .longopt_id = OPT_LINKANDROID_PREVIEW_KEYFRAME_INTERVAL,
+        .longopt = "linkandroid-preview-keyframe-interval",
+        .argdesc = "ms",
+        .text = "Set the interval between full preview images with\n"
+                "--linkandroid-preview-tiles (in milliseconds).\n"
+                "Default is 10000.",
+    },
+    {
+        .longopt_id = OPT_LINKANDROID_PREVIEW_MAX_STALENESS,
+        .longopt = "linkandroid-preview-max-staleness",
+        .argdesc = "ms",
+        .text = "Do not encode nor send the previews visually identical to\n"
+                "the last one sent (the device may repeat frames while\n"
+                "nothing changes), but still send one at least every <ms>\n"
+                "milliseconds, so that the server knows the device is\n"
+                "alive.\n"
+                "Set to 0 to send all the previews.\n"
+                "Default is 0.",
+    },
+    {
+        .longopt_id = OPT_LINKANDROID_COALESCE_WINDOW,
+        .longopt = "linkandroid-coalesce-window",
+        .argdesc = "ms",
+        .text = "Merge the touch move and scroll events forwarded to the\n"
+                "WebSocket server within this window (in milliseconds).\n"
+                "Only the last move of each pointer is sent, and scroll\n"
+                "deltas are accumulated. Other events are never delayed.\n"
+                "Set to 0 to forward every event immediately.\n"
+                "Default is 16.",
+    },
     {
         .longopt_id = OPT_LINKANDROID_SKIP_TASKBAR,
         .longopt = "linkandroid-skip-taskbar",
         .text = "Hide the application icon from the taskbar (Windows)\n"
                 "or Dock (macOS). Useful for running in background.",
     },
+    {
+        .longopt_id = OPT_LINKANDROID_HOST,
+        .longopt = "linkandroid-host",
+        .argdesc = "serial1,serial2,...",
+        .optional_arg = true,
+        .text = "Serve several devices from a single process (host mode).\n"
+                "The devices are mirrored headless (video and control only)\n"
+                "through a single connection to --linkandroid-server, the\n"
+                "messages being tagged with the device serial. The sockets\n"
+                "of all the devices are read by a single thread, and the\n"
+                "video is decoded by a shared pool of threads.\n"
+                "Devices may also be added and removed by the WebSocket\n"
+                "server at runtime.\n"
+                "Requires --linkandroid-server and --no-window.",
+    },
     {
         .shortopt = 'x',
         .longopt = "flex-display",
@@ -1777,6 +2033,41 @@ parse_buffering_time(const char *s, sc_tick *tick) {
     return true;
 }
 
+static bool
+parse_video_buffer(const char *s, sc_tick *tick, bool *adaptive)
+{
+    if (!strcmp(s, "auto"))
+    {
+        *adaptive = true;
+        return true;
+    }
+
+    *adaptive = false;
+    return parse_buffering_time(s, tick);
+}
+
+static bool
+parse_video_buffer_range(const char *s, sc_tick *min, sc_tick *max)
+{
+    long values[2];
+    size_t count = parse_integers_arg(s, ':', 2, values, 0, 60 * 60 * 1000,
+                                      "video buffer range");
+    if (!count)
+    {
+        return false;
+    }
+
+    if (count != 2 || values[0] > values[1])
+    {
+        LOGE("Invalid video buffer range (expected min:max): %s", s);
+        return false;
+    }
+
+    *min = SC_TICK_FROM_MS(values[0]);
+    *max = SC_TICK_FROM_MS(values[1]);
+    return true;
+}
+
 static bool
 parse_audio_output_buffer(const char *s, sc_tick *tick)
 {
@@ -1792,6 +2083,37 @@ parse_audio_output_buffer(const char *s, sc_tick *tick)
     return true;
 }
 
+static bool
+parse_video_decoder_threads(const char *s, uint8_t *threads) {
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 64,
+                                "video decoder threads");
+    if (!ok) {
+        return false;
+    }
+
+    *threads = (uint8_t) value;
+    return true;
+}
+
+static bool
+parse_video_decoder_thread_type(const char *s,
+                                enum sc_decoder_thread_type *type) {
+    if (!strcmp(s, "slice")) {
+        *type = SC_DECODER_THREAD_TYPE_SLICE;
+        return true;
+    }
+
+    if (!strcmp(s, "frame")) {
+        *type = SC_DECODER_THREAD_TYPE_FRAME;
+        return true;
+    }
+
+    LOGE("Unsupported video decoder thread type: %s (expected slice or "
+         "frame)", s);
+    return false;
+}
+
 static bool
 parse_display_ime_policy(const char *s, enum sc_display_ime_policy *policy)
 {
@@ -2514,6 +2836,92 @@ parse_time_limit(const char *s, sc_tick *tick)
     return true;
 }
 
+static bool
+parse_replay_buffer(const char *s, sc_tick *tick)
+{
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, 3600, "replay buffer");
+    if (!ok)
+    {
+        return false;
+    }
+
+    *tick = SC_TICK_FROM_SEC(value);
+    return true;
+}
+
+static bool
+parse_replay_buffer_size(const char *s, uint32_t *size)
+{
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, 4096,
+                                "replay buffer size");
+    if (!ok)
+    {
+        return false;
+    }
+
+    *size = (uint32_t) value;
+    return true;
+}
+
+static bool
+parse_record_segment_time(const char *s, sc_tick *tick)
+{
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 0x7FFFFFFF,
+                                "record segment time");
+    if (!ok)
+    {
+        return false;
+    }
+
+    *tick = SC_TICK_FROM_SEC(value);
+    return true;
+}
+
+static bool
+parse_latency_stats(const char *s, sc_tick *interval)
+{
+    if (!s)
+    {
+        // Keep the default interval
+        return true;
+    }
+
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 0, 3600,
+                                "latency stats interval");
+    if (!ok)
+    {
+        return false;
+    }
+
+    *interval = SC_TICK_FROM_SEC(value);
+    return true;
+}
+
+static bool
+parse_video_catch_up(const char *s, sc_tick *threshold)
+{
+    if (!s)
+    {
+        *threshold = SC_TICK_FROM_MS(300);
+        return true;
+    }
+
+    long value;
+    bool ok = parse_integer_arg(s, &value, false, 1, 60000,
+                                "video catch-up threshold");
+    if (!ok)
+    {
+        return false;
+    }
+
+    *threshold = SC_TICK_FROM_MS(value);
+    return true;
+}
+
 static bool
 parse_screen_off_timeout(const char *s, sc_tick *tick)
 {
@@ -2737,6 +3145,47 @@ parse_render_fit(const char *optarg, enum sc_render_fit *mode) {
     return false;
 }
 
+static bool
+parse_linkandroid_preview_transport(const char *optarg,
+                            enum sc_linkandroid_preview_transport *transport) {
+    if (!strcmp(optarg, "text")) {
+        *transport = SC_LINKANDROID_PREVIEW_TRANSPORT_TEXT;
+        return true;
+    }
+
+    if (!strcmp(optarg, "binary")) {
+        *transport = SC_LINKANDROID_PREVIEW_TRANSPORT_BINARY;
+        return true;
+    }
+
+    LOGE("Unsupported preview transport: %s (expected text or binary)",
+         optarg);
+    return false;
+}
+
+static bool
+parse_linkandroid_preview_format(const char *optarg,
+                                 enum sc_linkandroid_preview_format *format) {
+    if (!strcmp(optarg, "png")) {
+        *format = SC_LINKANDROID_PREVIEW_FORMAT_PNG;
+        return true;
+    }
+
+    if (!strcmp(optarg, "jpeg")) {
+        *format = SC_LINKANDROID_PREVIEW_FORMAT_JPEG;
+        return true;
+    }
+
+    if (!strcmp(optarg, "webp")) {
+        *format = SC_LINKANDROID_PREVIEW_FORMAT_WEBP;
+        return true;
+    }
+
+    LOGE("Unsupported preview format: %s (expected png, jpeg or webp)",
+         optarg);
+    return false;
+}
+
 static bool
 parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                        const char *optstring, const struct option *longopts)
@@ -2956,6 +3405,24 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             case OPT_VIDEO_ENCODER:
                 opts->video_encoder = optarg;
                 break;
+            case OPT_VIDEO_DECODER_THREADS:
+                if (!parse_video_decoder_threads(optarg,
+                        &opts->video_decoder_threads)) {
+                    return false;
+                }
+                break;
+            case OPT_VIDEO_DECODER_THREAD_TYPE:
+                if (!parse_video_decoder_thread_type(optarg,
+                        &opts->video_decoder_thread_type)) {
+                    return false;
+                }
+                break;
+            case OPT_VIDEO_DECODER_HWACCEL:
+                // The type is validated by the decoder (it depends on the
+                // FFmpeg build), which falls back to software decoding
+                opts->video_decoder_hwaccel =
+                    strcmp(optarg, "none") ? optarg : NULL;
+                break;
             case OPT_AUDIO_ENCODER:
                 opts->audio_encoder = optarg;
                 break;
@@ -2977,7 +3444,19 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                 opts->power_off_on_close = true;
                 break;
             case OPT_VIDEO_BUFFER:
-                if (!parse_buffering_time(optarg, &opts->video_buffer)) {
+                if (!parse_video_buffer(optarg, &opts->video_buffer,
+                                        &opts->video_buffer_adaptive)) {
+                    return false;
+                }
+                break;
+            case OPT_VIDEO_BUFFER_RANGE:
+                if (!parse_video_buffer_range(optarg, &opts->video_buffer_min,
+                                              &opts->video_buffer_max)) {
+                    return false;
+                }
+                break;
+            case OPT_VIDEO_CATCH_UP:
+                if (!parse_video_catch_up(optarg, &opts->video_catch_up)) {
                     return false;
                 }
                 break;
@@ -3188,6 +3667,45 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                     return false;
                 }
                 break;
+            case OPT_REPLAY_BUFFER:
+                if (!parse_replay_buffer(optarg, &opts->replay_buffer)) {
+                    return false;
+                }
+                break;
+            case OPT_REPLAY_BUFFER_SIZE:
+                if (!parse_replay_buffer_size(optarg,
+                                              &opts->replay_buffer_size)) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_SEGMENT_TIME:
+                if (!parse_record_segment_time(optarg,
+                                               &opts->record_segment_time)) {
+                    return false;
+                }
+                break;
+            case OPT_RECORD_FRAGMENTED:
+                opts->record_fragmented = true;
+                break;
+            case OPT_CAPTURE_STREAM:
+                opts->capture_stream = optarg;
+                break;
+            case OPT_REPLAY_STREAM:
+                opts->replay_stream = optarg;
+                break;
+            case OPT_REPLAY_STREAM_MAX_SPEED:
+                opts->replay_stream_max_speed = true;
+                break;
+            case OPT_TRACE_FILE:
+                opts->trace_file = optarg;
+                break;
+            case OPT_LATENCY_STATS:
+                if (!parse_latency_stats(optarg,
+                                         &opts->latency_stats_interval)) {
+                    return false;
+                }
+                opts->latency_stats = true;
+                break;
             case 'x':
                 opts->flex_display = true;
                 break;
@@ -3227,9 +3745,76 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
                 opts->linkandroid_preview_ratio = (uint8_t)ratio;
                 break;
             }
+            case OPT_LINKANDROID_PREVIEW_TRANSPORT:
+                if (!parse_linkandroid_preview_transport(optarg,
+                        &opts->linkandroid_preview_transport)) {
+                    return false;
+                }
+                break;
+            case OPT_LINKANDROID_PREVIEW_FORMAT:
+                if (!parse_linkandroid_preview_format(optarg,
+                        &opts->linkandroid_preview_format)) {
+                    return false;
+                }
+                break;
+            case OPT_LINKANDROID_PREVIEW_QUALITY:
+            {
+                char *endptr;
+                long quality = strtol(optarg, &endptr, 10);
+                if (*endptr != '\0' || quality < 1 || quality > 100)
+                {
+                    LOGE("Invalid preview quality: %s (must be between 1 and 100)", optarg);
+                    return false;
+                }
+                opts->linkandroid_preview_quality = (uint8_t)quality;
+                break;
+            }
+            case OPT_LINKANDROID_PREVIEW_TILES:
+                opts->linkandroid_preview_tiles = true;
+                break;
+            case OPT_LINKANDROID_PREVIEW_KEYFRAME_INTERVAL:
+            {
+                char *endptr;
+                long ms = strtol(optarg, &endptr, 10);
+                if (*endptr != '\0' || ms < 1 || ms > 3600000)
+                {
+                    LOGE("Invalid preview keyframe interval: %s (must be between 1 and 3600000)", optarg);
+                    return false;
+                }
+                opts->linkandroid_preview_keyframe_interval = (uint32_t)ms;
+                break;
+            }
+            case OPT_LINKANDROID_PREVIEW_MAX_STALENESS:
+            {
+                char *endptr;
+                long ms = strtol(optarg, &endptr, 10);
+                if (*endptr != '\0' || ms < 0 || ms > 3600000)
+                {
+                    LOGE("Invalid preview max staleness: %s (must be between 0 and 3600000)", optarg);
+                    return false;
+                }
+                opts->linkandroid_preview_max_staleness = (uint32_t)ms;
+                break;
+            }
+            case OPT_LINKANDROID_COALESCE_WINDOW:
+            {
+                char *endptr;
+                long ms = strtol(optarg, &endptr, 10);
+                if (*endptr != '\0' || ms < 0 || ms > 1000)
+                {
+                    LOGE("Invalid coalesce window: %s (must be between 0 and 1000)", optarg);
+                    return false;
+                }
+                opts->linkandroid_coalesce_window = (uint32_t)ms;
+                break;
+            }
             case OPT_LINKANDROID_SKIP_TASKBAR:
                 opts->linkandroid_skip_taskbar = true;
                 break;
+            case OPT_LINKANDROID_HOST:
+                opts->linkandroid_host = true;
+                opts->linkandroid_host_serials = optarg;
+                break;
             default:
                 // getopt prints the error message on stderr
                 return false;
@@ -3266,6 +3851,64 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
     v4l2 = !!opts->v4l2_device;
 #endif
 
+    if (opts->linkandroid_host)
+    {
+        if (!opts->linkandroid_server)
+        {
+            LOGE("--linkandroid-host requires --linkandroid-server");
+            return false;
+        }
+
+        if (opts->window)
+        {
+            LOGE("--linkandroid-host requires --no-window");
+            return false;
+        }
+
+        if (selectors || otg || v4l2 || opts->record_filename
+            || opts->replay_buffer)
+        {
+            LOGE("--linkandroid-host is incompatible with device selectors, "
+                 "--otg, --v4l2-sink, --record and --replay-buffer");
+            return false;
+        }
+
+        if (opts->audio)
+        {
+            LOGI("Host mode: audio disabled");
+            opts->audio = false;
+        }
+    }
+
+    if (opts->replay_stream)
+    {
+        if (selectors || otg || opts->tcpip || opts->list
+            || opts->linkandroid_host || opts->capture_stream)
+        {
+            LOGE("--replay-stream is incompatible with device selectors, "
+                 "--otg, --tcpip, --list-*, --linkandroid-host and "
+                 "--capture-stream");
+            return false;
+        }
+
+        if (opts->control)
+        {
+            LOGI("Replay: control disabled");
+            opts->control = false;
+        }
+    }
+    else if (opts->replay_stream_max_speed)
+    {
+        LOGE("--replay-stream-max-speed requires --replay-stream");
+        return false;
+    }
+
+    if (opts->capture_stream && opts->linkandroid_host)
+    {
+        LOGE("--capture-stream is incompatible with --linkandroid-host");
+        return false;
+    }
+
     if (!opts->window)
     {
         // Without window, there cannot be any video playback
@@ -3286,16 +3929,24 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
         opts->audio_playback = false;
     }
 
+    if (opts->linkandroid_preview_tiles
+        && !(opts->linkandroid_server && opts->linkandroid_preview_interval))
+    {
+        LOGE("--linkandroid-preview-tiles requires --linkandroid-server and "
+             "--linkandroid-preview-interval");
+        return false;
+    }
+
     // LinkAndroid: Video is needed if preview sender is enabled
     bool needs_video_for_preview = opts->linkandroid_server && opts->linkandroid_preview_interval > 0;
 
-    if (opts->video && !opts->video_playback && !opts->record_filename && !v4l2 && !needs_video_for_preview)
+    if (opts->video && !opts->video_playback && !opts->record_filename && !opts->replay_buffer && !opts->capture_stream && !v4l2 && !needs_video_for_preview)
     {
         LOGI("No video playback, no recording, no V4L2 sink: video disabled");
         opts->video = false;
     }
 
-    if (opts->audio && !opts->audio_playback && !opts->record_filename)
+    if (opts->audio && !opts->audio_playback && !opts->record_filename && !opts->replay_buffer && !opts->capture_stream)
     {
         LOGI("No audio playback, no recording: audio disabled");
         opts->audio = false;
@@ -3668,6 +4319,13 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
         return false;
     }
 
+    if ((opts->record_segment_time || opts->record_fragmented)
+            && !opts->record_filename)
+    {
+        LOGE("Record segmentation specified without recording");
+        return false;
+    }
+
     if (opts->record_filename)
     {
         if (!opts->video && !opts->audio)
@@ -3745,6 +4403,40 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             LOGE("Recording to MP4 container does not support VP8 video");
             return false;
         }
+
+        if (opts->record_fragmented
+                && opts->record_format != SC_RECORD_FORMAT_MP4
+                && opts->record_format != SC_RECORD_FORMAT_M4A
+                && opts->record_format != SC_RECORD_FORMAT_AAC)
+        {
+            LOGE("Fragmented recording requires a MP4 container "
+                 "(mp4, m4a or aac)");
+            return false;
+        }
+    }
+
+    if (opts->replay_buffer)
+    {
+        if (!opts->linkandroid_server)
+        {
+            LOGE("--replay-buffer requires --linkandroid-server (the replay "
+                 "is written on a WebSocket request)");
+            return false;
+        }
+
+        if (!opts->video && !opts->audio)
+        {
+            LOGE("Video and audio disabled, nothing to replay");
+            return false;
+        }
+
+        if (sc_orientation_is_mirror(opts->record_orientation))
+        {
+            LOGE("Record orientation only supports rotation, not "
+                 "flipping: %s",
+                 sc_orientation_get_name(opts->record_orientation));
+            return false;
+        }
     }
 
     if (opts->audio_codec == SC_CODEC_FLAC && opts->audio_bit_rate)
@@ -3818,6 +4510,18 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
         opts->start_fps_counter = false;
     }
 
+    if (opts->latency_stats && !opts->video_playback)
+    {
+        LOGW("--latency-stats has no effect without video playback");
+        opts->latency_stats = false;
+    }
+
+    if (opts->video_catch_up && !opts->video)
+    {
+        LOGW("--video-catch-up has no effect without video");
+        opts->video_catch_up = 0;
+    }
+
     if (otg)
     {
         // OTG mode is compatible with only very few options.
@@ -3827,6 +4531,11 @@ parse_args_with_getopt(struct scrcpy_cli_args *args, int argc, char *argv[],
             LOGE("OTG mode: cannot record");
             return false;
         }
+        if (opts->replay_buffer)
+        {
+            LOGE("OTG mode: cannot buffer a replay");
+            return false;
+        }
         if (opts->turn_screen_off)
         {
             LOGE("OTG mode: could not turn screen off");
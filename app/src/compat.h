@@ -61,6 +61,12 @@
 # define SCRCPY_LAVC_HAS_CODECPAR_CODEC_SIDEDATA
 #endif
 
+// avcodec_get_hw_config() and AVCodecContext.extra_hw_frames are available
+// since FFmpeg 4.0 (lavc 58.18.100)
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(58, 18, 100)
+# define SCRCPY_LAVC_HAS_HWACCEL
+#endif
+
 #ifndef HAVE_STRDUP
 char *strdup(const char *s);
 #endif
@@ -3,6 +3,7 @@
 #include <assert.h>
 
 #include "util/log.h"
+#include "util/trace.h"
 
 // LinkAndroid: WebSocket event forwarding
 #include "input_manager.h"
@@ -114,16 +115,7 @@ sc_controller_push_msg(struct sc_controller *controller,
     }
 
     // LinkAndroid: Forward event to WebSocket server if available
-    if (g_websocket_client && g_device_width > 0 && g_device_height > 0)
-    {
-        la_websocket_client_send_event(g_websocket_client, msg,
-                                       g_device_width, g_device_height);
-    }
-    else
-    {
-        LOGD("WebSocket not ready (client=%p, width=%u, height=%u)",
-             (void *)g_websocket_client, g_device_width, g_device_height);
-    }
+    sc_input_manager_forward_event(msg);
 
     bool pushed = false;
 
@@ -185,8 +177,10 @@ process_msg(struct sc_controller *controller,
         return false;
     }
 
+    sc_tick trace_start = sc_trace_begin();
     ssize_t w =
         net_send_all(controller->control_socket, serialized_msg, length);
+    sc_trace_end("controller send", trace_start);
     if ((size_t)w != length)
     {
         *eos = true;
@@ -233,6 +227,8 @@ run_controller(void *data)
         } else {
             msg = sc_vecdeque_pop(&controller->queue);
         }
+        sc_trace_counter("controller queue",
+                         sc_vecdeque_size(&controller->queue));
         sc_mutex_unlock(&controller->mutex);
 
         if (sc_get_log_level() <= SC_LOG_LEVEL_VERBOSE) {
@@ -1,26 +1,233 @@
 #include "decoder.h"
 
 #include <errno.h>
+#include <string.h>
 #include <libavcodec/packet.h>
 #include <libavutil/avutil.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
 
 #include "util/log.h"
+#include "util/trace.h"
 
 /** Downcast packet_sink to decoder */
 #define DOWNCAST(SINK) container_of(SINK, struct sc_decoder, packet_sink)
 
+// Line alignment of the downloaded frames converted to YUV420P
+#define SC_DECODER_SW_FRAME_ALIGN 32
+
+#ifdef SCRCPY_LAVC_HAS_HWACCEL
+// Hardware device types tried (in order) by --video-decoder-hwaccel=auto
+static const char *const sc_decoder_hwaccel_auto_types[] = {
+    "vaapi",
+    "vdpau",
+    "d3d11va",
+    "dxva2",
+    "videotoolbox",
+};
+
+static enum AVPixelFormat
+sc_decoder_get_format(AVCodecContext *ctx, const enum AVPixelFormat *fmts) {
+    struct sc_decoder *decoder = ctx->opaque;
+
+    for (const enum AVPixelFormat *p = fmts; *p != AV_PIX_FMT_NONE; ++p) {
+        if (*p == decoder->hw_pix_fmt) {
+            return *p;
+        }
+    }
+
+    LOGW("Decoder '%s': hardware decoding not supported for this stream, "
+         "fallback to software decoding", decoder->name);
+    decoder->hw_pix_fmt = AV_PIX_FMT_NONE;
+
+    for (const enum AVPixelFormat *p = fmts; *p != AV_PIX_FMT_NONE; ++p) {
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(*p);
+        if (!(desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+            return *p;
+        }
+    }
+
+    return AV_PIX_FMT_NONE;
+}
+
+static enum AVPixelFormat
+sc_decoder_find_hw_pix_fmt(const AVCodec *codec, enum AVHWDeviceType type) {
+    for (int i = 0;; ++i) {
+        const AVCodecHWConfig *config = avcodec_get_hw_config(codec, i);
+        if (!config) {
+            return AV_PIX_FMT_NONE;
+        }
+
+        if (config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX
+                && config->device_type == type) {
+            return config->pix_fmt;
+        }
+    }
+}
+
+static bool
+sc_decoder_try_hwaccel(struct sc_decoder *decoder, AVCodecContext *ctx,
+                       const char *type_name) {
+    enum AVHWDeviceType type = av_hwdevice_find_type_by_name(type_name);
+    if (type == AV_HWDEVICE_TYPE_NONE) {
+        LOGD("Decoder '%s': hwaccel %s not available in this FFmpeg build",
+             decoder->name, type_name);
+        return false;
+    }
+
+    enum AVPixelFormat hw_pix_fmt =
+        sc_decoder_find_hw_pix_fmt(ctx->codec, type);
+    if (hw_pix_fmt == AV_PIX_FMT_NONE) {
+        LOGD("Decoder '%s': hwaccel %s not supported by codec %s",
+             decoder->name, type_name, ctx->codec->name);
+        return false;
+    }
+
+    AVBufferRef *device_ctx;
+    int r = av_hwdevice_ctx_create(&device_ctx, type, NULL, NULL, 0);
+    if (r < 0) {
+        LOGD("Decoder '%s': could not create %s device: %d", decoder->name,
+             type_name, r);
+        return false;
+    }
+
+    ctx->hw_device_ctx = device_ctx; // owned by the codec context
+    ctx->get_format = sc_decoder_get_format;
+    ctx->opaque = decoder;
+    // Frame sinks accepting hardware frames may retain some surfaces
+    ctx->extra_hw_frames = 2;
+    decoder->hw_pix_fmt = hw_pix_fmt;
+
+    LOGI("Decoder '%s': hardware decoding using %s", decoder->name,
+         type_name);
+    return true;
+}
+
+static void
+sc_decoder_init_hwaccel(struct sc_decoder *decoder, AVCodecContext *ctx,
+                        const char *hwaccel) {
+    if (!strcmp(hwaccel, "auto")) {
+        for (size_t i = 0; i < ARRAY_LEN(sc_decoder_hwaccel_auto_types); ++i) {
+            if (sc_decoder_try_hwaccel(decoder, ctx,
+                                       sc_decoder_hwaccel_auto_types[i])) {
+                return;
+            }
+        }
+        LOGI("Decoder '%s': no hardware decoder available, using software "
+             "decoding", decoder->name);
+        return;
+    }
+
+    if (!sc_decoder_try_hwaccel(decoder, ctx, hwaccel)) {
+        LOGW("Decoder '%s': could not initialize hwaccel %s, fallback to "
+             "software decoding", decoder->name, hwaccel);
+    }
+}
+#endif
+
+// Create the decoding context from the (already opened) demuxer context
+static AVCodecContext *
+sc_decoder_open_context(struct sc_decoder *decoder,
+                        const AVCodecContext *src_ctx) {
+    const struct sc_decoder_params *params = decoder->params;
+    const AVCodec *codec = src_ctx->codec;
+
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    if (!ctx) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    AVCodecParameters *par = avcodec_parameters_alloc();
+    if (!par) {
+        LOG_OOM();
+        goto error_free_context;
+    }
+
+    int r = avcodec_parameters_from_context(par, src_ctx);
+    if (r >= 0) {
+        r = avcodec_parameters_to_context(ctx, par);
+    }
+    avcodec_parameters_free(&par);
+    if (r < 0) {
+        LOGE("Decoder '%s': could not copy codec parameters", decoder->name);
+        goto error_free_context;
+    }
+
+    ctx->flags = src_ctx->flags;
+    ctx->thread_count = params->threads;
+    if (params->thread_type == SC_DECODER_THREAD_TYPE_FRAME) {
+        ctx->thread_type = FF_THREAD_FRAME;
+        // Frame threading is disabled by libavcodec in low delay mode
+        ctx->flags &= ~AV_CODEC_FLAG_LOW_DELAY;
+    } else {
+        ctx->thread_type = FF_THREAD_SLICE;
+    }
+
+    if (params->hwaccel) {
+#ifdef SCRCPY_LAVC_HAS_HWACCEL
+        sc_decoder_init_hwaccel(decoder, ctx, params->hwaccel);
+#else
+        LOGW("Hardware decoding requires FFmpeg >= 4.0, using software "
+             "decoding");
+#endif
+    }
+
+    if (avcodec_open2(ctx, codec, NULL) < 0) {
+        LOGE("Decoder '%s': could not open codec", decoder->name);
+        goto error_free_context;
+    }
+
+    return ctx;
+
+error_free_context:
+    avcodec_free_context(&ctx);
+    return NULL;
+}
+
 static bool
 sc_decoder_open(struct sc_decoder *decoder, AVCodecContext *ctx,
                 const struct sc_stream_session *session) {
+    decoder->own_ctx = NULL;
+    decoder->hw_pix_fmt = AV_PIX_FMT_NONE;
+    decoder->hw_download_frame = NULL;
+    decoder->sw_frame = NULL;
+    decoder->sws_ctx = NULL;
+    decoder->sw_pool = NULL;
+    decoder->sw_pool_size = 0;
+
+    if (decoder->params) {
+        decoder->own_ctx = sc_decoder_open_context(decoder, ctx);
+        if (!decoder->own_ctx) {
+            return false;
+        }
+        ctx = decoder->own_ctx;
+    }
+
     decoder->frame = av_frame_alloc();
     if (!decoder->frame) {
         LOG_OOM();
-        return false;
+        goto error_free_context;
+    }
+
+    if (decoder->hw_pix_fmt != AV_PIX_FMT_NONE) {
+        decoder->hw_download_frame = av_frame_alloc();
+        if (!decoder->hw_download_frame) {
+            LOG_OOM();
+            goto error_free_frames;
+        }
+
+        decoder->sw_frame = av_frame_alloc();
+        if (!decoder->sw_frame) {
+            LOG_OOM();
+            goto error_free_frames;
+        }
     }
 
     if (!sc_frame_source_sinks_open(&decoder->frame_source, ctx, session)) {
-        av_frame_free(&decoder->frame);
-        return false;
+        goto error_free_frames;
     }
 
     decoder->ctx = ctx;
@@ -35,12 +242,161 @@ sc_decoder_open(struct sc_decoder *decoder, AVCodecContext *ctx,
     memset(&decoder->frame_size, 0, sizeof(decoder->frame_size));
 
     return true;
+
+error_free_frames:
+    av_frame_free(&decoder->sw_frame);
+    av_frame_free(&decoder->hw_download_frame);
+    av_frame_free(&decoder->frame);
+error_free_context:
+    avcodec_free_context(&decoder->own_ctx);
+
+    return false;
 }
 
 static void
 sc_decoder_close(struct sc_decoder *decoder) {
     sc_frame_source_sinks_close(&decoder->frame_source);
+    sws_freeContext(decoder->sws_ctx);
+    // Buffers still referenced are freed on their last unref
+    av_buffer_pool_uninit(&decoder->sw_pool);
+    av_frame_free(&decoder->sw_frame);
+    av_frame_free(&decoder->hw_download_frame);
     av_frame_free(&decoder->frame);
+    avcodec_free_context(&decoder->own_ctx);
+}
+
+// Allocate the YUV420P buffer of decoder->sw_frame from the pool, to avoid a
+// full-size allocation for every frame
+static bool
+sc_decoder_get_sw_buffer(struct sc_decoder *decoder, int width, int height) {
+    int size = av_image_get_buffer_size(AV_PIX_FMT_YUV420P, width, height,
+                                        SC_DECODER_SW_FRAME_ALIGN);
+    if (size < 0) {
+        return false;
+    }
+
+    if (!decoder->sw_pool || decoder->sw_pool_size != size) {
+        // The resolution changed
+        av_buffer_pool_uninit(&decoder->sw_pool);
+        decoder->sw_pool = av_buffer_pool_init(size, NULL);
+        if (!decoder->sw_pool) {
+            LOG_OOM();
+            return false;
+        }
+        decoder->sw_pool_size = size;
+    }
+
+    AVFrame *sw_frame = decoder->sw_frame;
+    sw_frame->buf[0] = av_buffer_pool_get(decoder->sw_pool);
+    if (!sw_frame->buf[0]) {
+        LOG_OOM();
+        return false;
+    }
+
+    sw_frame->format = AV_PIX_FMT_YUV420P;
+    sw_frame->width = width;
+    sw_frame->height = height;
+    int r = av_image_fill_arrays(sw_frame->data, sw_frame->linesize,
+                                 sw_frame->buf[0]->data, AV_PIX_FMT_YUV420P,
+                                 width, height, SC_DECODER_SW_FRAME_ALIGN);
+    if (r < 0) {
+        av_frame_unref(sw_frame);
+        return false;
+    }
+
+    return true;
+}
+
+// Download a hardware frame into decoder->sw_frame (in YUV420P)
+static bool
+sc_decoder_download_frame(struct sc_decoder *decoder, const AVFrame *hw_frame) {
+    AVFrame *frame = decoder->hw_download_frame;
+    AVFrame *sw_frame = decoder->sw_frame;
+
+    // Download in the native format of the device (typically NV12)
+    int r = av_hwframe_transfer_data(frame, hw_frame, 0);
+    if (r < 0) {
+        LOGE("Decoder '%s': could not download hardware frame: %d",
+             decoder->name, r);
+        return false;
+    }
+
+    r = av_frame_copy_props(frame, hw_frame);
+    if (r < 0) {
+        av_frame_unref(frame);
+        return false;
+    }
+
+    if (frame->format == AV_PIX_FMT_YUV420P) {
+        av_frame_move_ref(sw_frame, frame);
+        return true;
+    }
+
+    decoder->sws_ctx =
+        sws_getCachedContext(decoder->sws_ctx, frame->width, frame->height,
+                             frame->format, frame->width, frame->height,
+                             AV_PIX_FMT_YUV420P, SWS_POINT, NULL, NULL, NULL);
+    if (!decoder->sws_ctx) {
+        LOGE("Decoder '%s': could not create swscale context",
+             decoder->name);
+        goto error;
+    }
+
+    if (!sc_decoder_get_sw_buffer(decoder, frame->width, frame->height)) {
+        goto error;
+    }
+
+    r = av_frame_copy_props(sw_frame, frame);
+    if (r < 0) {
+        av_frame_unref(sw_frame);
+        goto error;
+    }
+
+    sws_scale(decoder->sws_ctx, (const uint8_t *const *) frame->data,
+              frame->linesize, 0, frame->height, sw_frame->data,
+              sw_frame->linesize);
+    av_frame_unref(frame);
+
+    return true;
+
+error:
+    av_frame_unref(frame);
+    return false;
+}
+
+// Push a frame in hardware memory: the sinks accepting hardware frames
+// receive it as is, the others receive a copy in CPU memory (downloaded only
+// once, and only if needed)
+static bool
+sc_decoder_push_hw_frame(struct sc_decoder *decoder, const AVFrame *hw_frame) {
+    struct sc_frame_source *source = &decoder->frame_source;
+    bool downloaded = false;
+    bool ok = true;
+
+    sc_frame_source_foreach_sink(source, sink) {
+        const AVFrame *frame = hw_frame;
+        if (!sink->ops->accept_hw_frames) {
+            if (!downloaded) {
+                ok = sc_decoder_download_frame(decoder, hw_frame);
+                if (!ok) {
+                    break;
+                }
+                downloaded = true;
+            }
+            frame = decoder->sw_frame;
+        }
+
+        ok = sink->ops->push(sink, frame);
+        if (!ok) {
+            break;
+        }
+    }
+
+    if (downloaded) {
+        av_frame_unref(decoder->sw_frame);
+    }
+
+    return ok;
 }
 
 static bool
@@ -51,7 +407,22 @@ sc_decoder_push(struct sc_decoder *decoder, const AVPacket *packet) {
         return true;
     }
 
+    if (decoder->catchup) {
+        bool key_frame = packet->flags & AV_PKT_FLAG_KEY;
+        enum sc_catchup_action action =
+            sc_catchup_push(decoder->catchup, packet->pts, packet->size,
+                            key_frame, sc_tick_now());
+        if (action == SC_CATCHUP_ACTION_DROP) {
+            return true;
+        }
+
+        decoder->ctx->skip_frame = action == SC_CATCHUP_ACTION_DECODE_REF_ONLY
+                                 ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    }
+
+    sc_tick trace_start = sc_trace_begin();
     int ret = avcodec_send_packet(decoder->ctx, packet);
+    sc_trace_end("decode", trace_start);
     if (ret < 0 && ret != AVERROR(EAGAIN)) {
         LOGE("Decoder '%s': could not send video packet: %d",
              decoder->name, ret);
@@ -59,10 +430,12 @@ sc_decoder_push(struct sc_decoder *decoder, const AVPacket *packet) {
     }
 
     for (;;) {
+        trace_start = sc_trace_begin();
         ret = avcodec_receive_frame(decoder->ctx, decoder->frame);
         if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
             break;
         }
+        sc_trace_end("decode", trace_start);
 
         if (ret) {
             LOGE("Decoder '%s', could not receive video frame: %d",
@@ -72,6 +445,11 @@ sc_decoder_push(struct sc_decoder *decoder, const AVPacket *packet) {
 
         // a frame was received
 
+        if (decoder->latency_stats) {
+            sc_latency_stats_on_decoded(decoder->latency_stats,
+                                        decoder->frame->pts);
+        }
+
         if (decoder->ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
             assert(decoder->frame->width >= 0);
             assert(decoder->frame->height >= 0);
@@ -97,8 +475,15 @@ sc_decoder_push(struct sc_decoder *decoder, const AVPacket *packet) {
             decoder->frame_size = frame_size;
         }
 
-        bool ok = sc_frame_source_sinks_push(&decoder->frame_source,
-                                             decoder->frame);
+        trace_start = sc_trace_begin();
+        bool ok;
+        if (decoder->frame->hw_frames_ctx) {
+            ok = sc_decoder_push_hw_frame(decoder, decoder->frame);
+        } else {
+            ok = sc_frame_source_sinks_push(&decoder->frame_source,
+                                            decoder->frame);
+        }
+        sc_trace_end("frame sinks push", trace_start);
         av_frame_unref(decoder->frame);
         if (!ok) {
             // Error already logged
@@ -145,8 +530,12 @@ sc_decoder_packet_sink_push_session(struct sc_packet_sink *sink,
 }
 
 void
-sc_decoder_init(struct sc_decoder *decoder, const char *name) {
+sc_decoder_init(struct sc_decoder *decoder, const char *name,
+                const struct sc_decoder_params *params) {
     decoder->name = name; // statically allocated
+    decoder->params = params;
+    decoder->latency_stats = NULL;
+    decoder->catchup = NULL;
     sc_frame_source_init(&decoder->frame_source);
 
     static const struct sc_packet_sink_ops ops = {
@@ -158,3 +547,14 @@ sc_decoder_init(struct sc_decoder *decoder, const char *name) {
 
     decoder->packet_sink.ops = &ops;
 }
+
+void
+sc_decoder_set_latency_stats(struct sc_decoder *decoder,
+                             struct sc_latency_stats *latency_stats) {
+    decoder->latency_stats = latency_stats;
+}
+
+void
+sc_decoder_set_catchup(struct sc_decoder *decoder, struct sc_catchup *catchup) {
+    decoder->catchup = catchup;
+}
@@ -5,25 +5,67 @@
 
 #include <libavcodec/avcodec.h>
 
+#include "catchup.h"
 #include "coords.h"
+#include "latency_stats.h"
+#include "options.h"
 #include "trait/frame_source.h"
 #include "trait/packet_sink.h"
 
+struct sc_decoder_params {
+    unsigned threads; // 0 for auto
+    enum sc_decoder_thread_type thread_type;
+    const char *hwaccel; // NULL (software), "auto" or a hw device type name
+};
+
 struct sc_decoder {
     struct sc_packet_sink packet_sink; // packet sink trait
     struct sc_frame_source frame_source; // frame source trait
 
     const char *name; // must be statically allocated (e.g. a string literal)
+    const struct sc_decoder_params *params; // NULL to use the demuxer context
 
     AVCodecContext *ctx;
+    AVCodecContext *own_ctx; // non-NULL if the decoder owns the context
     AVFrame *frame;
 
+    // Hardware decoding
+    enum AVPixelFormat hw_pix_fmt; // AV_PIX_FMT_NONE for software decoding
+    AVFrame *hw_download_frame; // frame downloaded in its native format
+    AVFrame *sw_frame; // YUV420P frame pushed to the CPU sinks
+    struct SwsContext *sws_ctx;
+    // Buffers of sw_frame (the sinks may keep references), reinitialized on
+    // resolution change
+    AVBufferPool *sw_pool;
+    int sw_pool_size;
+
     struct sc_stream_session session; // only initialized for video stream
     struct sc_size frame_size;
+
+    struct sc_latency_stats *latency_stats; // NULL if disabled
+    struct sc_catchup *catchup; // NULL if disabled
 };
 
 // The name must be statically allocated (e.g. a string literal)
+//
+// If params is not NULL, it must outlive the decoder, and the decoder opens
+// its own codec context (instead of decoding with the one opened by the
+// demuxer) to configure threading and hardware decoding.
+void
+sc_decoder_init(struct sc_decoder *decoder, const char *name,
+                const struct sc_decoder_params *params);
+
+// Report the decoding time of the frames to the latency stats
+//
+// Must be called before the decoder is opened.
+void
+sc_decoder_set_latency_stats(struct sc_decoder *decoder,
+                             struct sc_latency_stats *latency_stats);
+
+// Skip or drop packets when the decoding falls behind the stream (video only)
+//
+// Must be called before the decoder is opened.
 void
-sc_decoder_init(struct sc_decoder *decoder, const char *name);
+sc_decoder_set_catchup(struct sc_decoder *decoder, struct sc_catchup *catchup);
 
 #endif
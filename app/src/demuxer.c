@@ -5,9 +5,9 @@
 #include <libavcodec/avcodec.h>
 #include <libavutil/channel_layout.h>
 
-#include "packet_merger.h"
 #include "util/binary.h"
 #include "util/log.h"
+#include "util/trace.h"
 
 #define SC_PACKET_HEADER_SIZE 12
 
@@ -16,6 +16,14 @@
 
 #define SC_PACKET_PTS_MASK (SC_PACKET_FLAG_KEY_FRAME - 1)
 
+// Large enough to receive many audio packets (or small video packets) at once
+#define SC_DEMUXER_RECV_BUFFER_SIZE (256 * 1024)
+
+// In reactor mode, stop reading the socket while this number of items are
+// waiting for the sinks, and read again once half of them are processed
+#define SC_DEMUXER_MAX_PENDING_ITEMS 32
+#define SC_DEMUXER_RESUME_ITEMS (SC_DEMUXER_MAX_PENDING_ITEMS / 2)
+
 static enum AVCodecID
 sc_demuxer_to_avcodec_id(uint32_t codec_id) {
 #define SC_CODEC_ID_H264 UINT32_C(0x68323634) // "h264" in ASCII
@@ -60,8 +68,8 @@ sc_demuxer_to_avcodec_id(uint32_t codec_id) {
 static bool
 sc_demuxer_recv_codec_id(struct sc_demuxer *demuxer, uint32_t *codec_id) {
     uint8_t data[4];
-    ssize_t r = net_recv_all(demuxer->socket, data, 4);
-    if (r < 4) {
+    bool ok = sc_net_reader_read(&demuxer->reader, data, 4);
+    if (!ok) {
         return false;
     }
 
@@ -118,9 +126,7 @@ sc_demuxer_recv_header(struct sc_demuxer *demuxer,
     // <---------------------------------> <---------------- . . .
     //            packet size                       raw packet
     //
-    ssize_t r = net_recv_all(demuxer->socket, buf, SC_PACKET_HEADER_SIZE);
-    assert(r <= SC_PACKET_HEADER_SIZE);
-    return r == SC_PACKET_HEADER_SIZE;
+    return sc_net_reader_read(&demuxer->reader, buf, SC_PACKET_HEADER_SIZE);
 }
 
 static bool
@@ -137,69 +143,25 @@ sc_demuxer_parse_session(const uint8_t *header,
     session->video.client_resized = header[3] & 1;
 }
 
-static bool
-sc_demuxer_recv_packet(struct sc_demuxer *demuxer, const uint8_t *header,
-                       AVPacket *packet) {
-    assert(!sc_demuxer_is_session(header));
-    uint64_t pts_flags = sc_read64be(header);
-    uint32_t len = sc_read32be(&header[8]);
-    if (!len) {
-        LOGE("Invalid packet length: 0");
-        return false;
-    }
-
-    if (av_new_packet(packet, len)) {
-        LOG_OOM();
-        return false;
-    }
-
-    ssize_t r = net_recv_all(demuxer->socket, packet->data, len);
-    if (r < 0 || ((uint32_t) r) < len) {
-        av_packet_unref(packet);
-        return false;
-    }
-
-    if (pts_flags & SC_PACKET_FLAG_CONFIG) {
-        packet->pts = AV_NOPTS_VALUE;
-    } else {
-        packet->pts = pts_flags & SC_PACKET_PTS_MASK;
-    }
-
-    if (pts_flags & SC_PACKET_FLAG_KEY_FRAME) {
-        packet->flags |= AV_PKT_FLAG_KEY;
-    }
-
-    packet->dts = packet->pts;
-    return true;
-}
-
-static int
-run_demuxer(void *data) {
-    struct sc_demuxer *demuxer = data;
-
-    // Flag to report end-of-stream (i.e. device disconnected)
-    enum sc_demuxer_status status = SC_DEMUXER_STATUS_ERROR;
-
-    uint32_t raw_codec_id;
-    bool ok = sc_demuxer_recv_codec_id(demuxer, &raw_codec_id);
-    if (!ok) {
-        LOGE("Demuxer '%s': stream disabled due to connection error",
-             demuxer->name);
-        goto end;
-    }
+// Return the decoder of the stream, or NULL if the stream must not be
+// demuxed (the status is then set)
+static const AVCodec *
+sc_demuxer_find_codec(struct sc_demuxer *demuxer, uint32_t raw_codec_id,
+                      enum sc_demuxer_status *status) {
+    *status = SC_DEMUXER_STATUS_ERROR;
 
     if (raw_codec_id == 0) {
         LOGW("Demuxer '%s': stream explicitly disabled by the device",
              demuxer->name);
         sc_packet_source_sinks_disable(&demuxer->packet_source);
-        status = SC_DEMUXER_STATUS_DISABLED;
-        goto end;
+        *status = SC_DEMUXER_STATUS_DISABLED;
+        return NULL;
     }
 
     if (raw_codec_id == 1) {
         LOGE("Demuxer '%s': stream configuration error on the device",
              demuxer->name);
-        goto end;
+        return NULL;
     }
 
     enum AVCodecID codec_id = sc_demuxer_to_avcodec_id(raw_codec_id);
@@ -207,7 +169,7 @@ run_demuxer(void *data) {
         LOGE("Demuxer '%s': stream disabled due to unsupported codec",
              demuxer->name);
         sc_packet_source_sinks_disable(&demuxer->packet_source);
-        goto end;
+        return NULL;
     }
 
     const AVCodec *codec = avcodec_find_decoder(codec_id);
@@ -215,43 +177,40 @@ run_demuxer(void *data) {
         LOGE("Demuxer '%s': stream disabled due to missing decoder",
              demuxer->name);
         sc_packet_source_sinks_disable(&demuxer->packet_source);
-        goto end;
+        return NULL;
+    }
+
+    return codec;
+}
+
+static bool
+sc_demuxer_check_session(const struct sc_stream_session *session) {
+    if (!session->video.width || !session->video.height) {
+        LOGE("Invalid session video size: %" PRIu32 "x%" PRIu32,
+             session->video.width, session->video.height);
+        return false;
     }
 
+    return true;
+}
+
+// Open the codec context and the sinks (the session is NULL for audio)
+static bool
+sc_demuxer_open(struct sc_demuxer *demuxer, const AVCodec *codec,
+                uint32_t raw_codec_id,
+                const struct sc_stream_session *session) {
     AVCodecContext *codec_ctx = avcodec_alloc_context3(codec);
     if (!codec_ctx) {
         LOG_OOM();
-        goto end;
+        return false;
     }
 
     codec_ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
 
-    uint8_t header[SC_PACKET_HEADER_SIZE];
-    struct sc_stream_session session_data;
-
-    struct sc_stream_session *session = NULL;
     if (codec->type == AVMEDIA_TYPE_VIDEO) {
-        bool ok = sc_demuxer_recv_header(demuxer, header);
-        if (!ok) {
-            goto finally_free_context;
-        }
-
-        if (!sc_demuxer_is_session(header)) {
-            LOGE("Unexpected packet (not a session header)");
-            goto finally_free_context;
-        }
-
-        session = &session_data;
-        sc_demuxer_parse_session(header, session);
-
-        if (!session_data.video.width || !session_data.video.height) {
-            LOGE("Invalid session video size: %" PRIu32 "x%" PRIu32,
-                 session_data.video.width, session_data.video.height);
-            goto finally_free_context;
-        }
-
-        codec_ctx->width = session_data.video.width;
-        codec_ctx->height = session_data.video.height;
+        assert(session);
+        codec_ctx->width = session->video.width;
+        codec_ctx->height = session->video.height;
         codec_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
 
     } else {
@@ -272,29 +231,183 @@ run_demuxer(void *data) {
 
     if (avcodec_open2(codec_ctx, codec, NULL) < 0) {
         LOGE("Demuxer '%s': could not open codec", demuxer->name);
-        goto finally_free_context;
+        goto error_free_context;
     }
 
     if (!sc_packet_source_sinks_open(&demuxer->packet_source, codec_ctx,
                                      session)) {
-        goto finally_free_context;
+        goto error_free_context;
     }
 
     // Config packets must be merged with the next non-config packet only for
     // H.26x
-    bool must_merge_config_packet = raw_codec_id == SC_CODEC_ID_H264
-                                 || raw_codec_id == SC_CODEC_ID_H265;
+    demuxer->must_merge_config_packet = raw_codec_id == SC_CODEC_ID_H264
+                                     || raw_codec_id == SC_CODEC_ID_H265;
+    if (demuxer->must_merge_config_packet) {
+        sc_packet_merger_init(&demuxer->merger);
+    }
 
-    struct sc_packet_merger merger;
+    demuxer->codec_ctx = codec_ctx;
+    return true;
 
-    if (must_merge_config_packet) {
-        sc_packet_merger_init(&merger);
+error_free_context:
+    avcodec_free_context(&codec_ctx);
+    return false;
+}
+
+static void
+sc_demuxer_close(struct sc_demuxer *demuxer) {
+    LOGD("Demuxer '%s': end of frames", demuxer->name);
+
+    if (demuxer->must_merge_config_packet) {
+        sc_packet_merger_destroy(&demuxer->merger);
+    }
+
+    sc_packet_source_sinks_close(&demuxer->packet_source);
+    avcodec_free_context(&demuxer->codec_ctx);
+}
+
+// Initialize a media packet from its header (the payload is not received)
+static bool
+sc_demuxer_new_packet(struct sc_demuxer *demuxer, const uint8_t *header,
+                      AVPacket *packet) {
+    assert(!sc_demuxer_is_session(header));
+    uint64_t pts_flags = sc_read64be(header);
+    uint32_t len = sc_read32be(&header[8]);
+    if (!len) {
+        LOGE("Invalid packet length: 0");
+        return false;
+    }
+
+    if (!sc_packet_pool_new_packet(&demuxer->packet_pool, packet, len)) {
+        return false;
+    }
+
+    if (pts_flags & SC_PACKET_FLAG_CONFIG) {
+        packet->pts = AV_NOPTS_VALUE;
+    } else {
+        packet->pts = pts_flags & SC_PACKET_PTS_MASK;
+    }
+
+    if (pts_flags & SC_PACKET_FLAG_KEY_FRAME) {
+        packet->flags |= AV_PKT_FLAG_KEY;
+    }
+
+    packet->dts = packet->pts;
+    return true;
+}
+
+static bool
+sc_demuxer_recv_packet(struct sc_demuxer *demuxer, const uint8_t *header,
+                       AVPacket *packet) {
+    if (!sc_demuxer_new_packet(demuxer, header, packet)) {
+        return false;
+    }
+
+    sc_tick trace_start = sc_trace_begin();
+    bool ok = sc_net_reader_read(&demuxer->reader, packet->data,
+                                 packet->size);
+    sc_trace_end("demuxer recv", trace_start);
+    if (!ok) {
+        av_packet_unref(packet);
+        return false;
+    }
+
+    if (demuxer->latency_stats && packet->pts != AV_NOPTS_VALUE) {
+        sc_latency_stats_on_received(demuxer->latency_stats, packet->pts);
+    }
+
+    if (demuxer->catchup && demuxer->socket != SC_SOCKET_NONE) {
+        ssize_t pending = net_pending(demuxer->socket);
+        if (pending >= 0) {
+            size_t buffered = sc_net_reader_available(&demuxer->reader);
+            sc_catchup_set_pending(demuxer->catchup, buffered + pending);
+        }
+    }
+
+    return true;
+}
+
+static bool
+sc_demuxer_push_packet(struct sc_demuxer *demuxer, AVPacket *packet) {
+    if (demuxer->must_merge_config_packet) {
+        // Prepend any config packet to the next media packet
+        bool ok = sc_packet_merger_merge(&demuxer->merger, packet);
+        if (!ok) {
+            return false;
+        }
+    }
+
+    // On error, the sink already logged its concrete error
+    sc_tick trace_start = sc_trace_begin();
+    bool ok = sc_packet_source_sinks_push(&demuxer->packet_source, packet);
+    sc_trace_end("packet sinks push", trace_start);
+    return ok;
+}
+
+static int
+run_demuxer(void *data) {
+    struct sc_demuxer *demuxer = data;
+
+    // Flag to report end-of-stream (i.e. device disconnected)
+    enum sc_demuxer_status status = SC_DEMUXER_STATUS_ERROR;
+
+    bool ok = sc_net_reader_init(&demuxer->reader, demuxer->socket,
+                                 SC_DEMUXER_RECV_BUFFER_SIZE);
+    if (!ok) {
+        goto end;
+    }
+
+    demuxer->reader.capture = demuxer->capture;
+    demuxer->reader.replay = demuxer->replay;
+
+    sc_packet_pool_init(&demuxer->packet_pool);
+
+    uint32_t raw_codec_id;
+    ok = sc_demuxer_recv_codec_id(demuxer, &raw_codec_id);
+    if (!ok) {
+        LOGE("Demuxer '%s': stream disabled due to connection error",
+             demuxer->name);
+        goto finally_destroy_reader;
+    }
+
+    const AVCodec *codec =
+        sc_demuxer_find_codec(demuxer, raw_codec_id, &status);
+    if (!codec) {
+        goto finally_destroy_reader;
+    }
+
+    uint8_t header[SC_PACKET_HEADER_SIZE];
+    struct sc_stream_session session_data;
+
+    struct sc_stream_session *session = NULL;
+    if (codec->type == AVMEDIA_TYPE_VIDEO) {
+        bool ok = sc_demuxer_recv_header(demuxer, header);
+        if (!ok) {
+            goto finally_destroy_reader;
+        }
+
+        if (!sc_demuxer_is_session(header)) {
+            LOGE("Unexpected packet (not a session header)");
+            goto finally_destroy_reader;
+        }
+
+        session = &session_data;
+        sc_demuxer_parse_session(header, session);
+
+        if (!sc_demuxer_check_session(session)) {
+            goto finally_destroy_reader;
+        }
+    }
+
+    if (!sc_demuxer_open(demuxer, codec, raw_codec_id, session)) {
+        goto finally_destroy_reader;
     }
 
     AVPacket *packet = av_packet_alloc();
     if (!packet) {
         LOG_OOM();
-        goto finally_close_sinks;
+        goto finally_close;
     }
 
     for (;;) {
@@ -319,56 +432,451 @@ run_demuxer(void *data) {
                 break;
             }
 
-            if (must_merge_config_packet) {
-                // Prepend any config packet to the next media packet
-                ok = sc_packet_merger_merge(&merger, packet);
-                if (!ok) {
-                    av_packet_unref(packet);
-                    break;
-                }
-            }
-
-            ok = sc_packet_source_sinks_push(&demuxer->packet_source, packet);
+            ok = sc_demuxer_push_packet(demuxer, packet);
             av_packet_unref(packet);
             if (!ok) {
-                // The sink already logged its concrete error
                 break;
             }
         }
     }
 
-    LOGD("Demuxer '%s': end of frames", demuxer->name);
-
-    if (must_merge_config_packet) {
-        sc_packet_merger_destroy(&merger);
-    }
-
     av_packet_free(&packet);
-finally_close_sinks:
-    sc_packet_source_sinks_close(&demuxer->packet_source);
-finally_free_context:
-    avcodec_free_context(&codec_ctx);
+finally_close:
+    sc_demuxer_close(demuxer);
+finally_destroy_reader:
+    LOGD("Demuxer '%s': %" PRIu64 " receive calls", demuxer->name,
+         demuxer->reader.recv_count);
+    sc_packet_pool_destroy(&demuxer->packet_pool);
+    sc_net_reader_destroy(&demuxer->reader);
 end:
     demuxer->cbs->on_ended(demuxer, status, demuxer->cbs_userdata);
 
     return 0;
 }
 
-void
-sc_demuxer_init(struct sc_demuxer *demuxer, const char *name, sc_socket socket,
-                const struct sc_demuxer_callbacks *cbs, void *cbs_userdata) {
-    assert(socket != SC_SOCKET_NONE);
+// Reactor mode: the reactor callback parses the stream and queues the items,
+// processed in order by a job of the strand.
+
+static void
+sc_demuxer_end(struct sc_demuxer *demuxer) {
+    if (demuxer->codec_ctx) {
+        sc_demuxer_close(demuxer);
+    }
+
+    LOGD("Demuxer '%s': %" PRIu64 " receive calls", demuxer->name,
+         demuxer->reader.recv_count);
+    sc_packet_pool_destroy(&demuxer->packet_pool);
+    sc_net_reader_destroy(&demuxer->reader);
+
+    demuxer->cbs->on_ended(demuxer, demuxer->status, demuxer->cbs_userdata);
+
+    sc_mutex_lock(&demuxer->mutex);
+    demuxer->ended = true;
+    sc_cond_signal(&demuxer->cond);
+    sc_mutex_unlock(&demuxer->mutex);
+    // The demuxer may not be accessed anymore
+}
+
+static void
+sc_demuxer_fail(struct sc_demuxer *demuxer) {
+    sc_mutex_lock(&demuxer->mutex);
+    demuxer->failed = true;
+    if (demuxer->paused) {
+        // Resumed under the lock: the handle may be removed (and freed) by
+        // the callback as soon as it is watched again
+        demuxer->paused = false;
+        sc_reactor_resume(demuxer->reactor, demuxer->handle);
+    }
+    sc_mutex_unlock(&demuxer->mutex);
+
+    // Wake up the reactor callback even if the device sends nothing more, so
+    // that it stops demuxing
+    net_interrupt(demuxer->socket);
+}
+
+static bool
+sc_demuxer_process(struct sc_demuxer *demuxer, struct sc_demuxer_item *item,
+                   bool failed) {
+    switch (item->type) {
+        case SC_DEMUXER_ITEM_OPEN: {
+            if (failed) {
+                return true;
+            }
+            bool video = item->open.codec->type == AVMEDIA_TYPE_VIDEO;
+            return sc_demuxer_open(demuxer, item->open.codec,
+                                   item->open.raw_codec_id,
+                                   video ? &item->open.session : NULL);
+        }
+        case SC_DEMUXER_ITEM_SESSION:
+            if (failed || !demuxer->codec_ctx) {
+                return true;
+            }
+            return sc_packet_source_sinks_push_session(&demuxer->packet_source,
+                                                       &item->session);
+        case SC_DEMUXER_ITEM_PACKET: {
+            bool ok = true;
+            if (!failed && demuxer->codec_ctx) {
+                ok = sc_demuxer_push_packet(demuxer, item->packet);
+            }
+            av_packet_free(&item->packet);
+            return ok;
+        }
+        default:
+            assert(!"unexpected item");
+            return false;
+    }
+}
+
+static void
+run_demuxer_job(void *userdata) {
+    struct sc_demuxer *demuxer = userdata;
+
+    sc_mutex_lock(&demuxer->mutex);
+
+    while (!sc_vecdeque_is_empty(&demuxer->items)) {
+        struct sc_demuxer_item item = sc_vecdeque_pop(&demuxer->items);
+        bool failed = demuxer->failed;
+
+        // Read the socket again once the sinks caught up
+        if (demuxer->paused && sc_vecdeque_size(&demuxer->items)
+                                   <= SC_DEMUXER_RESUME_ITEMS) {
+            demuxer->paused = false;
+            sc_reactor_resume(demuxer->reactor, demuxer->handle);
+        }
+
+        sc_mutex_unlock(&demuxer->mutex);
+
+        if (!sc_demuxer_process(demuxer, &item, failed)) {
+            sc_demuxer_fail(demuxer);
+        }
+
+        sc_mutex_lock(&demuxer->mutex);
+    }
+
+    bool finished = demuxer->finished;
+    if (!finished) {
+        demuxer->scheduled = false;
+    }
+
+    sc_mutex_unlock(&demuxer->mutex);
+
+    if (finished) {
+        // All the items have been processed
+        sc_demuxer_end(demuxer);
+    }
+}
+
+static void
+sc_demuxer_schedule(struct sc_demuxer *demuxer) {
+    bool ok = sc_strand_post(&demuxer->strand, run_demuxer_job, demuxer);
+    if (!ok) {
+        // Should never happen, process the items from the current thread
+        LOGW("Demuxer '%s': could not post job", demuxer->name);
+        run_demuxer_job(demuxer);
+    }
+}
+
+static bool
+sc_demuxer_queue(struct sc_demuxer *demuxer,
+                 const struct sc_demuxer_item *item) {
+    sc_mutex_lock(&demuxer->mutex);
+    bool ok = sc_vecdeque_push(&demuxer->items, *item);
+    bool schedule = ok && !demuxer->scheduled;
+    if (schedule) {
+        demuxer->scheduled = true;
+    }
+    sc_mutex_unlock(&demuxer->mutex);
+
+    if (!ok) {
+        LOG_OOM();
+        return false;
+    }
+
+    if (schedule) {
+        sc_demuxer_schedule(demuxer);
+    }
+
+    return true;
+}
+
+static enum sc_reactor_action
+sc_demuxer_finish(struct sc_demuxer *demuxer, enum sc_demuxer_status status) {
+    // Unregister the socket before the demuxer may be joined and the socket
+    // closed
+    sc_reactor_remove(demuxer->reactor, demuxer->handle);
+
+    if (demuxer->parser.packet) {
+        // Incomplete packet
+        av_packet_free(&demuxer->parser.packet);
+    }
+
+    sc_mutex_lock(&demuxer->mutex);
+    demuxer->finished = true;
+    demuxer->status = demuxer->failed ? SC_DEMUXER_STATUS_ERROR : status;
+    bool schedule = !demuxer->scheduled;
+    demuxer->scheduled = true;
+    sc_mutex_unlock(&demuxer->mutex);
+
+    if (schedule) {
+        sc_demuxer_schedule(demuxer);
+    }
+
+    return SC_REACTOR_PAUSE;
+}
+
+// Parse the buffered data, return false if the stream must end (the status
+// is then set)
+static bool
+sc_demuxer_parse(struct sc_demuxer *demuxer, enum sc_demuxer_status *status) {
+    struct sc_net_reader *reader = &demuxer->reader;
+    uint8_t header[SC_PACKET_HEADER_SIZE];
+
+    *status = SC_DEMUXER_STATUS_ERROR;
+
+    for (;;) {
+        switch (demuxer->parser.state) {
+            case SC_DEMUXER_PARSE_CODEC_ID: {
+                if (sc_net_reader_available(reader) < 4) {
+                    return true;
+                }
+
+                uint8_t data[4];
+                sc_net_reader_take(reader, data, sizeof(data));
+                uint32_t raw_codec_id = sc_read32be(data);
+
+                const AVCodec *codec =
+                    sc_demuxer_find_codec(demuxer, raw_codec_id, status);
+                if (!codec) {
+                    return false;
+                }
+
+                demuxer->parser.codec = codec;
+                demuxer->parser.raw_codec_id = raw_codec_id;
+
+                if (codec->type == AVMEDIA_TYPE_VIDEO) {
+                    // The codec is opened once the session is received
+                    demuxer->parser.state = SC_DEMUXER_PARSE_SESSION;
+                    break;
+                }
+
+                struct sc_demuxer_item item = {
+                    .type = SC_DEMUXER_ITEM_OPEN,
+                    .open = {
+                        .codec = codec,
+                        .raw_codec_id = raw_codec_id,
+                    },
+                };
+                if (!sc_demuxer_queue(demuxer, &item)) {
+                    return false;
+                }
 
+                demuxer->parser.state = SC_DEMUXER_PARSE_HEADER;
+                break;
+            }
+            case SC_DEMUXER_PARSE_SESSION: {
+                if (sc_net_reader_available(reader)
+                        < SC_PACKET_HEADER_SIZE) {
+                    return true;
+                }
+
+                sc_net_reader_take(reader, header, SC_PACKET_HEADER_SIZE);
+                if (!sc_demuxer_is_session(header)) {
+                    LOGE("Unexpected packet (not a session header)");
+                    return false;
+                }
+
+                struct sc_demuxer_item item = {
+                    .type = SC_DEMUXER_ITEM_OPEN,
+                    .open = {
+                        .codec = demuxer->parser.codec,
+                        .raw_codec_id = demuxer->parser.raw_codec_id,
+                    },
+                };
+                sc_demuxer_parse_session(header, &item.open.session);
+                if (!sc_demuxer_check_session(&item.open.session)) {
+                    return false;
+                }
+
+                if (!sc_demuxer_queue(demuxer, &item)) {
+                    return false;
+                }
+
+                demuxer->parser.state = SC_DEMUXER_PARSE_HEADER;
+                break;
+            }
+            case SC_DEMUXER_PARSE_HEADER: {
+                if (sc_net_reader_available(reader)
+                        < SC_PACKET_HEADER_SIZE) {
+                    return true;
+                }
+
+                sc_net_reader_take(reader, header, SC_PACKET_HEADER_SIZE);
+
+                if (sc_demuxer_is_session(header)) {
+                    struct sc_demuxer_item item = {
+                        .type = SC_DEMUXER_ITEM_SESSION,
+                    };
+                    sc_demuxer_parse_session(header, &item.session);
+                    if (!sc_demuxer_queue(demuxer, &item)) {
+                        return false;
+                    }
+                    break;
+                }
+
+                AVPacket *packet = av_packet_alloc();
+                if (!packet) {
+                    LOG_OOM();
+                    return false;
+                }
+
+                if (!sc_demuxer_new_packet(demuxer, header, packet)) {
+                    av_packet_free(&packet);
+                    return false;
+                }
+
+                demuxer->parser.packet = packet;
+                demuxer->parser.offset = 0;
+                demuxer->parser.state = SC_DEMUXER_PARSE_PAYLOAD;
+                break;
+            }
+            case SC_DEMUXER_PARSE_PAYLOAD: {
+                AVPacket *packet = demuxer->parser.packet;
+                uint32_t offset = demuxer->parser.offset;
+                offset += sc_net_reader_take(reader, packet->data + offset,
+                                             packet->size - offset);
+                demuxer->parser.offset = offset;
+                if (offset < (uint32_t) packet->size) {
+                    return true;
+                }
+
+                if (demuxer->latency_stats && packet->pts != AV_NOPTS_VALUE) {
+                    sc_latency_stats_on_received(demuxer->latency_stats,
+                                                 packet->pts);
+                }
+
+                struct sc_demuxer_item item = {
+                    .type = SC_DEMUXER_ITEM_PACKET,
+                    .packet = packet,
+                };
+                if (!sc_demuxer_queue(demuxer, &item)) {
+                    // Freed by sc_demuxer_finish()
+                    return false;
+                }
+
+                demuxer->parser.packet = NULL;
+                demuxer->parser.state = SC_DEMUXER_PARSE_HEADER;
+                break;
+            }
+            default:
+                assert(!"unexpected parser state");
+                return false;
+        }
+    }
+}
+
+static enum sc_reactor_action
+sc_demuxer_on_readable(void *userdata) {
+    struct sc_demuxer *demuxer = userdata;
+
+    sc_mutex_lock(&demuxer->mutex);
+    bool failed = demuxer->failed;
+    sc_mutex_unlock(&demuxer->mutex);
+
+    if (failed) {
+        return sc_demuxer_finish(demuxer, SC_DEMUXER_STATUS_ERROR);
+    }
+
+    ssize_t r = sc_net_reader_recv(&demuxer->reader);
+    if (r <= 0) {
+        enum sc_demuxer_status status = SC_DEMUXER_STATUS_ERROR;
+        switch (demuxer->parser.state) {
+            case SC_DEMUXER_PARSE_CODEC_ID:
+                LOGE("Demuxer '%s': stream disabled due to connection error",
+                     demuxer->name);
+                break;
+            case SC_DEMUXER_PARSE_HEADER:
+                // end of stream
+                status = SC_DEMUXER_STATUS_EOS;
+                break;
+            default:
+                break;
+        }
+        return sc_demuxer_finish(demuxer, status);
+    }
+
+    enum sc_demuxer_status status;
+    if (!sc_demuxer_parse(demuxer, &status)) {
+        return sc_demuxer_finish(demuxer, status);
+    }
+
+    // Stop reading while the sinks are late
+    sc_mutex_lock(&demuxer->mutex);
+    bool pause =
+        sc_vecdeque_size(&demuxer->items) >= SC_DEMUXER_MAX_PENDING_ITEMS;
+    demuxer->paused = pause;
+    sc_mutex_unlock(&demuxer->mutex);
+
+    return pause ? SC_REACTOR_PAUSE : SC_REACTOR_CONTINUE;
+}
+
+static void
+sc_demuxer_init_common(struct sc_demuxer *demuxer, const char *name,
+                       sc_socket socket, struct sc_stream_replay *replay,
+                       const struct sc_demuxer_callbacks *cbs,
+                       void *cbs_userdata) {
     demuxer->name = name; // statically allocated
     demuxer->socket = socket;
+    demuxer->capture = NULL;
+    demuxer->replay = replay;
+    demuxer->latency_stats = NULL;
+    demuxer->catchup = NULL;
     sc_packet_source_init(&demuxer->packet_source);
 
+    demuxer->codec_ctx = NULL;
+    demuxer->must_merge_config_packet = false;
+    demuxer->reactor = NULL;
+
     assert(cbs && cbs->on_ended);
 
     demuxer->cbs = cbs;
     demuxer->cbs_userdata = cbs_userdata;
 }
 
+void
+sc_demuxer_init(struct sc_demuxer *demuxer, const char *name, sc_socket socket,
+                const struct sc_demuxer_callbacks *cbs, void *cbs_userdata) {
+    assert(socket != SC_SOCKET_NONE);
+    sc_demuxer_init_common(demuxer, name, socket, NULL, cbs, cbs_userdata);
+}
+
+void
+sc_demuxer_init_replay(struct sc_demuxer *demuxer, const char *name,
+                       struct sc_stream_replay *replay,
+                       const struct sc_demuxer_callbacks *cbs,
+                       void *cbs_userdata) {
+    assert(replay);
+    sc_demuxer_init_common(demuxer, name, SC_SOCKET_NONE, replay, cbs,
+                           cbs_userdata);
+}
+
+void
+sc_demuxer_set_capture(struct sc_demuxer *demuxer,
+                       struct sc_stream_capture *capture) {
+    assert(!demuxer->replay);
+    demuxer->capture = capture;
+}
+
+void
+sc_demuxer_set_latency_stats(struct sc_demuxer *demuxer,
+                             struct sc_latency_stats *latency_stats) {
+    demuxer->latency_stats = latency_stats;
+}
+
+void
+sc_demuxer_set_catchup(struct sc_demuxer *demuxer, struct sc_catchup *catchup) {
+    demuxer->catchup = catchup;
+}
+
 bool
 sc_demuxer_start(struct sc_demuxer *demuxer) {
     LOGD("Demuxer '%s': starting thread", demuxer->name);
@@ -382,7 +890,87 @@ sc_demuxer_start(struct sc_demuxer *demuxer) {
     return true;
 }
 
+bool
+sc_demuxer_start_reactor(struct sc_demuxer *demuxer,
+                         struct sc_reactor *reactor,
+                         struct sc_worker_pool *pool) {
+    // A replay has no socket to watch
+    assert(!demuxer->replay);
+
+    LOGD("Demuxer '%s': starting on reactor", demuxer->name);
+
+    bool ok = sc_mutex_init(&demuxer->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&demuxer->cond);
+    if (!ok) {
+        goto error_destroy_mutex;
+    }
+
+    ok = sc_net_reader_init(&demuxer->reader, demuxer->socket,
+                            SC_DEMUXER_RECV_BUFFER_SIZE);
+    if (!ok) {
+        goto error_destroy_cond;
+    }
+
+    demuxer->reader.capture = demuxer->capture;
+
+    sc_packet_pool_init(&demuxer->packet_pool);
+    sc_strand_init(&demuxer->strand, pool);
+    sc_vecdeque_init(&demuxer->items);
+
+    demuxer->parser.state = SC_DEMUXER_PARSE_CODEC_ID;
+    demuxer->parser.packet = NULL;
+    demuxer->scheduled = false;
+    demuxer->paused = false;
+    demuxer->failed = false;
+    demuxer->finished = false;
+    demuxer->ended = false;
+
+    // Set before the callback may be called
+    demuxer->reactor = reactor;
+    sc_mutex_lock(&demuxer->mutex);
+    demuxer->handle = sc_reactor_add(reactor, demuxer->socket,
+                                     sc_demuxer_on_readable, demuxer);
+    sc_mutex_unlock(&demuxer->mutex);
+    if (!demuxer->handle) {
+        LOGE("Demuxer '%s': could not register socket", demuxer->name);
+        goto error_destroy_reader;
+    }
+
+    return true;
+
+error_destroy_reader:
+    demuxer->reactor = NULL;
+    sc_strand_destroy(&demuxer->strand);
+    sc_packet_pool_destroy(&demuxer->packet_pool);
+    sc_net_reader_destroy(&demuxer->reader);
+error_destroy_cond:
+    sc_cond_destroy(&demuxer->cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&demuxer->mutex);
+
+    return false;
+}
+
 void
 sc_demuxer_join(struct sc_demuxer *demuxer) {
-    sc_thread_join(&demuxer->thread, NULL);
+    if (!demuxer->reactor) {
+        sc_thread_join(&demuxer->thread, NULL);
+        return;
+    }
+
+    sc_mutex_lock(&demuxer->mutex);
+    while (!demuxer->ended) {
+        sc_cond_wait(&demuxer->cond, &demuxer->mutex);
+    }
+    sc_mutex_unlock(&demuxer->mutex);
+
+    sc_strand_destroy(&demuxer->strand);
+    assert(sc_vecdeque_is_empty(&demuxer->items));
+    sc_vecdeque_destroy(&demuxer->items);
+    sc_cond_destroy(&demuxer->cond);
+    sc_mutex_destroy(&demuxer->mutex);
 }
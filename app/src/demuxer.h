@@ -4,29 +4,105 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
 
+#include "catchup.h"
+#include "latency_stats.h"
+#include "packet_merger.h"
+#include "packet_pool.h"
 #include "trait/packet_source.h"
 #include "util/net.h"
+#include "util/net_reader.h"
+#include "util/reactor.h"
+#include "util/stream_capture.h"
 #include "util/thread.h"
+#include "util/vecdeque.h"
+#include "util/worker_pool.h"
+
+enum sc_demuxer_status {
+    SC_DEMUXER_STATUS_EOS,
+    SC_DEMUXER_STATUS_DISABLED,
+    SC_DEMUXER_STATUS_ERROR,
+};
+
+// Data received by the reactor callback, processed by the strand jobs
+// (reactor mode only)
+struct sc_demuxer_item {
+    enum {
+        SC_DEMUXER_ITEM_OPEN,
+        SC_DEMUXER_ITEM_SESSION,
+        SC_DEMUXER_ITEM_PACKET,
+    } type;
+    union {
+        struct {
+            const AVCodec *codec;
+            uint32_t raw_codec_id;
+            struct sc_stream_session session; // video only
+        } open;
+        struct sc_stream_session session;
+        AVPacket *packet;
+    };
+};
 
 struct sc_demuxer {
     struct sc_packet_source packet_source; // packet source trait
 
     const char *name; // must be statically allocated (e.g. a string literal)
 
-    sc_socket socket;
+    sc_socket socket; // SC_SOCKET_NONE on replay
     sc_thread thread;
 
+    struct sc_stream_capture *capture; // NULL if not captured
+    struct sc_stream_replay *replay; // read instead of the socket if not NULL
+    struct sc_latency_stats *latency_stats; // NULL if disabled
+    struct sc_catchup *catchup; // NULL if disabled
+
+    // Only accessed from the demuxer thread (or the reactor callback)
+    struct sc_net_reader reader;
+    struct sc_packet_pool packet_pool;
+
+    // Only accessed from the demuxer thread (or the strand jobs)
+    AVCodecContext *codec_ctx;
+    // Config packets must be merged with the next non-config packet only for
+    // H.26x
+    bool must_merge_config_packet;
+    struct sc_packet_merger merger;
+
+    // Reactor mode (see sc_demuxer_start_reactor())
+    struct sc_reactor *reactor; // NULL in thread mode
+    struct sc_reactor_handle *handle;
+    struct sc_strand strand;
+
+    // Incremental parsing state (only accessed from the reactor callback)
+    struct {
+        enum {
+            SC_DEMUXER_PARSE_CODEC_ID,
+            SC_DEMUXER_PARSE_SESSION, // first session of a video stream
+            SC_DEMUXER_PARSE_HEADER,
+            SC_DEMUXER_PARSE_PAYLOAD,
+        } state;
+        const AVCodec *codec;
+        uint32_t raw_codec_id;
+        AVPacket *packet; // packet being received
+        uint32_t offset; // payload bytes received
+    } parser;
+
+    // Protected by the mutex
+    sc_mutex mutex;
+    sc_cond cond;
+    struct sc_demuxer_item_queue SC_VECDEQUE(struct sc_demuxer_item) items;
+    bool scheduled; // a strand job is processing the items
+    bool paused; // the reactor stopped reading (too many pending items)
+    bool failed; // a sink failed, stop demuxing
+    bool finished; // no more items will be queued
+    enum sc_demuxer_status status; // set once finished
+    bool ended;
+
     const struct sc_demuxer_callbacks *cbs;
     void *cbs_userdata;
 };
 
-enum sc_demuxer_status {
-    SC_DEMUXER_STATUS_EOS,
-    SC_DEMUXER_STATUS_DISABLED,
-    SC_DEMUXER_STATUS_ERROR,
-};
-
 struct sc_demuxer_callbacks {
     void (*on_ended)(struct sc_demuxer *demuxer, enum sc_demuxer_status,
                      void *userdata);
@@ -37,9 +113,65 @@ void
 sc_demuxer_init(struct sc_demuxer *demuxer, const char *name, sc_socket socket,
                 const struct sc_demuxer_callbacks *cbs, void *cbs_userdata);
 
+/**
+ * Initialize a demuxer reading a capture (see util/stream_capture.h) instead
+ * of a socket
+ *
+ * It must be started in thread mode (sc_demuxer_start()).
+ */
+void
+sc_demuxer_init_replay(struct sc_demuxer *demuxer, const char *name,
+                       struct sc_stream_replay *replay,
+                       const struct sc_demuxer_callbacks *cbs,
+                       void *cbs_userdata);
+
+/**
+ * Record the bytes received on the socket to a capture
+ *
+ * Must be called before the demuxer is started.
+ */
+void
+sc_demuxer_set_capture(struct sc_demuxer *demuxer,
+                       struct sc_stream_capture *capture);
+
+/**
+ * Report the arrival time of the packets to the latency stats
+ *
+ * Must be called before the demuxer is started.
+ */
+void
+sc_demuxer_set_latency_stats(struct sc_demuxer *demuxer,
+                             struct sc_latency_stats *latency_stats);
+
+/**
+ * Report the bytes waiting in the socket to the catch-up policy of the decoder
+ *
+ * Must be called before the demuxer is started. Only the thread mode reports
+ * them (a replay has no socket, and in reactor mode the socket is not read
+ * while the sinks are late).
+ */
+void
+sc_demuxer_set_catchup(struct sc_demuxer *demuxer, struct sc_catchup *catchup);
+
 bool
 sc_demuxer_start(struct sc_demuxer *demuxer);
 
+/**
+ * Start demuxing without a dedicated thread
+ *
+ * The socket is read from the reactor thread, and the packets are pushed to
+ * the sinks (e.g. decoded) from jobs of a strand of the pool, so that many
+ * demuxers share a few threads. The sink callbacks are called in order, but
+ * not always from the same thread.
+ *
+ * If the sinks are slower than the stream, the socket is not read until they
+ * catch up.
+ */
+bool
+sc_demuxer_start_reactor(struct sc_demuxer *demuxer,
+                         struct sc_reactor *reactor,
+                         struct sc_worker_pool *pool);
+
 void
 sc_demuxer_join(struct sc_demuxer *demuxer);
 
@@ -21,6 +21,12 @@ enum {
     SC_EVENT_AOA_OPEN_ERROR,
     SC_EVENT_DISCONNECTED_ICON_LOADED,
     SC_EVENT_DISCONNECTED_TIMEOUT,
+    // Host mode (data1 is the device id)
+    SC_EVENT_HOST_DEVICE_CONNECTED,
+    SC_EVENT_HOST_DEVICE_CONNECTION_FAILED,
+    SC_EVENT_HOST_DEVICE_DISCONNECTED,
+    // Host mode (data1 is a struct sc_host_command, owned by the event)
+    SC_EVENT_HOST_COMMAND,
 };
 
 bool
@@ -0,0 +1,802 @@
+#include "host.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL3/SDL.h>
+
+#include "catchup.h"
+#include "controller.h"
+#include "decoder.h"
+#include "demuxer.h"
+#include "events.h"
+#include "server.h"
+#include "util/log.h"
+#include "util/rand.h"
+#include "util/reactor.h"
+#include "util/thread.h"
+#include "util/worker_pool.h"
+
+#include "../../linkandroid/src/json/cJSON.h"
+#include "../../linkandroid/src/preview_sender.h"
+#include "../../linkandroid/src/websocket_client.h"
+
+// The workers decode the videos and encode the previews of all the devices
+#define SC_HOST_MAX_WORKERS 16
+
+struct sc_host;
+
+struct sc_host_device {
+    struct sc_host *host;
+    uint32_t id; // identifies the device in the events (never reused)
+    char *serial; // as requested, tags the WebSocket messages
+
+    struct sc_server server;
+    struct sc_demuxer demuxer;
+    struct sc_decoder decoder;
+    struct la_preview_sender preview_sender;
+    struct sc_controller controller;
+    struct sc_catchup catchup;
+
+    bool connected;
+    bool demuxer_started;
+    bool preview_sender_initialized;
+    bool catchup_initialized;
+    bool controller_initialized;
+    bool controller_started; // protected by the host mutex
+
+    struct sc_host_device *next;
+};
+
+struct sc_host {
+    const struct scrcpy_options *options;
+    // Must outlive the decoders
+    struct sc_decoder_params decoder_params;
+
+    struct la_websocket_client *ws_client;
+
+    struct sc_reactor reactor;
+    bool has_reactor; // otherwise, one demuxer thread per device
+    struct sc_worker_pool pool;
+
+    // The list is only modified from the main thread, but it is also read
+    // from the WebSocket thread to route the control messages
+    sc_mutex mutex;
+    struct sc_host_device *devices;
+    uint32_t next_id;
+    struct sc_rand rand;
+};
+
+enum sc_host_action {
+    SC_HOST_ACTION_ADD,
+    SC_HOST_ACTION_REMOVE,
+};
+
+// Request received from the WebSocket thread, executed by the main thread
+struct sc_host_command {
+    enum sc_host_action action;
+    char *serial;
+};
+
+static void
+sc_host_push_device_event(uint32_t type, struct sc_host_device *device) {
+    void *id = (void *) (uintptr_t) device->id;
+    switch (type) {
+        case SC_EVENT_HOST_DEVICE_CONNECTED:
+            sc_push_event_with_data(SC_EVENT_HOST_DEVICE_CONNECTED, id);
+            break;
+        case SC_EVENT_HOST_DEVICE_CONNECTION_FAILED:
+            sc_push_event_with_data(SC_EVENT_HOST_DEVICE_CONNECTION_FAILED,
+                                    id);
+            break;
+        default:
+            assert(type == SC_EVENT_HOST_DEVICE_DISCONNECTED);
+            sc_push_event_with_data(SC_EVENT_HOST_DEVICE_DISCONNECTED, id);
+            break;
+    }
+}
+
+static void
+sc_host_on_connection_failed(struct sc_server *server, void *userdata) {
+    (void) server;
+    struct sc_host_device *device = userdata;
+
+    sc_host_push_device_event(SC_EVENT_HOST_DEVICE_CONNECTION_FAILED, device);
+}
+
+static void
+sc_host_on_connected(struct sc_server *server, void *userdata) {
+    (void) server;
+    struct sc_host_device *device = userdata;
+
+    sc_host_push_device_event(SC_EVENT_HOST_DEVICE_CONNECTED, device);
+}
+
+static void
+sc_host_on_disconnected(struct sc_server *server, void *userdata) {
+    (void) server;
+    struct sc_host_device *device = userdata;
+
+    LOGD("Host: server of device %s disconnected", device->serial);
+    // Handled by the demuxer or controller end
+}
+
+static void
+sc_host_demuxer_on_ended(struct sc_demuxer *demuxer,
+                         enum sc_demuxer_status status, void *userdata) {
+    (void) demuxer;
+    struct sc_host_device *device = userdata;
+
+    if (status != SC_DEMUXER_STATUS_EOS) {
+        LOGE("Host: demuxer error for device %s", device->serial);
+    }
+
+    sc_host_push_device_event(SC_EVENT_HOST_DEVICE_DISCONNECTED, device);
+}
+
+static void
+sc_host_controller_on_ended(struct sc_controller *controller, bool error,
+                            void *userdata) {
+    // Note: this function may be called twice, once from the controller thread
+    // and once from the receiver thread
+    (void) controller;
+    struct sc_host_device *device = userdata;
+
+    if (error) {
+        LOGE("Host: controller error for device %s", device->serial);
+    }
+
+    sc_host_push_device_event(SC_EVENT_HOST_DEVICE_DISCONNECTED, device);
+}
+
+// Called from the worker decoding the video of the device
+static void
+sc_host_catchup_on_request_key_frame(struct sc_catchup *catchup,
+                                     void *userdata) {
+    (void) catchup;
+    struct sc_host_device *device = userdata;
+
+    struct sc_control_msg msg;
+    msg.type = SC_CONTROL_MSG_TYPE_RESET_VIDEO;
+
+    if (!sc_controller_push_msg(&device->controller, &msg)) {
+        LOGW("Host: could not request a key frame for device %s",
+             device->serial);
+    }
+}
+
+// Report the state of a device to the WebSocket server:
+//
+//   {"type":"host_device","serial":..,"data":{"state":..,"name":..}}
+static void
+sc_host_send_state(struct sc_host *host, const char *serial,
+                   const char *state, const char *name) {
+    cJSON *root = cJSON_CreateObject();
+    if (!root) {
+        LOG_OOM();
+        return;
+    }
+
+    cJSON_AddStringToObject(root, "type", "host_device");
+    cJSON_AddStringToObject(root, "serial", serial);
+    cJSON *data = cJSON_AddObjectToObject(root, "data");
+    if (data) {
+        cJSON_AddStringToObject(data, "state", state);
+        if (name) {
+            cJSON_AddStringToObject(data, "name", name);
+        }
+    }
+
+    char *json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!json) {
+        LOG_OOM();
+        return;
+    }
+
+    la_websocket_client_send(host->ws_client, json);
+    free(json);
+}
+
+static struct sc_host_device *
+sc_host_find_by_serial(struct sc_host *host, const char *serial) {
+    for (struct sc_host_device *d = host->devices; d; d = d->next) {
+        if (!strcmp(d->serial, serial)) {
+            return d;
+        }
+    }
+    return NULL;
+}
+
+static struct sc_host_device *
+sc_host_find_by_id(struct sc_host *host, uint32_t id) {
+    for (struct sc_host_device *d = host->devices; d; d = d->next) {
+        if (d->id == id) {
+            return d;
+        }
+    }
+    return NULL;
+}
+
+// Generate a scrcpy id not used by the other devices
+static uint32_t
+sc_host_generate_scid(struct sc_host *host) {
+    for (;;) {
+        // Only use 31 bits to avoid issues with signed values on the Java-side
+        uint32_t scid = sc_rand_u32(&host->rand) & 0x7FFFFFFF;
+        bool used = false;
+        for (struct sc_host_device *d = host->devices; d; d = d->next) {
+            if (d->server.params.scid == scid) {
+                used = true;
+                break;
+            }
+        }
+        if (!used) {
+            return scid;
+        }
+    }
+}
+
+static void
+sc_host_add_device(struct sc_host *host, const char *serial) {
+    if (sc_host_find_by_serial(host, serial)) {
+        LOGW("Host: device %s already added", serial);
+        return;
+    }
+
+    struct sc_host_device *device = calloc(1, sizeof(*device));
+    if (!device) {
+        LOG_OOM();
+        return;
+    }
+
+    device->serial = strdup(serial);
+    if (!device->serial) {
+        LOG_OOM();
+        free(device);
+        return;
+    }
+
+    device->host = host;
+    device->id = host->next_id++;
+
+    const struct scrcpy_options *options = host->options;
+    struct sc_server_params params = {
+        .scid = sc_host_generate_scid(host),
+        .req_serial = device->serial,
+        .log_level = options->log_level,
+        .video_codec = options->video_codec,
+        .audio_codec = options->audio_codec,
+        .video_source = options->video_source,
+        .audio_source = options->audio_source,
+        .camera_facing = options->camera_facing,
+        .crop = options->crop,
+        .port_range = options->port_range,
+        .tunnel_host = options->tunnel_host,
+        .tunnel_port = options->tunnel_port,
+        .min_size_alignment = options->min_size_alignment,
+        .max_size = options->max_size,
+        .video_bit_rate = options->video_bit_rate,
+        .max_fps = options->max_fps,
+        .angle = options->angle,
+        .screen_off_timeout = options->screen_off_timeout,
+        .capture_orientation = options->capture_orientation,
+        .capture_orientation_lock = options->capture_orientation_lock,
+        .control = options->control,
+        .display_id = options->display_id,
+        .new_display = options->new_display,
+        .display_ime_policy = options->display_ime_policy,
+        .video = options->video,
+        .audio = false,
+        .show_touches = options->show_touches,
+        .stay_awake = options->stay_awake,
+        .video_codec_options = options->video_codec_options,
+        .video_encoder = options->video_encoder,
+        .camera_id = options->camera_id,
+        .camera_size = options->camera_size,
+        .camera_ar = options->camera_ar,
+        .camera_fps = options->camera_fps,
+        .force_adb_forward = options->force_adb_forward,
+        .power_off_on_close = options->power_off_on_close,
+        .clipboard_autosync = false,
+        .downsize_on_error = options->downsize_on_error,
+        .cleanup = options->cleanup,
+        .power_on = options->power_on,
+        .kill_adb_on_close = false,
+        .camera_high_speed = options->camera_high_speed,
+        .camera_torch = options->camera_torch,
+        .camera_zoom = options->camera_zoom,
+        .vd_destroy_content = options->vd_destroy_content,
+        .vd_system_decorations = options->vd_system_decorations,
+        .keep_active = options->keep_active,
+        .ignore_video_encoder_constraints =
+            options->ignore_video_encoder_constraints,
+    };
+
+    static const struct sc_server_callbacks cbs = {
+        .on_connection_failed = sc_host_on_connection_failed,
+        .on_connected = sc_host_on_connected,
+        .on_disconnected = sc_host_on_disconnected,
+    };
+    if (!sc_server_init(&device->server, &params, &cbs, device)) {
+        goto error_free_device;
+    }
+
+    if (!sc_server_start(&device->server)) {
+        sc_server_destroy(&device->server);
+        goto error_free_device;
+    }
+
+    sc_mutex_lock(&host->mutex);
+    device->next = host->devices;
+    host->devices = device;
+    sc_mutex_unlock(&host->mutex);
+
+    LOGI("Host: connecting to device %s", serial);
+    sc_host_send_state(host, serial, "connecting", NULL);
+    return;
+
+error_free_device:
+    sc_host_send_state(host, serial, "failed", NULL);
+    free(device->serial);
+    free(device);
+}
+
+// Stop and free a device (from the main thread)
+static void
+sc_host_remove_device(struct sc_host *host, struct sc_host_device *device,
+                      const char *state) {
+    // Do not route the control messages to this device anymore
+    sc_mutex_lock(&host->mutex);
+    struct sc_host_device **prev = &host->devices;
+    while (*prev != device) {
+        assert(*prev);
+        prev = &(*prev)->next;
+    }
+    *prev = device->next;
+    sc_mutex_unlock(&host->mutex);
+
+    if (device->controller_started) {
+        sc_controller_stop(&device->controller);
+    }
+
+    // Shutdown the sockets and kill the server: the demuxer reads the end of
+    // stream
+    sc_server_stop(&device->server);
+
+    if (device->demuxer_started) {
+        // In reactor mode, also wait for the last packets decoded (and the
+        // decoder closed) by the workers
+        sc_demuxer_join(&device->demuxer);
+    }
+
+    if (device->controller_started) {
+        sc_controller_join(&device->controller);
+    }
+    if (device->controller_initialized) {
+        sc_controller_destroy(&device->controller);
+    }
+
+    sc_server_join(&device->server);
+    sc_server_destroy(&device->server);
+
+    // Its frame sink has been closed by the video decoder
+    if (device->preview_sender_initialized) {
+        la_preview_sender_destroy(&device->preview_sender);
+    }
+
+    if (device->catchup_initialized) {
+        sc_catchup_destroy(&device->catchup);
+    }
+
+    LOGI("Host: device %s %s", device->serial, state);
+    sc_host_send_state(host, device->serial, state, NULL);
+
+    free(device->serial);
+    free(device);
+}
+
+// Start streaming once the device is connected
+static bool
+sc_host_start_device(struct sc_host *host, struct sc_host_device *device) {
+    const struct scrcpy_options *options = host->options;
+    struct sc_server *server = &device->server;
+
+    device->connected = true;
+
+    if (options->video) {
+        static const struct sc_demuxer_callbacks demuxer_cbs = {
+            .on_ended = sc_host_demuxer_on_ended,
+        };
+        sc_demuxer_init(&device->demuxer, "video", server->video_socket,
+                        &demuxer_cbs, device);
+
+        if (options->linkandroid_preview_interval) {
+            sc_decoder_init(&device->decoder, "video", &host->decoder_params);
+            sc_packet_source_add_sink(&device->demuxer.packet_source,
+                                      &device->decoder.packet_sink);
+
+            struct la_preview_sender_params params = {
+                .interval_ms = options->linkandroid_preview_interval,
+                .ratio = options->linkandroid_preview_ratio,
+                .binary = options->linkandroid_preview_transport
+                       == SC_LINKANDROID_PREVIEW_TRANSPORT_BINARY,
+                .format = la_preview_format_from_option(
+                              options->linkandroid_preview_format),
+                .quality = options->linkandroid_preview_quality,
+                .tiles = options->linkandroid_preview_tiles,
+                .keyframe_interval_ms =
+                    options->linkandroid_preview_keyframe_interval,
+                .max_staleness_ms =
+                    options->linkandroid_preview_max_staleness,
+                .serial = device->serial,
+                .pool = &host->pool,
+            };
+            if (!la_preview_sender_init(&device->preview_sender,
+                                        host->ws_client, &params)) {
+                LOGE("Host: could not initialize preview sender");
+                return false;
+            }
+            device->preview_sender_initialized = true;
+
+            sc_frame_source_add_sink(&device->decoder.frame_source,
+                                     &device->preview_sender.frame_sink);
+        }
+    }
+
+    if (options->control) {
+        static const struct sc_controller_callbacks controller_cbs = {
+            .on_ended = sc_host_controller_on_ended,
+        };
+        if (!sc_controller_init(&device->controller, server->control_socket,
+                                &controller_cbs, device)) {
+            return false;
+        }
+        device->controller_initialized = true;
+
+        sc_controller_configure(&device->controller, NULL, NULL);
+
+        if (!sc_controller_start(&device->controller)) {
+            return false;
+        }
+
+        sc_mutex_lock(&host->mutex);
+        device->controller_started = true;
+        sc_mutex_unlock(&host->mutex);
+    }
+
+    if (options->video_catch_up && device->preview_sender_initialized) {
+        static const struct sc_catchup_callbacks catchup_cbs = {
+            .on_request_key_frame = sc_host_catchup_on_request_key_frame,
+        };
+        sc_catchup_init(&device->catchup, options->video_catch_up,
+                        options->control ? &catchup_cbs : NULL, device);
+        device->catchup_initialized = true;
+
+        // In reactor mode, only the lag of the packets is measured
+        sc_demuxer_set_catchup(&device->demuxer, &device->catchup);
+        sc_decoder_set_catchup(&device->decoder, &device->catchup);
+    }
+
+    if (options->video) {
+        bool ok = host->has_reactor
+                ? sc_demuxer_start_reactor(&device->demuxer, &host->reactor,
+                                           &host->pool)
+                : sc_demuxer_start(&device->demuxer);
+        if (!ok) {
+            return false;
+        }
+        device->demuxer_started = true;
+    }
+
+    const char *name = server->info.device_name;
+    LOGI("Host: device %s connected (%s)", device->serial, name);
+    sc_host_send_state(host, device->serial, "connected", name);
+
+    return true;
+}
+
+static void
+sc_host_push_command(const cJSON *data) {
+    const cJSON *action = cJSON_GetObjectItemCaseSensitive(data, "action");
+    const cJSON *serial = cJSON_GetObjectItemCaseSensitive(data, "serial");
+    if (!cJSON_IsString(action) || !cJSON_IsString(serial)
+            || !*serial->valuestring) {
+        LOGW("Host: invalid host command");
+        return;
+    }
+
+    enum sc_host_action type;
+    if (!strcmp(action->valuestring, "add")) {
+        type = SC_HOST_ACTION_ADD;
+    } else if (!strcmp(action->valuestring, "remove")) {
+        type = SC_HOST_ACTION_REMOVE;
+    } else {
+        LOGW("Host: unknown host action: %s", action->valuestring);
+        return;
+    }
+
+    struct sc_host_command *command = malloc(sizeof(*command));
+    if (!command) {
+        LOG_OOM();
+        return;
+    }
+
+    command->action = type;
+    command->serial = strdup(serial->valuestring);
+    if (!command->serial) {
+        LOG_OOM();
+        free(command);
+        return;
+    }
+
+    if (!sc_push_event_with_data(SC_EVENT_HOST_COMMAND, command)) {
+        free(command->serial);
+        free(command);
+    }
+}
+
+// Called from the WebSocket thread
+static void
+sc_host_on_message(const char *json, void *userdata) {
+    struct sc_host *host = userdata;
+
+    cJSON *root = cJSON_Parse(json);
+    if (!root) {
+        LOGW("Host: invalid WebSocket message: %s", json);
+        return;
+    }
+
+    const cJSON *type = cJSON_GetObjectItemCaseSensitive(root, "type");
+    if (cJSON_IsString(type)) {
+        if (!strcmp(type->valuestring, "quit")) {
+            LOGI("WebSocket quit command received, requesting application "
+                 "exit");
+            sc_push_event(SDL_EVENT_QUIT);
+            goto end;
+        }
+
+        if (!strcmp(type->valuestring, "host")) {
+            sc_host_push_command(
+                cJSON_GetObjectItemCaseSensitive(root, "data"));
+            goto end;
+        }
+    }
+
+    // Any other message is a control message for the device of its serial
+    const cJSON *serial = cJSON_GetObjectItemCaseSensitive(root, "serial");
+    if (!cJSON_IsString(serial)) {
+        LOGW("Host: WebSocket message without device serial ignored");
+        goto end;
+    }
+
+    struct sc_control_msg msg;
+    // msg must be initialized, specifically pointer fields, to avoid double
+    // free on error
+    memset(&msg, 0, sizeof(msg));
+    if (!la_websocket_deserialize_event(json, &msg)) {
+        LOGW("Failed to deserialize WebSocket message: %s", json);
+        goto end;
+    }
+
+    sc_mutex_lock(&host->mutex);
+    struct sc_host_device *device =
+        sc_host_find_by_serial(host, serial->valuestring);
+    // If pushed successfully, the controller takes ownership of the msg data
+    bool pushed = device && device->controller_started
+               && sc_controller_push_msg(&device->controller, &msg);
+    sc_mutex_unlock(&host->mutex);
+
+    if (!pushed) {
+        LOGW("Host: control message for device %s not pushed",
+             serial->valuestring);
+        sc_control_msg_destroy(&msg);
+    }
+
+end:
+    cJSON_Delete(root);
+}
+
+static void
+sc_host_handle_command(struct sc_host *host, struct sc_host_command *command) {
+    if (command->action == SC_HOST_ACTION_ADD) {
+        sc_host_add_device(host, command->serial);
+    } else {
+        struct sc_host_device *device =
+            sc_host_find_by_serial(host, command->serial);
+        if (device) {
+            sc_host_remove_device(host, device, "removed");
+        } else {
+            LOGW("Host: unknown device %s", command->serial);
+        }
+    }
+
+    free(command->serial);
+    free(command);
+}
+
+static void
+sc_host_handle_device_event(struct sc_host *host, const SDL_Event *event) {
+    uint32_t id = (uint32_t) (uintptr_t) event->user.data1;
+    struct sc_host_device *device = sc_host_find_by_id(host, id);
+    if (!device) {
+        // Already removed (e.g. disconnected from both the demuxer and the
+        // controller)
+        return;
+    }
+
+    switch (event->type) {
+        case SC_EVENT_HOST_DEVICE_CONNECTED:
+            if (!device->connected && !sc_host_start_device(host, device)) {
+                sc_host_remove_device(host, device, "failed");
+            }
+            break;
+        case SC_EVENT_HOST_DEVICE_CONNECTION_FAILED:
+            sc_host_remove_device(host, device, "failed");
+            break;
+        default:
+            assert(event->type == SC_EVENT_HOST_DEVICE_DISCONNECTED);
+            sc_host_remove_device(host, device, "disconnected");
+            break;
+    }
+}
+
+static void
+sc_host_event_loop(struct sc_host *host) {
+    SDL_Event event;
+    while (SDL_WaitEvent(&event)) {
+        switch (event.type) {
+            case SDL_EVENT_QUIT:
+                LOGD("User requested to quit");
+                return;
+            case SC_EVENT_HOST_DEVICE_CONNECTED:
+            case SC_EVENT_HOST_DEVICE_CONNECTION_FAILED:
+            case SC_EVENT_HOST_DEVICE_DISCONNECTED:
+                sc_host_handle_device_event(host, &event);
+                break;
+            case SC_EVENT_HOST_COMMAND:
+                sc_host_handle_command(host, event.user.data1);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+static void
+sc_host_add_devices(struct sc_host *host, const char *serials) {
+    char *list = strdup(serials);
+    if (!list) {
+        LOG_OOM();
+        return;
+    }
+
+    char *serial = list;
+    for (;;) {
+        char *sep = strchr(serial, ',');
+        if (sep) {
+            *sep = '\0';
+        }
+        if (*serial) {
+            sc_host_add_device(host, serial);
+        }
+        if (!sep) {
+            break;
+        }
+        serial = sep + 1;
+    }
+
+    free(list);
+}
+
+static unsigned
+sc_host_worker_count(void) {
+    int cores = SDL_GetNumLogicalCPUCores();
+    if (cores < 1) {
+        return 1;
+    }
+    return cores < SC_HOST_MAX_WORKERS ? (unsigned) cores
+                                       : SC_HOST_MAX_WORKERS;
+}
+
+enum scrcpy_exit_code
+scrcpy_host(struct scrcpy_options *options) {
+    static struct sc_host host_instance;
+    struct sc_host *host = &host_instance;
+
+    assert(options->linkandroid_host);
+    assert(options->linkandroid_server);
+
+    if (!SDL_Init(SDL_INIT_EVENTS)) {
+        LOGE("Could not initialize SDL: %s", SDL_GetError());
+        return SCRCPY_EXIT_FAILURE;
+    }
+
+    atexit(SDL_Quit);
+
+    enum scrcpy_exit_code ret = SCRCPY_EXIT_FAILURE;
+
+    host->options = options;
+    host->devices = NULL;
+    host->next_id = 0;
+    sc_rand_init(&host->rand);
+
+    // Many decoders run in parallel: decode each stream on a single thread
+    // (the frames are only used for the previews)
+    host->decoder_params = (struct sc_decoder_params) {
+        .threads = 1,
+        .thread_type = options->video_decoder_thread_type,
+        .hwaccel = options->video_decoder_hwaccel,
+    };
+
+    if (!sc_mutex_init(&host->mutex)) {
+        return SCRCPY_EXIT_FAILURE;
+    }
+
+    unsigned workers = sc_host_worker_count();
+    if (!sc_worker_pool_init(&host->pool, workers)) {
+        goto end_destroy_mutex;
+    }
+
+    if (!sc_worker_pool_start(&host->pool)) {
+        goto end_destroy_pool;
+    }
+
+    host->has_reactor = sc_reactor_init(&host->reactor);
+    if (host->has_reactor && !sc_reactor_start(&host->reactor)) {
+        sc_reactor_destroy(&host->reactor);
+        host->has_reactor = false;
+    }
+    if (!host->has_reactor) {
+        LOGI("Host: I/O reactor unavailable, using one thread per device");
+    }
+
+    LOGI("Host mode: %u workers", workers);
+
+    host->ws_client = la_websocket_client_init(options->linkandroid_server,
+                                               sc_host_on_message, host);
+    if (!host->ws_client) {
+        LOGE("Host: could not initialize WebSocket client");
+        goto end_stop;
+    }
+
+    if (options->linkandroid_host_serials) {
+        sc_host_add_devices(host, options->linkandroid_host_serials);
+    }
+
+    sc_host_event_loop(host);
+    ret = SCRCPY_EXIT_SUCCESS;
+
+    while (host->devices) {
+        sc_host_remove_device(host, host->devices, "removed");
+    }
+
+    la_websocket_client_destroy(host->ws_client);
+
+    // Free the commands received meanwhile
+    SDL_Event event;
+    while (sc_dequeue_event(SC_EVENT_HOST_COMMAND, &event)) {
+        struct sc_host_command *command = event.user.data1;
+        free(command->serial);
+        free(command);
+    }
+
+end_stop:
+    // All the demuxers are joined, so no socket is registered anymore
+    if (host->has_reactor) {
+        sc_reactor_stop(&host->reactor);
+        sc_reactor_join(&host->reactor);
+        sc_reactor_destroy(&host->reactor);
+    }
+
+    sc_worker_pool_stop(&host->pool);
+    sc_worker_pool_join(&host->pool);
+end_destroy_pool:
+    sc_worker_pool_destroy(&host->pool);
+end_destroy_mutex:
+    sc_mutex_destroy(&host->mutex);
+
+    return ret;
+}
@@ -0,0 +1,31 @@
+#ifndef SC_HOST_H
+#define SC_HOST_H
+
+#include "common.h"
+
+#include "options.h"
+#include "scrcpy.h"
+
+/**
+ * Host mode (--linkandroid-host): serve many devices from a single process
+ *
+ * Each device has its own server (adb tunnel, sockets and controller), but
+ * they all share:
+ *  - a single WebSocket connection, the messages being tagged with the device
+ *    serial;
+ *  - a single reactor thread reading all the video sockets (on Linux, one
+ *    demuxer thread per device otherwise);
+ *  - a pool of worker threads decoding the videos and encoding the previews.
+ *
+ * Devices are added from the command line, or at runtime by the WebSocket
+ * server:
+ *
+ *   {"type":"host","data":{"action":"add","serial":"0123456789abcdef"}}
+ *   {"type":"host","data":{"action":"remove","serial":"0123456789abcdef"}}
+ *
+ * Their state is reported by "host_device" messages.
+ */
+enum scrcpy_exit_code
+scrcpy_host(struct scrcpy_options *options);
+
+#endif
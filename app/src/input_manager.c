@@ -9,26 +9,49 @@
 #include "android/keycodes.h"
 #include "events.h"
 #include "input_events.h"
+#include "latency_stats.h"
+#include "replay_buffer.h"
 #include "screen.h"
 #include "shortcut_mod.h"
 #include "util/log.h"
+#include "util/thread.h"
+#include "video_regulator.h"
 #include "events.h"
 
 // LinkAndroid: WebSocket event forwarding
 #include "../../linkandroid/src/websocket_client.h"
+#include "../../linkandroid/src/event_coalescer.h"
+#include "../../linkandroid/src/screenshot.h"
 #include "../../linkandroid/src/json/cJSON.h"
 
 // Global variables for WebSocket event forwarding
 struct la_websocket_client *g_websocket_client = NULL;
+// NULL if not initialized, or once destroyed
+static struct la_event_coalescer *g_event_coalescer = NULL;
+static struct la_event_coalescer g_event_coalescer_instance;
+// Events are pushed from the main thread and the WebSocket thread: the
+// coalescer must not be destroyed while one of them is using it
+static sc_mutex g_event_coalescer_mutex;
 uint16_t g_device_width = 0;
 uint16_t g_device_height = 0;
 
 // Track the display power state (on/off) for WebSocket query support
 // Initialized to true (screen on by default)
-// Updated whenever set_display_power() is called
+// Updated whenever push_display_power() is called
 bool g_screen_power_on = true;
 
+// NULL in headless mode (no window)
 static struct sc_input_manager *g_input_manager = NULL;
+// Controller for the control messages received via WebSocket (may be NULL)
+static struct sc_controller *g_websocket_controller = NULL;
+// Written on a "replay" request (NULL if --replay-buffer is not set)
+static struct sc_replay_buffer *g_replay_buffer = NULL;
+// Answers the "screenshot" requests (NULL if no video is decoded)
+static struct la_screenshot *g_screenshot = NULL;
+// Reported on a "stats" request (NULL if --latency-stats is not set)
+static struct sc_latency_stats *g_latency_stats = NULL;
+// Reported on a "stats" request (NULL if --video-buffer is not set)
+static struct sc_video_regulator *g_video_regulator = NULL;
 
 // Task data for window operations that must run on main thread
 struct window_top_task_data {
@@ -53,15 +76,324 @@ task_set_always_on_top(void *userdata) {
 
 // Forward declaration for screen power control
 static void
-set_display_power(struct sc_input_manager *im, bool on);
+push_display_power(struct sc_controller *controller, bool on);
 
 static void
-on_websocket_message(const char *json, void *userdata) {
+send_replay_response(const char *request_id, bool success,
+                     const char *filename, const char *error) {
+    cJSON *resp = cJSON_CreateObject();
+    if (!resp) {
+        return;
+    }
+
+    cJSON_AddStringToObject(resp, "type", "replay");
+    // Echo back the request id for request/response pairing
+    if (request_id) {
+        cJSON_AddStringToObject(resp, "id", request_id);
+    }
+    cJSON *resp_data = cJSON_AddObjectToObject(resp, "data");
+    if (resp_data) {
+        cJSON_AddBoolToObject(resp_data, "success", success);
+        if (filename) {
+            cJSON_AddStringToObject(resp_data, "filename", filename);
+        }
+        if (error) {
+            cJSON_AddStringToObject(resp_data, "error", error);
+        }
+    }
+
+    char *resp_str = cJSON_PrintUnformatted(resp);
+    if (resp_str) {
+        la_websocket_client_send(g_websocket_client, resp_str);
+        free(resp_str);
+    }
+    cJSON_Delete(resp);
+}
+
+void
+sc_input_manager_on_replay_dumped(struct sc_replay_buffer *replay,
+                                  const char *filename, bool success,
+                                  void *userdata) {
+    (void) replay;
+    char *request_id = userdata;
+    send_replay_response(request_id, success, filename,
+                         success ? NULL : "write failed");
+    free(request_id);
+}
+
+static void
+handle_replay_request(cJSON *root) {
+    cJSON *req_id = cJSON_GetObjectItemCaseSensitive(root, "id");
+    const char *request_id = (cJSON_IsString(req_id) && req_id->valuestring)
+                                 ? req_id->valuestring : NULL;
+
+    if (!g_replay_buffer) {
+        LOGW("WebSocket replay request ignored: no replay buffer "
+             "(see --replay-buffer)");
+        send_replay_response(request_id, false, NULL, "disabled");
+        return;
+    }
+
+    // Optional output file, the name is generated otherwise
+    const char *filename = NULL;
+    cJSON *data = cJSON_GetObjectItemCaseSensitive(root, "data");
+    if (data) {
+        cJSON *file = cJSON_GetObjectItemCaseSensitive(data, "filename");
+        if (cJSON_IsString(file) && file->valuestring) {
+            filename = file->valuestring;
+        }
+    }
+
+    // Owned by the dump, released on completion
+    char *id = NULL;
+    if (request_id) {
+        id = strdup(request_id);
+        if (!id) {
+            LOG_OOM();
+            return;
+        }
+    }
+
+    LOGI("WebSocket replay request received");
+    if (!sc_replay_buffer_dump(g_replay_buffer, filename, id)) {
+        send_replay_response(request_id, false, filename, "rejected");
+        free(id);
+    }
+}
+
+static void
+send_screenshot_response(const char *request_id,
+                         const struct la_screenshot_image *image,
+                         const char *error) {
+    cJSON *resp = cJSON_CreateObject();
+    if (!resp) {
+        return;
+    }
+
+    cJSON_AddStringToObject(resp, "type", "screenshot");
+    if (request_id) {
+        cJSON_AddStringToObject(resp, "id", request_id);
+    }
+    cJSON *resp_data = cJSON_AddObjectToObject(resp, "data");
+    if (resp_data) {
+        cJSON_AddBoolToObject(resp_data, "success", image != NULL);
+        if (image) {
+            cJSON_AddStringToObject(resp_data, "format",
+                                    la_preview_format_name(image->format));
+            cJSON_AddNumberToObject(resp_data, "width", image->width);
+            cJSON_AddNumberToObject(resp_data, "height", image->height);
+            cJSON_AddNumberToObject(resp_data, "pts", (double) image->pts);
+            cJSON_AddStringToObject(resp_data, "image", image->data_url);
+        } else if (error) {
+            cJSON_AddStringToObject(resp_data, "error", error);
+        }
+    }
+
+    char *resp_str = cJSON_PrintUnformatted(resp);
+    cJSON_Delete(resp);
+    if (!resp_str) {
+        LOG_OOM();
+        if (image) {
+            send_screenshot_response(request_id, NULL, "out of memory");
+        }
+        return;
+    }
+
+    if (image && strlen(resp_str) > LA_WEBSOCKET_MAX_MESSAGE_SIZE) {
+        // Never leave a request without response
+        LOGW("WebSocket screenshot too large (%zu bytes), use 'maxSize', "
+             "'ratio' or 'jpeg'", strlen(resp_str));
+        free(resp_str);
+        send_screenshot_response(request_id, NULL, "too large");
+        return;
+    }
+
+    bool ok = la_websocket_client_send(g_websocket_client, resp_str);
+    if (!ok) {
+        LOGW("Could not send WebSocket screenshot response");
+    }
+    free(resp_str);
+}
+
+void
+sc_input_manager_on_screenshot(struct la_screenshot *screenshot,
+                               const char *request_id,
+                               const struct la_screenshot_image *image,
+                               const char *error, void *userdata) {
+    (void) screenshot;
     (void) userdata;
-    if (!g_input_manager || !g_input_manager->screen) {
-        LOGW("WebSocket message received but input manager or screen not ready");
+    send_screenshot_response(request_id, image, error);
+}
+
+static bool
+parse_screenshot_format(const char *s, enum la_preview_format *format) {
+    static const enum la_preview_format formats[] = {
+        LA_PREVIEW_FORMAT_PNG,
+        LA_PREVIEW_FORMAT_JPEG,
+        LA_PREVIEW_FORMAT_WEBP,
+    };
+    for (size_t i = 0; i < ARRAY_LEN(formats); ++i) {
+        if (!strcmp(s, la_preview_format_name(formats[i]))) {
+            *format = formats[i];
+            return true;
+        }
+    }
+    if (!strcmp(s, "jpg")) {
+        *format = LA_PREVIEW_FORMAT_JPEG;
+        return true;
+    }
+    return false;
+}
+
+// Read an optional integer in [min, max]
+static bool
+parse_screenshot_int(cJSON *data, const char *name, int min, int max,
+                     int *value) {
+    cJSON *item = cJSON_GetObjectItemCaseSensitive(data, name);
+    if (!item) {
+        return true;
+    }
+    if (!cJSON_IsNumber(item) || item->valuedouble < min
+            || item->valuedouble > max) {
+        LOGW("WebSocket screenshot: invalid '%s'", name);
+        return false;
+    }
+    *value = item->valueint;
+    return true;
+}
+
+static void
+handle_screenshot_request(cJSON *root) {
+    cJSON *req_id = cJSON_GetObjectItemCaseSensitive(root, "id");
+    const char *request_id = (cJSON_IsString(req_id) && req_id->valuestring)
+                                 ? req_id->valuestring : NULL;
+
+    if (!g_screenshot) {
+        LOGW("WebSocket screenshot request ignored: video is not decoded");
+        send_screenshot_response(request_id, NULL, "unavailable");
+        return;
+    }
+
+    struct la_screenshot_params params = {
+        .format = LA_PREVIEW_FORMAT_PNG,
+        .quality = LA_PREVIEW_DEFAULT_QUALITY,
+        .ratio = 100,
+        .max_size = 0,
+    };
+
+    cJSON *data = cJSON_GetObjectItemCaseSensitive(root, "data");
+    if (data) {
+        cJSON *format = cJSON_GetObjectItemCaseSensitive(data, "format");
+        if (format && (!cJSON_IsString(format) || !format->valuestring
+                || !parse_screenshot_format(format->valuestring,
+                                            &params.format))) {
+            LOGW("WebSocket screenshot: invalid 'format'");
+            send_screenshot_response(request_id, NULL, "invalid format");
+            return;
+        }
+
+        int quality = params.quality;
+        int ratio = params.ratio;
+        int max_size = params.max_size;
+        if (!parse_screenshot_int(data, "quality", 1, 100, &quality)
+                || !parse_screenshot_int(data, "ratio", 1, 100, &ratio)
+                || !parse_screenshot_int(data, "maxSize", 0, 0xFFFF,
+                                         &max_size)) {
+            send_screenshot_response(request_id, NULL, "invalid parameter");
+            return;
+        }
+        params.quality = quality;
+        params.ratio = ratio;
+        params.max_size = max_size;
+    }
+
+    LOGD("WebSocket screenshot request received");
+    if (!la_screenshot_request(g_screenshot, request_id, &params)) {
+        send_screenshot_response(request_id, NULL, "rejected");
+    }
+}
+
+static void
+handle_stats_request(cJSON *root) {
+    cJSON *req_id = cJSON_GetObjectItemCaseSensitive(root, "id");
+    const char *request_id = (cJSON_IsString(req_id) && req_id->valuestring)
+                                 ? req_id->valuestring : NULL;
+
+    cJSON *resp = cJSON_CreateObject();
+    if (!resp) {
         return;
     }
+
+    cJSON_AddStringToObject(resp, "type", "stats");
+    if (request_id) {
+        cJSON_AddStringToObject(resp, "id", request_id);
+    }
+    cJSON *resp_data = cJSON_AddObjectToObject(resp, "data");
+    if (resp_data) {
+        cJSON_AddBoolToObject(resp_data, "success",
+                              g_latency_stats || g_video_regulator);
+        if (g_video_regulator) {
+            struct sc_video_regulator_stats vr_stats;
+            sc_video_regulator_get_stats(g_video_regulator, &vr_stats);
+
+            // Delay in microseconds, like the latencies
+            cJSON *buffer = cJSON_AddObjectToObject(resp_data, "videoBuffer");
+            if (buffer) {
+                cJSON_AddNumberToObject(buffer, "delay",
+                                        (double) vr_stats.delay);
+                cJSON_AddNumberToObject(buffer, "frames",
+                                        (double) vr_stats.frames);
+                cJSON_AddNumberToObject(buffer, "late",
+                                        (double) vr_stats.late);
+                cJSON_AddNumberToObject(buffer, "dropped",
+                                        (double) vr_stats.dropped);
+            }
+        }
+        if (g_latency_stats) {
+            struct sc_latency_stats_summary summaries[SC_LATENCY_STAGE_COUNT];
+            sc_latency_stats_get(g_latency_stats, summaries);
+
+            // Values in microseconds
+            cJSON *latency = cJSON_AddObjectToObject(resp_data, "latency");
+            for (unsigned i = 0; latency && i < SC_LATENCY_STAGE_COUNT; ++i) {
+                const struct sc_latency_stats_summary *summary = &summaries[i];
+                cJSON *stage =
+                    cJSON_AddObjectToObject(latency, sc_latency_stage_name(i));
+                if (stage) {
+                    cJSON_AddNumberToObject(stage, "count",
+                                            (double) summary->count);
+                    cJSON_AddNumberToObject(stage, "p50",
+                                            (double) summary->p50);
+                    cJSON_AddNumberToObject(stage, "p95",
+                                            (double) summary->p95);
+                    cJSON_AddNumberToObject(stage, "p99",
+                                            (double) summary->p99);
+                    cJSON_AddNumberToObject(stage, "max",
+                                            (double) summary->max);
+                }
+            }
+        } else if (!g_video_regulator) {
+            LOGW("WebSocket stats request ignored: no latency stats "
+                 "(see --latency-stats)");
+            cJSON_AddStringToObject(resp_data, "error", "disabled");
+        }
+    }
+
+    char *resp_str = cJSON_PrintUnformatted(resp);
+    if (resp_str) {
+        la_websocket_client_send(g_websocket_client, resp_str);
+        free(resp_str);
+    }
+    cJSON_Delete(resp);
+}
+
+static void
+on_websocket_message(const char *json, void *userdata) {
+    (void) userdata;
+    // In headless mode, there is no screen: window commands are ignored
+    struct sc_screen *screen = g_input_manager ? g_input_manager->screen
+                                               : NULL;
+    struct sc_controller *controller = g_websocket_controller;
     
     // First, try to parse as panel configuration
     cJSON *root = cJSON_Parse(json);
@@ -83,8 +415,13 @@ on_websocket_message(const char *json, void *userdata) {
             
             // Check for active command
             if (strcmp(type_item->valuestring, "active") == 0) {
+                if (!screen) {
+                    LOGW("WebSocket active command ignored: no window");
+                    cJSON_Delete(root);
+                    return;
+                }
                 LOGI("WebSocket active command received, raising window to front");
-                bool ok = sc_run_on_main_thread(task_raise_window, g_input_manager->screen, false);
+                bool ok = sc_run_on_main_thread(task_raise_window, screen, false);
                 if (!ok) {
                     LOGW("Could not post raise window task to main thread");
                 }
@@ -94,6 +431,11 @@ on_websocket_message(const char *json, void *userdata) {
             
             // Check for top command
             if (strcmp(type_item->valuestring, "top") == 0) {
+                if (!screen) {
+                    LOGW("WebSocket top command ignored: no window");
+                    cJSON_Delete(root);
+                    return;
+                }
                 cJSON *data = cJSON_GetObjectItemCaseSensitive(root, "data");
                 if (data) {
                     cJSON *enable = cJSON_GetObjectItemCaseSensitive(data, "enable");
@@ -105,7 +447,7 @@ on_websocket_message(const char *json, void *userdata) {
                         // Allocate task data
                         struct window_top_task_data *task_data = malloc(sizeof(*task_data));
                         if (task_data) {
-                            task_data->screen = g_input_manager->screen;
+                            task_data->screen = screen;
                             task_data->enable = enable_top;
                             bool ok = sc_run_on_main_thread(task_set_always_on_top, task_data, false);
                             if (!ok) {
@@ -133,15 +475,15 @@ on_websocket_message(const char *json, void *userdata) {
                     if (cJSON_IsString(action)) {
                         if (strcmp(action->valuestring, "on") == 0) {
                             LOGI("WebSocket screen_power on command received");
-                            if (g_input_manager->controller) {
-                                set_display_power(g_input_manager, true);
+                            if (controller) {
+                                push_display_power(controller, true);
                             } else {
                                 LOGW("Controller not ready, cannot turn screen on");
                             }
                         } else if (strcmp(action->valuestring, "off") == 0) {
                             LOGI("WebSocket screen_power off command received");
-                            if (g_input_manager->controller) {
-                                set_display_power(g_input_manager, false);
+                            if (controller) {
+                                push_display_power(controller, false);
                             } else {
                                 LOGW("Controller not ready, cannot turn screen off");
                             }
@@ -188,10 +530,36 @@ on_websocket_message(const char *json, void *userdata) {
                 return;
             }
 
+            // Write the instant replay buffer to a file
+            if (strcmp(type_item->valuestring, "replay") == 0) {
+                handle_replay_request(root);
+                cJSON_Delete(root);
+                return;
+            }
+
+            // Encode the last decoded frame
+            if (strcmp(type_item->valuestring, "screenshot") == 0) {
+                handle_screenshot_request(root);
+                cJSON_Delete(root);
+                return;
+            }
+
+            // Report the pipeline latency statistics
+            if (strcmp(type_item->valuestring, "stats") == 0) {
+                handle_stats_request(root);
+                cJSON_Delete(root);
+                return;
+            }
+
             // Handle panel configuration
             if (strcmp(type_item->valuestring, "panel") == 0) {
+                if (!screen) {
+                    LOGW("WebSocket panel configuration ignored: no window");
+                    cJSON_Delete(root);
+                    return;
+                }
                 LOGD("Handling panel configuration");
-                sc_screen_update_panel(g_input_manager->screen, json);
+                sc_screen_update_panel(screen, json);
                 cJSON_Delete(root);
                 return;
             }
@@ -200,7 +568,7 @@ on_websocket_message(const char *json, void *userdata) {
     }
 
     // Otherwise, handle as control message
-    if (!g_input_manager->controller) {
+    if (!controller) {
         LOGW("WebSocket control message received but controller not ready");
         return;
     }
@@ -210,7 +578,7 @@ on_websocket_message(const char *json, void *userdata) {
     memset(&msg, 0, sizeof(msg));
 
     if (la_websocket_deserialize_event(json, &msg)) {
-        if (!sc_controller_push_msg(g_input_manager->controller, &msg)) {
+        if (!sc_controller_push_msg(controller, &msg)) {
             LOGW("Failed to push WebSocket control message");
             sc_control_msg_destroy(&msg);
         }
@@ -220,18 +588,52 @@ on_websocket_message(const char *json, void *userdata) {
     }
 }
 
-void
-sc_input_manager_init_websocket(struct sc_input_manager *im, const char *server_url) {
-    g_input_manager = im;
+static void
+init_websocket(const char *server_url, uint32_t coalesce_window_ms) {
     if (server_url) {
         LOGI("Initializing LinkAndroid WebSocket client: %s", server_url);
+        // Initialized before the client, whose thread may forward events
+        if (!sc_mutex_init(&g_event_coalescer_mutex)) {
+            LOGW("Failed to initialize WebSocket client");
+            return;
+        }
+
         g_websocket_client = la_websocket_client_init(server_url, on_websocket_message, NULL);
         if (!g_websocket_client) {
             LOGW("Failed to initialize WebSocket client");
+            sc_mutex_destroy(&g_event_coalescer_mutex);
+            return;
+        }
+
+        if (la_event_coalescer_init(&g_event_coalescer_instance,
+                                    g_websocket_client, coalesce_window_ms)) {
+            sc_mutex_lock(&g_event_coalescer_mutex);
+            g_event_coalescer = &g_event_coalescer_instance;
+            sc_mutex_unlock(&g_event_coalescer_mutex);
+        } else {
+            // Events are forwarded without coalescing
+            LOGW("Failed to initialize event coalescer");
         }
     }
 }
 
+void
+sc_input_manager_init_websocket(struct sc_input_manager *im, const char *server_url,
+                                uint32_t coalesce_window_ms) {
+    g_input_manager = im;
+    g_websocket_controller = im->controller;
+    init_websocket(server_url, coalesce_window_ms);
+}
+
+void
+sc_input_manager_init_websocket_headless(struct sc_controller *controller,
+                                         const char *server_url,
+                                         uint32_t coalesce_window_ms) {
+    g_input_manager = NULL;
+    g_websocket_controller = controller;
+    init_websocket(server_url, coalesce_window_ms);
+}
+
 void
 sc_input_manager_set_device_size(uint16_t width, uint16_t height) {
     g_device_width = width;
@@ -239,13 +641,72 @@ sc_input_manager_set_device_size(uint16_t width, uint16_t height) {
     LOGI("LinkAndroid: Device size set to %ux%u", width, height);
 }
 
+void
+sc_input_manager_set_replay_buffer(struct sc_replay_buffer *replay) {
+    g_replay_buffer = replay;
+}
+
+void
+sc_input_manager_set_screenshot(struct la_screenshot *screenshot) {
+    g_screenshot = screenshot;
+}
+
+void
+sc_input_manager_set_latency_stats(struct sc_latency_stats *stats) {
+    g_latency_stats = stats;
+}
+
+void
+sc_input_manager_set_video_regulator(struct sc_video_regulator *vr) {
+    g_video_regulator = vr;
+}
+
+void
+sc_input_manager_forward_event(const struct sc_control_msg *msg) {
+    if (!g_websocket_client || !g_device_width || !g_device_height) {
+        LOGD("WebSocket not ready (client=%p, width=%u, height=%u)",
+             (void *) g_websocket_client, g_device_width, g_device_height);
+        return;
+    }
+
+    // Held while the event is pushed, so that the coalescer is never
+    // destroyed in the meantime
+    sc_mutex_lock(&g_event_coalescer_mutex);
+    if (g_event_coalescer) {
+        // Touch moves and scrolls may be merged with the next events
+        la_event_coalescer_push(g_event_coalescer, msg, g_device_width,
+                                g_device_height);
+    } else {
+        la_websocket_client_send_event(g_websocket_client, msg,
+                                       g_device_width, g_device_height);
+    }
+    sc_mutex_unlock(&g_event_coalescer_mutex);
+}
+
 void
 sc_input_manager_cleanup_websocket(void) {
-    if (g_websocket_client) {
-        LOGI("Cleaning up LinkAndroid WebSocket client");
-        la_websocket_client_destroy(g_websocket_client);
-        g_websocket_client = NULL;
+    if (!g_websocket_client) {
+        return;
+    }
+
+    // The WebSocket thread may still forward events until the client is
+    // destroyed: once the pointer is reset (and any push in progress is
+    // finished), they are sent directly
+    sc_mutex_lock(&g_event_coalescer_mutex);
+    struct la_event_coalescer *coalescer = g_event_coalescer;
+    g_event_coalescer = NULL;
+    sc_mutex_unlock(&g_event_coalescer_mutex);
+
+    if (coalescer) {
+        // Flush the pending events while the client is still alive
+        la_event_coalescer_destroy(coalescer);
     }
+
+    LOGI("Cleaning up LinkAndroid WebSocket client");
+    la_websocket_client_destroy(g_websocket_client);
+    g_websocket_client = NULL;
+
+    sc_mutex_destroy(&g_event_coalescer_mutex);
 }
 
 #include "util/sdl.h"
@@ -446,14 +907,14 @@ set_device_clipboard(struct sc_input_manager *im, bool paste,
 }
 
 static void
-set_display_power(struct sc_input_manager *im, bool on) {
-    assert(im->controller && !im->camera);
+push_display_power(struct sc_controller *controller, bool on) {
+    assert(controller);
 
     struct sc_control_msg msg;
     msg.type = SC_CONTROL_MSG_TYPE_SET_DISPLAY_POWER;
     msg.set_display_power.on = on;
 
-    if (!sc_controller_push_msg(im->controller, &msg)) {
+    if (!sc_controller_push_msg(controller, &msg)) {
         LOGW("Could not request 'set screen power mode'");
     }
 
@@ -461,6 +922,12 @@ set_display_power(struct sc_input_manager *im, bool on) {
     g_screen_power_on = on;
 }
 
+static void
+set_display_power(struct sc_input_manager *im, bool on) {
+    assert(im->controller && !im->camera);
+    push_display_power(im->controller, on);
+}
+
 static void
 switch_fps_counter_state(struct sc_input_manager *im) {
     struct sc_fps_counter *fps_counter = &im->screen->fps_counter;
@@ -82,17 +82,77 @@ extern struct la_websocket_client *g_websocket_client;
 extern uint16_t g_device_width;
 extern uint16_t g_device_height;
 
+// Forward a control message to the WebSocket server (if connected), through
+// the event coalescer if any
+//
+// It may be called from any thread until sc_input_manager_cleanup_websocket().
+void
+sc_input_manager_forward_event(const struct sc_control_msg *msg);
+
 // Track screen power state (on/off) for WebSocket query support
 extern bool g_screen_power_on;
 
 // Initialize WebSocket client for event forwarding
+//
+// Touch move and scroll events are coalesced within coalesce_window_ms (0 to
+// forward every event immediately).
 void
-sc_input_manager_init_websocket(struct sc_input_manager *im, const char *server_url);
+sc_input_manager_init_websocket(struct sc_input_manager *im, const char *server_url,
+                                uint32_t coalesce_window_ms);
+
+// Initialize WebSocket client without screen (headless mode, --no-window):
+// only control messages (if controller is not NULL) and previews are handled
+void
+sc_input_manager_init_websocket_headless(struct sc_controller *controller,
+                                         const char *server_url,
+                                         uint32_t coalesce_window_ms);
 
 // Set device dimensions for event forwarding
 void
 sc_input_manager_set_device_size(uint16_t width, uint16_t height);
 
+struct sc_replay_buffer;
+
+// Set the replay buffer written on a "replay" WebSocket request (must be
+// called before the WebSocket client is initialized)
+void
+sc_input_manager_set_replay_buffer(struct sc_replay_buffer *replay);
+
+// Replay buffer callback, reporting the result to the WebSocket server
+void
+sc_input_manager_on_replay_dumped(struct sc_replay_buffer *replay,
+                                  const char *filename, bool success,
+                                  void *userdata);
+
+struct sc_latency_stats;
+
+// Set the latency stats reported on a "stats" WebSocket request (must be
+// called before the WebSocket client is initialized)
+void
+sc_input_manager_set_latency_stats(struct sc_latency_stats *stats);
+
+struct sc_video_regulator;
+
+// Set the video buffer reported on a "stats" WebSocket request (must be
+// called before the WebSocket client is initialized)
+void
+sc_input_manager_set_video_regulator(struct sc_video_regulator *vr);
+
+struct la_screenshot;
+struct la_screenshot_image;
+
+// Set the screenshot handler answering the "screenshot" WebSocket requests
+// (must be called before the WebSocket client is initialized)
+void
+sc_input_manager_set_screenshot(struct la_screenshot *screenshot);
+
+// Screenshot callback, sending the image to the WebSocket server
+void
+sc_input_manager_on_screenshot(struct la_screenshot *screenshot,
+                               const char *request_id,
+                               const struct la_screenshot_image *image,
+                               const char *error, void *userdata);
+
 // Cleanup WebSocket client
 void
 sc_input_manager_cleanup_websocket(void);
@@ -0,0 +1,96 @@
+#include "jitter_estimator.h"
+
+#include <assert.h>
+
+#include "util/log.h"
+
+//#define SC_JITTER_DEBUG // uncomment to debug
+
+// The percentile of the deviations to absorb
+#define SC_JITTER_PERCENTILE 95
+// Convergence speed (the delay moves by 1/N of the difference on each frame)
+#define SC_JITTER_ATTACK 4
+#define SC_JITTER_RELEASE 64
+
+void
+sc_jitter_estimator_init(struct sc_jitter_estimator *je, sc_tick min_delay,
+                         sc_tick max_delay) {
+    assert(min_delay >= 0);
+    assert(min_delay <= max_delay);
+
+    je->min_delay = min_delay;
+    je->max_delay = max_delay;
+    je->delay = min_delay;
+    je->count = 0;
+    je->head = 0;
+    je->frames = 0;
+    je->late = 0;
+}
+
+static sc_tick
+sc_jitter_estimator_get_percentile(struct sc_jitter_estimator *je) {
+    assert(je->count);
+
+    // Sort a copy (insertion sort, the window is small)
+    sc_tick sorted[SC_JITTER_ESTIMATOR_WINDOW];
+    for (unsigned i = 0; i < je->count; ++i) {
+        sc_tick value = je->deviations[i];
+        unsigned j = i;
+        while (j && sorted[j - 1] > value) {
+            sorted[j] = sorted[j - 1];
+            --j;
+        }
+        sorted[j] = value;
+    }
+
+    unsigned index = je->count * SC_JITTER_PERCENTILE / 100;
+    if (index == je->count) {
+        index = je->count - 1;
+    }
+    return sorted[index];
+}
+
+void
+sc_jitter_estimator_push(struct sc_jitter_estimator *je,
+                         struct sc_clock *clock, sc_tick system,
+                         sc_tick stream) {
+    ++je->frames;
+
+    if (!clock->range) {
+        // No estimation yet
+        return;
+    }
+
+    sc_tick deviation = system - sc_clock_to_system_time(clock, stream);
+    if (deviation > je->delay) {
+        ++je->late;
+    }
+
+    je->deviations[je->head] = deviation;
+    je->head = (je->head + 1) % SC_JITTER_ESTIMATOR_WINDOW;
+    if (je->count < SC_JITTER_ESTIMATOR_WINDOW) {
+        ++je->count;
+    }
+
+    sc_tick target = sc_jitter_estimator_get_percentile(je);
+    if (target < je->min_delay) {
+        target = je->min_delay;
+    } else if (target > je->max_delay) {
+        target = je->max_delay;
+    }
+
+    sc_tick diff = target - je->delay;
+    if (diff > 0) {
+        // Round up, so that the target is actually reached
+        je->delay += (diff + SC_JITTER_ATTACK - 1) / SC_JITTER_ATTACK;
+    } else {
+        je->delay += diff / SC_JITTER_RELEASE;
+    }
+
+    assert(je->delay >= je->min_delay && je->delay <= je->max_delay);
+
+#ifdef SC_JITTER_DEBUG
+    LOGD("Jitter: deviation=%" PRItick " target=%" PRItick " delay=%" PRItick,
+         deviation, target, je->delay);
+#endif
+}
@@ -0,0 +1,59 @@
+#ifndef SC_JITTER_ESTIMATOR_H
+#define SC_JITTER_ESTIMATOR_H
+
+#include "common.h"
+
+#include <stdint.h>
+
+#include "clock.h"
+#include "util/tick.h"
+
+#define SC_JITTER_ESTIMATOR_WINDOW 128
+
+/**
+ * Estimate the buffering delay required to absorb the jitter of the frames
+ * arrival.
+ *
+ * The clock (see clock.h) estimates the expected arrival (system) time of a
+ * frame from its pts. The deviation of the actual arrival time from this
+ * estimation is the delay that would be necessary to play this frame on time.
+ *
+ * The target delay is a high percentile of the deviations over the last
+ * frames, bounded by [min_delay, max_delay]. The effective delay converges to
+ * the target smoothly: quickly when it must increase (to avoid stuttering),
+ * slowly when it may decrease (to avoid oscillating).
+ */
+struct sc_jitter_estimator {
+    sc_tick min_delay;
+    sc_tick max_delay;
+
+    // The effective delay
+    sc_tick delay;
+
+    // Circular buffer of the last deviations
+    sc_tick deviations[SC_JITTER_ESTIMATOR_WINDOW];
+    unsigned count;
+    unsigned head;
+
+    uint64_t frames;
+    // Frames arrived after their expected display time (with the effective
+    // delay at the time they arrived)
+    uint64_t late;
+};
+
+void
+sc_jitter_estimator_init(struct sc_jitter_estimator *je, sc_tick min_delay,
+                         sc_tick max_delay);
+
+/**
+ * Account the arrival of a frame
+ *
+ * It must be called before the clock is updated with this frame (the deviation
+ * is measured against the previous estimation).
+ */
+void
+sc_jitter_estimator_push(struct sc_jitter_estimator *je,
+                         struct sc_clock *clock, sc_tick system,
+                         sc_tick stream);
+
+#endif
@@ -0,0 +1,220 @@
+#include "latency_stats.h"
+
+#include <assert.h>
+#include <inttypes.h>
+
+#include "util/log.h"
+
+bool
+sc_latency_stats_init(struct sc_latency_stats *stats, sc_tick print_interval) {
+    bool ok = sc_mutex_init(&stats->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    stats->print_interval = print_interval;
+    stats->next_print = 0;
+
+    for (unsigned i = 0; i < SC_LATENCY_STATS_FRAMES; ++i) {
+        stats->frames[i].pts = -1;
+    }
+    stats->head = 0;
+
+    stats->has_min_offset = false;
+    stats->min_offset = 0;
+
+    for (unsigned i = 0; i < SC_LATENCY_STAGE_COUNT; ++i) {
+        sc_histogram_init(&stats->hist[i]);
+        sc_histogram_init(&stats->interval_hist[i]);
+    }
+
+    return true;
+}
+
+void
+sc_latency_stats_destroy(struct sc_latency_stats *stats) {
+    sc_mutex_destroy(&stats->mutex);
+}
+
+const char *
+sc_latency_stage_name(enum sc_latency_stage stage) {
+    switch (stage) {
+        case SC_LATENCY_STAGE_NETWORK:
+            return "network";
+        case SC_LATENCY_STAGE_DECODE:
+            return "decode";
+        case SC_LATENCY_STAGE_BUFFER:
+            return "buffer";
+        case SC_LATENCY_STAGE_RENDER:
+            return "render";
+        case SC_LATENCY_STAGE_TOTAL:
+            return "total";
+        default:
+            assert(!"unexpected latency stage");
+            return NULL;
+    }
+}
+
+static void
+sc_latency_stats_record(struct sc_latency_stats *stats,
+                        enum sc_latency_stage stage, sc_tick duration) {
+    sc_mutex_assert(&stats->mutex);
+
+    // The clocks are monotonic, but be defensive
+    uint64_t value = duration > 0 ? duration : 0;
+    sc_histogram_record(&stats->hist[stage], value);
+    sc_histogram_record(&stats->interval_hist[stage], value);
+}
+
+// Find a frame in flight (the most recent ones are the most likely)
+static struct sc_latency_stats_frame *
+sc_latency_stats_find(struct sc_latency_stats *stats, int64_t pts) {
+    sc_mutex_assert(&stats->mutex);
+
+    for (unsigned i = 1; i <= SC_LATENCY_STATS_FRAMES; ++i) {
+        unsigned index = (stats->head + SC_LATENCY_STATS_FRAMES - i)
+                       % SC_LATENCY_STATS_FRAMES;
+        struct sc_latency_stats_frame *frame = &stats->frames[index];
+        if (frame->pts == pts) {
+            return frame;
+        }
+    }
+
+    // Not received, or overwritten by more recent frames
+    return NULL;
+}
+
+static void
+sc_latency_stats_summarize(const struct sc_histogram *hist,
+                           struct sc_latency_stats_summary *summary) {
+    summary->count = hist->count;
+    summary->p50 = sc_histogram_percentile(hist, 50);
+    summary->p95 = sc_histogram_percentile(hist, 95);
+    summary->p99 = sc_histogram_percentile(hist, 99);
+    summary->max = hist->max;
+}
+
+static void
+sc_latency_stats_print(struct sc_latency_stats *stats) {
+    sc_mutex_assert(&stats->mutex);
+
+    uint64_t frames = stats->interval_hist[SC_LATENCY_STAGE_TOTAL].count;
+    LOGI("Latency over %" PRIu64 " frames (p50 / p95 / p99 / max):", frames);
+    for (unsigned i = 0; i < SC_LATENCY_STAGE_COUNT; ++i) {
+        struct sc_latency_stats_summary s;
+        sc_latency_stats_summarize(&stats->interval_hist[i], &s);
+        LOGI("    %-8s %6.1f / %6.1f / %6.1f / %6.1f ms",
+             sc_latency_stage_name(i), s.p50 / 1000.0, s.p95 / 1000.0,
+             s.p99 / 1000.0, s.max / 1000.0);
+        sc_histogram_init(&stats->interval_hist[i]);
+    }
+}
+
+static void
+sc_latency_stats_check_interval_expired(struct sc_latency_stats *stats,
+                                        sc_tick now) {
+    sc_mutex_assert(&stats->mutex);
+
+    if (!stats->print_interval) {
+        return;
+    }
+
+    if (!stats->next_print) {
+        // First frame presented
+        stats->next_print = now + stats->print_interval;
+        return;
+    }
+
+    if (now < stats->next_print) {
+        return;
+    }
+
+    sc_latency_stats_print(stats);
+
+    uint32_t elapsed_intervals =
+        (now - stats->next_print) / stats->print_interval + 1;
+    stats->next_print += elapsed_intervals * stats->print_interval;
+}
+
+void
+sc_latency_stats_on_received(struct sc_latency_stats *stats, int64_t pts) {
+    assert(pts >= 0);
+    sc_tick now = sc_tick_now();
+
+    sc_mutex_lock(&stats->mutex);
+
+    // The PTS is in microseconds, like sc_tick, but on the device clock
+    sc_tick offset = now - pts;
+    if (!stats->has_min_offset || offset < stats->min_offset) {
+        stats->min_offset = offset;
+        stats->has_min_offset = true;
+    }
+    sc_latency_stats_record(stats, SC_LATENCY_STAGE_NETWORK,
+                            offset - stats->min_offset);
+
+    struct sc_latency_stats_frame *frame = &stats->frames[stats->head];
+    frame->pts = pts;
+    frame->received = now;
+    frame->decoded = 0;
+    frame->pushed = 0;
+    stats->head = (stats->head + 1) % SC_LATENCY_STATS_FRAMES;
+
+    sc_mutex_unlock(&stats->mutex);
+}
+
+void
+sc_latency_stats_on_decoded(struct sc_latency_stats *stats, int64_t pts) {
+    sc_tick now = sc_tick_now();
+
+    sc_mutex_lock(&stats->mutex);
+    struct sc_latency_stats_frame *frame = sc_latency_stats_find(stats, pts);
+    if (frame && !frame->decoded) {
+        frame->decoded = now;
+        sc_latency_stats_record(stats, SC_LATENCY_STAGE_DECODE,
+                                now - frame->received);
+    }
+    sc_mutex_unlock(&stats->mutex);
+}
+
+void
+sc_latency_stats_on_pushed(struct sc_latency_stats *stats, int64_t pts) {
+    sc_tick now = sc_tick_now();
+
+    sc_mutex_lock(&stats->mutex);
+    struct sc_latency_stats_frame *frame = sc_latency_stats_find(stats, pts);
+    if (frame && frame->decoded && !frame->pushed) {
+        frame->pushed = now;
+        sc_latency_stats_record(stats, SC_LATENCY_STAGE_BUFFER,
+                                now - frame->decoded);
+    }
+    sc_mutex_unlock(&stats->mutex);
+}
+
+void
+sc_latency_stats_on_presented(struct sc_latency_stats *stats, int64_t pts) {
+    sc_tick now = sc_tick_now();
+
+    sc_mutex_lock(&stats->mutex);
+    struct sc_latency_stats_frame *frame = sc_latency_stats_find(stats, pts);
+    if (frame && frame->pushed) {
+        sc_latency_stats_record(stats, SC_LATENCY_STAGE_RENDER,
+                                now - frame->pushed);
+        sc_latency_stats_record(stats, SC_LATENCY_STAGE_TOTAL,
+                                now - frame->received);
+        // The same frame may be presented again (e.g. on resume), count it
+        // only once
+        frame->pts = -1;
+    }
+    sc_latency_stats_check_interval_expired(stats, now);
+    sc_mutex_unlock(&stats->mutex);
+}
+
+void
+sc_latency_stats_get(struct sc_latency_stats *stats,
+                     struct sc_latency_stats_summary *summaries) {
+    sc_mutex_lock(&stats->mutex);
+    for (unsigned i = 0; i < SC_LATENCY_STAGE_COUNT; ++i) {
+        sc_latency_stats_summarize(&stats->hist[i], &summaries[i]);
+    }
+    sc_mutex_unlock(&stats->mutex);
+}
@@ -0,0 +1,118 @@
+#ifndef SC_LATENCY_STATS_H
+#define SC_LATENCY_STATS_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util/histogram.h"
+#include "util/thread.h"
+#include "util/tick.h"
+
+// Number of frames tracked simultaneously through the pipeline
+#define SC_LATENCY_STATS_FRAMES 64
+
+/**
+ * Stages of the video pipeline, each measured between two timestamps of the
+ * same frame
+ */
+enum sc_latency_stage {
+    // Packet arrival (demuxer) relative to the server PTS, minus the smallest
+    // offset observed (the device and client clocks are not synchronized, so
+    // only the network and encoder jitter can be measured)
+    SC_LATENCY_STAGE_NETWORK,
+    // Packet arrival (demuxer) to decoded frame (decoder)
+    SC_LATENCY_STAGE_DECODE,
+    // Decoded frame (decoder) to frame buffer push (screen)
+    SC_LATENCY_STAGE_BUFFER,
+    // Frame buffer push to SDL_RenderPresent() (screen)
+    SC_LATENCY_STAGE_RENDER,
+    // Packet arrival (demuxer) to SDL_RenderPresent() (screen)
+    SC_LATENCY_STAGE_TOTAL,
+};
+
+#define SC_LATENCY_STAGE_COUNT (SC_LATENCY_STAGE_TOTAL + 1)
+
+// Timestamps of a frame in flight (0 if not reached yet)
+struct sc_latency_stats_frame {
+    int64_t pts; // -1 if the slot is unused
+    sc_tick received;
+    sc_tick decoded;
+    sc_tick pushed;
+};
+
+struct sc_latency_stats_summary {
+    uint64_t count;
+    // in microseconds
+    sc_tick p50;
+    sc_tick p95;
+    sc_tick p99;
+    sc_tick max;
+};
+
+/**
+ * Per-stage latency histograms of the video frames
+ *
+ * The components of the pipeline report the timestamps of each frame
+ * (identified by its PTS) if they have been given a latency stats instance,
+ * so the cost is a NULL check when disabled.
+ *
+ * All functions are thread-safe.
+ */
+struct sc_latency_stats {
+    sc_mutex mutex;
+
+    sc_tick print_interval; // 0 to never print
+    sc_tick next_print; // 0 until the first frame is presented
+
+    // Ring buffer of the frames in flight
+    struct sc_latency_stats_frame frames[SC_LATENCY_STATS_FRAMES];
+    unsigned head; // index of the next slot to use
+
+    bool has_min_offset;
+    sc_tick min_offset; // smallest (arrival - PTS)
+
+    // Since the start (for the "stats" WebSocket request)
+    struct sc_histogram hist[SC_LATENCY_STAGE_COUNT];
+    // Since the last print
+    struct sc_histogram interval_hist[SC_LATENCY_STAGE_COUNT];
+};
+
+/**
+ * Initialize the latency stats
+ *
+ * If print_interval is not 0, the percentiles of the last interval are logged
+ * periodically.
+ */
+bool
+sc_latency_stats_init(struct sc_latency_stats *stats, sc_tick print_interval);
+
+void
+sc_latency_stats_destroy(struct sc_latency_stats *stats);
+
+// A (non-config) packet has been received by the demuxer
+void
+sc_latency_stats_on_received(struct sc_latency_stats *stats, int64_t pts);
+
+// A frame has been output by the decoder
+void
+sc_latency_stats_on_decoded(struct sc_latency_stats *stats, int64_t pts);
+
+// A frame has been pushed to the screen frame buffer
+void
+sc_latency_stats_on_pushed(struct sc_latency_stats *stats, int64_t pts);
+
+// A frame has been presented on the screen
+void
+sc_latency_stats_on_presented(struct sc_latency_stats *stats, int64_t pts);
+
+// Get the summaries since the start, indexed by enum sc_latency_stage
+void
+sc_latency_stats_get(struct sc_latency_stats *stats,
+                     struct sc_latency_stats_summary *summaries);
+
+const char *
+sc_latency_stage_name(enum sc_latency_stage stage);
+
+#endif
@@ -9,6 +9,7 @@
 
 #include "cli.h"
 #include "events.h"
+#include "host.h"
 #include "options.h"
 #include "scrcpy.h"
 #ifdef HAVE_USB
@@ -17,6 +18,7 @@
 #include "util/log.h"
 #include "util/net.h"
 #include "util/term.h"
+#include "util/trace.h"
 #include "version.h"
 
 #ifdef _WIN32
@@ -96,19 +98,40 @@ main_scrcpy(int argc, char *argv[])
 
     sc_log_configure();
 
-    if (!sc_main_thread_init()) {
+    // Before any thread is started
+    if (args.opts.trace_file && !sc_trace_init(args.opts.trace_file))
+    {
         ret = SCRCPY_EXIT_FAILURE;
         goto net_cleanup;
     }
 
+    if (!sc_main_thread_init()) {
+        ret = SCRCPY_EXIT_FAILURE;
+        goto trace_cleanup;
+    }
+
+    if (args.opts.linkandroid_host)
+    {
+        ret = scrcpy_host(&args.opts);
+    }
+    else
+    {
 #ifdef HAVE_USB
-    ret = args.opts.otg ? scrcpy_otg(&args.opts) : scrcpy(&args.opts);
+        ret = args.opts.otg ? scrcpy_otg(&args.opts) : scrcpy(&args.opts);
 #else
-    ret = scrcpy(&args.opts);
+        ret = scrcpy(&args.opts);
 #endif
+    }
 
     sc_main_thread_destroy();
 
+trace_cleanup:
+    // All the threads have been joined
+    if (args.opts.trace_file)
+    {
+        sc_trace_destroy();
+    }
+
 net_cleanup:
     net_cleanup();
 
@@ -17,7 +17,10 @@ const struct scrcpy_options scrcpy_options_default = {
     .camera_size = NULL,
     .camera_ar = NULL,
     .camera_zoom = NULL,
+    .video_decoder_hwaccel = NULL,
     .camera_fps = 0,
+    .video_decoder_threads = 0,
+    .video_decoder_thread_type = SC_DECODER_THREAD_TYPE_SLICE,
     .log_level = SC_LOG_LEVEL_INFO,
     .video_codec = SC_CODEC_H264,
     .audio_codec = SC_CODEC_OPUS,
@@ -71,6 +74,13 @@ const struct scrcpy_options scrcpy_options_default = {
     .audio_output_buffer = SC_TICK_FROM_MS(10),
     .time_limit = 0,
     .screen_off_timeout = -1,
+    .replay_buffer = 0,
+    .replay_buffer_size = 128,
+    .record_segment_time = 0,
+    .video_buffer_min = 0,
+    .video_buffer_max = SC_TICK_FROM_MS(500),
+    .latency_stats_interval = SC_TICK_FROM_SEC(10),
+    .video_catch_up = 0,
 #ifdef HAVE_V4L2
     .v4l2_device = NULL,
     .v4l2_buffer = 0,
@@ -122,12 +132,28 @@ const struct scrcpy_options scrcpy_options_default = {
     .linkandroid_panel_show = false,
     .linkandroid_preview_interval = 0, // disabled by default
     .linkandroid_preview_ratio = 100,  // 100% (original resolution) by default
+    .linkandroid_preview_transport = SC_LINKANDROID_PREVIEW_TRANSPORT_TEXT,
+    .linkandroid_preview_format = SC_LINKANDROID_PREVIEW_FORMAT_PNG,
+    .linkandroid_preview_quality = 80,
+    .linkandroid_preview_tiles = false,
+    .linkandroid_preview_keyframe_interval = 10000,
+    .linkandroid_preview_max_staleness = 0,
+    .linkandroid_coalesce_window = 16, // about one frame
     .linkandroid_skip_taskbar = false,
+    .linkandroid_host = false,
+    .linkandroid_host_serials = NULL,
+    .capture_stream = NULL,
+    .replay_stream = NULL,
+    .trace_file = NULL,
     .camera_torch = false,
     .keep_active = false,
     .flex_display = false,
     .ignore_video_encoder_constraints = false,
     .update_terminal_title = true,
+    .record_fragmented = false,
+    .video_buffer_adaptive = false,
+    .replay_stream_max_speed = false,
+    .latency_stats = false,
 };
 
 enum sc_orientation
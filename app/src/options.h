@@ -247,6 +247,22 @@ enum sc_render_fit {
     SC_RENDER_FIT_UNSCALED,
 };
 
+enum sc_decoder_thread_type {
+    SC_DECODER_THREAD_TYPE_SLICE, // no additional latency
+    SC_DECODER_THREAD_TYPE_FRAME, // one frame of latency per thread
+};
+
+enum sc_linkandroid_preview_transport {
+    SC_LINKANDROID_PREVIEW_TRANSPORT_TEXT,   // base64 data URL inside JSON
+    SC_LINKANDROID_PREVIEW_TRANSPORT_BINARY, // fixed header + raw image bytes
+};
+
+enum sc_linkandroid_preview_format {
+    SC_LINKANDROID_PREVIEW_FORMAT_PNG,
+    SC_LINKANDROID_PREVIEW_FORMAT_JPEG,
+    SC_LINKANDROID_PREVIEW_FORMAT_WEBP,
+};
+
 struct sc_port_range {
     uint16_t first;
     uint16_t last;
@@ -270,7 +286,10 @@ struct scrcpy_options
     const char *camera_size;
     const char *camera_ar;
     const char *camera_zoom;
+    const char *video_decoder_hwaccel; // NULL (disabled), "auto" or a type
     uint16_t camera_fps;
+    uint8_t video_decoder_threads; // 0 for auto
+    enum sc_decoder_thread_type video_decoder_thread_type;
     enum sc_log_level log_level;
     enum sc_codec video_codec;
     enum sc_codec audio_codec;
@@ -309,6 +328,13 @@ struct scrcpy_options
     sc_tick audio_output_buffer;
     sc_tick time_limit;
     sc_tick screen_off_timeout;
+    sc_tick replay_buffer; // 0 for disabled
+    uint32_t replay_buffer_size; // in MiB
+    sc_tick record_segment_time; // 0 for disabled
+    sc_tick video_buffer_min; // bounds of the adaptive video buffer
+    sc_tick video_buffer_max;
+    sc_tick latency_stats_interval; // 0 to never print
+    sc_tick video_catch_up; // 0 for disabled
 #ifdef HAVE_V4L2
     const char *v4l2_device;
     sc_tick v4l2_buffer;
@@ -364,12 +390,28 @@ struct scrcpy_options
     bool linkandroid_panel_show;           // Enable right-side panel (dynamic via WebSocket)
     uint32_t linkandroid_preview_interval; // Preview interval in milliseconds (0 = disabled)
     uint8_t linkandroid_preview_ratio;     // Preview resolution ratio (1-100, 100 = original)
+    enum sc_linkandroid_preview_transport linkandroid_preview_transport;
+    enum sc_linkandroid_preview_format linkandroid_preview_format;
+    uint8_t linkandroid_preview_quality;   // JPEG/WebP quality (1-100)
+    bool linkandroid_preview_tiles;        // Send only the changed preview tiles
+    uint32_t linkandroid_preview_keyframe_interval; // Full preview interval in ms (tiles mode)
+    uint32_t linkandroid_preview_max_staleness; // Heartbeat of unchanged previews in ms (0 = disabled)
+    uint32_t linkandroid_coalesce_window;  // Input events coalescing window in ms (0 = disabled)
     bool linkandroid_skip_taskbar;         // Hide from taskbar/dock
+    bool linkandroid_host;                 // Serve several devices (host mode)
+    const char *linkandroid_host_serials;  // Comma-separated (may be NULL)
+    const char *capture_stream; // directory (may be NULL)
+    const char *replay_stream; // directory (may be NULL)
+    const char *trace_file; // may be NULL
     bool camera_torch;
     bool keep_active;
     bool flex_display;
     bool ignore_video_encoder_constraints;
     bool update_terminal_title;
+    bool record_fragmented;
+    bool video_buffer_adaptive;
+    bool replay_stream_max_speed;
+    bool latency_stats;
 };
 
 extern const struct scrcpy_options scrcpy_options_default;
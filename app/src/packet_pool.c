@@ -0,0 +1,71 @@
+#include "packet_pool.h"
+
+#include <assert.h>
+#include <string.h>
+#include <libavcodec/avcodec.h>
+
+#include "util/log.h"
+
+void
+sc_packet_pool_init(struct sc_packet_pool *pool) {
+    for (unsigned i = 0; i < SC_PACKET_POOL_CLASSES; ++i) {
+        pool->pools[i] = NULL;
+    }
+}
+
+void
+sc_packet_pool_destroy(struct sc_packet_pool *pool) {
+    for (unsigned i = 0; i < SC_PACKET_POOL_CLASSES; ++i) {
+        // Buffers still referenced are freed on their last unref
+        av_buffer_pool_uninit(&pool->pools[i]);
+    }
+}
+
+static unsigned
+sc_packet_pool_get_class(size_t alloc_size) {
+    unsigned shift = SC_PACKET_POOL_MIN_SHIFT;
+    while (((size_t) 1 << shift) < alloc_size) {
+        ++shift;
+    }
+    return shift - SC_PACKET_POOL_MIN_SHIFT;
+}
+
+bool
+sc_packet_pool_new_packet(struct sc_packet_pool *pool, AVPacket *packet,
+                          size_t size) {
+    assert(!packet->buf);
+
+    size_t alloc_size = size + AV_INPUT_BUFFER_PADDING_SIZE;
+    if (alloc_size > ((size_t) 1 << SC_PACKET_POOL_MAX_SHIFT)) {
+        // Too large to be recycled
+        if (av_new_packet(packet, size)) {
+            LOG_OOM();
+            return false;
+        }
+        return true;
+    }
+
+    unsigned cls = sc_packet_pool_get_class(alloc_size);
+    if (!pool->pools[cls]) {
+        size_t class_size = (size_t) 1 << (cls + SC_PACKET_POOL_MIN_SHIFT);
+        pool->pools[cls] = av_buffer_pool_init(class_size, NULL);
+        if (!pool->pools[cls]) {
+            LOG_OOM();
+            return false;
+        }
+    }
+
+    AVBufferRef *buf = av_buffer_pool_get(pool->pools[cls]);
+    if (!buf) {
+        LOG_OOM();
+        return false;
+    }
+
+    // Recycled buffers are not cleared, only the padding must be zeroed
+    memset(buf->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    packet->buf = buf;
+    packet->data = buf->data;
+    packet->size = size;
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef SC_PACKET_POOL_H
+#define SC_PACKET_POOL_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <libavcodec/packet.h>
+#include <libavutil/buffer.h>
+
+#define SC_PACKET_POOL_MIN_SHIFT 10 // 1 KiB
+#define SC_PACKET_POOL_MAX_SHIFT 24 // 16 MiB
+#define SC_PACKET_POOL_CLASSES \
+    (SC_PACKET_POOL_MAX_SHIFT - SC_PACKET_POOL_MIN_SHIFT + 1)
+
+/**
+ * Recycle the packet payload buffers
+ *
+ * Payloads are carved from AVBufferPools, one per power-of-two size class, so
+ * that receiving a packet does not allocate its payload once the pool is warm.
+ *
+ * A buffer returns to its pool once the last reference is released, possibly
+ * from another thread (e.g. the decoder or the recorder). The pool may be
+ * destroyed while buffers are still referenced: the memory is released when
+ * the last one is unreferenced.
+ */
+struct sc_packet_pool {
+    AVBufferPool *pools[SC_PACKET_POOL_CLASSES]; // created on first use
+};
+
+void
+sc_packet_pool_init(struct sc_packet_pool *pool);
+
+void
+sc_packet_pool_destroy(struct sc_packet_pool *pool);
+
+/**
+ * Initialize the packet payload, like av_new_packet()
+ *
+ * The packet must be blank (i.e. initialized or unreferenced).
+ */
+bool
+sc_packet_pool_new_packet(struct sc_packet_pool *pool, AVPacket *packet,
+                          size_t size);
+
+#endif
@@ -2,6 +2,7 @@
 
 #include <assert.h>
 #include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <libavcodec/avcodec.h>
@@ -9,6 +10,7 @@
 #include <libavutil/time.h>
 #include <libavutil/display.h>
 
+#include "util/file.h"
 #include "util/log.h"
 #include "util/str.h"
 
@@ -82,6 +84,36 @@ sc_recorder_get_format_name(enum sc_record_format format) {
     }
 }
 
+static bool
+sc_recorder_is_mp4(enum sc_record_format format) {
+    return format == SC_RECORD_FORMAT_MP4
+        || format == SC_RECORD_FORMAT_M4A
+        || format == SC_RECORD_FORMAT_AAC;
+}
+
+static char *
+sc_recorder_get_segment_filename(const char *filename, unsigned index) {
+    // Insert the index before the extension (if any)
+    const char *ext = strrchr(filename, '.');
+    const char *sep = strrchr(filename, SC_PATH_SEPARATOR);
+    if (!ext || (sep && ext < sep)) {
+        ext = filename + strlen(filename);
+    }
+
+    size_t stem_len = ext - filename;
+    // "-" + at least 3 digits (up to 10 for an unsigned) + '\0'
+    size_t len = strlen(filename) + 12;
+    char *segment_filename = malloc(len);
+    if (!segment_filename) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    snprintf(segment_filename, len, "%.*s-%03u%s", (int) stem_len, filename,
+             index, ext);
+    return segment_filename;
+}
+
 static bool
 sc_recorder_set_extradata(AVStream *ostream, const AVPacket *packet) {
     uint8_t *extradata = av_malloc(packet->size * sizeof(uint8_t));
@@ -106,6 +138,14 @@ sc_recorder_rescale_packet(AVStream *stream, AVPacket *packet) {
 static bool
 sc_recorder_write_stream(struct sc_recorder *recorder,
                          struct sc_recorder_stream *st, AVPacket *packet) {
+    // Each segment starts at 0 (the packets of the other stream received
+    // after the rotation may be slightly older than the segment start)
+    packet->pts -= recorder->segment_start;
+    if (packet->pts < 0) {
+        packet->pts = 0;
+    }
+    packet->dts = packet->pts;
+
     AVStream *stream = recorder->ctx->streams[st->index];
     sc_recorder_rescale_packet(stream, packet);
     if (st->last_pts != AV_NOPTS_VALUE && packet->pts <= st->last_pts) {
@@ -130,53 +170,206 @@ sc_recorder_write_audio(struct sc_recorder *recorder, AVPacket *packet) {
     return sc_recorder_write_stream(recorder, &recorder->audio_stream, packet);
 }
 
-static bool
+static AVFormatContext *
 sc_recorder_open_output_file(struct sc_recorder *recorder) {
     const char *format_name = sc_recorder_get_format_name(recorder->format);
     assert(format_name);
     const AVOutputFormat *format = find_muxer(format_name);
     if (!format) {
         LOGE("Could not find muxer");
-        return false;
+        return NULL;
     }
 
-    recorder->ctx = avformat_alloc_context();
-    if (!recorder->ctx) {
+    char *filename;
+    if (recorder->segment_time) {
+        filename = sc_recorder_get_segment_filename(recorder->filename,
+                                                    recorder->segment_index);
+        if (!filename) {
+            return NULL;
+        }
+    } else {
+        filename = recorder->filename;
+    }
+
+    AVFormatContext *ctx = avformat_alloc_context();
+    if (!ctx) {
         LOG_OOM();
-        return false;
+        goto error_free_filename;
     }
 
-    char *file_url = sc_str_concat("file:", recorder->filename);
+    char *file_url = sc_str_concat("file:", filename);
     if (!file_url) {
-        avformat_free_context(recorder->ctx);
-        return false;
+        goto error_free_context;
     }
 
-    int ret = avio_open(&recorder->ctx->pb, file_url, AVIO_FLAG_WRITE);
+    int ret = avio_open(&ctx->pb, file_url, AVIO_FLAG_WRITE);
     free(file_url);
     if (ret < 0) {
-        LOGE("Failed to open output file: %s", recorder->filename);
-        avformat_free_context(recorder->ctx);
-        return false;
+        LOGE("Failed to open output file: %s", filename);
+        goto error_free_context;
     }
 
     // contrary to the deprecated API (av_oformat_next()), av_muxer_iterate()
     // returns (on purpose) a pointer-to-const, but AVFormatContext.oformat
     // still expects a pointer-to-non-const (it has not be updated accordingly)
     // <https://github.com/FFmpeg/FFmpeg/commit/0694d8702421e7aff1340038559c438b61bb30dd>
-    recorder->ctx->oformat = (AVOutputFormat *) format;
+    ctx->oformat = (AVOutputFormat *) format;
 
-    av_dict_set(&recorder->ctx->metadata, "comment",
+    av_dict_set(&ctx->metadata, "comment",
                 "Recorded by scrcpy " SCRCPY_VERSION, 0);
 
-    LOGI("Recording started to %s file: %s", format_name, recorder->filename);
-    return true;
+    LOGI("Recording started to %s file: %s", format_name, filename);
+
+    if (filename != recorder->filename) {
+        free(filename);
+    }
+    return ctx;
+
+error_free_context:
+    avformat_free_context(ctx);
+error_free_filename:
+    if (filename != recorder->filename) {
+        free(filename);
+    }
+
+    return NULL;
 }
 
 static void
-sc_recorder_close_output_file(struct sc_recorder *recorder) {
-    avio_close(recorder->ctx->pb);
-    avformat_free_context(recorder->ctx);
+sc_recorder_close_output_file(AVFormatContext *ctx) {
+    avio_close(ctx->pb);
+    avformat_free_context(ctx);
+}
+
+static bool
+sc_recorder_write_header(struct sc_recorder *recorder) {
+    AVDictionary *opts = NULL;
+    if (recorder->fragmented && sc_recorder_is_mp4(recorder->format)) {
+        // Write an empty moov atom and a fragment per key frame, so that the
+        // file is playable (and may be streamed) while it is written
+        av_dict_set(&opts, "movflags",
+                    "+frag_keyframe+empty_moov+default_base_moof", 0);
+    }
+
+    int ret = avformat_write_header(recorder->ctx, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        LOGE("Failed to write header to %s", recorder->filename);
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+sc_recorder_set_orientation(AVStream *stream, enum sc_orientation orientation) {
+    assert(!sc_orientation_is_mirror(orientation));
+
+    uint8_t *raw_data;
+#ifdef SCRCPY_LAVC_HAS_CODECPAR_CODEC_SIDEDATA
+    AVPacketSideData *sd =
+        av_packet_side_data_new(&stream->codecpar->coded_side_data,
+                                &stream->codecpar->nb_coded_side_data,
+                                AV_PKT_DATA_DISPLAYMATRIX,
+                                sizeof(int32_t) * 9, 0);
+    if (!sd) {
+        LOG_OOM();
+        return false;
+    }
+
+    raw_data = sd->data;
+#else
+    raw_data = av_stream_new_side_data(stream, AV_PKT_DATA_DISPLAYMATRIX,
+                                      sizeof(int32_t) * 9);
+    if (!raw_data) {
+        LOG_OOM();
+        return false;
+    }
+#endif
+
+    int32_t *matrix = (int32_t *) raw_data;
+
+    unsigned rotation = orientation;
+    unsigned angle = rotation * 90;
+
+    av_display_rotation_set(matrix, angle);
+
+    return true;
+}
+
+static bool
+sc_recorder_must_rotate(struct sc_recorder *recorder, const AVPacket *packet,
+                        bool video) {
+    if (!recorder->segment_time) {
+        return false;
+    }
+
+    if (recorder->video) {
+        // Each segment must start on a video key frame
+        if (!video || !(packet->flags & AV_PKT_FLAG_KEY)) {
+            return false;
+        }
+    }
+
+    return packet->pts - recorder->segment_start >= recorder->segment_time;
+}
+
+// Finish the current file and continue the recording to the next segment
+static bool
+sc_recorder_rotate(struct sc_recorder *recorder, int64_t segment_start) {
+    AVFormatContext *prev = recorder->ctx;
+
+    int ret = av_write_trailer(prev);
+    if (ret < 0) {
+        LOGE("Failed to write trailer to %s", recorder->filename);
+        return false;
+    }
+
+    ++recorder->segment_index;
+    AVFormatContext *ctx = sc_recorder_open_output_file(recorder);
+    if (!ctx) {
+        return false;
+    }
+
+    // Create the same streams, in the same order (so that the packets stream
+    // indexes remain valid)
+    for (unsigned i = 0; i < prev->nb_streams; ++i) {
+        AVStream *stream = avformat_new_stream(ctx, NULL);
+        if (!stream) {
+            LOG_OOM();
+            goto error;
+        }
+
+        ret = avcodec_parameters_copy(stream->codecpar,
+                                      prev->streams[i]->codecpar);
+        if (ret < 0) {
+            goto error;
+        }
+
+#ifndef SCRCPY_LAVC_HAS_CODECPAR_CODEC_SIDEDATA
+        // The display matrix is not part of the codec parameters
+        if ((int) i == recorder->video_stream.index
+                && recorder->orientation != SC_ORIENTATION_0) {
+            if (!sc_recorder_set_orientation(stream, recorder->orientation)) {
+                goto error;
+            }
+        }
+#endif
+    }
+
+    sc_recorder_close_output_file(prev);
+    recorder->ctx = ctx;
+    recorder->segment_start = segment_start;
+
+    // The time base of the new streams is set by the muxer
+    recorder->video_stream.last_pts = AV_NOPTS_VALUE;
+    recorder->audio_stream.last_pts = AV_NOPTS_VALUE;
+
+    return sc_recorder_write_header(recorder);
+
+error:
+    sc_recorder_close_output_file(ctx);
+    return false;
 }
 
 static inline bool
@@ -265,9 +458,8 @@ sc_recorder_process_header(struct sc_recorder *recorder) {
         }
     }
 
-    bool ok = avformat_write_header(recorder->ctx, NULL) >= 0;
+    bool ok = sc_recorder_write_header(recorder);
     if (!ok) {
-        LOGE("Failed to write header to %s", recorder->filename);
         goto end;
     }
 
@@ -399,6 +591,16 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
                 video_pkt_previous->duration = video_pkt->pts
                                              - video_pkt_previous->pts;
 
+                if (sc_recorder_must_rotate(recorder, video_pkt_previous,
+                                            true)) {
+                    bool ok = sc_recorder_rotate(recorder,
+                                                 video_pkt_previous->pts);
+                    if (!ok) {
+                        error = true;
+                        goto end;
+                    }
+                }
+
                 bool ok = sc_recorder_write_video(recorder, video_pkt_previous);
                 av_packet_free(&video_pkt_previous);
                 if (!ok) {
@@ -416,6 +618,14 @@ sc_recorder_process_packets(struct sc_recorder *recorder) {
             audio_pkt->pts -= pts_origin;
             audio_pkt->dts = audio_pkt->pts;
 
+            if (sc_recorder_must_rotate(recorder, audio_pkt, false)) {
+                bool ok = sc_recorder_rotate(recorder, audio_pkt->pts);
+                if (!ok) {
+                    error = true;
+                    goto end;
+                }
+            }
+
             bool ok = sc_recorder_write_audio(recorder, audio_pkt);
             if (!ok) {
                 LOGE("Could not record audio packet");
@@ -462,13 +672,9 @@ end:
 
 static bool
 sc_recorder_record(struct sc_recorder *recorder) {
-    bool ok = sc_recorder_open_output_file(recorder);
-    if (!ok) {
-        return false;
-    }
-
-    ok = sc_recorder_process_packets(recorder);
-    sc_recorder_close_output_file(recorder);
+    // The output file is opened by sc_recorder_start()
+    bool ok = sc_recorder_process_packets(recorder);
+    sc_recorder_close_output_file(recorder->ctx);
     return ok;
 }
 
@@ -505,42 +711,6 @@ run_recorder(void *data) {
     return 0;
 }
 
-static bool
-sc_recorder_set_orientation(AVStream *stream, enum sc_orientation orientation) {
-    assert(!sc_orientation_is_mirror(orientation));
-
-    uint8_t *raw_data;
-#ifdef SCRCPY_LAVC_HAS_CODECPAR_CODEC_SIDEDATA
-    AVPacketSideData *sd =
-        av_packet_side_data_new(&stream->codecpar->coded_side_data,
-                                &stream->codecpar->nb_coded_side_data,
-                                AV_PKT_DATA_DISPLAYMATRIX,
-                                sizeof(int32_t) * 9, 0);
-    if (!sd) {
-        LOG_OOM();
-        return false;
-    }
-
-    raw_data = sd->data;
-#else
-    raw_data = av_stream_new_side_data(stream, AV_PKT_DATA_DISPLAYMATRIX,
-                                      sizeof(int32_t) * 9);
-    if (!raw_data) {
-        LOG_OOM();
-        return false;
-    }
-#endif
-
-    int32_t *matrix = (int32_t *) raw_data;
-
-    unsigned rotation = orientation;
-    unsigned angle = rotation * 90;
-
-    av_display_rotation_set(matrix, angle);
-
-    return true;
-}
-
 static bool
 sc_recorder_video_packet_sink_open(struct sc_packet_sink *sink,
                                    AVCodecContext *ctx,
@@ -757,8 +927,9 @@ sc_recorder_stream_init(struct sc_recorder_stream *stream) {
 bool
 sc_recorder_init(struct sc_recorder *recorder, const char *filename,
                  enum sc_record_format format, bool video, bool audio,
-                 enum sc_orientation orientation,
-                 const struct sc_recorder_callbacks *cbs, void *cbs_userdata) {
+                 enum sc_orientation orientation, sc_tick segment_time,
+                 bool fragmented, const struct sc_recorder_callbacks *cbs,
+                 void *cbs_userdata) {
     assert(!sc_orientation_is_mirror(orientation));
 
     recorder->filename = strdup(filename);
@@ -798,6 +969,11 @@ sc_recorder_init(struct sc_recorder *recorder, const char *filename,
 
     recorder->format = format;
 
+    recorder->segment_time = segment_time;
+    recorder->fragmented = fragmented;
+    recorder->segment_index = 0;
+    recorder->segment_start = 0;
+
     assert(cbs && cbs->on_ended);
     recorder->cbs = cbs;
     recorder->cbs_userdata = cbs_userdata;
@@ -835,10 +1011,18 @@ error_free_filename:
 
 bool
 sc_recorder_start(struct sc_recorder *recorder) {
+    // Open the output file before the packet sinks may be opened (they add
+    // the streams to the format context)
+    recorder->ctx = sc_recorder_open_output_file(recorder);
+    if (!recorder->ctx) {
+        return false;
+    }
+
     bool ok = sc_thread_create(&recorder->thread, run_recorder,
                                "scrcpy-recorder", recorder);
     if (!ok) {
         LOGE("Could not start recorder thread");
+        sc_recorder_close_output_file(recorder->ctx);
         return false;
     }
 
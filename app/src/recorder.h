@@ -11,6 +11,7 @@
 #include "options.h"
 #include "trait/packet_sink.h"
 #include "util/thread.h"
+#include "util/tick.h"
 #include "util/vecdeque.h"
 
 struct sc_recorder_queue SC_VECDEQUE(AVPacket *);
@@ -41,6 +42,15 @@ struct sc_recorder {
     enum sc_record_format format;
     AVFormatContext *ctx;
 
+    // If not 0, start a new file (at a video key frame) every segment_time
+    sc_tick segment_time;
+    // Write a fragmented MP4 (playable even if the recording is interrupted)
+    bool fragmented;
+    // The index of the current segment, and its start (relative to the
+    // recording start)
+    unsigned segment_index;
+    int64_t segment_start;
+
     sc_thread thread;
     sc_mutex mutex;
     sc_cond cond;
@@ -68,11 +78,23 @@ struct sc_recorder_callbacks {
                      void *userdata);
 };
 
+/**
+ * Initialize a recorder
+ *
+ * If segment_time is not 0, the recording is split into several files, named
+ * from filename with a segment index inserted before the extension (for
+ * example "file.mp4" is recorded to "file-000.mp4", "file-001.mp4", etc.).
+ * Each segment starts on a video key frame.
+ *
+ * If fragmented is set, MP4 files are written as fragmented MP4, so that they
+ * remain playable if the recording is interrupted.
+ */
 bool
 sc_recorder_init(struct sc_recorder *recorder, const char *filename,
                  enum sc_record_format format, bool video, bool audio,
-                 enum sc_orientation orientation,
-                 const struct sc_recorder_callbacks *cbs, void *cbs_userdata);
+                 enum sc_orientation orientation, sc_tick segment_time,
+                 bool fragmented, const struct sc_recorder_callbacks *cbs,
+                 void *cbs_userdata);
 
 bool
 sc_recorder_start(struct sc_recorder *recorder);
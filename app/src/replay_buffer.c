@@ -0,0 +1,756 @@
+#include "replay_buffer.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "util/log.h"
+
+/** Downcast packet sinks to replay buffer */
+#define DOWNCAST_VIDEO(SINK) \
+    container_of(SINK, struct sc_replay_buffer, video_packet_sink)
+#define DOWNCAST_AUDIO(SINK) \
+    container_of(SINK, struct sc_replay_buffer, audio_packet_sink)
+
+// The item at index i from the front (it must exist)
+#define QUEUE_AT(pv, i) ((pv)->data[((pv)->origin + (i)) % (pv)->cap])
+#define QUEUE_FRONT(pv) QUEUE_AT(pv, 0)
+#define QUEUE_BACK(pv) QUEUE_AT(pv, (pv)->size - 1)
+
+struct sc_replay_buffer_dump {
+    struct sc_replay_buffer *replay;
+
+    char *filename;
+    enum sc_record_format format;
+    void *userdata;
+
+    bool video;
+    bool audio;
+    // Including the config packets (if any)
+    struct sc_replay_buffer_queue video_packets;
+    struct sc_replay_buffer_queue audio_packets;
+
+    // Set by the recorder on end
+    bool success;
+};
+
+static AVPacket *
+sc_replay_buffer_packet_ref(const AVPacket *packet) {
+    AVPacket *p = av_packet_alloc();
+    if (!p) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    if (av_packet_ref(p, packet)) {
+        av_packet_free(&p);
+        return NULL;
+    }
+
+    return p;
+}
+
+static inline size_t
+sc_replay_buffer_packet_bytes(const AVPacket *packet) {
+    // A pooled buffer may be larger than the packet payload, count the memory
+    // actually retained
+    return packet->buf ? packet->buf->size : (size_t) packet->size;
+}
+
+static void
+sc_replay_buffer_queue_clear(struct sc_replay_buffer_queue *queue) {
+    while (!sc_vecdeque_is_empty(queue)) {
+        AVPacket *p = sc_vecdeque_pop(queue);
+        av_packet_free(&p);
+    }
+}
+
+// Must be called with the mutex locked
+static void
+sc_replay_buffer_drop_front(struct sc_replay_buffer *replay,
+                            struct sc_replay_buffer_stream *stream) {
+    AVPacket *p = sc_vecdeque_pop(&stream->queue);
+    size_t bytes = sc_replay_buffer_packet_bytes(p);
+    assert(replay->bytes >= bytes);
+    replay->bytes -= bytes;
+    av_packet_free(&p);
+}
+
+// Must be called with the mutex locked
+static void
+sc_replay_buffer_drop_gop(struct sc_replay_buffer *replay) {
+    struct sc_replay_buffer_queue *queue = &replay->video_stream.queue;
+    assert(!sc_vecdeque_is_empty(queue));
+    assert(QUEUE_FRONT(queue)->flags & AV_PKT_FLAG_KEY);
+
+    (void) sc_vecdeque_popref(&replay->keyframes);
+    do {
+        sc_replay_buffer_drop_front(replay, &replay->video_stream);
+    } while (!sc_vecdeque_is_empty(queue)
+            && !(QUEUE_FRONT(queue)->flags & AV_PKT_FLAG_KEY));
+}
+
+// Must be called with the mutex locked
+static void
+sc_replay_buffer_trim_video(struct sc_replay_buffer *replay) {
+    struct sc_replay_buffer_queue *queue = &replay->video_stream.queue;
+    if (sc_vecdeque_is_empty(queue)) {
+        return;
+    }
+
+    int64_t last_pts = QUEUE_BACK(queue)->pts;
+
+    // Drop the oldest GOP if the window still covers the requested duration
+    // without it (or if the memory limit is exceeded)
+    while (sc_vecdeque_size(&replay->keyframes) > 1) {
+        int64_t next_keyframe_pts = QUEUE_AT(&replay->keyframes, 1);
+        if (last_pts - next_keyframe_pts < replay->max_duration
+                && replay->bytes <= replay->max_bytes) {
+            break;
+        }
+        sc_replay_buffer_drop_gop(replay);
+    }
+
+    if (replay->bytes > replay->max_bytes) {
+        // A single GOP does not fit, start again from the next key frame
+        LOGW("Replay buffer: GOP larger than %zu bytes, dropped",
+             replay->max_bytes);
+        while (!sc_vecdeque_is_empty(queue)) {
+            sc_replay_buffer_drop_front(replay, &replay->video_stream);
+        }
+        sc_vecdeque_clear(&replay->keyframes);
+        replay->wait_keyframe = true;
+    }
+}
+
+// Must be called with the mutex locked
+static void
+sc_replay_buffer_trim_audio(struct sc_replay_buffer *replay) {
+    struct sc_replay_buffer_queue *queue = &replay->audio_stream.queue;
+    if (sc_vecdeque_is_empty(queue)) {
+        return;
+    }
+
+    struct sc_replay_buffer_queue *video_queue = &replay->video_stream.queue;
+    bool has_video = !sc_vecdeque_is_empty(video_queue);
+
+    // Do not keep audio before the first video packet
+    int64_t min_pts = has_video
+                    ? QUEUE_FRONT(video_queue)->pts
+                    : QUEUE_BACK(queue)->pts - replay->max_duration;
+
+    while (!sc_vecdeque_is_empty(queue)) {
+        bool too_old = QUEUE_FRONT(queue)->pts < min_pts;
+        // Without video packets, the audio packets are dropped one by one
+        bool too_big = !has_video && replay->bytes > replay->max_bytes;
+        if (!too_old && !too_big) {
+            break;
+        }
+        sc_replay_buffer_drop_front(replay, &replay->audio_stream);
+    }
+}
+
+static bool
+sc_replay_buffer_push(struct sc_replay_buffer *replay,
+                      struct sc_replay_buffer_stream *stream,
+                      const AVPacket *packet, bool video) {
+    sc_mutex_lock(&replay->mutex);
+
+    if (packet->pts == AV_NOPTS_VALUE) {
+        // A config packet: only the last one is needed
+        AVPacket *config = sc_replay_buffer_packet_ref(packet);
+        if (!config) {
+            sc_mutex_unlock(&replay->mutex);
+            return false;
+        }
+        if (stream->config) {
+            av_packet_free(&stream->config);
+        }
+        stream->config = config;
+        sc_mutex_unlock(&replay->mutex);
+        return true;
+    }
+
+    bool keyframe = video && (packet->flags & AV_PKT_FLAG_KEY);
+    if (video) {
+        if (replay->wait_keyframe) {
+            if (!keyframe) {
+                // The window must start on a key frame
+                sc_mutex_unlock(&replay->mutex);
+                return true;
+            }
+            replay->wait_keyframe = false;
+        }
+
+        if (keyframe) {
+            size_t size = sc_vecdeque_size(&replay->keyframes);
+            if (!sc_vecdeque_reserve(&replay->keyframes, size + 1)) {
+                LOG_OOM();
+                sc_mutex_unlock(&replay->mutex);
+                return false;
+            }
+        }
+    }
+
+    AVPacket *p = sc_replay_buffer_packet_ref(packet);
+    if (!p) {
+        sc_mutex_unlock(&replay->mutex);
+        return false;
+    }
+
+    if (!sc_vecdeque_push(&stream->queue, p)) {
+        LOG_OOM();
+        av_packet_free(&p);
+        sc_mutex_unlock(&replay->mutex);
+        return false;
+    }
+
+    if (keyframe) {
+        // Cannot fail, the space is reserved
+        sc_vecdeque_push_noresize(&replay->keyframes, p->pts);
+    }
+
+    replay->bytes += sc_replay_buffer_packet_bytes(p);
+
+    sc_replay_buffer_trim_video(replay);
+    sc_replay_buffer_trim_audio(replay);
+
+    sc_mutex_unlock(&replay->mutex);
+    return true;
+}
+
+static bool
+sc_replay_buffer_stream_open(struct sc_replay_buffer *replay,
+                             struct sc_replay_buffer_stream *stream,
+                             const AVCodecContext *ctx) {
+    AVCodecParameters *codecpar = avcodec_parameters_alloc();
+    if (!codecpar) {
+        LOG_OOM();
+        return false;
+    }
+
+    if (avcodec_parameters_from_context(codecpar, ctx) < 0) {
+        avcodec_parameters_free(&codecpar);
+        return false;
+    }
+
+    sc_mutex_lock(&replay->mutex);
+    assert(!stream->enabled);
+    stream->codec = ctx->codec;
+    stream->codecpar = codecpar;
+    stream->enabled = true;
+    sc_mutex_unlock(&replay->mutex);
+
+    return true;
+}
+
+static bool
+sc_replay_buffer_video_packet_sink_open(struct sc_packet_sink *sink,
+                                        AVCodecContext *ctx,
+                                        const struct sc_stream_session *session) {
+    (void) session;
+
+    struct sc_replay_buffer *replay = DOWNCAST_VIDEO(sink);
+    return sc_replay_buffer_stream_open(replay, &replay->video_stream, ctx);
+}
+
+static void
+sc_replay_buffer_video_packet_sink_close(struct sc_packet_sink *sink) {
+    // The packets are kept, the window may still be dumped after the end of
+    // the stream
+    (void) sink;
+}
+
+static bool
+sc_replay_buffer_video_packet_sink_push(struct sc_packet_sink *sink,
+                                        const AVPacket *packet) {
+    struct sc_replay_buffer *replay = DOWNCAST_VIDEO(sink);
+    return sc_replay_buffer_push(replay, &replay->video_stream, packet, true);
+}
+
+static bool
+sc_replay_buffer_audio_packet_sink_open(struct sc_packet_sink *sink,
+                                        AVCodecContext *ctx,
+                                        const struct sc_stream_session *session) {
+    (void) session;
+
+    struct sc_replay_buffer *replay = DOWNCAST_AUDIO(sink);
+    return sc_replay_buffer_stream_open(replay, &replay->audio_stream, ctx);
+}
+
+static void
+sc_replay_buffer_audio_packet_sink_close(struct sc_packet_sink *sink) {
+    (void) sink;
+}
+
+static bool
+sc_replay_buffer_audio_packet_sink_push(struct sc_packet_sink *sink,
+                                        const AVPacket *packet) {
+    struct sc_replay_buffer *replay = DOWNCAST_AUDIO(sink);
+    return sc_replay_buffer_push(replay, &replay->audio_stream, packet, false);
+}
+
+static void
+sc_replay_buffer_audio_packet_sink_disable(struct sc_packet_sink *sink) {
+    // The audio stream is never enabled, the dumps will contain only video
+    (void) sink;
+    LOGW("Audio stream disabled in replay buffer");
+}
+
+static void
+sc_replay_buffer_stream_init(struct sc_replay_buffer_stream *stream) {
+    stream->enabled = false;
+    stream->codec = NULL;
+    stream->codecpar = NULL;
+    stream->config = NULL;
+    sc_vecdeque_init(&stream->queue);
+}
+
+static void
+sc_replay_buffer_stream_destroy(struct sc_replay_buffer_stream *stream) {
+    sc_replay_buffer_queue_clear(&stream->queue);
+    sc_vecdeque_destroy(&stream->queue);
+    if (stream->config) {
+        av_packet_free(&stream->config);
+    }
+    if (stream->codecpar) {
+        avcodec_parameters_free(&stream->codecpar);
+    }
+}
+
+bool
+sc_replay_buffer_init(struct sc_replay_buffer *replay,
+                      const struct sc_replay_buffer_params *params,
+                      const struct sc_replay_buffer_callbacks *cbs) {
+    assert(params->video || params->audio);
+    assert(params->max_duration > 0);
+    assert(!sc_orientation_is_mirror(params->orientation));
+    assert(cbs && cbs->on_dumped);
+
+    bool ok = sc_mutex_init(&replay->mutex);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_cond_init(&replay->dump_cond);
+    if (!ok) {
+        sc_mutex_destroy(&replay->mutex);
+        return false;
+    }
+
+    replay->video = params->video;
+    replay->audio = params->audio;
+    replay->max_duration = params->max_duration;
+    replay->max_bytes = params->max_bytes;
+    replay->orientation = params->orientation;
+
+    sc_replay_buffer_stream_init(&replay->video_stream);
+    sc_replay_buffer_stream_init(&replay->audio_stream);
+    sc_vecdeque_init(&replay->keyframes);
+    replay->wait_keyframe = true;
+    replay->bytes = 0;
+
+    replay->dumping = false;
+    replay->dump_thread_started = false;
+    replay->stopped = false;
+
+    replay->cbs = cbs;
+
+    if (params->video) {
+        static const struct sc_packet_sink_ops video_ops = {
+            .open = sc_replay_buffer_video_packet_sink_open,
+            .close = sc_replay_buffer_video_packet_sink_close,
+            .push = sc_replay_buffer_video_packet_sink_push,
+        };
+
+        replay->video_packet_sink.ops = &video_ops;
+    }
+
+    if (params->audio) {
+        static const struct sc_packet_sink_ops audio_ops = {
+            .open = sc_replay_buffer_audio_packet_sink_open,
+            .close = sc_replay_buffer_audio_packet_sink_close,
+            .push = sc_replay_buffer_audio_packet_sink_push,
+            .disable = sc_replay_buffer_audio_packet_sink_disable,
+        };
+
+        replay->audio_packet_sink.ops = &audio_ops;
+    }
+
+    return true;
+}
+
+static enum sc_record_format
+sc_replay_buffer_get_format(const char *filename) {
+    const char *dot = strrchr(filename, '.');
+    if (dot) {
+        if (!strcmp(dot, ".mp4")) {
+            return SC_RECORD_FORMAT_MP4;
+        }
+        if (!strcmp(dot, ".mkv")) {
+            return SC_RECORD_FORMAT_MKV;
+        }
+    }
+
+    return SC_RECORD_FORMAT_AUTO; // unsupported
+}
+
+static char *
+sc_replay_buffer_generate_filename(void) {
+    // Matroska supports all the stream codecs
+    char name[64];
+    time_t now = time(NULL);
+    struct tm *tm = localtime(&now);
+    if (!tm || !strftime(name, sizeof(name),
+                         "scrcpy-replay-%Y%m%d-%H%M%S.mkv", tm)) {
+        LOGE("Could not generate replay file name");
+        return NULL;
+    }
+
+    char *filename = strdup(name);
+    if (!filename) {
+        LOG_OOM();
+    }
+    return filename;
+}
+
+static void
+sc_replay_buffer_dump_destroy(struct sc_replay_buffer_dump *dump) {
+    sc_replay_buffer_queue_clear(&dump->video_packets);
+    sc_vecdeque_destroy(&dump->video_packets);
+    sc_replay_buffer_queue_clear(&dump->audio_packets);
+    sc_vecdeque_destroy(&dump->audio_packets);
+    free(dump->filename);
+    free(dump);
+}
+
+// Must be called with the mutex locked
+static bool
+sc_replay_buffer_snapshot(struct sc_replay_buffer_stream *stream,
+                          struct sc_replay_buffer_queue *out) {
+    size_t size = sc_vecdeque_size(&stream->queue);
+    if (!sc_vecdeque_reserve(out, size + 1)) {
+        LOG_OOM();
+        return false;
+    }
+
+    if (stream->config) {
+        AVPacket *config = sc_replay_buffer_packet_ref(stream->config);
+        if (!config) {
+            return false;
+        }
+        sc_vecdeque_push_noresize(out, config);
+    }
+
+    for (size_t i = 0; i < size; ++i) {
+        AVPacket *p = sc_replay_buffer_packet_ref(QUEUE_AT(&stream->queue, i));
+        if (!p) {
+            return false;
+        }
+        sc_vecdeque_push_noresize(out, p);
+    }
+
+    return true;
+}
+
+static AVCodecContext *
+sc_replay_buffer_new_codec_context(const struct sc_replay_buffer_stream *stream) {
+    AVCodecContext *ctx = avcodec_alloc_context3(stream->codec);
+    if (!ctx) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    if (avcodec_parameters_to_context(ctx, stream->codecpar) < 0) {
+        avcodec_free_context(&ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+static bool
+sc_replay_buffer_open_sink(const struct sc_replay_buffer_stream *stream,
+                           struct sc_packet_sink *sink, AVCodecContext **pctx) {
+    AVCodecContext *ctx = sc_replay_buffer_new_codec_context(stream);
+    if (!ctx) {
+        return false;
+    }
+
+    if (!sink->ops->open(sink, ctx, NULL)) {
+        avcodec_free_context(&ctx);
+        return false;
+    }
+
+    // The codec context must be valid until the sink is closed
+    *pctx = ctx;
+    return true;
+}
+
+static bool
+sc_replay_buffer_push_all(struct sc_packet_sink *sink,
+                          struct sc_replay_buffer_queue *packets) {
+    while (!sc_vecdeque_is_empty(packets)) {
+        AVPacket *p = sc_vecdeque_pop(packets);
+        bool ok = sink->ops->push(sink, p);
+        av_packet_free(&p);
+        if (!ok) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void
+sc_replay_buffer_on_recorder_ended(struct sc_recorder *recorder, bool success,
+                                   void *userdata) {
+    (void) recorder;
+
+    struct sc_replay_buffer_dump *dump = userdata;
+    dump->success = success;
+}
+
+static bool
+sc_replay_buffer_write(struct sc_replay_buffer_dump *dump) {
+    struct sc_replay_buffer *replay = dump->replay;
+
+    static const struct sc_recorder_callbacks recorder_cbs = {
+        .on_ended = sc_replay_buffer_on_recorder_ended,
+    };
+
+    // The existing recorder muxes the packets, exactly as if they were
+    // received from the demuxers (config packets first)
+    struct sc_recorder recorder;
+    bool ok = sc_recorder_init(&recorder, dump->filename, dump->format,
+                               dump->video, dump->audio, replay->orientation,
+                               0, false, &recorder_cbs, dump);
+    if (!ok) {
+        return false;
+    }
+
+    ok = sc_recorder_start(&recorder);
+    if (!ok) {
+        sc_recorder_destroy(&recorder);
+        return false;
+    }
+
+    struct sc_packet_sink *video_sink = &recorder.video_packet_sink;
+    struct sc_packet_sink *audio_sink = &recorder.audio_packet_sink;
+    AVCodecContext *video_ctx = NULL;
+    AVCodecContext *audio_ctx = NULL;
+
+    // The codec parameters are never written once the stream is enabled
+    if (dump->video) {
+        ok = sc_replay_buffer_open_sink(&replay->video_stream, video_sink,
+                                        &video_ctx);
+    }
+    if (ok && dump->audio) {
+        ok = sc_replay_buffer_open_sink(&replay->audio_stream, audio_sink,
+                                        &audio_ctx);
+    }
+
+    if (ok && dump->video) {
+        ok = sc_replay_buffer_push_all(video_sink, &dump->video_packets);
+    }
+    if (ok && dump->audio) {
+        ok = sc_replay_buffer_push_all(audio_sink, &dump->audio_packets);
+    }
+
+    // Closing the sinks finishes the recording
+    if (video_ctx) {
+        video_sink->ops->close(video_sink);
+    }
+    if (audio_ctx) {
+        audio_sink->ops->close(audio_sink);
+    }
+    // In case a sink could not be opened
+    sc_recorder_stop(&recorder);
+
+    sc_recorder_join(&recorder);
+    sc_recorder_destroy(&recorder);
+
+    avcodec_free_context(&video_ctx);
+    avcodec_free_context(&audio_ctx);
+
+    return ok && dump->success;
+}
+
+static int
+run_replay_dump(void *data) {
+    struct sc_replay_buffer_dump *dump = data;
+    struct sc_replay_buffer *replay = dump->replay;
+
+    // Dumping is a background task
+    bool ok = sc_thread_set_priority(SC_THREAD_PRIORITY_LOW);
+    (void) ok; // We don't care if it worked
+
+    bool success = sc_replay_buffer_write(dump);
+    if (success) {
+        LOGI("Replay written to %s", dump->filename);
+    } else {
+        LOGE("Could not write replay to %s", dump->filename);
+    }
+
+    replay->cbs->on_dumped(replay, dump->filename, success, dump->userdata);
+
+    sc_replay_buffer_dump_destroy(dump);
+
+    sc_mutex_lock(&replay->mutex);
+    replay->dumping = false;
+    sc_cond_broadcast(&replay->dump_cond);
+    sc_mutex_unlock(&replay->mutex);
+
+    LOGD("Replay dump thread ended");
+
+    return 0;
+}
+
+bool
+sc_replay_buffer_dump(struct sc_replay_buffer *replay, const char *filename,
+                      void *userdata) {
+    struct sc_replay_buffer_dump *dump = malloc(sizeof(*dump));
+    if (!dump) {
+        LOG_OOM();
+        return false;
+    }
+
+    dump->replay = replay;
+    dump->userdata = userdata;
+    dump->success = false;
+    sc_vecdeque_init(&dump->video_packets);
+    sc_vecdeque_init(&dump->audio_packets);
+
+    if (filename) {
+        dump->filename = strdup(filename);
+        if (!dump->filename) {
+            LOG_OOM();
+        }
+    } else {
+        dump->filename = sc_replay_buffer_generate_filename();
+    }
+    if (!dump->filename) {
+        free(dump);
+        return false;
+    }
+
+    dump->format = sc_replay_buffer_get_format(dump->filename);
+    if (!dump->format) {
+        LOGE("Unsupported replay file extension (expected .mp4 or .mkv): %s",
+             dump->filename);
+        goto error;
+    }
+
+    sc_mutex_lock(&replay->mutex);
+
+    if (replay->stopped) {
+        goto error_unlock;
+    }
+
+    if (replay->dumping) {
+        LOGW("Replay dump already in progress");
+        goto error_unlock;
+    }
+
+    struct sc_replay_buffer_stream *video_stream = &replay->video_stream;
+    struct sc_replay_buffer_stream *audio_stream = &replay->audio_stream;
+    dump->video = video_stream->enabled
+               && !sc_vecdeque_is_empty(&video_stream->queue);
+    dump->audio = audio_stream->enabled
+               && !sc_vecdeque_is_empty(&audio_stream->queue);
+    if (!dump->video && !dump->audio) {
+        LOGW("Replay buffer is empty");
+        goto error_unlock;
+    }
+
+    // Only the references are copied, the lock is held for a short time
+    if (dump->video
+            && !sc_replay_buffer_snapshot(video_stream, &dump->video_packets)) {
+        goto error_unlock;
+    }
+    if (dump->audio
+            && !sc_replay_buffer_snapshot(audio_stream, &dump->audio_packets)) {
+        goto error_unlock;
+    }
+
+    if (replay->dump_thread_started) {
+        // The previous dump is complete (dumping is false), only its thread
+        // remains to be joined
+        sc_thread_join(&replay->dump_thread, NULL);
+        replay->dump_thread_started = false;
+    }
+
+    bool ok = sc_thread_create(&replay->dump_thread, run_replay_dump,
+                               "scrcpy-replay", dump);
+    if (!ok) {
+        LOGE("Could not start replay dump thread");
+        goto error_unlock;
+    }
+
+    replay->dumping = true;
+    replay->dump_thread_started = true;
+
+    sc_mutex_unlock(&replay->mutex);
+
+    LOGI("Writing replay to %s", dump->filename);
+    return true;
+
+error_unlock:
+    sc_mutex_unlock(&replay->mutex);
+error:
+    sc_replay_buffer_dump_destroy(dump);
+
+    return false;
+}
+
+void
+sc_replay_buffer_get_window(struct sc_replay_buffer *replay,
+                            sc_tick *duration, size_t *bytes) {
+    sc_mutex_lock(&replay->mutex);
+
+    struct sc_replay_buffer_queue *queue = &replay->video_stream.queue;
+    if (sc_vecdeque_is_empty(queue)) {
+        queue = &replay->audio_stream.queue;
+    }
+
+    *duration = sc_vecdeque_is_empty(queue)
+              ? 0
+              : QUEUE_BACK(queue)->pts - QUEUE_FRONT(queue)->pts;
+    *bytes = replay->bytes;
+
+    sc_mutex_unlock(&replay->mutex);
+}
+
+void
+sc_replay_buffer_stop(struct sc_replay_buffer *replay) {
+    sc_mutex_lock(&replay->mutex);
+    replay->stopped = true;
+    sc_mutex_unlock(&replay->mutex);
+}
+
+void
+sc_replay_buffer_join(struct sc_replay_buffer *replay) {
+    sc_mutex_lock(&replay->mutex);
+    while (replay->dumping) {
+        sc_cond_wait(&replay->dump_cond, &replay->mutex);
+    }
+    bool started = replay->dump_thread_started;
+    replay->dump_thread_started = false;
+    sc_mutex_unlock(&replay->mutex);
+
+    if (started) {
+        sc_thread_join(&replay->dump_thread, NULL);
+    }
+}
+
+void
+sc_replay_buffer_destroy(struct sc_replay_buffer *replay) {
+    assert(!replay->dump_thread_started);
+
+    sc_replay_buffer_stream_destroy(&replay->video_stream);
+    sc_replay_buffer_stream_destroy(&replay->audio_stream);
+    sc_vecdeque_destroy(&replay->keyframes);
+    sc_cond_destroy(&replay->dump_cond);
+    sc_mutex_destroy(&replay->mutex);
+}
@@ -0,0 +1,148 @@
+#ifndef SC_REPLAY_BUFFER_H
+#define SC_REPLAY_BUFFER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+
+#include "options.h"
+#include "recorder.h"
+#include "trait/packet_sink.h"
+#include "util/thread.h"
+#include "util/tick.h"
+#include "util/vecdeque.h"
+
+/**
+ * Instant replay buffer
+ *
+ * Packet sinks keeping the last encoded video and audio packets in memory, so
+ * that the last seconds can be written to a file on demand ("what just
+ * happened"), without recording the whole session.
+ *
+ * The packets are only referenced (they are never copied). The video window
+ * always starts on a key frame: the oldest GOP is dropped as soon as the
+ * remaining packets still cover the requested duration, or if the memory
+ * limit is exceeded. The audio packets older than the first video packet are
+ * dropped.
+ *
+ * A push only takes a reference under a mutex, so the demuxers are never
+ * blocked by a dump: the packets are muxed (by a sc_recorder) from a separate
+ * thread.
+ */
+
+struct sc_replay_buffer_queue SC_VECDEQUE(AVPacket *);
+
+struct sc_replay_buffer_stream {
+    // Set once the stream is open
+    bool enabled;
+
+    // Copied on open, to create the codec contexts of the dumps
+    const AVCodec *codec;
+    AVCodecParameters *codecpar;
+
+    // The last config packet, to write before the first packet of a dump
+    AVPacket *config;
+
+    struct sc_replay_buffer_queue queue;
+};
+
+struct sc_replay_buffer {
+    struct sc_packet_sink video_packet_sink;
+    struct sc_packet_sink audio_packet_sink;
+
+    bool video;
+    bool audio;
+    sc_tick max_duration;
+    size_t max_bytes;
+    enum sc_orientation orientation;
+
+    sc_mutex mutex;
+
+    struct sc_replay_buffer_stream video_stream;
+    struct sc_replay_buffer_stream audio_stream;
+
+    // The pts of the video key frames in the queue, in order
+    struct SC_VECDEQUE(int64_t) keyframes;
+    // Drop the video packets until the next key frame
+    bool wait_keyframe;
+    // The memory retained by the queued packets
+    size_t bytes;
+
+    // At most one dump at a time
+    sc_cond dump_cond;
+    bool dumping;
+    bool dump_thread_started;
+    sc_thread dump_thread;
+    // Set on sc_replay_buffer_stop(), reject any new dump
+    bool stopped;
+
+    const struct sc_replay_buffer_callbacks *cbs;
+};
+
+struct sc_replay_buffer_callbacks {
+    /**
+     * Called from the dump thread once the file is written (or failed)
+     *
+     * The userdata is the one passed to sc_replay_buffer_dump().
+     */
+    void (*on_dumped)(struct sc_replay_buffer *replay, const char *filename,
+                      bool success, void *userdata);
+};
+
+struct sc_replay_buffer_params {
+    bool video;
+    bool audio;
+    sc_tick max_duration;
+    size_t max_bytes;
+    enum sc_orientation orientation; // applied to the dumped files
+};
+
+bool
+sc_replay_buffer_init(struct sc_replay_buffer *replay,
+                      const struct sc_replay_buffer_params *params,
+                      const struct sc_replay_buffer_callbacks *cbs);
+
+/**
+ * Write the current window to a file from a separate thread
+ *
+ * The format is determined by the file extension (mp4 or mkv). If filename is
+ * NULL, a name based on the current date is generated (in the current
+ * directory).
+ *
+ * Return false if the dump could not be started (a dump is already in
+ * progress, the buffer is empty, etc.). In that case, on_dumped() is not
+ * called.
+ */
+bool
+sc_replay_buffer_dump(struct sc_replay_buffer *replay, const char *filename,
+                      void *userdata);
+
+/**
+ * Get the duration and the memory of the current window
+ *
+ * The duration is the difference between the pts of the last and the first
+ * video packets (or audio packets if there is no video).
+ */
+void
+sc_replay_buffer_get_window(struct sc_replay_buffer *replay,
+                            sc_tick *duration, size_t *bytes);
+
+/**
+ * Reject any new dump
+ */
+void
+sc_replay_buffer_stop(struct sc_replay_buffer *replay);
+
+/**
+ * Wait for the current dump (if any) to complete
+ */
+void
+sc_replay_buffer_join(struct sc_replay_buffer *replay);
+
+void
+sc_replay_buffer_destroy(struct sc_replay_buffer *replay);
+
+#endif
@@ -15,14 +15,17 @@
 #endif
 
 #include "audio_player.h"
+#include "catchup.h"
 #include "controller.h"
 #include "decoder.h"
 #include "demuxer.h"
 #include "events.h"
 #include "file_pusher.h"
 #include "keyboard_sdk.h"
+#include "latency_stats.h"
 #include "mouse_sdk.h"
 #include "recorder.h"
+#include "replay_buffer.h"
 #include "screen.h"
 #include "sdl_hints.h"
 #include "server.h"
@@ -37,9 +40,11 @@
 #include "usb/usb.h"
 #endif
 #include "util/acksync.h"
+#include "util/file.h"
 #include "util/log.h"
 #include "util/rand.h"
 #include "util/str.h"
+#include "util/stream_capture.h"
 #include "util/term.h"
 #include "util/timeout.h"
 #include "util/tick.h"
@@ -54,6 +59,7 @@
 // LinkAndroid: WebSocket event forwarding
 #include "input_manager.h"
 #include "../linkandroid/src/preview_sender.h"
+#include "../linkandroid/src/screenshot.h"
 
 struct scrcpy
 {
@@ -65,7 +71,15 @@ struct scrcpy
     struct sc_decoder video_decoder;
     struct sc_decoder audio_decoder;
     struct sc_recorder recorder;
+    struct sc_replay_buffer replay_buffer;
     struct sc_video_regulator video_regulator;
+    // --capture-stream and --replay-stream
+    struct sc_stream_capture video_capture;
+    struct sc_stream_capture audio_capture;
+    struct sc_stream_replay video_replay;
+    struct sc_stream_replay audio_replay;
+    struct sc_latency_stats latency_stats;
+    struct sc_catchup video_catchup;
 #ifdef HAVE_V4L2
     struct sc_v4l2_sink v4l2_sink;
     struct sc_video_regulator v4l2_regulator;
@@ -105,6 +119,8 @@ struct scrcpy
     struct sc_timeout timeout;
     // LinkAndroid: Preview sender
     struct la_preview_sender preview_sender;
+    // LinkAndroid: Screenshots requested via WebSocket
+    struct la_screenshot screenshot;
 };
 
 #ifdef _WIN32
@@ -195,6 +211,43 @@ await_for_server(bool *connected)
     return false;
 }
 
+static bool
+scrcpy_open_capture(struct sc_stream_capture *capture, const char *dir,
+                    const char *filename, const char *device_name,
+                    sc_tick start)
+{
+    char *path = sc_file_build_path(dir, filename);
+    if (!path)
+    {
+        LOG_OOM();
+        return false;
+    }
+
+    bool ok = sc_stream_capture_init(capture, path, device_name, start);
+    if (ok)
+    {
+        LOGI("Capturing stream to %s", path);
+    }
+    free(path);
+    return ok;
+}
+
+static bool
+scrcpy_open_replay(struct sc_stream_replay *replay, const char *dir,
+                   const char *filename, bool max_speed)
+{
+    char *path = sc_file_build_path(dir, filename);
+    if (!path)
+    {
+        LOG_OOM();
+        return false;
+    }
+
+    bool ok = sc_stream_replay_init(replay, path, max_speed);
+    free(path);
+    return ok;
+}
+
 static void
 sc_recorder_on_ended(struct sc_recorder *recorder, bool success,
                      void *userdata)
@@ -267,6 +320,22 @@ sc_controller_on_ended(struct sc_controller *controller, bool error,
     }
 }
 
+static void
+sc_video_catchup_on_request_key_frame(struct sc_catchup *catchup,
+                                      void *userdata)
+{
+    (void)catchup;
+    struct sc_controller *controller = userdata;
+
+    struct sc_control_msg msg;
+    msg.type = SC_CONTROL_MSG_TYPE_RESET_VIDEO;
+
+    if (!sc_controller_push_msg(controller, &msg))
+    {
+        LOGW("Could not request a video key frame");
+    }
+}
+
 static void
 sc_server_on_connection_failed(struct sc_server *server, void *userdata)
 {
@@ -392,11 +461,18 @@ scrcpy(struct scrcpy_options *options)
     bool file_pusher_initialized = false;
     bool recorder_initialized = false;
     bool recorder_started = false;
+    bool replay_buffer_initialized = false;
 #ifdef HAVE_V4L2
     bool v4l2_sink_initialized = false;
 #endif
     bool video_demuxer_started = false;
     bool audio_demuxer_started = false;
+    bool video_capture_initialized = false;
+    bool audio_capture_initialized = false;
+    bool video_replay_initialized = false;
+    bool audio_replay_initialized = false;
+    bool latency_stats_initialized = false;
+    bool video_catchup_initialized = false;
 #ifdef HAVE_USB
     bool aoa_hid_initialized = false;
     bool keyboard_aoa_initialized = false;
@@ -409,7 +485,7 @@ scrcpy(struct scrcpy_options *options)
     bool timeout_initialized = false;
     bool timeout_started = false;
     bool preview_sender_initialized = false;
-    bool preview_sender_started = false;
+    bool screenshot_initialized = false;
     bool disconnected = false;
 
     struct sc_acksync *acksync = NULL;
@@ -506,12 +582,16 @@ scrcpy(struct scrcpy_options *options)
     // SDL_HINT_RENDER_BATCHING was removed in SDL3; batching is always enabled.
 #endif
 
-    if (!sc_server_start(&s->server))
+    // On replay, there is no device: adb and the server are not used
+    if (!options->replay_stream)
     {
-        goto end;
-    }
+        if (!sc_server_start(&s->server))
+        {
+            goto end;
+        }
 
-    server_started = true;
+        server_started = true;
+    }
 
     if (options->list)
     {
@@ -559,37 +639,121 @@ scrcpy(struct scrcpy_options *options)
         }
     }
 
-    // Await for server without blocking Ctrl+C handling
-    bool connected;
-    if (!await_for_server(&connected))
-    {
-        LOGE("Server connection failed");
-        goto end;
-    }
+    const char *device_name;
+    const char *serial = NULL;
 
-    if (!connected)
+    if (options->replay_stream)
     {
-        // This is not an error, user requested to quit
-        LOGD("User requested to quit");
-        ret = SCRCPY_EXIT_SUCCESS;
-        goto end;
+        // The streams are read from the files written by --capture-stream
+        bool max_speed = options->replay_stream_max_speed;
+        if (options->video)
+        {
+            if (!scrcpy_open_replay(&s->video_replay, options->replay_stream,
+                                    "video.capture", max_speed))
+            {
+                LOGE("Could not open the captured video stream in %s (use "
+                     "--no-video if it was not captured)",
+                     options->replay_stream);
+                goto end;
+            }
+            video_replay_initialized = true;
+        }
+
+        if (options->audio)
+        {
+            if (scrcpy_open_replay(&s->audio_replay, options->replay_stream,
+                                   "audio.capture", max_speed))
+            {
+                audio_replay_initialized = true;
+            }
+            else
+            {
+                LOGW("No captured audio stream: audio disabled");
+                options->audio = false;
+                options->audio_playback = false;
+            }
+        }
+
+        if (!video_replay_initialized && !audio_replay_initialized)
+        {
+            LOGE("Nothing to replay");
+            goto end;
+        }
+
+        device_name = video_replay_initialized
+                    ? s->video_replay.device_name
+                    : s->audio_replay.device_name;
+        LOGI("Replaying %s (captured from %s)", options->replay_stream,
+             device_name);
     }
+    else
+    {
+        // Await for server without blocking Ctrl+C handling
+        bool connected;
+        if (!await_for_server(&connected))
+        {
+            LOGE("Server connection failed");
+            goto end;
+        }
+
+        if (!connected)
+        {
+            // This is not an error, user requested to quit
+            LOGD("User requested to quit");
+            ret = SCRCPY_EXIT_SUCCESS;
+            goto end;
+        }
 
-    LOGD("Server connected");
+        LOGD("Server connected");
 
-    // It is necessarily initialized here, since the device is connected
-    struct sc_server_info *info = &s->server.info;
+        // It is necessarily initialized here, since the device is connected
+        device_name = s->server.info.device_name;
+
+        serial = s->server.serial;
+        assert(serial);
+    }
 
     const char *window_title =
-        options->window_title ? options->window_title : info->device_name;
+        options->window_title ? options->window_title : device_name;
     assert(window_title);
 
     if (options->update_terminal_title) {
         set_terminal_title_with_prefix(window_title);
     }
 
-    const char *serial = s->server.serial;
-    assert(serial);
+    if (options->capture_stream)
+    {
+        if (!sc_file_create_dir(options->capture_stream))
+        {
+            LOGE("Could not create capture directory: %s",
+                 options->capture_stream);
+            goto end;
+        }
+
+        // Shared by the captures, so that the streams are replayed in sync
+        sc_tick start = sc_tick_now();
+        if (options->video)
+        {
+            if (!scrcpy_open_capture(&s->video_capture,
+                                     options->capture_stream, "video.capture",
+                                     device_name, start))
+            {
+                goto end;
+            }
+            video_capture_initialized = true;
+        }
+
+        if (options->audio)
+        {
+            if (!scrcpy_open_capture(&s->audio_capture,
+                                     options->capture_stream, "audio.capture",
+                                     device_name, start))
+            {
+                goto end;
+            }
+            audio_capture_initialized = true;
+        }
+    }
 
     struct sc_file_pusher *fp = NULL;
 
@@ -602,13 +766,42 @@ scrcpy(struct scrcpy_options *options)
         file_pusher_initialized = true;
     }
 
+    // Reported by the video demuxer, decoder and screen (NULL if disabled)
+    struct sc_latency_stats *latency_stats = NULL;
+    if (options->latency_stats)
+    {
+        if (!sc_latency_stats_init(&s->latency_stats,
+                                   options->latency_stats_interval))
+        {
+            goto end;
+        }
+        latency_stats_initialized = true;
+        latency_stats = &s->latency_stats;
+
+        // Queried on a WebSocket request
+        sc_input_manager_set_latency_stats(latency_stats);
+    }
+
     if (options->video)
     {
         static const struct sc_demuxer_callbacks video_demuxer_cbs = {
             .on_ended = sc_video_demuxer_on_ended,
         };
-        sc_demuxer_init(&s->video_demuxer, "video", s->server.video_socket,
-                        &video_demuxer_cbs, NULL);
+        if (video_replay_initialized)
+        {
+            sc_demuxer_init_replay(&s->video_demuxer, "video",
+                                   &s->video_replay, &video_demuxer_cbs, NULL);
+        }
+        else
+        {
+            sc_demuxer_init(&s->video_demuxer, "video",
+                            s->server.video_socket, &video_demuxer_cbs, NULL);
+        }
+        if (video_capture_initialized)
+        {
+            sc_demuxer_set_capture(&s->video_demuxer, &s->video_capture);
+        }
+        sc_demuxer_set_latency_stats(&s->video_demuxer, latency_stats);
     }
 
     if (options->audio)
@@ -616,8 +809,22 @@ scrcpy(struct scrcpy_options *options)
         static const struct sc_demuxer_callbacks audio_demuxer_cbs = {
             .on_ended = sc_audio_demuxer_on_ended,
         };
-        sc_demuxer_init(&s->audio_demuxer, "audio", s->server.audio_socket,
-                        &audio_demuxer_cbs, options);
+        if (audio_replay_initialized)
+        {
+            sc_demuxer_init_replay(&s->audio_demuxer, "audio",
+                                   &s->audio_replay, &audio_demuxer_cbs,
+                                   options);
+        }
+        else
+        {
+            sc_demuxer_init(&s->audio_demuxer, "audio",
+                            s->server.audio_socket, &audio_demuxer_cbs,
+                            options);
+        }
+        if (audio_capture_initialized)
+        {
+            sc_demuxer_set_capture(&s->audio_demuxer, &s->audio_capture);
+        }
     }
 
     // LinkAndroid: Video decoder is needed for playback OR for preview sending
@@ -627,15 +834,22 @@ scrcpy(struct scrcpy_options *options)
 #ifdef HAVE_V4L2
     needs_video_decoder |= !!options->v4l2_device;
 #endif
+    // Must outlive the video decoder
+    const struct sc_decoder_params video_decoder_params = {
+        .threads = options->video_decoder_threads,
+        .thread_type = options->video_decoder_thread_type,
+        .hwaccel = options->video_decoder_hwaccel,
+    };
     if (needs_video_decoder)
     {
-        sc_decoder_init(&s->video_decoder, "video");
+        sc_decoder_init(&s->video_decoder, "video", &video_decoder_params);
+        sc_decoder_set_latency_stats(&s->video_decoder, latency_stats);
         sc_packet_source_add_sink(&s->video_demuxer.packet_source,
                                   &s->video_decoder.packet_sink);
     }
     if (needs_audio_decoder)
     {
-        sc_decoder_init(&s->audio_decoder, "audio");
+        sc_decoder_init(&s->audio_decoder, "audio", NULL);
         sc_packet_source_add_sink(&s->audio_demuxer.packet_source,
                                   &s->audio_decoder.packet_sink);
     }
@@ -648,7 +862,9 @@ scrcpy(struct scrcpy_options *options)
         if (!sc_recorder_init(&s->recorder, options->record_filename,
                               options->record_format, options->video,
                               options->audio, options->record_orientation,
-                              &recorder_cbs, NULL))
+                              options->record_segment_time,
+                              options->record_fragmented, &recorder_cbs,
+                              NULL))
         {
             goto end;
         }
@@ -672,6 +888,58 @@ scrcpy(struct scrcpy_options *options)
         }
     }
 
+    if (options->replay_buffer)
+    {
+        static const struct sc_replay_buffer_callbacks replay_buffer_cbs = {
+            .on_dumped = sc_input_manager_on_replay_dumped,
+        };
+        const struct sc_replay_buffer_params replay_buffer_params = {
+            .video = options->video,
+            .audio = options->audio,
+            .max_duration = options->replay_buffer,
+            .max_bytes = (size_t) options->replay_buffer_size << 20,
+            .orientation = options->record_orientation,
+        };
+        if (!sc_replay_buffer_init(&s->replay_buffer, &replay_buffer_params,
+                                   &replay_buffer_cbs))
+        {
+            goto end;
+        }
+        replay_buffer_initialized = true;
+
+        // Written on a WebSocket request
+        sc_input_manager_set_replay_buffer(&s->replay_buffer);
+
+        if (options->video)
+        {
+            sc_packet_source_add_sink(&s->video_demuxer.packet_source,
+                                      &s->replay_buffer.video_packet_sink);
+        }
+        if (options->audio)
+        {
+            sc_packet_source_add_sink(&s->audio_demuxer.packet_source,
+                                      &s->replay_buffer.audio_packet_sink);
+        }
+    }
+
+    // LinkAndroid: Screenshots of the decoded frames, on WebSocket requests
+    // (unavailable if the video is not decoded)
+    if (options->linkandroid_server && needs_video_decoder)
+    {
+        static const struct la_screenshot_callbacks screenshot_cbs = {
+            .on_screenshot = sc_input_manager_on_screenshot,
+        };
+        if (!la_screenshot_init(&s->screenshot, &screenshot_cbs, NULL))
+        {
+            goto end;
+        }
+        screenshot_initialized = true;
+
+        sc_input_manager_set_screenshot(&s->screenshot);
+        sc_frame_source_add_sink(&s->video_decoder.frame_source,
+                                 &s->screenshot.frame_sink);
+    }
+
     struct sc_controller *controller = NULL;
     struct sc_key_processor *kp = NULL;
     struct sc_mouse_processor *mp = NULL;
@@ -866,13 +1134,23 @@ scrcpy(struct scrcpy_options *options)
     // There is a controller if and only if control is enabled
     assert(options->control == !!controller);
 
-    if (options->window) {
-        // LinkAndroid: Screen needs video=true if either playback or preview is enabled
-        bool screen_needs_video = options->video_playback ||
-                                  (options->linkandroid_server && options->linkandroid_preview_interval > 0);
+    if (options->video_catch_up && needs_video_decoder)
+    {
+        static const struct sc_catchup_callbacks catchup_cbs = {
+            .on_request_key_frame = sc_video_catchup_on_request_key_frame,
+        };
+        // Without control, wait for the next key frame of the encoder
+        sc_catchup_init(&s->video_catchup, options->video_catch_up,
+                        controller ? &catchup_cbs : NULL, controller);
+        video_catchup_initialized = true;
+
+        sc_demuxer_set_catchup(&s->video_demuxer, &s->video_catchup);
+        sc_decoder_set_catchup(&s->video_decoder, &s->video_catchup);
+    }
 
+    if (options->window) {
         struct sc_screen_params screen_params = {
-            .video = screen_needs_video,
+            .video = options->video_playback,
             .camera = options->video_source == SC_VIDEO_SOURCE_CAMERA,
             .flex_display = options->flex_display,
             .controller = controller,
@@ -898,6 +1176,7 @@ scrcpy(struct scrcpy_options *options)
             .mipmaps = options->mipmaps,
             .fullscreen = options->fullscreen,
             .start_fps_counter = options->start_fps_counter,
+            .latency_stats = latency_stats,
             .panel_show = options->linkandroid_panel_show,
             // LinkAndroid: Hide window if preview is enabled but video playback is disabled
             .hide_window = !options->video_playback && options->linkandroid_preview_interval > 0,
@@ -908,26 +1187,45 @@ scrcpy(struct scrcpy_options *options)
         }
         screen_initialized = true;
 
-        // LinkAndroid: Initialize WebSocket client for event forwarding
-        if (options->linkandroid_server) {
-            sc_input_manager_init_websocket(&s->screen.im, options->linkandroid_server);
-        }
-
-        // LinkAndroid: Connect video frames to screen if video playback is enabled
-        // OR if preview sender is enabled (so it can capture frames)
-        bool need_screen_frames = options->video_playback ||
-                                  (options->linkandroid_server && options->linkandroid_preview_interval > 0);
-
-        if (need_screen_frames) {
+        // LinkAndroid: The preview sender is a separate frame sink, the screen
+        // only needs the frames for video playback
+        if (options->video_playback) {
             struct sc_frame_source *src = &s->video_decoder.frame_source;
-            if (options->video_buffer) {
+            if (options->video_buffer_adaptive) {
+                sc_video_regulator_init_adaptive(&s->video_regulator,
+                                                 options->video_buffer_min,
+                                                 options->video_buffer_max,
+                                                 true);
+                sc_frame_source_add_sink(src, &s->video_regulator.frame_sink);
+                src = &s->video_regulator.frame_source;
+            } else if (options->video_buffer) {
                 sc_video_regulator_init(&s->video_regulator,
                                         options->video_buffer, true);
                 sc_frame_source_add_sink(src, &s->video_regulator.frame_sink);
                 src = &s->video_regulator.frame_source;
             }
             sc_frame_source_add_sink(src, &s->screen.frame_sink);
+
+            if (options->video_buffer_adaptive || options->video_buffer) {
+                // Queried on a WebSocket request
+                sc_input_manager_set_video_regulator(&s->video_regulator);
+            }
         }
+
+        // LinkAndroid: Initialize WebSocket client for event forwarding
+        if (options->linkandroid_server) {
+            sc_input_manager_init_websocket(&s->screen.im, options->linkandroid_server,
+                                            options->linkandroid_coalesce_window);
+        }
+    } else if (options->linkandroid_server) {
+        // LinkAndroid: Headless mode (--no-window): no screen, no SDL window
+        // and no renderer. The decoder only feeds the preview sender (and the
+        // v4l2 sink if any), and the WebSocket client only forwards control
+        // messages and previews.
+        LOGI("LinkAndroid headless mode");
+        sc_input_manager_init_websocket_headless(controller,
+                                                 options->linkandroid_server,
+                                                 options->linkandroid_coalesce_window);
     }
 
     // LinkAndroid: Initialize preview sender if enabled
@@ -936,19 +1234,36 @@ scrcpy(struct scrcpy_options *options)
         // Get the global websocket client
         extern struct la_websocket_client *g_websocket_client;
 
-        if (g_websocket_client && screen_initialized)
+        if (g_websocket_client)
         {
+            struct la_preview_sender_params params = {
+                .interval_ms = options->linkandroid_preview_interval,
+                .ratio = options->linkandroid_preview_ratio,
+                .binary = options->linkandroid_preview_transport
+                       == SC_LINKANDROID_PREVIEW_TRANSPORT_BINARY,
+                .format = la_preview_format_from_option(
+                              options->linkandroid_preview_format),
+                .quality = options->linkandroid_preview_quality,
+                .tiles = options->linkandroid_preview_tiles,
+                .keyframe_interval_ms =
+                    options->linkandroid_preview_keyframe_interval,
+                .max_staleness_ms =
+                    options->linkandroid_preview_max_staleness,
+            };
             bool ok = la_preview_sender_init(&s->preview_sender,
                                              g_websocket_client,
-                                             &s->screen,
-                                             options->linkandroid_preview_interval,
-                                             options->linkandroid_preview_ratio);
+                                             &params);
             if (ok)
             {
+                // Receive the decoded frames directly (not regulated by
+                // --video-buffer), independently of the screen
+                sc_frame_source_add_sink(&s->video_decoder.frame_source,
+                                         &s->preview_sender.frame_sink);
                 preview_sender_initialized = true;
-                LOGI("LinkAndroid preview sender initialized (interval: %u ms, ratio: %u%%)",
+                LOGI("LinkAndroid preview sender initialized (interval: %u ms, ratio: %u%%, format: %s)",
                      options->linkandroid_preview_interval,
-                     options->linkandroid_preview_ratio);
+                     options->linkandroid_preview_ratio,
+                     la_preview_format_name(params.format));
             }
             else
             {
@@ -957,7 +1272,7 @@ scrcpy(struct scrcpy_options *options)
         }
         else
         {
-            LOGW("Cannot initialize preview sender: WebSocket client or screen not available");
+            LOGW("Cannot initialize preview sender: WebSocket client not available");
         }
     }
 
@@ -994,6 +1309,20 @@ scrcpy(struct scrcpy_options *options)
     // Now that the header values have been consumed, the socket(s) will
     // receive the stream(s). Start the demuxer(s).
 
+    if (options->replay_stream)
+    {
+        // The captured arrival times are relative to this instant
+        sc_tick start = sc_tick_now();
+        if (video_replay_initialized)
+        {
+            sc_stream_replay_start(&s->video_replay, start);
+        }
+        if (audio_replay_initialized)
+        {
+            sc_stream_replay_start(&s->audio_replay, start);
+        }
+    }
+
     if (options->video)
     {
         if (!sc_demuxer_start(&s->video_demuxer))
@@ -1012,20 +1341,6 @@ scrcpy(struct scrcpy_options *options)
         audio_demuxer_started = true;
     }
 
-    // LinkAndroid: Start preview sender after demuxers are started
-    if (preview_sender_initialized)
-    {
-        if (la_preview_sender_start(&s->preview_sender))
-        {
-            preview_sender_started = true;
-            LOGI("LinkAndroid preview sender started");
-        }
-        else
-        {
-            LOGW("Failed to start preview sender");
-        }
-    }
-
     // If the device screen is to be turned off, send the control message after
     // everything is set up
     if (options->control && options->turn_screen_off)
@@ -1103,12 +1418,6 @@ scrcpy(struct scrcpy_options *options)
     disconnected = ret == SCRCPY_EXIT_DISCONNECTED;
 
 end:
-    // LinkAndroid: Stop preview sender before other cleanup
-    if (preview_sender_started)
-    {
-        la_preview_sender_stop(&s->preview_sender);
-    }
-
     if (timeout_started)
     {
         sc_timeout_stop(&s->timeout);
@@ -1144,6 +1453,14 @@ end:
         // shutdown the sockets and kill the server
         sc_server_stop(&s->server);
     }
+    if (video_replay_initialized)
+    {
+        sc_stream_replay_interrupt(&s->video_replay);
+    }
+    if (audio_replay_initialized)
+    {
+        sc_stream_replay_interrupt(&s->audio_replay);
+    }
 
     if (screen_initialized) {
         if (disconnected) {
@@ -1176,6 +1493,24 @@ end:
         sc_demuxer_join(&s->audio_demuxer);
     }
 
+    // The demuxers do not access the captures and replays anymore
+    if (video_capture_initialized)
+    {
+        sc_stream_capture_destroy(&s->video_capture);
+    }
+    if (audio_capture_initialized)
+    {
+        sc_stream_capture_destroy(&s->audio_capture);
+    }
+    if (video_replay_initialized)
+    {
+        sc_stream_replay_destroy(&s->video_replay);
+    }
+    if (audio_replay_initialized)
+    {
+        sc_stream_replay_destroy(&s->audio_replay);
+    }
+
 #ifdef HAVE_V4L2
     if (v4l2_sink_initialized)
     {
@@ -1247,7 +1582,16 @@ end:
 
     sc_server_destroy(&s->server);
 
-    // LinkAndroid: Destroy preview sender
+    // Wait for the replay being written (if any) while the WebSocket client
+    // can still report it
+    if (replay_buffer_initialized)
+    {
+        sc_replay_buffer_stop(&s->replay_buffer);
+        sc_replay_buffer_join(&s->replay_buffer);
+    }
+
+    // LinkAndroid: Destroy preview sender (its frame sink has been closed by
+    // the video decoder, once the video demuxer has been joined)
     if (preview_sender_initialized)
     {
         la_preview_sender_destroy(&s->preview_sender);
@@ -1256,5 +1600,32 @@ end:
     // LinkAndroid: Cleanup WebSocket client
     sc_input_manager_cleanup_websocket();
 
+    // Its frame sink has been closed by the video decoder, and the pending
+    // requests have been answered
+    if (screenshot_initialized)
+    {
+        la_screenshot_destroy(&s->screenshot);
+    }
+
+    // Destroyed after the WebSocket client, which may still query it (the
+    // demuxer and the screen have been joined)
+    if (latency_stats_initialized)
+    {
+        sc_latency_stats_destroy(&s->latency_stats);
+    }
+
+    // The video demuxer has been joined
+    if (video_catchup_initialized)
+    {
+        sc_catchup_destroy(&s->video_catchup);
+    }
+
+    // Destroyed after the WebSocket client, which may still request a replay
+    // (rejected once stopped)
+    if (replay_buffer_initialized)
+    {
+        sc_replay_buffer_destroy(&s->replay_buffer);
+    }
+
     return ret;
 }
@@ -17,6 +17,7 @@
 #include "options.h"
 #include "util/log.h"
 #include "util/sdl.h"
+#include "util/trace.h"
 
 // LinkAndroid: WebSocket event forwarding
 #include "input_manager.h"
@@ -323,6 +324,8 @@ sc_screen_render(struct sc_screen *screen, bool update_content_rect) {
         return;
     }
 
+    sc_tick trace_start = sc_trace_begin();
+
     if (update_content_rect || screen->panel_layout_dirty)
     {
         screen->panel_layout_dirty = false;
@@ -392,6 +395,7 @@ sc_screen_render(struct sc_screen *screen, bool update_content_rect) {
     }
 
     sc_sdl_render_present(renderer);
+    sc_trace_end("render", trace_start);
 
     // LinkAndroid: Send ready event after the first frame is completely rendered
     if (!screen->ready_event_sent && texture && g_websocket_client)
@@ -681,6 +685,11 @@ sc_screen_frame_sink_push(struct sc_frame_sink *sink, const AVFrame *frame)
 {
     struct sc_screen *screen = DOWNCAST(sink);
 
+    if (screen->latency_stats) {
+        // Before the frame may be consumed (and presented) by the main thread
+        sc_latency_stats_on_pushed(screen->latency_stats, frame->pts);
+    }
+
     sc_mutex_lock(&screen->mutex);
     bool previous_skipped = sc_frame_buffer_has_frame(&screen->fb);
     bool ok = sc_frame_buffer_push(&screen->fb, frame);
@@ -764,6 +773,7 @@ sc_screen_init(struct sc_screen *screen,
     screen->req.fullscreen = params->fullscreen;
     screen->req.start_fps_counter = params->start_fps_counter;
     screen->req.hide_window = params->hide_window;
+    screen->latency_stats = params->latency_stats;
 
     screen->prevent_auto_resize = false;
 
@@ -1465,12 +1475,19 @@ sc_screen_apply_frame(struct sc_screen *screen, bool can_resize) {
         sc_screen_update_content_rect(screen);
     }
 
+    sc_tick trace_start = sc_trace_begin();
     bool ok = sc_texture_set_from_frame(&screen->tex, frame);
+    sc_trace_end("texture upload", trace_start);
     if (!ok) {
         return false;
     }
 
     sc_screen_render(screen, false);
+
+    if (screen->latency_stats) {
+        sc_latency_stats_on_presented(screen->latency_stats, frame->pts);
+    }
+
     return true;
 }
 
@@ -16,6 +16,7 @@
 #include "fps_counter.h"
 #include "frame_buffer.h"
 #include "input_manager.h"
+#include "latency_stats.h"
 #include "mouse_capture.h"
 #include "options.h"
 #include "texture.h"
@@ -74,6 +75,7 @@ struct sc_screen
     struct sc_input_manager im;
     struct sc_mouse_capture mc; // only used in mouse relative mode
     struct sc_fps_counter fps_counter;
+    struct sc_latency_stats *latency_stats; // NULL if disabled
 
     struct sc_mutex mutex;
     struct sc_frame_buffer fb; // protected by mutex
@@ -190,6 +192,7 @@ struct sc_screen_params
 
     bool fullscreen;
     bool start_fps_counter;
+    struct sc_latency_stats *latency_stats; // NULL if disabled
 
     bool panel_show;  // Enable panel area (shown/hidden dynamically via WebSocket)
     bool hide_window; // LinkAndroid: Keep window hidden (for preview-only mode)
@@ -1,5 +1,6 @@
 #include "util/file.h"
 
+#include <errno.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -94,3 +95,17 @@ sc_file_is_regular(const char *path) {
     return S_ISREG(path_stat.st_mode);
 }
 
+
+FILE *
+sc_file_open(const char *path, const char *mode) {
+    return fopen(path, mode);
+}
+
+bool
+sc_file_create_dir(const char *path) {
+    if (mkdir(path, 0755) && errno != EEXIST) {
+        perror("mkdir");
+        return false;
+    }
+    return true;
+}
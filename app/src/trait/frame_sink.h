@@ -15,6 +15,11 @@
  */
 struct sc_frame_sink {
     const struct sc_frame_sink_ops *ops;
+
+    // Private, linked by the frame source (a sink may only be added to a
+    // single source)
+    struct sc_frame_sink *prev;
+    struct sc_frame_sink *next;
 };
 
 struct sc_frame_sink_ops {
@@ -29,6 +34,13 @@ struct sc_frame_sink_ops {
      */
     bool (*push_session)(struct sc_frame_sink *sink,
                          const struct sc_stream_session *session);
+
+    /**
+     * If set, the sink accepts frames in hardware memory (hwaccel decoding),
+     * and downloads them by itself if needed. Otherwise, it always receives
+     * YUV420P frames in CPU memory.
+     */
+    bool accept_hw_frames;
 };
 
 #endif
@@ -4,24 +4,38 @@
 
 void
 sc_frame_source_init(struct sc_frame_source *source) {
+    source->first_sink = NULL;
+    source->last_sink = NULL;
     source->sink_count = 0;
 }
 
 void
 sc_frame_source_add_sink(struct sc_frame_source *source,
                          struct sc_frame_sink *sink) {
-    assert(source->sink_count < SC_FRAME_SOURCE_MAX_SINKS);
     assert(sink);
     assert(sink->ops);
-    source->sinks[source->sink_count++] = sink;
+    assert(sink != source->last_sink);
+
+    sink->prev = source->last_sink;
+    sink->next = NULL;
+    if (source->last_sink) {
+        source->last_sink->next = sink;
+    } else {
+        source->first_sink = sink;
+    }
+    source->last_sink = sink;
+    ++source->sink_count;
 }
 
+// Close the sinks added before the given one (or all the sinks if end is
+// NULL), in reverse order
 static void
-sc_frame_source_sinks_close_firsts(struct sc_frame_source *source,
-                                    unsigned count) {
-    while (count) {
-        struct sc_frame_sink *sink = source->sinks[--count];
+sc_frame_source_sinks_close_before(struct sc_frame_source *source,
+                                   struct sc_frame_sink *end) {
+    struct sc_frame_sink *sink = end ? end->prev : source->last_sink;
+    while (sink) {
         sink->ops->close(sink);
+        sink = sink->prev;
     }
 }
 
@@ -30,10 +44,9 @@ sc_frame_source_sinks_open(struct sc_frame_source *source,
                            const AVCodecContext *ctx,
                            const struct sc_stream_session *session) {
     assert(source->sink_count);
-    for (unsigned i = 0; i < source->sink_count; ++i) {
-        struct sc_frame_sink *sink = source->sinks[i];
+    sc_frame_source_foreach_sink(source, sink) {
         if (!sink->ops->open(sink, ctx, session)) {
-            sc_frame_source_sinks_close_firsts(source, i);
+            sc_frame_source_sinks_close_before(source, sink);
             return false;
         }
     }
@@ -44,15 +57,14 @@ sc_frame_source_sinks_open(struct sc_frame_source *source,
 void
 sc_frame_source_sinks_close(struct sc_frame_source *source) {
     assert(source->sink_count);
-    sc_frame_source_sinks_close_firsts(source, source->sink_count);
+    sc_frame_source_sinks_close_before(source, NULL);
 }
 
 bool
 sc_frame_source_sinks_push(struct sc_frame_source *source,
                             const AVFrame *frame) {
     assert(source->sink_count);
-    for (unsigned i = 0; i < source->sink_count; ++i) {
-        struct sc_frame_sink *sink = source->sinks[i];
+    sc_frame_source_foreach_sink(source, sink) {
         if (!sink->ops->push(sink, frame)) {
             return false;
         }
@@ -65,8 +77,7 @@ bool
 sc_frame_source_sinks_push_session(struct sc_frame_source *source,
                                    const struct sc_stream_session *session) {
     assert(source->sink_count);
-    for (unsigned i = 0; i < source->sink_count; ++i) {
-        struct sc_frame_sink *sink = source->sinks[i];
+    sc_frame_source_foreach_sink(source, sink) {
         if (sink->ops->push_session &&
                 !sink->ops->push_session(sink, session)) {
             return false;
@@ -7,18 +7,26 @@
 
 #include "trait/frame_sink.h"
 
-#define SC_FRAME_SOURCE_MAX_SINKS 2
-
 /**
  * Frame source trait
  *
  * Component able to send AVFrames should implement this trait.
  */
 struct sc_frame_source {
-    struct sc_frame_sink *sinks[SC_FRAME_SOURCE_MAX_SINKS];
+    // Any number of sinks may be attached, they are linked in their order of
+    // addition (without allocation)
+    struct sc_frame_sink *first_sink;
+    struct sc_frame_sink *last_sink;
     unsigned sink_count;
 };
 
+/**
+ * Iterate over the sinks of a source, in their order of addition
+ */
+#define sc_frame_source_foreach_sink(source, sink) \
+    for (struct sc_frame_sink *sink = (source)->first_sink; sink; \
+            sink = sink->next)
+
 void
 sc_frame_source_init(struct sc_frame_source *source);
 
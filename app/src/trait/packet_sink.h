@@ -13,6 +13,11 @@
  */
 struct sc_packet_sink {
     const struct sc_packet_sink_ops *ops;
+
+    // Private, linked by the packet source (a sink may only be added to a
+    // single source)
+    struct sc_packet_sink *prev;
+    struct sc_packet_sink *next;
 };
 
 struct sc_stream_session_video {
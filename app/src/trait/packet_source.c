@@ -4,24 +4,38 @@
 
 void
 sc_packet_source_init(struct sc_packet_source *source) {
+    source->first_sink = NULL;
+    source->last_sink = NULL;
     source->sink_count = 0;
 }
 
 void
 sc_packet_source_add_sink(struct sc_packet_source *source,
                           struct sc_packet_sink *sink) {
-    assert(source->sink_count < SC_PACKET_SOURCE_MAX_SINKS);
     assert(sink);
     assert(sink->ops);
-    source->sinks[source->sink_count++] = sink;
+    assert(sink != source->last_sink);
+
+    sink->prev = source->last_sink;
+    sink->next = NULL;
+    if (source->last_sink) {
+        source->last_sink->next = sink;
+    } else {
+        source->first_sink = sink;
+    }
+    source->last_sink = sink;
+    ++source->sink_count;
 }
 
+// Close the sinks added before the given one (or all the sinks if end is
+// NULL), in reverse order
 static void
-sc_packet_source_sinks_close_firsts(struct sc_packet_source *source,
-                                    unsigned count) {
-    while (count) {
-        struct sc_packet_sink *sink = source->sinks[--count];
+sc_packet_source_sinks_close_before(struct sc_packet_source *source,
+                                    struct sc_packet_sink *end) {
+    struct sc_packet_sink *sink = end ? end->prev : source->last_sink;
+    while (sink) {
         sink->ops->close(sink);
+        sink = sink->prev;
     }
 }
 
@@ -30,10 +44,9 @@ sc_packet_source_sinks_open(struct sc_packet_source *source,
                             AVCodecContext *ctx,
                             const struct sc_stream_session *session) {
     assert(source->sink_count);
-    for (unsigned i = 0; i < source->sink_count; ++i) {
-        struct sc_packet_sink *sink = source->sinks[i];
+    sc_packet_source_foreach_sink(source, sink) {
         if (!sink->ops->open(sink, ctx, session)) {
-            sc_packet_source_sinks_close_firsts(source, i);
+            sc_packet_source_sinks_close_before(source, sink);
             return false;
         }
     }
@@ -44,15 +57,14 @@ sc_packet_source_sinks_open(struct sc_packet_source *source,
 void
 sc_packet_source_sinks_close(struct sc_packet_source *source) {
     assert(source->sink_count);
-    sc_packet_source_sinks_close_firsts(source, source->sink_count);
+    sc_packet_source_sinks_close_before(source, NULL);
 }
 
 bool
 sc_packet_source_sinks_push(struct sc_packet_source *source,
                             const AVPacket *packet) {
     assert(source->sink_count);
-    for (unsigned i = 0; i < source->sink_count; ++i) {
-        struct sc_packet_sink *sink = source->sinks[i];
+    sc_packet_source_foreach_sink(source, sink) {
         if (!sink->ops->push(sink, packet)) {
             return false;
         }
@@ -65,8 +77,7 @@ bool
 sc_packet_source_sinks_push_session(struct sc_packet_source *source,
                                     const struct sc_stream_session *session) {
     assert(source->sink_count);
-    for (unsigned i = 0; i < source->sink_count; ++i) {
-        struct sc_packet_sink *sink = source->sinks[i];
+    sc_packet_source_foreach_sink(source, sink) {
         if (sink->ops->push_session
                 && !sink->ops->push_session(sink, session)) {
             return false;
@@ -79,8 +90,7 @@ sc_packet_source_sinks_push_session(struct sc_packet_source *source,
 void
 sc_packet_source_sinks_disable(struct sc_packet_source *source) {
     assert(source->sink_count);
-    for (unsigned i = 0; i < source->sink_count; ++i) {
-        struct sc_packet_sink *sink = source->sinks[i];
+    sc_packet_source_foreach_sink(source, sink) {
         if (sink->ops->disable) {
             sink->ops->disable(sink);
         }
@@ -7,18 +7,26 @@
 
 #include "trait/packet_sink.h"
 
-#define SC_PACKET_SOURCE_MAX_SINKS 2
-
 /**
  * Packet source trait
  *
  * Component able to send AVPackets should implement this trait.
  */
 struct sc_packet_source {
-    struct sc_packet_sink *sinks[SC_PACKET_SOURCE_MAX_SINKS];
+    // Any number of sinks may be attached, they are linked in their order of
+    // addition (without allocation)
+    struct sc_packet_sink *first_sink;
+    struct sc_packet_sink *last_sink;
     unsigned sink_count;
 };
 
+/**
+ * Iterate over the sinks of a source, in their order of addition
+ */
+#define sc_packet_source_foreach_sink(source, sink) \
+    for (struct sc_packet_sink *sink = (source)->first_sink; sink; \
+            sink = sink->next)
+
 void
 sc_packet_source_init(struct sc_packet_source *source);
 
@@ -4,6 +4,7 @@
 #include "common.h"
 
 #include <stdbool.h>
+#include <stdio.h>
 
 #ifdef _WIN32
 # define SC_PATH_SEPARATOR '\\'
@@ -55,4 +56,18 @@ sc_file_build_path(const char *dir, const char *filename);
 bool
 sc_file_is_regular(const char *path);
 
+/**
+ * Open a file like fopen(), the path being UTF-8 encoded (even on Windows)
+ */
+FILE *
+sc_file_open(const char *path, const char *mode);
+
+/**
+ * Create a directory (its parent must exist)
+ *
+ * Return true if the directory has been created or already exists.
+ */
+bool
+sc_file_create_dir(const char *path);
+
 #endif
@@ -0,0 +1,78 @@
+#include "histogram.h"
+
+#include <assert.h>
+#include <string.h>
+
+void
+sc_histogram_init(struct sc_histogram *hist) {
+    memset(hist, 0, sizeof(*hist));
+}
+
+static unsigned
+sc_histogram_index(uint32_t value) {
+    if (value < 2 * SC_HISTOGRAM_SUB_BUCKETS) {
+        return value;
+    }
+
+    // Keep the SC_HISTOGRAM_SUB_BUCKET_BITS bits following the most
+    // significant bit
+    unsigned shift = 1;
+    while ((value >> shift) >= 2 * SC_HISTOGRAM_SUB_BUCKETS) {
+        ++shift;
+    }
+    return shift * SC_HISTOGRAM_SUB_BUCKETS + (value >> shift);
+}
+
+// Return the highest value recorded in the bucket at the given index
+static uint64_t
+sc_histogram_bucket_upper(unsigned index) {
+    if (index < 2 * SC_HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+
+    unsigned shift = index / SC_HISTOGRAM_SUB_BUCKETS - 1;
+    uint64_t sub = SC_HISTOGRAM_SUB_BUCKETS
+                 + index % SC_HISTOGRAM_SUB_BUCKETS;
+    return ((sub + 1) << shift) - 1;
+}
+
+void
+sc_histogram_record(struct sc_histogram *hist, uint64_t value) {
+    uint32_t v = value < UINT32_MAX ? value : UINT32_MAX;
+    unsigned index = sc_histogram_index(v);
+    assert(index < SC_HISTOGRAM_BUCKETS);
+
+    ++hist->counts[index];
+    ++hist->count;
+    if (value > hist->max) {
+        hist->max = value;
+    }
+}
+
+uint64_t
+sc_histogram_percentile(const struct sc_histogram *hist, double percentile) {
+    assert(percentile >= 0 && percentile <= 100);
+
+    if (!hist->count) {
+        return 0;
+    }
+
+    // The rank of the value to return (at least the first one)
+    double r = hist->count * percentile / 100;
+    uint64_t rank = r;
+    if (rank < r || !rank) {
+        ++rank;
+    }
+
+    uint64_t total = 0;
+    for (unsigned i = 0; i < SC_HISTOGRAM_BUCKETS; ++i) {
+        total += hist->counts[i];
+        if (total >= rank) {
+            uint64_t upper = sc_histogram_bucket_upper(i);
+            return upper < hist->max ? upper : hist->max;
+        }
+    }
+
+    assert(!"unreachable");
+    return hist->max;
+}
@@ -0,0 +1,50 @@
+#ifndef SC_HISTOGRAM_H
+#define SC_HISTOGRAM_H
+
+#include "common.h"
+
+#include <stdint.h>
+
+#define SC_HISTOGRAM_SUB_BUCKET_BITS 4
+#define SC_HISTOGRAM_SUB_BUCKETS (1 << SC_HISTOGRAM_SUB_BUCKET_BITS)
+// Values up to UINT32_MAX
+#define SC_HISTOGRAM_BUCKETS \
+    ((32 - SC_HISTOGRAM_SUB_BUCKET_BITS + 1) * SC_HISTOGRAM_SUB_BUCKETS)
+
+/**
+ * Histogram of non-negative integer values with a bounded relative error (in
+ * the spirit of HdrHistogram)
+ *
+ * Values below 2 * SC_HISTOGRAM_SUB_BUCKETS are recorded exactly. Above, each
+ * power-of-two range is split into SC_HISTOGRAM_SUB_BUCKETS linear buckets,
+ * so the relative error is at most 1/SC_HISTOGRAM_SUB_BUCKETS (6.25%).
+ *
+ * Recording a value is O(1) and never allocates. Values greater than
+ * UINT32_MAX are saturated.
+ *
+ * It is not thread-safe.
+ */
+struct sc_histogram {
+    uint32_t counts[SC_HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t max;
+};
+
+// Also used to reset the histogram
+void
+sc_histogram_init(struct sc_histogram *hist);
+
+void
+sc_histogram_record(struct sc_histogram *hist, uint64_t value);
+
+/**
+ * Return the value at the given percentile (in [0, 100])
+ *
+ * The result is the highest value equivalent to the bucket containing the
+ * percentile (so it never underestimates), capped to the maximum recorded
+ * value. Return 0 if the histogram is empty.
+ */
+uint64_t
+sc_histogram_percentile(const struct sc_histogram *hist, double percentile);
+
+#endif
@@ -13,6 +13,7 @@
 # include <netinet/in.h>
 # include <netinet/tcp.h>
 # include <unistd.h>
+# include <sys/ioctl.h>
 # include <sys/socket.h>
 # include <sys/types.h>
 # define SOCKET_ERROR -1
@@ -236,6 +237,25 @@ net_send_all(sc_socket socket, const void *buf, size_t len) {
     return copied;
 }
 
+ssize_t
+net_pending(sc_socket socket) {
+    sc_raw_socket raw_sock = unwrap(socket);
+
+#ifdef _WIN32
+    u_long value;
+    int ret = ioctlsocket(raw_sock, FIONREAD, &value);
+#else
+    int value;
+    int ret = ioctl(raw_sock, FIONREAD, &value);
+#endif
+    if (ret == SOCKET_ERROR) {
+        net_perror("ioctl(FIONREAD)");
+        return -1;
+    }
+
+    return value;
+}
+
 bool
 net_interrupt(sc_socket socket) {
     assert(socket != SC_SOCKET_NONE);
@@ -73,6 +73,11 @@ net_send(sc_socket socket, const void *buf, size_t len);
 ssize_t
 net_send_all(sc_socket socket, const void *buf, size_t len);
 
+// Return the number of bytes which can be received without blocking, or -1 on
+// error
+ssize_t
+net_pending(sc_socket socket);
+
 // Shutdown the socket (or close on Windows) so that any blocking send() or
 // recv() are interrupted.
 bool
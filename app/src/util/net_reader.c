@@ -0,0 +1,156 @@
+#include "net_reader.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/log.h"
+
+bool
+sc_net_reader_init(struct sc_net_reader *reader, sc_socket socket,
+                   size_t size) {
+    assert(size);
+
+    reader->buf = malloc(size);
+    if (!reader->buf) {
+        LOG_OOM();
+        return false;
+    }
+
+    reader->socket = socket;
+    reader->size = size;
+    reader->head = 0;
+    reader->tail = 0;
+    reader->recv_count = 0;
+    reader->capture = NULL;
+    reader->replay = NULL;
+
+    return true;
+}
+
+void
+sc_net_reader_destroy(struct sc_net_reader *reader) {
+    free(reader->buf);
+}
+
+static ssize_t
+sc_net_reader_recv_raw(struct sc_net_reader *reader, void *buf, size_t len) {
+    ++reader->recv_count;
+
+    if (reader->replay) {
+        return sc_stream_replay_read(reader->replay, buf, len);
+    }
+
+    ssize_t r = net_recv(reader->socket, buf, len);
+    if (r > 0 && reader->capture) {
+        sc_stream_capture_write(reader->capture, buf, r);
+    }
+
+    return r;
+}
+
+static bool
+sc_net_reader_fill(struct sc_net_reader *reader, size_t len) {
+    assert(len <= reader->size);
+
+    if (reader->size - reader->head < len) {
+        // Not enough space after head, move the remaining bytes (if any) to
+        // the beginning of the buffer
+        size_t buffered = reader->tail - reader->head;
+        memmove(reader->buf, reader->buf + reader->head, buffered);
+        reader->head = 0;
+        reader->tail = buffered;
+    }
+
+    while (reader->tail - reader->head < len) {
+        // Receive as much as possible, not only the missing bytes
+        ssize_t r = sc_net_reader_recv_raw(reader, reader->buf + reader->tail,
+                                           reader->size - reader->tail);
+        if (r <= 0) {
+            return false;
+        }
+
+        reader->tail += r;
+    }
+
+    return true;
+}
+
+bool
+sc_net_reader_read(struct sc_net_reader *reader, void *to, size_t len) {
+    uint8_t *out = to;
+
+    // Consume the buffered data first
+    size_t buffered = reader->tail - reader->head;
+    size_t n = len < buffered ? len : buffered;
+    memcpy(out, reader->buf + reader->head, n);
+    reader->head += n;
+    out += n;
+    len -= n;
+
+    if (!len) {
+        return true;
+    }
+
+    // The buffer is empty
+    assert(reader->head == reader->tail);
+    reader->head = 0;
+    reader->tail = 0;
+
+    if (len > reader->size / 2) {
+        // Large payload (typically a video packet), receive it in place
+        if (!reader->capture && !reader->replay) {
+            ssize_t r = net_recv_all(reader->socket, out, len);
+            ++reader->recv_count;
+            return r >= 0 && (size_t) r == len;
+        }
+
+        // Record (or replay) each receive with its own arrival time
+        while (len) {
+            ssize_t r = sc_net_reader_recv_raw(reader, out, len);
+            if (r <= 0) {
+                return false;
+            }
+            out += r;
+            len -= r;
+        }
+        return true;
+    }
+
+    if (!sc_net_reader_fill(reader, len)) {
+        return false;
+    }
+
+    memcpy(out, reader->buf, len);
+    reader->head = len;
+    return true;
+}
+
+ssize_t
+sc_net_reader_recv(struct sc_net_reader *reader) {
+    // Move the remaining bytes (if any) to the beginning of the buffer
+    size_t buffered = reader->tail - reader->head;
+    memmove(reader->buf, reader->buf + reader->head, buffered);
+    reader->head = 0;
+    reader->tail = buffered;
+
+    // The caller must consume the buffered data before receiving more
+    assert(buffered < reader->size);
+
+    ssize_t r = sc_net_reader_recv_raw(reader, reader->buf + reader->tail,
+                                       reader->size - reader->tail);
+    if (r > 0) {
+        reader->tail += r;
+    }
+
+    return r;
+}
+
+size_t
+sc_net_reader_take(struct sc_net_reader *reader, void *to, size_t len) {
+    size_t buffered = reader->tail - reader->head;
+    size_t n = len < buffered ? len : buffered;
+    memcpy(to, reader->buf + reader->head, n);
+    reader->head += n;
+    return n;
+}
@@ -0,0 +1,87 @@
+#ifndef SC_NET_READER_H
+#define SC_NET_READER_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util/net.h"
+#include "util/stream_capture.h"
+
+/**
+ * Buffered reader over a blocking socket
+ *
+ * Each receive requests as many bytes as the buffer can hold, so that a
+ * sequence of small packets (typically audio) is read with a single syscall
+ * instead of two blocking reads (header + payload) per packet.
+ *
+ * Payloads larger than half the buffer are received directly into the
+ * destination, to avoid an additional copy.
+ *
+ * The reader may also be driven by a reactor (see util/reactor.h): on each
+ * readiness, sc_net_reader_recv() receives the available bytes, and
+ * sc_net_reader_take() consumes them without ever blocking.
+ *
+ * The received bytes may be recorded to a capture file, and a capture may be
+ * read instead of the socket (see util/stream_capture.h).
+ */
+struct sc_net_reader {
+    sc_socket socket;
+
+    uint8_t *buf;
+    size_t size;
+    size_t head; // read position
+    size_t tail; // end of the received data
+    // buffered: [head, tail)
+
+    uint64_t recv_count; // number of receive syscalls
+
+    struct sc_stream_capture *capture; // NULL if not captured
+    struct sc_stream_replay *replay; // read instead of the socket if not NULL
+};
+
+bool
+sc_net_reader_init(struct sc_net_reader *reader, sc_socket socket,
+                   size_t size);
+
+void
+sc_net_reader_destroy(struct sc_net_reader *reader);
+
+/**
+ * Read exactly len bytes
+ *
+ * Return false on end-of-stream or error.
+ */
+bool
+sc_net_reader_read(struct sc_net_reader *reader, void *to, size_t len);
+
+/**
+ * Receive the available bytes with a single syscall
+ *
+ * The socket must be readable, otherwise this call blocks. The buffer must not
+ * be full.
+ *
+ * Return the number of bytes received, 0 on end-of-stream, or -1 on error.
+ */
+ssize_t
+sc_net_reader_recv(struct sc_net_reader *reader);
+
+/**
+ * Return the number of buffered bytes
+ */
+static inline size_t
+sc_net_reader_available(const struct sc_net_reader *reader) {
+    return reader->tail - reader->head;
+}
+
+/**
+ * Consume up to len buffered bytes (without receiving)
+ *
+ * Return the number of bytes copied.
+ */
+size_t
+sc_net_reader_take(struct sc_net_reader *reader, void *to, size_t len);
+
+#endif
@@ -0,0 +1,289 @@
+#include "reactor.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#ifdef SC_REACTOR_EPOLL
+# include <sys/epoll.h>
+# include <sys/eventfd.h>
+# include <unistd.h>
+#endif
+
+#include "util/log.h"
+
+// Maximum number of events handled per epoll_wait() call
+#define SC_REACTOR_MAX_EVENTS 64
+
+struct sc_reactor_handle {
+    sc_socket socket;
+    sc_reactor_fn fn;
+    void *userdata;
+
+    // registered handles, protected by the reactor mutex
+    struct sc_reactor_handle *prev;
+    struct sc_reactor_handle *next;
+};
+
+#ifdef SC_REACTOR_EPOLL
+
+static bool
+sc_reactor_watch(struct sc_reactor *reactor, struct sc_reactor_handle *handle,
+                 int op) {
+    struct epoll_event event = {
+        .events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT,
+        .data.ptr = handle,
+    };
+    if (epoll_ctl(reactor->epoll_fd, op, handle->socket, &event)) {
+        LOGE("Reactor: could not watch socket: %d", errno);
+        return false;
+    }
+    return true;
+}
+
+bool
+sc_reactor_init(struct sc_reactor *reactor) {
+    reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (reactor->epoll_fd == -1) {
+        LOGE("Reactor: could not create epoll instance: %d", errno);
+        return false;
+    }
+
+    reactor->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (reactor->wake_fd == -1) {
+        LOGE("Reactor: could not create eventfd: %d", errno);
+        goto error_close_epoll;
+    }
+
+    // The wake fd is the only one registered with a NULL pointer
+    struct epoll_event event = {
+        .events = EPOLLIN,
+        .data.ptr = NULL,
+    };
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->wake_fd,
+                  &event)) {
+        LOGE("Reactor: could not watch eventfd: %d", errno);
+        goto error_close_wake;
+    }
+
+    bool ok = sc_mutex_init(&reactor->mutex);
+    if (!ok) {
+        goto error_close_wake;
+    }
+
+    reactor->stopped = false;
+    reactor->handles = NULL;
+
+    return true;
+
+error_close_wake:
+    close(reactor->wake_fd);
+error_close_epoll:
+    close(reactor->epoll_fd);
+
+    return false;
+}
+
+static int
+run_reactor(void *data) {
+    struct sc_reactor *reactor = data;
+
+    struct epoll_event events[SC_REACTOR_MAX_EVENTS];
+
+    while (!reactor->stopped) {
+        int n = epoll_wait(reactor->epoll_fd, events, SC_REACTOR_MAX_EVENTS,
+                           -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOGE("Reactor: epoll_wait() failed: %d", errno);
+            break;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            struct sc_reactor_handle *handle = events[i].data.ptr;
+            if (!handle) {
+                // Woken up by sc_reactor_stop()
+                reactor->stopped = true;
+                break;
+            }
+
+            enum sc_reactor_action action = handle->fn(handle->userdata);
+            if (action == SC_REACTOR_CONTINUE) {
+                sc_reactor_watch(reactor, handle, EPOLL_CTL_MOD);
+            }
+            // On SC_REACTOR_PAUSE, the handle may have been freed
+        }
+    }
+
+    LOGD("Reactor stopped");
+
+    return 0;
+}
+
+bool
+sc_reactor_start(struct sc_reactor *reactor) {
+    LOGD("Reactor: starting thread");
+
+    bool ok = sc_thread_create(&reactor->thread, run_reactor, "scrcpy-reactor",
+                               reactor);
+    if (!ok) {
+        LOGE("Reactor: could not start thread");
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_reactor_stop(struct sc_reactor *reactor) {
+    uint64_t value = 1;
+    ssize_t w = write(reactor->wake_fd, &value, sizeof(value));
+    if (w != sizeof(value)) {
+        LOGE("Reactor: could not wake up the reactor thread");
+    }
+}
+
+void
+sc_reactor_join(struct sc_reactor *reactor) {
+    sc_thread_join(&reactor->thread, NULL);
+}
+
+void
+sc_reactor_destroy(struct sc_reactor *reactor) {
+    struct sc_reactor_handle *handle = reactor->handles;
+    while (handle) {
+        struct sc_reactor_handle *next = handle->next;
+        free(handle);
+        handle = next;
+    }
+
+    sc_mutex_destroy(&reactor->mutex);
+    close(reactor->wake_fd);
+    close(reactor->epoll_fd);
+}
+
+struct sc_reactor_handle *
+sc_reactor_add(struct sc_reactor *reactor, sc_socket socket, sc_reactor_fn fn,
+               void *userdata) {
+    assert(socket != SC_SOCKET_NONE);
+    assert(fn);
+
+    struct sc_reactor_handle *handle = malloc(sizeof(*handle));
+    if (!handle) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    handle->socket = socket;
+    handle->fn = fn;
+    handle->userdata = userdata;
+
+    // Link the handle before it may be used by the reactor thread
+    sc_mutex_lock(&reactor->mutex);
+    handle->prev = NULL;
+    handle->next = reactor->handles;
+    if (reactor->handles) {
+        reactor->handles->prev = handle;
+    }
+    reactor->handles = handle;
+    sc_mutex_unlock(&reactor->mutex);
+
+    if (!sc_reactor_watch(reactor, handle, EPOLL_CTL_ADD)) {
+        sc_mutex_lock(&reactor->mutex);
+        reactor->handles = handle->next;
+        if (handle->next) {
+            handle->next->prev = NULL;
+        }
+        sc_mutex_unlock(&reactor->mutex);
+        free(handle);
+        return NULL;
+    }
+
+    return handle;
+}
+
+bool
+sc_reactor_resume(struct sc_reactor *reactor,
+                  struct sc_reactor_handle *handle) {
+    return sc_reactor_watch(reactor, handle, EPOLL_CTL_MOD);
+}
+
+void
+sc_reactor_remove(struct sc_reactor *reactor,
+                  struct sc_reactor_handle *handle) {
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, handle->socket, NULL)) {
+        LOGW("Reactor: could not unwatch socket: %d", errno);
+    }
+
+    sc_mutex_lock(&reactor->mutex);
+    if (handle->prev) {
+        handle->prev->next = handle->next;
+    } else {
+        reactor->handles = handle->next;
+    }
+    if (handle->next) {
+        handle->next->prev = handle->prev;
+    }
+    sc_mutex_unlock(&reactor->mutex);
+
+    free(handle);
+}
+
+#else // not SC_REACTOR_EPOLL
+
+bool
+sc_reactor_init(struct sc_reactor *reactor) {
+    (void) reactor;
+    LOGD("Reactor not supported on this platform");
+    return false;
+}
+
+bool
+sc_reactor_start(struct sc_reactor *reactor) {
+    (void) reactor;
+    return false;
+}
+
+void
+sc_reactor_stop(struct sc_reactor *reactor) {
+    (void) reactor;
+}
+
+void
+sc_reactor_join(struct sc_reactor *reactor) {
+    (void) reactor;
+}
+
+void
+sc_reactor_destroy(struct sc_reactor *reactor) {
+    (void) reactor;
+}
+
+struct sc_reactor_handle *
+sc_reactor_add(struct sc_reactor *reactor, sc_socket socket, sc_reactor_fn fn,
+               void *userdata) {
+    (void) reactor;
+    (void) socket;
+    (void) fn;
+    (void) userdata;
+    return NULL;
+}
+
+bool
+sc_reactor_resume(struct sc_reactor *reactor,
+                  struct sc_reactor_handle *handle) {
+    (void) reactor;
+    (void) handle;
+    return false;
+}
+
+void
+sc_reactor_remove(struct sc_reactor *reactor,
+                  struct sc_reactor_handle *handle) {
+    (void) reactor;
+    (void) handle;
+}
+
+#endif
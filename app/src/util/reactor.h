@@ -0,0 +1,117 @@
+#ifndef SC_REACTOR_H
+#define SC_REACTOR_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+#include "util/net.h"
+#include "util/thread.h"
+
+#ifdef __linux__
+// The reactor is only implemented with epoll. On other platforms,
+// sc_reactor_init() fails and the callers must keep one blocking thread per
+// socket.
+# define SC_REACTOR_EPOLL
+#endif
+
+enum sc_reactor_action {
+    SC_REACTOR_CONTINUE, // keep watching the socket
+    // Stop watching the socket until sc_reactor_resume() is called (also to
+    // be returned once the callback called sc_reactor_remove())
+    SC_REACTOR_PAUSE,
+};
+
+/**
+ * Called from the reactor thread when the socket is readable (or closed, or
+ * in error)
+ *
+ * The socket is readable, so a single (blocking) read will not block. A
+ * shutdown socket is readable too: the read returns 0.
+ *
+ * The callback must not block, since it delays all the other sockets.
+ */
+typedef enum sc_reactor_action (*sc_reactor_fn)(void *userdata);
+
+struct sc_reactor_handle;
+
+/**
+ * I/O reactor
+ *
+ * A single thread waits for many sockets to be readable, and calls their
+ * callback, instead of one thread blocking on each socket.
+ *
+ * Each socket is watched in one-shot mode: it is disabled while its callback
+ * runs, and enabled again according to the returned action. Therefore, a
+ * callback is never called concurrently with itself, and an owner may stop
+ * reading (backpressure) simply by returning SC_REACTOR_PAUSE.
+ */
+struct sc_reactor {
+#ifdef SC_REACTOR_EPOLL
+    int epoll_fd;
+    int wake_fd; // eventfd to interrupt epoll_wait()
+#endif
+    sc_thread thread;
+    bool stopped; // only accessed from the reactor thread
+
+    sc_mutex mutex;
+    struct sc_reactor_handle *handles; // registered handles (linked list)
+};
+
+bool
+sc_reactor_init(struct sc_reactor *reactor);
+
+bool
+sc_reactor_start(struct sc_reactor *reactor);
+
+/**
+ * Request the reactor thread to stop
+ *
+ * The callbacks of the sockets still registered are not called anymore.
+ */
+void
+sc_reactor_stop(struct sc_reactor *reactor);
+
+void
+sc_reactor_join(struct sc_reactor *reactor);
+
+/**
+ * Destroy the reactor (the thread must be joined)
+ *
+ * The handles still registered are freed.
+ */
+void
+sc_reactor_destroy(struct sc_reactor *reactor);
+
+/**
+ * Watch a socket
+ *
+ * May be called from any thread (including from a callback).
+ *
+ * Return the handle, or NULL on error.
+ */
+struct sc_reactor_handle *
+sc_reactor_add(struct sc_reactor *reactor, sc_socket socket, sc_reactor_fn fn,
+               void *userdata);
+
+/**
+ * Watch a socket again after its callback returned SC_REACTOR_PAUSE
+ *
+ * May be called from any thread.
+ */
+bool
+sc_reactor_resume(struct sc_reactor *reactor,
+                  struct sc_reactor_handle *handle);
+
+/**
+ * Stop watching a socket, and free its handle
+ *
+ * Must be called from the callback of this handle (which must then return
+ * SC_REACTOR_PAUSE), so that the socket is unregistered before its owner may
+ * close it.
+ */
+void
+sc_reactor_remove(struct sc_reactor *reactor,
+                  struct sc_reactor_handle *handle);
+
+#endif
@@ -0,0 +1,189 @@
+#include "stream_capture.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "util/binary.h"
+#include "util/file.h"
+#include "util/log.h"
+#include "util/str.h"
+
+#define SC_STREAM_CAPTURE_MAGIC "SCCAPT01"
+#define SC_STREAM_CAPTURE_MAGIC_LENGTH 8
+#define SC_STREAM_CAPTURE_CHUNK_HEADER_SIZE 12
+
+bool
+sc_stream_capture_init(struct sc_stream_capture *capture, const char *path,
+                       const char *device_name, sc_tick start) {
+    capture->file = sc_file_open(path, "wb");
+    if (!capture->file) {
+        LOGE("Could not create capture file: %s", path);
+        return false;
+    }
+
+    uint8_t header[SC_STREAM_CAPTURE_MAGIC_LENGTH
+                 + SC_STREAM_CAPTURE_NAME_LENGTH] = {0};
+    memcpy(header, SC_STREAM_CAPTURE_MAGIC, SC_STREAM_CAPTURE_MAGIC_LENGTH);
+    sc_strncpy((char *) &header[SC_STREAM_CAPTURE_MAGIC_LENGTH], device_name,
+               SC_STREAM_CAPTURE_NAME_LENGTH);
+
+    if (fwrite(header, sizeof(header), 1, capture->file) != 1) {
+        LOGE("Could not write capture file: %s", path);
+        fclose(capture->file);
+        return false;
+    }
+
+    capture->start = start;
+    capture->failed = false;
+    capture->bytes = 0;
+
+    return true;
+}
+
+void
+sc_stream_capture_write(struct sc_stream_capture *capture, const void *data,
+                        size_t len) {
+    assert(len && len <= UINT32_MAX);
+
+    if (capture->failed) {
+        return;
+    }
+
+    uint8_t header[SC_STREAM_CAPTURE_CHUNK_HEADER_SIZE];
+    sc_write64be(header, sc_tick_now() - capture->start);
+    sc_write32be(&header[8], len);
+
+    // Buffered by stdio, so that the receiving thread is not slowed down by a
+    // syscall per receive
+    if (fwrite(header, sizeof(header), 1, capture->file) != 1
+            || fwrite(data, len, 1, capture->file) != 1) {
+        LOGE("Could not write capture file, capture stopped");
+        capture->failed = true;
+        return;
+    }
+
+    capture->bytes += len;
+}
+
+void
+sc_stream_capture_destroy(struct sc_stream_capture *capture) {
+    if (fclose(capture->file)) {
+        LOGE("Could not close capture file");
+    }
+    LOGD("Stream capture: %" PRIu64 " bytes", capture->bytes);
+}
+
+bool
+sc_stream_replay_init(struct sc_stream_replay *replay, const char *path,
+                      bool max_speed) {
+    replay->file = sc_file_open(path, "rb");
+    if (!replay->file) {
+        return false;
+    }
+
+    uint8_t header[SC_STREAM_CAPTURE_MAGIC_LENGTH
+                 + SC_STREAM_CAPTURE_NAME_LENGTH];
+    if (fread(header, sizeof(header), 1, replay->file) != 1
+            || memcmp(header, SC_STREAM_CAPTURE_MAGIC,
+                      SC_STREAM_CAPTURE_MAGIC_LENGTH)) {
+        LOGE("Invalid capture file: %s", path);
+        goto error_close;
+    }
+
+    memcpy(replay->device_name, &header[SC_STREAM_CAPTURE_MAGIC_LENGTH],
+           SC_STREAM_CAPTURE_NAME_LENGTH);
+    replay->device_name[SC_STREAM_CAPTURE_NAME_LENGTH - 1] = '\0';
+
+    if (!sc_mutex_init(&replay->mutex)) {
+        goto error_close;
+    }
+
+    if (!sc_cond_init(&replay->cond)) {
+        sc_mutex_destroy(&replay->mutex);
+        goto error_close;
+    }
+
+    replay->max_speed = max_speed;
+    replay->start = 0;
+    replay->remaining = 0;
+    replay->interrupted = false;
+
+    return true;
+
+error_close:
+    fclose(replay->file);
+    return false;
+}
+
+void
+sc_stream_replay_destroy(struct sc_stream_replay *replay) {
+    sc_cond_destroy(&replay->cond);
+    sc_mutex_destroy(&replay->mutex);
+    fclose(replay->file);
+}
+
+void
+sc_stream_replay_start(struct sc_stream_replay *replay, sc_tick start) {
+    replay->start = start;
+}
+
+// Wait until the deadline, return false if interrupted
+static bool
+sc_stream_replay_wait(struct sc_stream_replay *replay, sc_tick deadline) {
+    sc_mutex_lock(&replay->mutex);
+    while (!replay->interrupted && !replay->max_speed
+            && sc_cond_timedwait(&replay->cond, &replay->mutex, deadline)) {
+        // spurious wake up or interrupted
+    }
+    bool interrupted = replay->interrupted;
+    sc_mutex_unlock(&replay->mutex);
+
+    return !interrupted;
+}
+
+ssize_t
+sc_stream_replay_read(struct sc_stream_replay *replay, void *buf, size_t len) {
+    assert(len);
+
+    if (!replay->remaining) {
+        uint8_t header[SC_STREAM_CAPTURE_CHUNK_HEADER_SIZE];
+        size_t r = fread(header, 1, sizeof(header), replay->file);
+        if (r != sizeof(header)) {
+            if (r || ferror(replay->file)) {
+                LOGE("Truncated capture file");
+                return -1;
+            }
+            // end of stream
+            return 0;
+        }
+
+        sc_tick time = sc_read64be(header);
+        replay->remaining = sc_read32be(&header[8]);
+        if (!replay->remaining) {
+            LOGE("Invalid capture chunk length: 0");
+            return -1;
+        }
+
+        if (!sc_stream_replay_wait(replay, replay->start + time)) {
+            return -1;
+        }
+    }
+
+    size_t n = len < replay->remaining ? len : replay->remaining;
+    if (fread(buf, n, 1, replay->file) != 1) {
+        LOGE("Truncated capture file");
+        return -1;
+    }
+
+    replay->remaining -= n;
+    return n;
+}
+
+void
+sc_stream_replay_interrupt(struct sc_stream_replay *replay) {
+    sc_mutex_lock(&replay->mutex);
+    replay->interrupted = true;
+    sc_cond_signal(&replay->cond);
+    sc_mutex_unlock(&replay->mutex);
+}
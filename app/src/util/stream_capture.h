@@ -0,0 +1,114 @@
+#ifndef SC_STREAM_CAPTURE_H
+#define SC_STREAM_CAPTURE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "util/thread.h"
+#include "util/tick.h"
+
+#define SC_STREAM_CAPTURE_NAME_LENGTH 64
+
+/**
+ * Capture of the raw bytes received on a stream socket, to replay a session
+ * exactly (same bytes, same timing, same receive boundaries) without device.
+ *
+ * The file starts with an 8-byte magic and the 64-byte device name (NUL
+ * padded), followed by one chunk per receive:
+ *
+ *  - arrival time (8 bytes, in microseconds since the capture start);
+ *  - length (4 bytes);
+ *  - the received bytes.
+ *
+ * Integers are big-endian. The end of the file is the end of the stream.
+ */
+struct sc_stream_capture {
+    FILE *file;
+    sc_tick start;
+    bool failed; // stop capturing after a write error
+    uint64_t bytes;
+};
+
+/**
+ * Create the capture file
+ *
+ * The arrival times are relative to `start`, which should be shared by the
+ * captures of the same session (so that the streams are replayed in sync).
+ */
+bool
+sc_stream_capture_init(struct sc_stream_capture *capture, const char *path,
+                       const char *device_name, sc_tick start);
+
+/**
+ * Record bytes just received
+ *
+ * A write error is logged once, then the capture is stopped (the stream is
+ * not affected).
+ */
+void
+sc_stream_capture_write(struct sc_stream_capture *capture, const void *data,
+                        size_t len);
+
+void
+sc_stream_capture_destroy(struct sc_stream_capture *capture);
+
+/**
+ * Replay of a capture, read like a socket
+ */
+struct sc_stream_replay {
+    FILE *file;
+    char device_name[SC_STREAM_CAPTURE_NAME_LENGTH];
+    bool max_speed; // do not wait for the original arrival times
+    sc_tick start;
+    uint32_t remaining; // remaining bytes of the current chunk
+
+    sc_mutex mutex;
+    sc_cond cond;
+    bool interrupted;
+};
+
+/**
+ * Open a capture file
+ *
+ * Return false if it does not exist or is not a valid capture.
+ */
+bool
+sc_stream_replay_init(struct sc_stream_replay *replay, const char *path,
+                      bool max_speed);
+
+void
+sc_stream_replay_destroy(struct sc_stream_replay *replay);
+
+/**
+ * Set the time corresponding to the capture start
+ *
+ * Must be called before the first read (unless max_speed is set).
+ */
+void
+sc_stream_replay_start(struct sc_stream_replay *replay, sc_tick start);
+
+/**
+ * Read the next received bytes (at most len), like net_recv()
+ *
+ * Block until the original arrival time of the chunk (unless max_speed is
+ * set). Never return more than the remaining bytes of the current chunk, so
+ * that the reads are split like the original receives.
+ *
+ * Return the number of bytes read, 0 on end-of-stream, or -1 on error or
+ * interruption.
+ */
+ssize_t
+sc_stream_replay_read(struct sc_stream_replay *replay, void *buf, size_t len);
+
+/**
+ * Interrupt any sc_stream_replay_read(), and make the next ones fail
+ */
+void
+sc_stream_replay_interrupt(struct sc_stream_replay *replay);
+
+#endif
@@ -0,0 +1,261 @@
+#include "trace.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef __linux__
+# include <pthread.h>
+#endif
+
+#include "util/file.h"
+#include "util/log.h"
+
+#define SC_TRACE_CHUNK_EVENTS 4096
+// Bound the memory used by each thread (32 MiB)
+#define SC_TRACE_MAX_CHUNKS 256
+
+struct sc_trace_event {
+    const char *name; // statically allocated
+    sc_tick ts;
+    int64_t value; // the duration of a span, or the value of a counter
+    bool counter;
+};
+
+struct sc_trace_chunk {
+    struct sc_trace_chunk *next;
+    unsigned count;
+    struct sc_trace_event events[SC_TRACE_CHUNK_EVENTS];
+};
+
+// Events recorded by a single thread
+struct sc_trace_buffer {
+    struct sc_trace_buffer *next; // in the list of all the buffers
+    unsigned tid;
+    char thread_name[16];
+    struct sc_trace_chunk *first;
+    struct sc_trace_chunk *last; // the chunk being filled
+    unsigned chunks;
+    uint64_t dropped;
+};
+
+bool sc_trace_enabled = false;
+
+static FILE *sc_trace_file;
+static sc_tick sc_trace_start;
+
+// The buffers of all the threads, pushed without lock
+static _Atomic(struct sc_trace_buffer *) sc_trace_buffers;
+static atomic_uint sc_trace_next_tid;
+
+// The buffer of the current thread (NULL until its first event)
+static _Thread_local struct sc_trace_buffer *sc_trace_local;
+
+bool
+sc_trace_init(const char *path) {
+    assert(!sc_trace_enabled);
+
+    // Open the file immediately, to fail early if it cannot be created
+    sc_trace_file = sc_file_open(path, "w");
+    if (!sc_trace_file) {
+        LOGE("Could not create trace file: %s", path);
+        return false;
+    }
+
+    sc_trace_start = sc_tick_now();
+    atomic_init(&sc_trace_buffers, NULL);
+    atomic_init(&sc_trace_next_tid, 1);
+    sc_trace_enabled = true;
+
+    return true;
+}
+
+static void
+sc_trace_get_thread_name(char *name, size_t len, unsigned tid) {
+#ifdef __linux__
+    // The name given to sc_thread_create() (or the process name for the main
+    // thread)
+    if (!pthread_getname_np(pthread_self(), name, len)) {
+        return;
+    }
+#endif
+    snprintf(name, len, "thread %u", tid);
+}
+
+static struct sc_trace_buffer *
+sc_trace_register_thread(void) {
+    struct sc_trace_buffer *buffer = malloc(sizeof(*buffer));
+    if (!buffer) {
+        LOG_OOM();
+        return NULL;
+    }
+
+    buffer->tid = atomic_fetch_add_explicit(&sc_trace_next_tid, 1,
+                                            memory_order_relaxed);
+    sc_trace_get_thread_name(buffer->thread_name, sizeof(buffer->thread_name),
+                             buffer->tid);
+    buffer->first = NULL;
+    buffer->last = NULL;
+    buffer->chunks = 0;
+    buffer->dropped = 0;
+
+    struct sc_trace_buffer *head =
+        atomic_load_explicit(&sc_trace_buffers, memory_order_relaxed);
+    do {
+        buffer->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&sc_trace_buffers, &head,
+                                                    buffer,
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+
+    return buffer;
+}
+
+static struct sc_trace_event *
+sc_trace_new_event(void) {
+    struct sc_trace_buffer *buffer = sc_trace_local;
+    if (!buffer) {
+        buffer = sc_trace_register_thread();
+        if (!buffer) {
+            return NULL;
+        }
+        sc_trace_local = buffer;
+    }
+
+    struct sc_trace_chunk *chunk = buffer->last;
+    if (!chunk || chunk->count == SC_TRACE_CHUNK_EVENTS) {
+        if (buffer->chunks == SC_TRACE_MAX_CHUNKS) {
+            ++buffer->dropped;
+            return NULL;
+        }
+
+        chunk = malloc(sizeof(*chunk));
+        if (!chunk) {
+            LOG_OOM();
+            ++buffer->dropped;
+            return NULL;
+        }
+
+        chunk->next = NULL;
+        chunk->count = 0;
+        if (buffer->last) {
+            buffer->last->next = chunk;
+        } else {
+            buffer->first = chunk;
+        }
+        buffer->last = chunk;
+        ++buffer->chunks;
+    }
+
+    return &chunk->events[chunk->count++];
+}
+
+void
+sc_trace_record_span(const char *name, sc_tick start, sc_tick end) {
+    struct sc_trace_event *event = sc_trace_new_event();
+    if (event) {
+        event->name = name;
+        event->ts = start;
+        event->value = end - start;
+        event->counter = false;
+    }
+}
+
+void
+sc_trace_record_counter(const char *name, int64_t value) {
+    struct sc_trace_event *event = sc_trace_new_event();
+    if (event) {
+        event->name = name;
+        event->ts = sc_tick_now();
+        event->value = value;
+        event->counter = true;
+    }
+}
+
+static bool
+sc_trace_write_buffer(FILE *file, const struct sc_trace_buffer *buffer) {
+    // The thread name, as displayed for its track
+    fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                  "\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+            buffer->tid, buffer->thread_name);
+
+    for (const struct sc_trace_chunk *chunk = buffer->first; chunk;
+            chunk = chunk->next) {
+        for (unsigned i = 0; i < chunk->count; ++i) {
+            const struct sc_trace_event *event = &chunk->events[i];
+            // Microseconds since the start
+            sc_tick ts = event->ts - sc_trace_start;
+            if (event->counter) {
+                fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,"
+                              "\"tid\":%u,\"ts\":%" PRIi64 ","
+                              "\"args\":{\"value\":%" PRIi64 "}}",
+                        event->name, buffer->tid, ts, event->value);
+            } else {
+                fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+                              "\"tid\":%u,\"ts\":%" PRIi64 ","
+                              "\"dur\":%" PRIi64 "}",
+                        event->name, buffer->tid, ts, event->value);
+            }
+        }
+    }
+
+    return !ferror(file);
+}
+
+static bool
+sc_trace_write(FILE *file, struct sc_trace_buffer *buffers) {
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+                  "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+                  "\"args\":{\"name\":\"scrcpy\"}}");
+
+    bool ok = true;
+    for (struct sc_trace_buffer *buffer = buffers; ok && buffer;
+            buffer = buffer->next) {
+        ok = sc_trace_write_buffer(file, buffer);
+    }
+
+    fprintf(file, "\n]}\n");
+
+    if (fclose(file) || !ok) {
+        LOGE("Could not write trace file");
+        return false;
+    }
+
+    return true;
+}
+
+void
+sc_trace_destroy(void) {
+    assert(sc_trace_enabled);
+    sc_trace_enabled = false;
+
+    struct sc_trace_buffer *buffers =
+        atomic_load_explicit(&sc_trace_buffers, memory_order_acquire);
+
+    if (sc_trace_write(sc_trace_file, buffers)) {
+        LOGI("Trace file written");
+    }
+
+    struct sc_trace_buffer *buffer = buffers;
+    while (buffer) {
+        if (buffer->dropped) {
+            LOGW("Trace: %" PRIu64 " events dropped (thread '%s')",
+                 buffer->dropped, buffer->thread_name);
+        }
+
+        struct sc_trace_chunk *chunk = buffer->first;
+        while (chunk) {
+            struct sc_trace_chunk *next = chunk->next;
+            free(chunk);
+            chunk = next;
+        }
+
+        struct sc_trace_buffer *next = buffer->next;
+        free(buffer);
+        buffer = next;
+    }
+
+    // The buffers of the (stopped) threads are released
+    sc_trace_local = NULL;
+}
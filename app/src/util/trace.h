@@ -0,0 +1,71 @@
+#ifndef SC_TRACE_H
+#define SC_TRACE_H
+
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util/tick.h"
+
+/**
+ * Timeline of spans and counters recorded from all threads, written to a
+ * Chrome trace-event JSON file (loadable in Perfetto or chrome://tracing)
+ *
+ * Each thread records its events into its own buffer, without any lock. The
+ * buffers are written once the threads have stopped, on sc_trace_destroy().
+ *
+ * The event names must be statically allocated (e.g. string literals).
+ *
+ * When tracing is disabled, each call costs a single check.
+ */
+
+// Only written by sc_trace_init() and sc_trace_destroy(), while no other
+// thread is running
+extern bool sc_trace_enabled;
+
+/**
+ * Start tracing, the events will be written to the given file
+ *
+ * Must be called before any thread is started.
+ */
+bool
+sc_trace_init(const char *path);
+
+/**
+ * Write the trace file and release the buffers
+ *
+ * Must be called after all threads recording events have been joined.
+ */
+void
+sc_trace_destroy(void);
+
+void
+sc_trace_record_span(const char *name, sc_tick start, sc_tick end);
+
+void
+sc_trace_record_counter(const char *name, int64_t value);
+
+/**
+ * Return the start of a span, to be passed to sc_trace_end()
+ */
+static inline sc_tick
+sc_trace_begin(void) {
+    return sc_trace_enabled ? sc_tick_now() : 0;
+}
+
+static inline void
+sc_trace_end(const char *name, sc_tick start) {
+    if (sc_trace_enabled) {
+        sc_trace_record_span(name, start, sc_tick_now());
+    }
+}
+
+static inline void
+sc_trace_counter(const char *name, int64_t value) {
+    if (sc_trace_enabled) {
+        sc_trace_record_counter(name, value);
+    }
+}
+
+#endif
@@ -0,0 +1,273 @@
+#include "worker_pool.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "util/log.h"
+
+bool
+sc_worker_pool_init(struct sc_worker_pool *pool, unsigned count) {
+    assert(count);
+
+    pool->threads = malloc(count * sizeof(*pool->threads));
+    if (!pool->threads) {
+        LOG_OOM();
+        return false;
+    }
+
+    bool ok = sc_mutex_init(&pool->mutex);
+    if (!ok) {
+        goto error_free_threads;
+    }
+
+    ok = sc_cond_init(&pool->cond);
+    if (!ok) {
+        goto error_destroy_mutex;
+    }
+
+    ok = sc_cond_init(&pool->idle_cond);
+    if (!ok) {
+        goto error_destroy_cond;
+    }
+
+    pool->count = count;
+    pool->stopped = false;
+    pool->ready_head = NULL;
+    pool->ready_tail = NULL;
+    pool->timers = NULL;
+
+    return true;
+
+error_destroy_cond:
+    sc_cond_destroy(&pool->cond);
+error_destroy_mutex:
+    sc_mutex_destroy(&pool->mutex);
+error_free_threads:
+    free(pool->threads);
+
+    return false;
+}
+
+static void
+sc_worker_pool_make_ready(struct sc_worker_pool *pool,
+                          struct sc_strand *strand) {
+    sc_mutex_assert(&pool->mutex);
+
+    strand->next = NULL;
+    if (pool->ready_tail) {
+        pool->ready_tail->next = strand;
+    } else {
+        pool->ready_head = strand;
+    }
+    pool->ready_tail = strand;
+
+    sc_cond_signal(&pool->cond);
+}
+
+static int
+run_worker(void *data) {
+    struct sc_worker_pool *pool = data;
+
+    sc_mutex_lock(&pool->mutex);
+
+    while (!pool->stopped) {
+        struct sc_worker_timer *timer = pool->timers;
+        if (timer && timer->deadline <= sc_tick_now()) {
+            pool->timers = timer->next;
+            timer->pending = false;
+
+            sc_mutex_unlock(&pool->mutex);
+            timer->fn(timer->userdata);
+            sc_mutex_lock(&pool->mutex);
+            continue;
+        }
+
+        struct sc_strand *strand = pool->ready_head;
+        if (strand) {
+            pool->ready_head = strand->next;
+            if (!pool->ready_head) {
+                pool->ready_tail = NULL;
+            }
+
+            assert(!sc_vecdeque_is_empty(&strand->queue));
+            struct sc_worker_job job = sc_vecdeque_pop(&strand->queue);
+
+            sc_mutex_unlock(&pool->mutex);
+            job.fn(job.userdata);
+            sc_mutex_lock(&pool->mutex);
+
+            if (sc_vecdeque_is_empty(&strand->queue)) {
+                strand->active = false;
+                sc_cond_broadcast(&pool->idle_cond);
+            } else {
+                // Let the other strands run before the next job of this one
+                sc_worker_pool_make_ready(pool, strand);
+            }
+            continue;
+        }
+
+        if (timer) {
+            sc_cond_timedwait(&pool->cond, &pool->mutex, timer->deadline);
+        } else {
+            sc_cond_wait(&pool->cond, &pool->mutex);
+        }
+    }
+
+    sc_mutex_unlock(&pool->mutex);
+
+    return 0;
+}
+
+bool
+sc_worker_pool_start(struct sc_worker_pool *pool) {
+    LOGD("Worker pool: starting %u threads", pool->count);
+
+    unsigned count = pool->count;
+    for (unsigned i = 0; i < count; ++i) {
+        bool ok = sc_thread_create(&pool->threads[i], run_worker,
+                                   "scrcpy-worker", pool);
+        if (!ok) {
+            LOGE("Worker pool: could not start thread");
+            // Only join the threads started
+            pool->count = i;
+            sc_worker_pool_stop(pool);
+            sc_worker_pool_join(pool);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void
+sc_worker_pool_stop(struct sc_worker_pool *pool) {
+    sc_mutex_lock(&pool->mutex);
+    pool->stopped = true;
+    sc_cond_broadcast(&pool->cond);
+    sc_cond_broadcast(&pool->idle_cond);
+    sc_mutex_unlock(&pool->mutex);
+}
+
+void
+sc_worker_pool_join(struct sc_worker_pool *pool) {
+    for (unsigned i = 0; i < pool->count; ++i) {
+        sc_thread_join(&pool->threads[i], NULL);
+    }
+}
+
+void
+sc_worker_pool_destroy(struct sc_worker_pool *pool) {
+    sc_cond_destroy(&pool->idle_cond);
+    sc_cond_destroy(&pool->cond);
+    sc_mutex_destroy(&pool->mutex);
+    free(pool->threads);
+}
+
+void
+sc_worker_timer_init(struct sc_worker_timer *timer, sc_worker_fn fn,
+                     void *userdata) {
+    timer->fn = fn;
+    timer->userdata = userdata;
+    timer->pending = false;
+    timer->next = NULL;
+}
+
+void
+sc_worker_pool_schedule(struct sc_worker_pool *pool,
+                        struct sc_worker_timer *timer, sc_tick deadline) {
+    sc_mutex_lock(&pool->mutex);
+    assert(!timer->pending);
+
+    timer->deadline = deadline;
+    timer->pending = true;
+
+    // Keep the timers sorted (there are only a few of them)
+    struct sc_worker_timer **prev = &pool->timers;
+    while (*prev && (*prev)->deadline <= deadline) {
+        prev = &(*prev)->next;
+    }
+    timer->next = *prev;
+    *prev = timer;
+
+    if (pool->timers == timer) {
+        // The earliest deadline changed
+        sc_cond_signal(&pool->cond);
+    }
+
+    sc_mutex_unlock(&pool->mutex);
+}
+
+bool
+sc_worker_pool_cancel(struct sc_worker_pool *pool,
+                      struct sc_worker_timer *timer) {
+    sc_mutex_lock(&pool->mutex);
+
+    bool pending = timer->pending;
+    if (pending) {
+        struct sc_worker_timer **prev = &pool->timers;
+        while (*prev != timer) {
+            assert(*prev);
+            prev = &(*prev)->next;
+        }
+        *prev = timer->next;
+        timer->pending = false;
+    }
+
+    sc_mutex_unlock(&pool->mutex);
+
+    return pending;
+}
+
+void
+sc_strand_init(struct sc_strand *strand, struct sc_worker_pool *pool) {
+    strand->pool = pool;
+    sc_vecdeque_init(&strand->queue);
+    strand->active = false;
+    strand->next = NULL;
+}
+
+void
+sc_strand_destroy(struct sc_strand *strand) {
+    struct sc_worker_pool *pool = strand->pool;
+
+    sc_mutex_lock(&pool->mutex);
+    // The worker may still access the strand once the last job returned
+    while (strand->active && !pool->stopped) {
+        sc_cond_wait(&pool->idle_cond, &pool->mutex);
+    }
+    sc_mutex_unlock(&pool->mutex);
+
+    sc_vecdeque_destroy(&strand->queue);
+}
+
+bool
+sc_strand_post(struct sc_strand *strand, sc_worker_fn fn, void *userdata) {
+    struct sc_worker_pool *pool = strand->pool;
+    struct sc_worker_job job = {
+        .fn = fn,
+        .userdata = userdata,
+    };
+
+    sc_mutex_lock(&pool->mutex);
+
+    if (pool->stopped) {
+        sc_mutex_unlock(&pool->mutex);
+        return false;
+    }
+
+    bool ok = sc_vecdeque_push(&strand->queue, job);
+    if (!ok) {
+        sc_mutex_unlock(&pool->mutex);
+        LOG_OOM();
+        return false;
+    }
+
+    if (!strand->active) {
+        strand->active = true;
+        sc_worker_pool_make_ready(pool, strand);
+    }
+
+    sc_mutex_unlock(&pool->mutex);
+
+    return true;
+}
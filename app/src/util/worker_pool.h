@@ -0,0 +1,138 @@
+#ifndef SC_WORKER_POOL_H
+#define SC_WORKER_POOL_H
+
+#include "common.h"
+
+#include <stdbool.h>
+
+#include "util/thread.h"
+#include "util/tick.h"
+#include "util/vecdeque.h"
+
+typedef void (*sc_worker_fn)(void *userdata);
+
+struct sc_worker_job {
+    sc_worker_fn fn;
+    void *userdata;
+};
+
+struct sc_worker_pool;
+
+/**
+ * Serial queue of jobs executed by a worker pool
+ *
+ * The jobs posted to the same strand are executed in order, one at a time
+ * (but not necessarily by the same worker thread). The jobs of different
+ * strands are executed in parallel.
+ *
+ * This allows to share a few threads between many streams, while each stream
+ * is processed sequentially (e.g. packets decoded in order).
+ */
+struct sc_strand {
+    struct sc_worker_pool *pool;
+
+    // All the fields below are protected by the pool mutex
+    struct sc_worker_job_queue SC_VECDEQUE(struct sc_worker_job) queue;
+    // true while the strand is in the ready list or its job is running
+    bool active;
+    struct sc_strand *next; // in the ready list
+};
+
+/**
+ * Job executed by any worker at a given time
+ */
+struct sc_worker_timer {
+    sc_worker_fn fn;
+    void *userdata;
+
+    // Protected by the pool mutex
+    sc_tick deadline;
+    bool pending;
+    struct sc_worker_timer *next; // timers sorted by deadline
+};
+
+/**
+ * Fixed set of threads executing the jobs of strands and timers
+ */
+struct sc_worker_pool {
+    sc_thread *threads;
+    unsigned count;
+
+    sc_mutex mutex;
+    sc_cond cond;
+    sc_cond idle_cond; // signaled when a strand becomes idle
+    bool stopped;
+
+    // Strands having jobs to execute
+    struct sc_strand *ready_head;
+    struct sc_strand *ready_tail;
+
+    struct sc_worker_timer *timers; // pending timers, sorted by deadline
+};
+
+bool
+sc_worker_pool_init(struct sc_worker_pool *pool, unsigned count);
+
+bool
+sc_worker_pool_start(struct sc_worker_pool *pool);
+
+/**
+ * Request the workers to stop
+ *
+ * The workers finish their current job, but the jobs not started yet are
+ * discarded, so the owners must wait for their strands to be idle before.
+ */
+void
+sc_worker_pool_stop(struct sc_worker_pool *pool);
+
+void
+sc_worker_pool_join(struct sc_worker_pool *pool);
+
+void
+sc_worker_pool_destroy(struct sc_worker_pool *pool);
+
+/**
+ * Schedule a timer to run its job at the given deadline
+ *
+ * The timer must not be pending.
+ */
+void
+sc_worker_pool_schedule(struct sc_worker_pool *pool,
+                        struct sc_worker_timer *timer, sc_tick deadline);
+
+/**
+ * Cancel a pending timer
+ *
+ * Return true if the timer was pending (its job will not run), false if it
+ * was not (its job may be running).
+ */
+bool
+sc_worker_pool_cancel(struct sc_worker_pool *pool,
+                      struct sc_worker_timer *timer);
+
+void
+sc_worker_timer_init(struct sc_worker_timer *timer, sc_worker_fn fn,
+                     void *userdata);
+
+void
+sc_strand_init(struct sc_strand *strand, struct sc_worker_pool *pool);
+
+/**
+ * Wait for the jobs of the strand to complete, then destroy it
+ *
+ * No job may be posted to the strand anymore. If the pool is stopped, the
+ * pending jobs are discarded.
+ */
+void
+sc_strand_destroy(struct sc_strand *strand);
+
+/**
+ * Post a job to be executed after all the jobs previously posted to this
+ * strand
+ *
+ * May be called from any thread, including from a job.
+ */
+bool
+sc_strand_post(struct sc_strand *strand, sc_worker_fn fn, void *userdata);
+
+#endif
@@ -1,6 +1,7 @@
 #include "video_regulator.h"
 
 #include <assert.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <libavcodec/avcodec.h>
 
@@ -43,11 +44,44 @@ sc_delayed_packet_destroy(struct sc_delayed_packet *dpacket) {
     }
 }
 
+// Indicate if the next queued frame should already have been displayed (in
+// that case, the current one is late)
+static bool
+sc_video_regulator_must_drop(struct sc_video_regulator *vr) {
+    if (!vr->adaptive || sc_vecdeque_is_empty(&vr->queue)) {
+        return false;
+    }
+
+    struct sc_delayed_packet *next = &vr->queue.data[vr->queue.origin];
+    if (next->type != SC_DELAYED_PACKET_TYPE_FRAME) {
+        return false;
+    }
+
+    sc_tick pts = SC_TICK_FROM_US(next->frame->pts);
+    sc_tick deadline = sc_clock_to_system_time(&vr->clock, pts) + vr->delay;
+    return deadline <= sc_tick_now();
+}
+
+static void
+sc_video_regulator_publish_stats(struct sc_video_regulator *vr) {
+    sc_mutex_assert(&vr->mutex);
+
+    atomic_store_explicit(&vr->stats_delay, vr->delay, memory_order_relaxed);
+    atomic_store_explicit(&vr->stats_frames,
+                          vr->adaptive ? vr->jitter.frames : 0,
+                          memory_order_relaxed);
+    atomic_store_explicit(&vr->stats_late,
+                          vr->adaptive ? vr->jitter.late : 0,
+                          memory_order_relaxed);
+    atomic_store_explicit(&vr->stats_dropped, vr->dropped,
+                          memory_order_relaxed);
+}
+
 static int
 run_buffering(void *data) {
     struct sc_video_regulator *vr = data;
 
-    assert(vr->delay > 0);
+    assert(vr->adaptive || vr->delay > 0);
 
     for (;;) {
         sc_mutex_lock(&vr->mutex);
@@ -63,6 +97,15 @@ run_buffering(void *data) {
 
         struct sc_delayed_packet dpacket = sc_vecdeque_pop(&vr->queue);
 
+        if (dpacket.type == SC_DELAYED_PACKET_TYPE_FRAME
+                && sc_video_regulator_must_drop(vr)) {
+            ++vr->dropped;
+            sc_video_regulator_publish_stats(vr);
+            sc_mutex_unlock(&vr->mutex);
+            sc_delayed_packet_destroy(&dpacket);
+            continue;
+        }
+
         bool ok;
         if (dpacket.type == SC_DELAYED_PACKET_TYPE_FRAME) {
             sc_tick max_deadline = sc_tick_now() + vr->delay;
@@ -190,6 +233,13 @@ sc_video_regulator_frame_sink_close(struct sc_frame_sink *sink) {
 
     sc_thread_join(&vr->thread, NULL);
 
+    if (vr->adaptive) {
+        LOGI("Video buffer: delay %" PRItick " ms, %" PRIu64 " late and %"
+             PRIu64 " dropped frames (out of %" PRIu64 ")",
+             SC_TICK_TO_MS(vr->delay), vr->jitter.late, vr->dropped,
+             vr->jitter.frames);
+    }
+
     sc_frame_source_sinks_close(&vr->frame_source);
 
     sc_cond_destroy(&vr->wait_cond);
@@ -209,8 +259,15 @@ sc_video_regulator_frame_sink_push(struct sc_frame_sink *sink,
         return false;
     }
 
+    sc_tick now = sc_tick_now();
     sc_tick pts = SC_TICK_FROM_US(frame->pts);
-    sc_clock_update(&vr->clock, sc_tick_now(), pts);
+    if (vr->adaptive) {
+        // Measure the jitter against the clock before it is updated
+        sc_jitter_estimator_push(&vr->jitter, &vr->clock, now, pts);
+        vr->delay = vr->jitter.delay;
+        sc_video_regulator_publish_stats(vr);
+    }
+    sc_clock_update(&vr->clock, now, pts);
     sc_cond_signal(&vr->wait_cond);
 
     if (vr->first_frame_asap && vr->clock.range == 1) {
@@ -277,13 +334,16 @@ sc_video_regulator_frame_sink_push_session(struct sc_frame_sink *sink,
     return true;
 }
 
-void
-sc_video_regulator_init(struct sc_video_regulator *vr, sc_tick delay,
-                        bool first_frame_asap) {
-    assert(delay > 0);
-
-    vr->delay = delay;
+static void
+sc_video_regulator_init_common(struct sc_video_regulator *vr,
+                               bool first_frame_asap) {
     vr->first_frame_asap = first_frame_asap;
+    vr->dropped = 0;
+
+    atomic_init(&vr->stats_delay, vr->delay);
+    atomic_init(&vr->stats_frames, 0);
+    atomic_init(&vr->stats_late, 0);
+    atomic_init(&vr->stats_dropped, 0);
 
     sc_frame_source_init(&vr->frame_source);
 
@@ -296,3 +356,35 @@ sc_video_regulator_init(struct sc_video_regulator *vr, sc_tick delay,
 
     vr->frame_sink.ops = &ops;
 }
+
+void
+sc_video_regulator_init(struct sc_video_regulator *vr, sc_tick delay,
+                        bool first_frame_asap) {
+    assert(delay > 0);
+
+    vr->delay = delay;
+    vr->adaptive = false;
+    sc_video_regulator_init_common(vr, first_frame_asap);
+}
+
+void
+sc_video_regulator_init_adaptive(struct sc_video_regulator *vr,
+                                 sc_tick min_delay, sc_tick max_delay,
+                                 bool first_frame_asap) {
+    sc_jitter_estimator_init(&vr->jitter, min_delay, max_delay);
+    vr->delay = vr->jitter.delay;
+    vr->adaptive = true;
+    sc_video_regulator_init_common(vr, first_frame_asap);
+}
+
+void
+sc_video_regulator_get_stats(struct sc_video_regulator *vr,
+                             struct sc_video_regulator_stats *stats) {
+    stats->delay = atomic_load_explicit(&vr->stats_delay,
+                                        memory_order_relaxed);
+    stats->frames = atomic_load_explicit(&vr->stats_frames,
+                                         memory_order_relaxed);
+    stats->late = atomic_load_explicit(&vr->stats_late, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&vr->stats_dropped,
+                                          memory_order_relaxed);
+}
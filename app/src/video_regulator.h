@@ -3,10 +3,13 @@
 
 #include "common.h"
 
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <libavutil/frame.h>
 
 #include "clock.h"
+#include "jitter_estimator.h"
 #include "trait/frame_source.h"
 #include "trait/frame_sink.h"
 #include "util/thread.h"
@@ -43,6 +46,19 @@ struct sc_video_regulator {
     sc_tick delay;
     bool first_frame_asap;
 
+    // If set, the delay is adjusted continuously to the measured jitter
+    bool adaptive;
+    struct sc_jitter_estimator jitter;
+    // Late frames dropped to catch up (only in adaptive mode)
+    uint64_t dropped;
+
+    // Copy of the statistics, readable without the mutex (which only exists
+    // while the frame sink is open)
+    atomic_int_least64_t stats_delay;
+    atomic_uint_least64_t stats_frames;
+    atomic_uint_least64_t stats_late;
+    atomic_uint_least64_t stats_dropped;
+
     sc_thread thread;
     sc_mutex mutex;
     sc_cond queue_cond;
@@ -53,6 +69,13 @@ struct sc_video_regulator {
     bool stopped;
 };
 
+struct sc_video_regulator_stats {
+    sc_tick delay; // the current (target) delay
+    uint64_t frames;
+    uint64_t late;
+    uint64_t dropped;
+};
+
 struct sc_video_regulator_callbacks {
     bool (*on_new_frame)(struct sc_video_regulator *vr, const AVFrame *frame,
                          void *userdata);
@@ -69,4 +92,27 @@ void
 sc_video_regulator_init(struct sc_video_regulator *vr, sc_tick delay,
                         bool first_frame_asap);
 
+/**
+ * Initialize a video regulator with an adaptive delay.
+ *
+ * The delay is adjusted continuously, between min_delay and max_delay, to
+ * absorb the measured jitter of the frames arrival (see jitter_estimator.h).
+ * When a frame is still queued while the next one should already have been
+ * displayed, it is dropped to catch up.
+ */
+void
+sc_video_regulator_init_adaptive(struct sc_video_regulator *vr,
+                                 sc_tick min_delay, sc_tick max_delay,
+                                 bool first_frame_asap);
+
+/**
+ * Get the statistics of the regulator
+ *
+ * It may be called from any thread once the regulator is initialized, even
+ * if the frame sink is not open (yet or anymore).
+ */
+void
+sc_video_regulator_get_stats(struct sc_video_regulator *vr,
+                             struct sc_video_regulator_stats *stats);
+
 #endif
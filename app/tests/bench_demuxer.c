@@ -0,0 +1,386 @@
+#include "common.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <libavcodec/avcodec.h>
+
+#include "demuxer.h"
+#include "util/binary.h"
+
+#define BENCH_AUDIO_PACKETS 200000
+#define BENCH_VIDEO_PACKETS 20000
+
+// Count the heap allocations (from any thread) by interposing the glibc
+// allocator, FFmpeg allocates via posix_memalign()
+#ifdef __GLIBC__
+# define BENCH_COUNT_ALLOCS
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static atomic_ulong alloc_count;
+
+void *malloc(size_t size) {
+    atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+    atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+    void *p = __libc_memalign(alignment, size);
+    if (!p) {
+        return ENOMEM;
+    }
+    *ptr = p;
+    return 0;
+}
+
+static unsigned long
+get_alloc_count(void) {
+    return atomic_load_explicit(&alloc_count, memory_order_relaxed);
+}
+#else
+static unsigned long
+get_alloc_count(void) {
+    return 0;
+}
+#endif
+
+static double
+wall_time_ms(void) {
+    struct timespec ts;
+    int r = clock_gettime(CLOCK_MONOTONIC, &ts);
+    assert(!r);
+    (void) r;
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+struct stream {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    unsigned packets;
+};
+
+static void
+stream_append(struct stream *stream, const void *data, size_t len) {
+    if (stream->size + len > stream->capacity) {
+        stream->capacity = (stream->size + len) * 2;
+        stream->data = realloc(stream->data, stream->capacity);
+        assert(stream->data);
+    }
+    memcpy(stream->data + stream->size, data, len);
+    stream->size += len;
+}
+
+static void
+stream_append_packet(struct stream *stream, uint64_t pts_flags,
+                     uint32_t len) {
+    uint8_t header[12];
+    sc_write64be(header, pts_flags);
+    sc_write32be(&header[8], len);
+    stream_append(stream, header, sizeof(header));
+
+    uint8_t payload[4096];
+    memset(payload, 0x5a, sizeof(payload));
+    while (len) {
+        uint32_t chunk = len < sizeof(payload) ? len : sizeof(payload);
+        stream_append(stream, payload, chunk);
+        len -= chunk;
+    }
+
+    ++stream->packets;
+}
+
+static uint32_t
+bench_rand(uint32_t *state) {
+    *state = *state * 1103515245 + 12345;
+    return *state >> 8;
+}
+
+// Same packet sizes as a recorded Opus stream: 20 ms packets of 150-400 bytes
+static void
+make_audio_stream(struct stream *stream, unsigned count) {
+    uint8_t codec_id[4];
+    sc_write32be(codec_id, 0x6f707573); // "opus"
+    stream_append(stream, codec_id, sizeof(codec_id));
+
+    uint32_t seed = 42;
+    for (unsigned i = 0; i < count; ++i) {
+        uint32_t len = 150 + bench_rand(&seed) % 250;
+        stream_append_packet(stream, (uint64_t) i * 20000, len);
+    }
+}
+
+// Same packet sizes as a recorded H.264 screen stream: a 40-80 KB key frame
+// every 60 frames, 1-20 KB otherwise
+static void
+make_video_stream(struct stream *stream, unsigned count) {
+    uint8_t codec_id[4];
+    sc_write32be(codec_id, 0x68323634); // "h264"
+    stream_append(stream, codec_id, sizeof(codec_id));
+
+    uint8_t session[12] = {0x80};
+    sc_write32be(&session[4], 1080);
+    sc_write32be(&session[8], 2400);
+    stream_append(stream, session, sizeof(session));
+
+    // Config packet (SPS/PPS)
+    stream_append_packet(stream, UINT64_C(1) << 62, 32);
+
+    uint32_t seed = 42;
+    for (unsigned i = 0; i < count; ++i) {
+        uint64_t pts_flags = (uint64_t) i * 16666;
+        uint32_t len;
+        if (i % 60 == 0) {
+            pts_flags |= UINT64_C(1) << 61;
+            len = 40000 + bench_rand(&seed) % 40000;
+        } else {
+            len = 1000 + bench_rand(&seed) % 19000;
+        }
+        stream_append_packet(stream, pts_flags, len);
+    }
+}
+
+struct writer {
+    pthread_t thread;
+    int fd;
+    const struct stream *stream;
+};
+
+static void *
+run_writer(void *data) {
+    struct writer *writer = data;
+    const uint8_t *p = writer->stream->data;
+    size_t remaining = writer->stream->size;
+    while (remaining) {
+        ssize_t w = write(writer->fd, p, remaining);
+        if (w <= 0) {
+            break;
+        }
+        p += w;
+        remaining -= w;
+    }
+
+    // End of stream
+    shutdown(writer->fd, SHUT_WR);
+    return NULL;
+}
+
+static void
+writer_start(struct writer *writer, int fd, const struct stream *stream) {
+    writer->fd = fd;
+    writer->stream = stream;
+    int r = pthread_create(&writer->thread, NULL, run_writer, writer);
+    assert(!r);
+    (void) r;
+}
+
+static void
+writer_join(struct writer *writer) {
+    pthread_join(writer->thread, NULL);
+    close(writer->fd);
+}
+
+struct counting_sink {
+    struct sc_packet_sink packet_sink; // packet sink trait
+    unsigned packets;
+    uint64_t bytes;
+};
+
+#define DOWNCAST(SINK) container_of(SINK, struct counting_sink, packet_sink)
+
+static bool
+counting_sink_open(struct sc_packet_sink *sink, AVCodecContext *ctx,
+                   const struct sc_stream_session *session) {
+    (void) sink;
+    (void) ctx;
+    (void) session;
+    return true;
+}
+
+static void
+counting_sink_close(struct sc_packet_sink *sink) {
+    (void) sink;
+}
+
+static bool
+counting_sink_push(struct sc_packet_sink *sink, const AVPacket *packet) {
+    struct counting_sink *cs = DOWNCAST(sink);
+    ++cs->packets;
+    cs->bytes += packet->size;
+    return true;
+}
+
+static void
+on_demuxer_ended(struct sc_demuxer *demuxer, enum sc_demuxer_status status,
+                 void *userdata) {
+    (void) demuxer;
+    (void) userdata;
+    assert(status == SC_DEMUXER_STATUS_EOS);
+    (void) status;
+}
+
+static void
+print_result(const char *name, unsigned packets, double ms,
+             unsigned long allocs, uint64_t recv_calls) {
+    printf("  %-8s %10.0f packets/s", name, packets / ms * 1000);
+#ifdef BENCH_COUNT_ALLOCS
+    printf(", %5.2f allocs/packet", (double) allocs / packets);
+#else
+    (void) allocs;
+#endif
+    printf(", %5.2f recv/packet\n", (double) recv_calls / packets);
+}
+
+// Previous implementation: a blocking read for the header, then
+// av_new_packet() and a blocking read for the payload
+static void
+bench_legacy(const struct stream *stream, bool video) {
+    int fds[2];
+    int r = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(!r);
+    (void) r;
+
+    struct writer writer;
+    writer_start(&writer, fds[1], stream);
+
+    AVPacket *packet = av_packet_alloc();
+    assert(packet);
+
+    unsigned long allocs = get_alloc_count();
+    double start = wall_time_ms();
+
+    uint8_t header[12];
+    ssize_t n = recv(fds[0], header, 4, MSG_WAITALL);
+    assert(n == 4);
+    uint64_t recv_calls = 1;
+    if (video) {
+        n = recv(fds[0], header, 12, MSG_WAITALL);
+        assert(n == 12);
+        ++recv_calls;
+    }
+
+    unsigned packets = 0;
+    for (;;) {
+        n = recv(fds[0], header, 12, MSG_WAITALL);
+        ++recv_calls;
+        if (n < 12) {
+            break;
+        }
+
+        uint32_t len = sc_read32be(&header[8]);
+        r = av_new_packet(packet, len);
+        assert(!r);
+        n = recv(fds[0], packet->data, len, MSG_WAITALL);
+        ++recv_calls;
+        assert(n == (ssize_t) len);
+        ++packets;
+        av_packet_unref(packet);
+    }
+
+    double ms = wall_time_ms() - start;
+    allocs = get_alloc_count() - allocs;
+
+    av_packet_free(&packet);
+    writer_join(&writer);
+    close(fds[0]);
+
+    assert(packets == stream->packets);
+    print_result("legacy", packets, ms, allocs, recv_calls);
+}
+
+static void
+bench_demuxer(const struct stream *stream) {
+    int fds[2];
+    int r = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(!r);
+    (void) r;
+
+    static const struct sc_packet_sink_ops ops = {
+        .open = counting_sink_open,
+        .close = counting_sink_close,
+        .push = counting_sink_push,
+    };
+    struct counting_sink sink = {
+        .packet_sink = {.ops = &ops},
+    };
+
+    static const struct sc_demuxer_callbacks cbs = {
+        .on_ended = on_demuxer_ended,
+    };
+    struct sc_demuxer demuxer;
+    sc_demuxer_init(&demuxer, "bench", fds[0], &cbs, NULL);
+    sc_packet_source_add_sink(&demuxer.packet_source, &sink.packet_sink);
+
+    struct writer writer;
+    writer_start(&writer, fds[1], stream);
+
+    unsigned long allocs = get_alloc_count();
+    double start = wall_time_ms();
+
+    bool ok = sc_demuxer_start(&demuxer);
+    assert(ok);
+    (void) ok;
+    sc_demuxer_join(&demuxer);
+
+    double ms = wall_time_ms() - start;
+    allocs = get_alloc_count() - allocs;
+
+    writer_join(&writer);
+    close(fds[0]);
+
+    // For H.264, the config packet is merged into the next packet
+    assert(sink.packets == stream->packets
+        || sink.packets + 1 == stream->packets);
+    // The reader buffer is released, but the counter is still valid
+    print_result("pooled", sink.packets, ms, allocs, demuxer.reader.recv_count);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned audio_packets = argc > 1 ? (unsigned) atoi(argv[1])
+                                      : BENCH_AUDIO_PACKETS;
+    unsigned video_packets = argc > 2 ? (unsigned) atoi(argv[2])
+                                      : BENCH_VIDEO_PACKETS;
+    if (!audio_packets || !video_packets) {
+        fprintf(stderr, "usage: %s [audio_packets video_packets]\n", argv[0]);
+        return 1;
+    }
+
+    struct stream audio = {0};
+    make_audio_stream(&audio, audio_packets);
+    printf("opus-like stream: %u packets, %zu bytes\n", audio.packets,
+           audio.size);
+    bench_legacy(&audio, false);
+    bench_demuxer(&audio);
+    free(audio.data);
+
+    struct stream video = {0};
+    make_video_stream(&video, video_packets);
+    printf("h264-like stream: %u packets, %zu bytes\n", video.packets,
+           video.size);
+    bench_legacy(&video, true);
+    bench_demuxer(&video);
+    free(video.data);
+
+    return 0;
+}
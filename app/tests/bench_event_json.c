@@ -0,0 +1,128 @@
+#include "common.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "control_msg.h"
+#include "../../linkandroid/src/event_json.h"
+
+#define BENCH_ITERATIONS 2000000
+
+static double
+cpu_time_ms(void) {
+    struct timespec ts;
+    int r = clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    assert(!r);
+    (void) r;
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// Previous implementation: mutex-protected id, malloc(512) and snprintf for
+// every event
+static uint32_t
+legacy_next_msg_id(void) {
+    static pthread_mutex_t id_mutex = PTHREAD_MUTEX_INITIALIZER;
+    static uint32_t counter = 1;
+
+    pthread_mutex_lock(&id_mutex);
+    counter = counter * 1103515245 + 12345;
+    uint32_t id = counter;
+    pthread_mutex_unlock(&id_mutex);
+
+    return id;
+}
+
+static char *
+legacy_serialize(const struct sc_control_msg *msg, uint16_t device_width,
+                 uint16_t device_height) {
+    char *json_str = malloc(512);
+    if (!json_str) {
+        return NULL;
+    }
+
+    char id_str[9];
+    snprintf(id_str, sizeof(id_str), "%08x", legacy_next_msg_id());
+
+    char pointer_id_str[32];
+    snprintf(pointer_id_str, sizeof(pointer_id_str), "%llu",
+             (unsigned long long) msg->inject_touch_event.pointer_id);
+
+    int x = (int) msg->inject_touch_event.position.point.x;
+    int y = (int) msg->inject_touch_event.position.point.y;
+
+    snprintf(json_str, 512,
+             "{\"type\":\"%s\",\"id\":\"%s\","
+             "\"data\":{\"pointer_id\":\"%s\","
+             "\"x\":%d,\"y\":%d,\"pressure\":%.6f,"
+             "\"width\":%u,\"height\":%u}}",
+             "touch_move", id_str, pointer_id_str,
+             x, y, msg->inject_touch_event.pressure,
+             device_width, device_height);
+
+    return json_str;
+}
+
+static struct sc_control_msg
+make_touch_move(int i) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT,
+        .inject_touch_event = {
+            .action = AMOTION_EVENT_ACTION_MOVE,
+            .pointer_id = SC_POINTER_ID_MOUSE,
+            .position = {
+                .screen_size = {1080, 2400},
+                .point = {i % 1080, i % 2400},
+            },
+            .pressure = 1.0f,
+        },
+    };
+    return msg;
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    // Prevent the compiler from optimizing the work away
+    size_t total = 0;
+
+    double start = cpu_time_ms();
+    for (int i = 0; i < BENCH_ITERATIONS; ++i) {
+        struct sc_control_msg msg = make_touch_move(i);
+        char *json = legacy_serialize(&msg, 1080, 2400);
+        assert(json);
+        total += strlen(json);
+        free(json);
+    }
+    double legacy_ms = cpu_time_ms() - start;
+
+    atomic_uint_least32_t id;
+    atomic_init(&id, 1);
+    // Written in place into a preallocated queue slot
+    char slot[1024];
+
+    start = cpu_time_ms();
+    for (int i = 0; i < BENCH_ITERATIONS; ++i) {
+        struct sc_control_msg msg = make_touch_move(i);
+        uint32_t msg_id =
+            atomic_fetch_add_explicit(&id, 1, memory_order_relaxed);
+        size_t len = la_event_json_serialize(&msg, msg_id, 1080, 2400, slot,
+                                             sizeof(slot));
+        assert(len && len <= sizeof(slot));
+        total += len;
+    }
+    double streaming_ms = cpu_time_ms() - start;
+
+    printf("touch_move events/s: legacy %.0f, streaming %.0f (x%.2f)\n",
+           BENCH_ITERATIONS / legacy_ms * 1000,
+           BENCH_ITERATIONS / streaming_ms * 1000,
+           legacy_ms / streaming_ms);
+    printf("(%zu bytes)\n", total);
+
+    return 0;
+}
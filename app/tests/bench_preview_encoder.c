@@ -0,0 +1,164 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+
+#include "../../linkandroid/src/preview_encoder.h"
+
+#define BENCH_WIDTH 1080
+#define BENCH_HEIGHT 2400
+#define BENCH_RATIO 20
+#define BENCH_ITERATIONS 50
+
+static double
+cpu_time_ms(void) {
+    struct timespec ts;
+    int r = clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    assert(!r);
+    (void) r;
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static AVFrame *
+make_frame(int width, int height) {
+    AVFrame *frame = av_frame_alloc();
+    assert(frame);
+
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = width;
+    frame->height = height;
+    int r = av_frame_get_buffer(frame, 32);
+    assert(!r);
+    (void) r;
+
+    // Some screen-like content: flat areas with a few gradients
+    for (int y = 0; y < height; ++y) {
+        uint8_t *line = frame->data[0] + y * frame->linesize[0];
+        for (int x = 0; x < width; ++x) {
+            line[x] = y < height / 8 ? 40 : (uint8_t) ((x + y) / 16);
+        }
+    }
+    for (int p = 1; p < 3; ++p) {
+        for (int y = 0; y < height / 2; ++y) {
+            uint8_t *line = frame->data[p] + y * frame->linesize[p];
+            for (int x = 0; x < width / 2; ++x) {
+                line[x] = (uint8_t) (128 + (p == 1 ? x : y) % 32);
+            }
+        }
+    }
+
+    return frame;
+}
+
+// Check that the packet is a complete image in the actual format
+static void
+assert_image(const AVPacket *packet, enum la_preview_format format) {
+    assert(packet && packet->size > 12);
+    const uint8_t *data = packet->data;
+    switch (format) {
+        case LA_PREVIEW_FORMAT_JPEG:
+            assert(data[0] == 0xFF && data[1] == 0xD8);
+            break;
+        case LA_PREVIEW_FORMAT_WEBP:
+            assert(!memcmp(data, "RIFF", 4) && !memcmp(data + 8, "WEBP", 4));
+            break;
+        default:
+            assert(!memcmp(data, "\x89PNG", 4));
+            break;
+    }
+    (void) data;
+}
+
+// Previous behavior: a new encoder session for every preview
+static double
+bench_one_shot(const AVFrame *frame, enum la_preview_format format,
+               uint8_t ratio, int iterations) {
+    double start = cpu_time_ms();
+    for (int i = 0; i < iterations; ++i) {
+        struct la_preview_encoder enc;
+        bool ok = la_preview_encoder_init(&enc);
+        assert(ok);
+        (void) ok;
+        const AVPacket *packet =
+            la_preview_encoder_encode(&enc, frame, format, ratio,
+                                      LA_PREVIEW_DEFAULT_QUALITY);
+        assert_image(packet, enc.image_format);
+        (void) packet;
+        la_preview_encoder_destroy(&enc);
+    }
+    return (cpu_time_ms() - start) / iterations;
+}
+
+static double
+bench_persistent(const AVFrame *frame, enum la_preview_format format,
+                 uint8_t ratio, int iterations, size_t *size) {
+    struct la_preview_encoder enc;
+    bool ok = la_preview_encoder_init(&enc);
+    assert(ok);
+    (void) ok;
+
+    double start = cpu_time_ms();
+    for (int i = 0; i < iterations; ++i) {
+        const AVPacket *packet =
+            la_preview_encoder_encode(&enc, frame, format, ratio,
+                                      LA_PREVIEW_DEFAULT_QUALITY);
+        // Every frame produces an image (no encoder delay)
+        assert_image(packet, enc.image_format);
+        *size = packet->size;
+    }
+    double result = (cpu_time_ms() - start) / iterations;
+
+    if (enc.image_format != format) {
+        printf("  (%s not available, %s used)\n",
+               la_preview_format_name(format),
+               la_preview_format_name(enc.image_format));
+    }
+
+    la_preview_encoder_destroy(&enc);
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    int width = argc > 1 ? atoi(argv[1]) : BENCH_WIDTH;
+    int height = argc > 2 ? atoi(argv[2]) : BENCH_HEIGHT;
+    int ratio = argc > 3 ? atoi(argv[3]) : BENCH_RATIO;
+    int iterations = argc > 4 ? atoi(argv[4]) : BENCH_ITERATIONS;
+    if (width <= 0 || height <= 0 || ratio < 1 || ratio > 100
+            || iterations <= 0) {
+        fprintf(stderr, "usage: %s [width height ratio iterations]\n",
+                argv[0]);
+        return 1;
+    }
+
+    AVFrame *frame = make_frame(width, height);
+
+    printf("preview %dx%d ratio=%d%% (%d iterations)\n", width, height, ratio,
+           iterations);
+
+    static const enum la_preview_format formats[] = {
+        LA_PREVIEW_FORMAT_PNG,
+        LA_PREVIEW_FORMAT_JPEG,
+        LA_PREVIEW_FORMAT_WEBP,
+    };
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i) {
+        enum la_preview_format format = formats[i];
+        size_t size = 0;
+        double one_shot = bench_one_shot(frame, format, ratio, iterations);
+        double persistent =
+            bench_persistent(frame, format, ratio, iterations, &size);
+
+        printf("%s (quality %d): %zu bytes/preview\n",
+               la_preview_format_name(format), LA_PREVIEW_DEFAULT_QUALITY,
+               size);
+        printf("  one-shot session:   %8.3f ms CPU/preview\n", one_shot);
+        printf("  persistent session: %8.3f ms CPU/preview\n", persistent);
+    }
+
+    av_frame_free(&frame);
+    return 0;
+}
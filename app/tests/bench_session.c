@@ -0,0 +1,517 @@
+#include "common.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libavcodec/avcodec.h>
+
+#include "control_msg.h"
+#include "decoder.h"
+#include "demuxer.h"
+#include "device_msg.h"
+#include "fake_device.h"
+#include "util/acksync.h"
+#include "util/net.h"
+#include "util/thread.h"
+#include "util/tick.h"
+
+// End-to-end session against a local fake device (see fake_device.h): real
+// TCP sockets, demuxers, decoders and control messages, without any phone or
+// adb.
+//
+//     bench_session [WIDTHxHEIGHT] [FPS] [SECONDS]
+//
+// It reports the frame rate and decoding time of the video, and the latency
+// of the control messages (one way, and round-trip through a clipboard
+// acknowledgement).
+
+// Interval between touch events (like a finger moving on the screen)
+#define BENCH_TOUCH_INTERVAL SC_TICK_FROM_MS(8)
+// A clipboard request (acknowledged by the device) every N touch events
+#define BENCH_ACK_EVERY 12
+#define BENCH_MAX_CONTROL_MSGS 100000
+
+struct bench_frame_sink {
+    struct sc_frame_sink frame_sink; // frame sink trait
+    unsigned frames;
+    sc_tick first;
+    sc_tick last;
+};
+
+#define DOWNCAST_FRAME(SINK) \
+    container_of(SINK, struct bench_frame_sink, frame_sink)
+
+static bool
+bench_frame_sink_open(struct sc_frame_sink *sink, const AVCodecContext *ctx,
+                      const struct sc_stream_session *session) {
+    (void) sink;
+    (void) ctx;
+    (void) session;
+    return true;
+}
+
+static void
+bench_frame_sink_close(struct sc_frame_sink *sink) {
+    (void) sink;
+}
+
+static bool
+bench_frame_sink_push(struct sc_frame_sink *sink, const AVFrame *frame) {
+    (void) frame;
+    struct bench_frame_sink *fs = DOWNCAST_FRAME(sink);
+    sc_tick now = sc_tick_now();
+    if (!fs->frames) {
+        fs->first = now;
+    }
+    fs->last = now;
+    ++fs->frames;
+    return true;
+}
+
+static void
+bench_frame_sink_init(struct bench_frame_sink *fs) {
+    static const struct sc_frame_sink_ops ops = {
+        .open = bench_frame_sink_open,
+        .close = bench_frame_sink_close,
+        .push = bench_frame_sink_push,
+    };
+
+    memset(fs, 0, sizeof(*fs));
+    fs->frame_sink.ops = &ops;
+}
+
+// Packet sink measuring the time spent in the decoder it wraps
+struct bench_decode_timer {
+    struct sc_packet_sink packet_sink; // packet sink trait
+    struct sc_packet_sink *decoder;
+    unsigned packets;
+    sc_tick total;
+    sc_tick max;
+};
+
+#define DOWNCAST_TIMER(SINK) \
+    container_of(SINK, struct bench_decode_timer, packet_sink)
+
+static bool
+bench_decode_timer_open(struct sc_packet_sink *sink, AVCodecContext *ctx,
+                        const struct sc_stream_session *session) {
+    struct bench_decode_timer *timer = DOWNCAST_TIMER(sink);
+    return timer->decoder->ops->open(timer->decoder, ctx, session);
+}
+
+static void
+bench_decode_timer_close(struct sc_packet_sink *sink) {
+    struct bench_decode_timer *timer = DOWNCAST_TIMER(sink);
+    timer->decoder->ops->close(timer->decoder);
+}
+
+static bool
+bench_decode_timer_push(struct sc_packet_sink *sink, const AVPacket *packet) {
+    struct bench_decode_timer *timer = DOWNCAST_TIMER(sink);
+
+    sc_tick start = sc_tick_now();
+    bool ok = timer->decoder->ops->push(timer->decoder, packet);
+    sc_tick duration = sc_tick_now() - start;
+
+    if (packet->pts != AV_NOPTS_VALUE) {
+        ++timer->packets;
+        timer->total += duration;
+        if (duration > timer->max) {
+            timer->max = duration;
+        }
+    }
+
+    return ok;
+}
+
+static bool
+bench_decode_timer_push_session(struct sc_packet_sink *sink,
+                                const struct sc_stream_session *session) {
+    struct bench_decode_timer *timer = DOWNCAST_TIMER(sink);
+    const struct sc_packet_sink_ops *ops = timer->decoder->ops;
+    return !ops->push_session || ops->push_session(timer->decoder, session);
+}
+
+static void
+bench_decode_timer_init(struct bench_decode_timer *timer,
+                        struct sc_packet_sink *decoder) {
+    static const struct sc_packet_sink_ops ops = {
+        .open = bench_decode_timer_open,
+        .close = bench_decode_timer_close,
+        .push = bench_decode_timer_push,
+        .push_session = bench_decode_timer_push_session,
+    };
+
+    memset(timer, 0, sizeof(*timer));
+    timer->packet_sink.ops = &ops;
+    timer->decoder = decoder;
+}
+
+struct bench_stream {
+    struct sc_demuxer demuxer;
+    struct sc_decoder decoder;
+    struct bench_decode_timer timer;
+    struct bench_frame_sink sink;
+    enum sc_demuxer_status status;
+};
+
+static void
+on_demuxer_ended(struct sc_demuxer *demuxer, enum sc_demuxer_status status,
+                 void *userdata) {
+    (void) demuxer;
+    struct bench_stream *stream = userdata;
+    stream->status = status;
+}
+
+static bool
+bench_stream_start(struct bench_stream *stream, const char *name,
+                   sc_socket socket) {
+    static const struct sc_demuxer_callbacks cbs = {
+        .on_ended = on_demuxer_ended,
+    };
+
+    sc_demuxer_init(&stream->demuxer, name, socket, &cbs, stream);
+    sc_decoder_init(&stream->decoder, name, NULL);
+    bench_decode_timer_init(&stream->timer, &stream->decoder.packet_sink);
+    bench_frame_sink_init(&stream->sink);
+
+    sc_frame_source_add_sink(&stream->decoder.frame_source,
+                             &stream->sink.frame_sink);
+    sc_packet_source_add_sink(&stream->demuxer.packet_source,
+                              &stream->timer.packet_sink);
+
+    return sc_demuxer_start(&stream->demuxer);
+}
+
+// Read the device messages (acknowledgements) from the control socket
+struct bench_receiver {
+    sc_thread thread;
+    sc_socket socket;
+    struct sc_acksync acksync;
+};
+
+static int
+run_receiver(void *data) {
+    struct bench_receiver *receiver = data;
+
+    static uint8_t buf[DEVICE_MSG_MAX_SIZE];
+    size_t len = 0;
+    for (;;) {
+        ssize_t r = net_recv(receiver->socket, buf + len,
+                             DEVICE_MSG_MAX_SIZE - len);
+        if (r <= 0) {
+            break;
+        }
+        len += r;
+
+        size_t head = 0;
+        for (;;) {
+            struct sc_device_msg msg;
+            r = sc_device_msg_deserialize(buf + head, len - head, &msg);
+            if (r == -1) {
+                fprintf(stderr, "Invalid device message\n");
+                goto end;
+            }
+            if (!r) {
+                break;
+            }
+            if (msg.type == DEVICE_MSG_TYPE_ACK_CLIPBOARD) {
+                sc_acksync_ack(&receiver->acksync,
+                               msg.ack_clipboard.sequence);
+            }
+            sc_device_msg_destroy(&msg);
+            head += r;
+        }
+
+        memmove(buf, buf + head, len - head);
+        len -= head;
+    }
+
+end:
+    sc_acksync_interrupt(&receiver->acksync);
+    return 0;
+}
+
+static sc_socket
+bench_connect(uint16_t port, bool first) {
+    sc_socket socket = net_socket();
+    if (socket == SC_SOCKET_NONE) {
+        return SC_SOCKET_NONE;
+    }
+
+    if (!net_connect(socket, IPV4_LOCALHOST, port)) {
+        net_close(socket);
+        return SC_SOCKET_NONE;
+    }
+
+    if (first) {
+        // Like the client in "adb forward" mode
+        char byte;
+        if (net_recv(socket, &byte, 1) != 1) {
+            net_close(socket);
+            return SC_SOCKET_NONE;
+        }
+    }
+
+    return socket;
+}
+
+static int
+cmp_tick(const void *a, const void *b) {
+    sc_tick ta = *(const sc_tick *) a;
+    sc_tick tb = *(const sc_tick *) b;
+    return (ta > tb) - (ta < tb);
+}
+
+static void
+print_latencies(const char *name, sc_tick *values, unsigned count) {
+    if (!count) {
+        printf("  %-10s no samples\n", name);
+        return;
+    }
+
+    qsort(values, count, sizeof(*values), cmp_tick);
+    sc_tick total = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        total += values[i];
+    }
+
+    printf("  %-10s %5u samples, avg %.3f ms, p50 %.3f ms, p99 %.3f ms, "
+           "max %.3f ms\n", name, count, (double) total / count / 1000,
+           values[count / 2] / 1000.0, values[count * 99 / 100] / 1000.0,
+           values[count - 1] / 1000.0);
+}
+
+static bool
+bench_send(sc_socket socket, const struct sc_control_msg *msg,
+           sc_tick *sent, unsigned *count) {
+    static uint8_t buf[SC_CONTROL_MSG_MAX_SIZE];
+    size_t len = sc_control_msg_serialize(msg, buf);
+    assert(len);
+
+    if (*count < BENCH_MAX_CONTROL_MSGS) {
+        sent[*count] = sc_tick_now();
+    }
+    ++*count;
+
+    return net_send_all(socket, buf, len) == (ssize_t) len;
+}
+
+// Move a finger on the screen, with a clipboard request from time to time,
+// until the end of the streams
+static void
+bench_input(sc_socket socket, struct sc_acksync *acksync, uint16_t width,
+            uint16_t height, sc_tick duration, sc_tick *sent,
+            unsigned *sent_count, sc_tick *rtts, unsigned *rtt_count) {
+    struct sc_control_msg touch = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT,
+        .inject_touch_event = {
+            .action = AMOTION_EVENT_ACTION_DOWN,
+            .pointer_id = SC_POINTER_ID_GENERIC_FINGER,
+            .position = {
+                .screen_size = {width, height},
+            },
+            .pressure = 1.0f,
+        },
+    };
+
+    char text[] = "bench";
+    struct sc_control_msg clipboard = {
+        .type = SC_CONTROL_MSG_TYPE_SET_CLIPBOARD,
+        .set_clipboard = {
+            .text = text,
+            .paste = false,
+        },
+    };
+
+    sc_tick start = sc_tick_now();
+    sc_tick deadline = start;
+    for (unsigned i = 0; deadline < start + duration; ++i) {
+        touch.inject_touch_event.position.point.x = i % width;
+        touch.inject_touch_event.position.point.y = (i * 3) % height;
+        if (!bench_send(socket, &touch, sent, sent_count)) {
+            return;
+        }
+        touch.inject_touch_event.action = AMOTION_EVENT_ACTION_MOVE;
+
+        if (i % BENCH_ACK_EVERY == 0) {
+            uint64_t sequence = i / BENCH_ACK_EVERY + 1;
+            clipboard.set_clipboard.sequence = sequence;
+
+            sc_tick t = sc_tick_now();
+            if (!bench_send(socket, &clipboard, sent, sent_count)) {
+                return;
+            }
+            enum sc_acksync_wait_result r =
+                sc_acksync_wait(acksync, sequence, t + SC_TICK_FROM_SEC(1));
+            if (r != SC_ACKSYNC_WAIT_OK) {
+                fprintf(stderr, "Clipboard request not acknowledged\n");
+                return;
+            }
+            rtts[(*rtt_count)++] = sc_tick_now() - t;
+        }
+
+        deadline += BENCH_TOUCH_INTERVAL;
+        sc_tick now = sc_tick_now();
+        if (deadline > now) {
+            sc_tick delay = deadline - now;
+            struct timespec ts = {
+                .tv_sec = SC_TICK_TO_SEC(delay),
+                .tv_nsec = SC_TICK_TO_NS(delay % SC_TICK_FREQ),
+            };
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    touch.inject_touch_event.action = AMOTION_EVENT_ACTION_UP;
+    bench_send(socket, &touch, sent, sent_count);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned width = 1280;
+    unsigned height = 720;
+    unsigned fps = 60;
+    unsigned seconds = 5;
+
+    if (argc > 1 && sscanf(argv[1], "%ux%u", &width, &height) != 2) {
+        fprintf(stderr, "usage: %s [WIDTHxHEIGHT] [FPS] [SECONDS]\n",
+                argv[0]);
+        return 1;
+    }
+    if (argc > 2) {
+        fps = strtoul(argv[2], NULL, 10);
+    }
+    if (argc > 3) {
+        seconds = strtoul(argv[3], NULL, 10);
+    }
+    if (!width || !height || width > 0xFFFF || height > 0xFFFF || !fps
+            || !seconds) {
+        fprintf(stderr, "Invalid parameters\n");
+        return 1;
+    }
+
+    if (!net_init()) {
+        return 1;
+    }
+
+    struct fake_device_params params = {
+        .device_name = "Fake device",
+        .video = true,
+        .audio = true,
+        .control = true,
+        .width = width,
+        .height = height,
+        .fps = fps,
+        .duration_ms = seconds * 1000,
+    };
+
+    static struct fake_device device;
+    if (!fake_device_init(&device, &params)) {
+        // No encoder in this FFmpeg build, skip the benchmark
+        return 77;
+    }
+
+    bool ok = fake_device_start(&device);
+    assert(ok);
+
+    sc_socket video_socket = bench_connect(device.port, true);
+    sc_socket audio_socket = bench_connect(device.port, false);
+    sc_socket control_socket = bench_connect(device.port, false);
+    assert(video_socket != SC_SOCKET_NONE);
+    assert(audio_socket != SC_SOCKET_NONE);
+    assert(control_socket != SC_SOCKET_NONE);
+    net_set_tcp_nodelay(control_socket, true);
+
+    char name[64];
+    ssize_t r = net_recv_all(video_socket, name, sizeof(name));
+    assert(r == sizeof(name));
+    (void) r;
+    name[sizeof(name) - 1] = '\0';
+
+    printf("%s: %ux%u @ %u fps, %u s, %s (%s)\n", name, width, height, fps,
+           seconds, avcodec_get_name(device.video_ctx->codec_id),
+           device.video_ctx->codec->name);
+
+    static struct bench_stream video;
+    static struct bench_stream audio;
+    ok = bench_stream_start(&video, "video", video_socket);
+    assert(ok);
+    ok = bench_stream_start(&audio, "audio", audio_socket);
+    assert(ok);
+
+    static struct bench_receiver receiver;
+    receiver.socket = control_socket;
+    ok = sc_acksync_init(&receiver.acksync);
+    assert(ok);
+    ok = sc_thread_create(&receiver.thread, run_receiver, "bench-receiver",
+                          &receiver);
+    assert(ok);
+
+    static sc_tick sent[BENCH_MAX_CONTROL_MSGS];
+    static sc_tick arrived[BENCH_MAX_CONTROL_MSGS];
+    static sc_tick rtts[BENCH_MAX_CONTROL_MSGS];
+    unsigned sent_count = 0;
+    unsigned rtt_count = 0;
+    bench_input(control_socket, &receiver.acksync, width, height,
+                SC_TICK_FROM_SEC(seconds), sent, &sent_count, rtts,
+                &rtt_count);
+
+    // The streams end (EOS) once the fake device sent everything
+    sc_demuxer_join(&video.demuxer);
+    sc_demuxer_join(&audio.demuxer);
+
+    // Wait for the last control messages
+    sc_tick deadline = sc_tick_now() + SC_TICK_FROM_SEC(1);
+    unsigned arrived_count;
+    while ((arrived_count = fake_device_get_control_ticks(
+                &device, arrived, BENCH_MAX_CONTROL_MSGS)) < sent_count
+            && sc_tick_now() < deadline) {
+        struct timespec ts = {0, 1000000};
+        nanosleep(&ts, NULL);
+    }
+
+    net_interrupt(control_socket);
+    sc_thread_join(&receiver.thread, NULL);
+    fake_device_stop(&device);
+    fake_device_join(&device);
+
+    bool success = video.status == SC_DEMUXER_STATUS_EOS
+                && audio.status == SC_DEMUXER_STATUS_EOS
+                && video.sink.frames == device.video_frames
+                && arrived_count == sent_count;
+
+    sc_tick span = video.sink.last - video.sink.first;
+    printf("  video      %u/%u frames decoded, %.1f fps, decode avg %.3f ms, "
+           "max %.3f ms (encode avg %.3f ms)\n", video.sink.frames,
+           device.video_frames,
+           span ? (video.sink.frames - 1) * (double) SC_TICK_FREQ / span : 0,
+           video.timer.packets
+               ? (double) video.timer.total / video.timer.packets / 1000 : 0,
+           video.timer.max / 1000.0,
+           device.video_frames
+               ? (double) device.video_encode_time / device.video_frames
+                     / 1000 : 0);
+    printf("  audio      %u/%u frames decoded\n", audio.sink.frames,
+           device.audio_packets);
+
+    unsigned n = MIN(sent_count, arrived_count);
+    n = MIN(n, BENCH_MAX_CONTROL_MSGS);
+    for (unsigned i = 0; i < n; ++i) {
+        // One way, from the serialization to the reception by the device
+        arrived[i] -= sent[i];
+    }
+    print_latencies("input", arrived, n);
+    print_latencies("round-trip", rtts, rtt_count);
+
+    sc_acksync_destroy(&receiver.acksync);
+    net_close(video_socket);
+    net_close(audio_socket);
+    net_close(control_socket);
+    fake_device_destroy(&device);
+    net_cleanup();
+
+    return success ? 0 : 1;
+}
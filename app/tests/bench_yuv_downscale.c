@@ -0,0 +1,155 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+
+#include "../../linkandroid/src/yuv_downscale.h"
+
+#define BENCH_WIDTH 1440
+#define BENCH_HEIGHT 3200
+#define BENCH_RATIO 10
+#define BENCH_ITERATIONS 100
+
+static double
+cpu_time_ms(void) {
+    struct timespec ts;
+    int r = clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    assert(!r);
+    (void) r;
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static AVFrame *
+make_frame(enum AVPixelFormat format, int width, int height) {
+    AVFrame *frame = av_frame_alloc();
+    assert(frame);
+
+    frame->format = format;
+    frame->width = width;
+    frame->height = height;
+    int r = av_frame_get_buffer(frame, 32);
+    assert(!r);
+    (void) r;
+
+    return frame;
+}
+
+static void
+fill_frame(AVFrame *frame) {
+    for (int y = 0; y < frame->height; ++y) {
+        uint8_t *line = frame->data[0] + y * frame->linesize[0];
+        for (int x = 0; x < frame->width; ++x) {
+            line[x] = y < frame->height / 8 ? 40 : (uint8_t) ((x + y) / 16);
+        }
+    }
+    for (int p = 1; p < 3; ++p) {
+        for (int y = 0; y < (frame->height + 1) / 2; ++y) {
+            uint8_t *line = frame->data[p] + y * frame->linesize[p];
+            for (int x = 0; x < (frame->width + 1) / 2; ++x) {
+                line[x] = (uint8_t) (128 + (p == 1 ? x : y) % 32);
+            }
+        }
+    }
+}
+
+// The previous (and fallback) preview scaler
+static double
+bench_swscale(const AVFrame *src, AVFrame *dst, bool dst_full_range,
+              int iterations) {
+    struct SwsContext *sws =
+        sws_getContext(src->width, src->height, src->format, dst->width,
+                       dst->height, dst->format, SWS_BILINEAR, NULL, NULL,
+                       NULL);
+    assert(sws);
+    const int *coefs = sws_getCoefficients(SWS_CS_DEFAULT);
+    sws_setColorspaceDetails(sws, coefs, 0, coefs, dst_full_range, 0,
+                             1 << 16, 1 << 16);
+
+    double start = cpu_time_ms();
+    for (int i = 0; i < iterations; ++i) {
+        sws_scale(sws, (const uint8_t *const *) src->data, src->linesize, 0,
+                  src->height, dst->data, dst->linesize);
+    }
+    double result = (cpu_time_ms() - start) / iterations;
+
+    sws_freeContext(sws);
+    return result;
+}
+
+static double
+bench_downscale(const AVFrame *src, AVFrame *dst, bool dst_full_range,
+                int iterations) {
+    enum la_yuv_downscale_output output =
+        dst->format == AV_PIX_FMT_RGB24 ? LA_YUV_DOWNSCALE_RGB24
+                                        : LA_YUV_DOWNSCALE_YUV420P;
+    struct la_yuv_downscale ds;
+    bool ok = la_yuv_downscale_init(&ds, src->width, src->height, false,
+                                    dst->width, dst->height, output,
+                                    dst_full_range);
+    assert(ok);
+    (void) ok;
+
+    double start = cpu_time_ms();
+    for (int i = 0; i < iterations; ++i) {
+        la_yuv_downscale_process(&ds, (const uint8_t *const *) src->data,
+                                 src->linesize, dst->data, dst->linesize);
+    }
+    double result = (cpu_time_ms() - start) / iterations;
+
+    la_yuv_downscale_destroy(&ds);
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    int width = argc > 1 ? atoi(argv[1]) : BENCH_WIDTH;
+    int height = argc > 2 ? atoi(argv[2]) : BENCH_HEIGHT;
+    int ratio = argc > 3 ? atoi(argv[3]) : BENCH_RATIO;
+    int iterations = argc > 4 ? atoi(argv[4]) : BENCH_ITERATIONS;
+    if (width <= 0 || height <= 0 || ratio < 1 || ratio > 100
+            || iterations <= 0) {
+        fprintf(stderr, "usage: %s [width height ratio iterations]\n",
+                argv[0]);
+        return 1;
+    }
+
+    int dst_width = width * ratio / 100;
+    int dst_height = height * ratio / 100;
+    if (dst_width < 1) dst_width = 1;
+    if (dst_height < 1) dst_height = 1;
+    if (!la_yuv_downscale_supported(width, height, dst_width, dst_height)) {
+        fprintf(stderr, "downscale %dx%d -> %dx%d not supported\n", width,
+                height, dst_width, dst_height);
+        return 1;
+    }
+
+    AVFrame *src = make_frame(AV_PIX_FMT_YUV420P, width, height);
+    fill_frame(src);
+
+    printf("downscale %dx%d -> %dx%d (%d iterations)\n", width, height,
+           dst_width, dst_height, iterations);
+
+    // YUV420P is used for JPEG and WebP, RGB24 for PNG
+    static const enum AVPixelFormat formats[] = {
+        AV_PIX_FMT_YUV420P,
+        AV_PIX_FMT_RGB24,
+    };
+    for (size_t i = 0; i < ARRAY_LEN(formats); ++i) {
+        AVFrame *dst = make_frame(formats[i], dst_width, dst_height);
+        double sws = bench_swscale(src, dst, true, iterations);
+        double fast = bench_downscale(src, dst, true, iterations);
+
+        printf("%s:\n", formats[i] == AV_PIX_FMT_RGB24 ? "rgb24" : "yuv420p");
+        printf("  swscale (bilinear): %8.3f ms CPU/frame\n", sws);
+        printf("  box downscale:      %8.3f ms CPU/frame (x%.1f)\n", fast,
+               fast > 0 ? sws / fast : 0);
+
+        av_frame_free(&dst);
+    }
+
+    av_frame_free(&src);
+    return 0;
+}
@@ -0,0 +1,825 @@
+#include "fake_device.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <libavutil/opt.h>
+
+#include "control_msg.h"
+#include "device_msg.h"
+#include "util/acksync.h"
+#include "util/binary.h"
+
+#define FAKE_DEVICE_NAME_FIELD_LENGTH 64
+
+#define FAKE_DEVICE_PACKET_FLAG_CONFIG    (UINT64_C(1) << 62)
+#define FAKE_DEVICE_PACKET_FLAG_KEY_FRAME (UINT64_C(1) << 61)
+
+#define FAKE_DEVICE_SAMPLE_RATE 48000
+
+static const AVRational fake_device_time_base_us = {1, 1000000};
+
+// Video encoders tried in order, the first one available is used
+static const struct {
+    enum AVCodecID id;
+    uint32_t raw_id;
+} fake_device_video_codecs[] = {
+    {AV_CODEC_ID_H264, UINT32_C(0x68323634)}, // "h264"
+    {AV_CODEC_ID_HEVC, UINT32_C(0x68323635)}, // "h265"
+#ifdef SCRCPY_LAVC_HAS_AV1
+    {AV_CODEC_ID_AV1, UINT32_C(0x00617631)}, // "av1"
+#endif
+    {AV_CODEC_ID_VP8, UINT32_C(0x00767038)}, // "vp8"
+    {AV_CODEC_ID_VP9, UINT32_C(0x00767039)}, // "vp9"
+};
+
+static bool
+fake_device_send_all(int fd, const void *data, size_t len) {
+    const uint8_t *p = data;
+    while (len) {
+        ssize_t w = send(fd, p, len, MSG_NOSIGNAL);
+        if (w <= 0) {
+            return false;
+        }
+        p += w;
+        len -= w;
+    }
+    return true;
+}
+
+static bool
+fake_device_send_packet(int fd, uint64_t pts_flags, const uint8_t *data,
+                        uint32_t len) {
+    uint8_t header[12];
+    sc_write64be(header, pts_flags);
+    sc_write32be(&header[8], len);
+    return fake_device_send_all(fd, header, sizeof(header))
+        && fake_device_send_all(fd, data, len);
+}
+
+static bool
+fake_device_sleep_until(struct fake_device *device, sc_tick deadline) {
+    sc_tick now = sc_tick_now();
+    if (deadline > now) {
+        sc_tick delay = deadline - now;
+        struct timespec ts = {
+            .tv_sec = SC_TICK_TO_SEC(delay),
+            .tv_nsec = SC_TICK_TO_NS(delay % SC_TICK_FREQ),
+        };
+        nanosleep(&ts, NULL);
+    }
+    return !atomic_load(&device->stopped);
+}
+
+static void
+fake_device_set_low_latency_options(AVCodecContext *ctx) {
+    if (!ctx->codec->priv_class) {
+        return;
+    }
+
+    // Unknown options are ignored, each encoder supports a subset of them
+    av_opt_set(ctx->priv_data, "preset", "ultrafast", 0); // x264, x265
+    av_opt_set(ctx->priv_data, "tune", "zerolatency", 0); // x264, x265
+    av_opt_set(ctx->priv_data, "deadline", "realtime", 0); // libvpx
+    av_opt_set(ctx->priv_data, "usage", "realtime", 0); // libaom
+    av_opt_set(ctx->priv_data, "cpu-used", "8", 0); // libvpx, libaom
+}
+
+static AVCodecContext *
+fake_device_open_video_encoder(const struct fake_device_params *params,
+                               uint32_t *raw_codec_id) {
+    for (size_t i = 0; i < ARRAY_LEN(fake_device_video_codecs); ++i) {
+        const AVCodec *codec =
+            avcodec_find_encoder(fake_device_video_codecs[i].id);
+        if (!codec) {
+            continue;
+        }
+
+        AVCodecContext *ctx = avcodec_alloc_context3(codec);
+        if (!ctx) {
+            return NULL;
+        }
+
+        ctx->width = params->width;
+        ctx->height = params->height;
+        ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+        ctx->time_base = (AVRational) {1, params->fps};
+        ctx->framerate = (AVRational) {params->fps, 1};
+        ctx->bit_rate = 8000000;
+        // A key frame every 2 seconds
+        ctx->gop_size = params->fps * 2;
+        ctx->max_b_frames = 0;
+        // The config packet is sent separately, like on the device
+        ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        fake_device_set_low_latency_options(ctx);
+
+        if (avcodec_open2(ctx, codec, NULL) < 0) {
+            avcodec_free_context(&ctx);
+            continue;
+        }
+
+        *raw_codec_id = fake_device_video_codecs[i].raw_id;
+        return ctx;
+    }
+
+    return NULL;
+}
+
+static AVCodecContext *
+fake_device_open_audio_encoder(void) {
+    const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_OPUS);
+    if (!codec) {
+        return NULL;
+    }
+
+    // libopus accepts packed formats, the native encoder planar float
+    static const enum AVSampleFormat sample_fmts[] = {
+        AV_SAMPLE_FMT_S16,
+        AV_SAMPLE_FMT_FLT,
+        AV_SAMPLE_FMT_FLTP,
+    };
+
+    for (size_t i = 0; i < ARRAY_LEN(sample_fmts); ++i) {
+        AVCodecContext *ctx = avcodec_alloc_context3(codec);
+        if (!ctx) {
+            return NULL;
+        }
+
+        ctx->sample_rate = FAKE_DEVICE_SAMPLE_RATE;
+        ctx->sample_fmt = sample_fmts[i];
+#ifdef SCRCPY_LAVU_HAS_CHLAYOUT
+        ctx->ch_layout = (AVChannelLayout) AV_CHANNEL_LAYOUT_STEREO;
+#else
+        ctx->channel_layout = AV_CH_LAYOUT_STEREO;
+        ctx->channels = 2;
+#endif
+        ctx->time_base = (AVRational) {1, FAKE_DEVICE_SAMPLE_RATE};
+        ctx->bit_rate = 128000;
+        // The native Opus encoder is experimental
+        ctx->strict_std_compliance = FF_COMPLIANCE_EXPERIMENTAL;
+
+        if (avcodec_open2(ctx, codec, NULL) < 0) {
+            avcodec_free_context(&ctx);
+            continue;
+        }
+
+        return ctx;
+    }
+
+    return NULL;
+}
+
+// Encode a frame (or flush the encoder if frame is NULL) and send the packets
+static bool
+fake_device_encode(int fd, AVCodecContext *ctx, const AVFrame *frame,
+                   AVPacket *packet, unsigned *packets, uint64_t *bytes) {
+    int ret = avcodec_send_frame(ctx, frame);
+    if (ret < 0) {
+        fprintf(stderr, "Fake device: could not encode frame: %d\n", ret);
+        return false;
+    }
+
+    for (;;) {
+        ret = avcodec_receive_packet(ctx, packet);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            return true;
+        }
+        if (ret < 0) {
+            fprintf(stderr, "Fake device: could not receive packet: %d\n",
+                    ret);
+            return false;
+        }
+
+        int64_t pts = av_rescale_q(packet->pts, ctx->time_base,
+                                   fake_device_time_base_us);
+        // The Opus encoder delay may make the first timestamps negative
+        uint64_t pts_flags = pts > 0 ? (uint64_t) pts : 0;
+        if (packet->flags & AV_PKT_FLAG_KEY) {
+            pts_flags |= FAKE_DEVICE_PACKET_FLAG_KEY_FRAME;
+        }
+
+        bool ok = fake_device_send_packet(fd, pts_flags, packet->data,
+                                          packet->size);
+        ++*packets;
+        *bytes += packet->size;
+        av_packet_unref(packet);
+        if (!ok) {
+            // The client closed the socket
+            return false;
+        }
+    }
+}
+
+static bool
+fake_device_send_stream_header(int fd, uint32_t raw_codec_id,
+                               const AVCodecContext *ctx, bool video) {
+    uint8_t codec_id[4];
+    sc_write32be(codec_id, raw_codec_id);
+    if (!fake_device_send_all(fd, codec_id, sizeof(codec_id))) {
+        return false;
+    }
+
+    if (video) {
+        uint8_t session[12] = {0x80}; // session packet flag
+        sc_write32be(&session[4], ctx->width);
+        sc_write32be(&session[8], ctx->height);
+        if (!fake_device_send_all(fd, session, sizeof(session))) {
+            return false;
+        }
+    }
+
+    if (ctx->extradata_size) {
+        return fake_device_send_packet(fd, FAKE_DEVICE_PACKET_FLAG_CONFIG,
+                                       ctx->extradata, ctx->extradata_size);
+    }
+
+    return true;
+}
+
+// A static background with a box moving across the screen, like a scrolling
+// UI (most of the screen does not change between frames)
+static void
+fake_device_fill_video_frame(AVFrame *frame, unsigned index) {
+    int w = frame->width;
+    int h = frame->height;
+    int box_w = w / 4;
+    int box_h = h / 8;
+    int box_x = (index * 8) % (w - box_w + 1);
+    int box_y = (index * 4) % (h - box_h + 1);
+
+    for (int y = 0; y < h; ++y) {
+        uint8_t *row = frame->data[0] + y * frame->linesize[0];
+        for (int x = 0; x < w; ++x) {
+            row[x] = 16 + ((x + y) >> 3) % 200;
+        }
+        if (y >= box_y && y < box_y + box_h) {
+            memset(row + box_x, 235, box_w);
+        }
+    }
+
+    for (int y = 0; y < h / 2; ++y) {
+        uint8_t *u = frame->data[1] + y * frame->linesize[1];
+        uint8_t *v = frame->data[2] + y * frame->linesize[2];
+        memset(u, 128, w / 2);
+        memset(v, 128, w / 2);
+        if (y >= box_y / 2 && y < (box_y + box_h) / 2) {
+            memset(u + box_x / 2, 90, box_w / 2);
+            memset(v + box_x / 2, 240, box_w / 2);
+        }
+    }
+}
+
+// A 400 Hz triangle wave
+static void
+fake_device_fill_audio_frame(AVFrame *frame, int64_t first_sample) {
+    enum AVSampleFormat fmt = frame->format;
+    for (int i = 0; i < frame->nb_samples; ++i) {
+        int phase = (first_sample + i) % 120; // 48000 / 400
+        float sample = 0.2f * (phase < 60 ? phase - 30 : 90 - phase) / 30;
+        switch (fmt) {
+            case AV_SAMPLE_FMT_S16: {
+                int16_t *data = (int16_t *) frame->data[0];
+                data[2 * i] = data[2 * i + 1] = sample * INT16_MAX;
+                break;
+            }
+            case AV_SAMPLE_FMT_FLT: {
+                float *data = (float *) frame->data[0];
+                data[2 * i] = data[2 * i + 1] = sample;
+                break;
+            }
+            default: {
+                assert(fmt == AV_SAMPLE_FMT_FLTP);
+                ((float *) frame->data[0])[i] = sample;
+                ((float *) frame->data[1])[i] = sample;
+                break;
+            }
+        }
+    }
+}
+
+static void *
+run_video(void *data) {
+    struct fake_device *device = data;
+    AVCodecContext *ctx = device->video_ctx;
+    int fd = device->video_socket;
+
+    AVFrame *frame = av_frame_alloc();
+    AVPacket *packet = av_packet_alloc();
+    if (!frame || !packet) {
+        goto end;
+    }
+
+    frame->format = ctx->pix_fmt;
+    frame->width = ctx->width;
+    frame->height = ctx->height;
+    if (av_frame_get_buffer(frame, 0) < 0) {
+        goto end;
+    }
+
+    if (!fake_device_send_stream_header(fd, device->video_codec_id, ctx,
+                                        true)) {
+        goto end;
+    }
+
+    unsigned fps = device->params.fps;
+    unsigned count = (uint64_t) fps * device->params.duration_ms / 1000;
+    unsigned packets = 0;
+    sc_tick start = sc_tick_now();
+    for (unsigned i = 0; i < count; ++i) {
+        // "Capture" the frames at the requested frame rate
+        sc_tick deadline = start + SC_TICK_FROM_SEC(i) / fps;
+        if (!fake_device_sleep_until(device, deadline)) {
+            goto end;
+        }
+
+        // The encoder may still reference the previous frame
+        if (av_frame_make_writable(frame) < 0) {
+            goto end;
+        }
+        fake_device_fill_video_frame(frame, i);
+        frame->pts = i;
+
+        sc_tick t = sc_tick_now();
+        bool ok = fake_device_encode(fd, ctx, frame, packet, &packets,
+                                     &device->video_bytes);
+        device->video_encode_time += sc_tick_now() - t;
+        if (!ok) {
+            goto end;
+        }
+    }
+
+    // Flush the delayed packets, if any
+    fake_device_encode(fd, ctx, NULL, packet, &packets, &device->video_bytes);
+
+end:
+    device->video_frames = packets;
+    av_packet_free(&packet);
+    av_frame_free(&frame);
+
+    // End of stream
+    shutdown(fd, SHUT_WR);
+    return NULL;
+}
+
+static void *
+run_audio(void *data) {
+    struct fake_device *device = data;
+    AVCodecContext *ctx = device->audio_ctx;
+    int fd = device->audio_socket;
+
+    AVFrame *frame = av_frame_alloc();
+    AVPacket *packet = av_packet_alloc();
+    if (!frame || !packet) {
+        goto end;
+    }
+
+    frame->format = ctx->sample_fmt;
+    frame->nb_samples = ctx->frame_size ? ctx->frame_size : 960;
+    frame->sample_rate = ctx->sample_rate;
+#ifdef SCRCPY_LAVU_HAS_CHLAYOUT
+    if (av_channel_layout_copy(&frame->ch_layout, &ctx->ch_layout) < 0) {
+        goto end;
+    }
+#else
+    frame->channel_layout = ctx->channel_layout;
+    frame->channels = ctx->channels;
+#endif
+    if (av_frame_get_buffer(frame, 0) < 0) {
+        goto end;
+    }
+
+    if (!fake_device_send_stream_header(fd, UINT32_C(0x6f707573) /* "opus" */,
+                                        ctx, false)) {
+        goto end;
+    }
+
+    int64_t total = (int64_t) FAKE_DEVICE_SAMPLE_RATE
+                  * device->params.duration_ms / 1000;
+    uint64_t bytes = 0;
+    unsigned packets = 0;
+    sc_tick start = sc_tick_now();
+    for (int64_t samples = 0; samples < total;
+            samples += frame->nb_samples) {
+        sc_tick deadline = start + SC_TICK_FROM_SEC(samples)
+                                 / FAKE_DEVICE_SAMPLE_RATE;
+        if (!fake_device_sleep_until(device, deadline)) {
+            goto end;
+        }
+
+        if (av_frame_make_writable(frame) < 0) {
+            goto end;
+        }
+        fake_device_fill_audio_frame(frame, samples);
+        frame->pts = samples;
+
+        if (!fake_device_encode(fd, ctx, frame, packet, &packets, &bytes)) {
+            goto end;
+        }
+    }
+
+    fake_device_encode(fd, ctx, NULL, packet, &packets, &bytes);
+
+end:
+    device->audio_packets = packets;
+    av_packet_free(&packet);
+    av_frame_free(&frame);
+
+    shutdown(fd, SHUT_WR);
+    return NULL;
+}
+
+// Return the size of the control message at the beginning of buf, 0 if it is
+// incomplete, -1 if it is invalid
+static ssize_t
+fake_device_control_msg_size(const uint8_t *buf, size_t len) {
+    if (!len) {
+        return 0;
+    }
+
+    size_t size;
+    switch (buf[0]) {
+        case SC_CONTROL_MSG_TYPE_INJECT_KEYCODE:
+            size = 14;
+            break;
+        case SC_CONTROL_MSG_TYPE_INJECT_TEXT:
+        case SC_CONTROL_MSG_TYPE_SCAN_FILE:
+            if (len < 5) {
+                return 0;
+            }
+            size = 5 + (size_t) sc_read32be(&buf[1]);
+            break;
+        case SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT:
+            size = 32;
+            break;
+        case SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT:
+            size = 21;
+            break;
+        case SC_CONTROL_MSG_TYPE_BACK_OR_SCREEN_ON:
+        case SC_CONTROL_MSG_TYPE_GET_CLIPBOARD:
+        case SC_CONTROL_MSG_TYPE_SET_DISPLAY_POWER:
+        case SC_CONTROL_MSG_TYPE_CAMERA_SET_TORCH:
+            size = 2;
+            break;
+        case SC_CONTROL_MSG_TYPE_SET_CLIPBOARD:
+            if (len < 14) {
+                return 0;
+            }
+            size = 14 + (size_t) sc_read32be(&buf[10]);
+            break;
+        case SC_CONTROL_MSG_TYPE_UHID_CREATE: {
+            if (len < 8) {
+                return 0;
+            }
+            size_t name_len = buf[7];
+            if (len < 10 + name_len) {
+                return 0;
+            }
+            size = 10 + name_len + sc_read16be(&buf[8 + name_len]);
+            break;
+        }
+        case SC_CONTROL_MSG_TYPE_UHID_INPUT:
+            if (len < 5) {
+                return 0;
+            }
+            size = 5 + (size_t) sc_read16be(&buf[3]);
+            break;
+        case SC_CONTROL_MSG_TYPE_UHID_DESTROY:
+            size = 3;
+            break;
+        case SC_CONTROL_MSG_TYPE_START_APP:
+            if (len < 2) {
+                return 0;
+            }
+            size = 2 + (size_t) buf[1];
+            break;
+        case SC_CONTROL_MSG_TYPE_RESIZE_DISPLAY:
+            size = 5;
+            break;
+        case SC_CONTROL_MSG_TYPE_EXPAND_NOTIFICATION_PANEL:
+        case SC_CONTROL_MSG_TYPE_EXPAND_SETTINGS_PANEL:
+        case SC_CONTROL_MSG_TYPE_COLLAPSE_PANELS:
+        case SC_CONTROL_MSG_TYPE_ROTATE_DEVICE:
+        case SC_CONTROL_MSG_TYPE_OPEN_HARD_KEYBOARD_SETTINGS:
+        case SC_CONTROL_MSG_TYPE_RESET_VIDEO:
+        case SC_CONTROL_MSG_TYPE_CAMERA_ZOOM_IN:
+        case SC_CONTROL_MSG_TYPE_CAMERA_ZOOM_OUT:
+            size = 1;
+            break;
+        default:
+            return -1;
+    }
+
+    if (size > SC_CONTROL_MSG_MAX_SIZE) {
+        return -1;
+    }
+
+    return len < size ? 0 : (ssize_t) size;
+}
+
+static bool
+fake_device_process_control_msg(struct fake_device *device,
+                                const uint8_t *msg, sc_tick arrival) {
+    pthread_mutex_lock(&device->mutex);
+    if (device->control_count == device->control_capacity) {
+        unsigned capacity = device->control_capacity
+                          ? device->control_capacity * 2 : 256;
+        sc_tick *ticks = realloc(device->control_ticks,
+                                 capacity * sizeof(*ticks));
+        if (!ticks) {
+            pthread_mutex_unlock(&device->mutex);
+            return false;
+        }
+        device->control_ticks = ticks;
+        device->control_capacity = capacity;
+    }
+    device->control_ticks[device->control_count++] = arrival;
+    pthread_mutex_unlock(&device->mutex);
+
+    if (msg[0] == SC_CONTROL_MSG_TYPE_SET_CLIPBOARD) {
+        uint64_t sequence = sc_read64be(&msg[1]);
+        if (sequence != SC_SEQUENCE_INVALID) {
+            // Acknowledge, like the device once the clipboard is set
+            uint8_t ack[9] = {DEVICE_MSG_TYPE_ACK_CLIPBOARD};
+            sc_write64be(&ack[1], sequence);
+            if (!fake_device_send_all(device->control_socket, ack,
+                                      sizeof(ack))) {
+                return false;
+            }
+
+            pthread_mutex_lock(&device->mutex);
+            ++device->acks;
+            pthread_mutex_unlock(&device->mutex);
+        }
+    }
+
+    return true;
+}
+
+static void
+fake_device_run_control(struct fake_device *device) {
+    uint8_t *buf = malloc(SC_CONTROL_MSG_MAX_SIZE);
+    if (!buf) {
+        return;
+    }
+
+    size_t len = 0;
+    for (;;) {
+        assert(len < SC_CONTROL_MSG_MAX_SIZE);
+        ssize_t r = recv(device->control_socket, buf + len,
+                         SC_CONTROL_MSG_MAX_SIZE - len, 0);
+        if (r <= 0) {
+            // Client disconnected
+            break;
+        }
+
+        sc_tick arrival = sc_tick_now();
+        len += r;
+
+        size_t head = 0;
+        for (;;) {
+            ssize_t size = fake_device_control_msg_size(buf + head,
+                                                        len - head);
+            if (size < 0) {
+                fprintf(stderr, "Fake device: invalid control message\n");
+                goto end;
+            }
+            if (!size) {
+                break;
+            }
+
+            if (!fake_device_process_control_msg(device, buf + head,
+                                                 arrival)) {
+                goto end;
+            }
+            head += size;
+        }
+
+        memmove(buf, buf + head, len - head);
+        len -= head;
+    }
+
+end:
+    free(buf);
+}
+
+static bool
+fake_device_accept(struct fake_device *device, int *socket) {
+    int fd = accept(device->server_socket, NULL, NULL);
+    if (fd == -1) {
+        if (!atomic_load(&device->stopped)) {
+            perror("Fake device: accept");
+        }
+        return false;
+    }
+
+    // Set under the lock to be shut down by fake_device_stop()
+    pthread_mutex_lock(&device->mutex);
+    *socket = fd;
+    pthread_mutex_unlock(&device->mutex);
+    return true;
+}
+
+static void *
+run_device(void *data) {
+    struct fake_device *device = data;
+    const struct fake_device_params *params = &device->params;
+
+    // The client connects the sockets in this order
+    int *sockets[3];
+    unsigned count = 0;
+    if (params->video) {
+        sockets[count++] = &device->video_socket;
+    }
+    if (params->audio) {
+        sockets[count++] = &device->audio_socket;
+    }
+    if (params->control) {
+        sockets[count++] = &device->control_socket;
+    }
+
+    for (unsigned i = 0; i < count; ++i) {
+        if (!fake_device_accept(device, sockets[i])) {
+            return NULL;
+        }
+
+        if (!i) {
+            // The client reads the dummy byte before connecting the other
+            // sockets, to detect a working connection
+            uint8_t dummy = 0;
+            if (!fake_device_send_all(*sockets[0], &dummy, 1)) {
+                return NULL;
+            }
+        }
+    }
+
+    uint8_t name[FAKE_DEVICE_NAME_FIELD_LENGTH] = {0};
+    strncpy((char *) name, params->device_name, sizeof(name) - 1);
+    if (!fake_device_send_all(*sockets[0], name, sizeof(name))) {
+        return NULL;
+    }
+
+    if (params->video) {
+        int r = pthread_create(&device->video_thread, NULL, run_video,
+                               device);
+        device->video_started = !r;
+    }
+    if (params->audio) {
+        int r = pthread_create(&device->audio_thread, NULL, run_audio,
+                               device);
+        device->audio_started = !r;
+    }
+
+    if (params->control) {
+        fake_device_run_control(device);
+    }
+
+    return NULL;
+}
+
+bool
+fake_device_init(struct fake_device *device,
+                 const struct fake_device_params *params) {
+    assert(params->video || params->audio || params->control);
+    assert(!params->video || (params->width && params->height && params->fps));
+
+    memset(device, 0, sizeof(*device));
+    device->params = *params;
+    device->video_socket = -1;
+    device->audio_socket = -1;
+    device->control_socket = -1;
+    atomic_init(&device->stopped, false);
+
+    if (pthread_mutex_init(&device->mutex, NULL)) {
+        return false;
+    }
+
+    if (params->video) {
+        device->video_ctx =
+            fake_device_open_video_encoder(params, &device->video_codec_id);
+        if (!device->video_ctx) {
+            fprintf(stderr, "Fake device: no video encoder available\n");
+            goto error_destroy_mutex;
+        }
+    }
+
+    if (params->audio) {
+        device->audio_ctx = fake_device_open_audio_encoder();
+        if (!device->audio_ctx) {
+            fprintf(stderr, "Fake device: no Opus encoder available\n");
+            goto error_free_video;
+        }
+    }
+
+    device->server_socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (device->server_socket == -1) {
+        goto error_free_audio;
+    }
+
+    int reuse = 1;
+    setsockopt(device->server_socket, SOL_SOCKET, SO_REUSEADDR, &reuse,
+               sizeof(reuse));
+
+    // Any free local port
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        .sin_port = 0,
+    };
+    socklen_t addr_len = sizeof(addr);
+    if (bind(device->server_socket, (struct sockaddr *) &addr, addr_len)
+            || listen(device->server_socket, 3)
+            || getsockname(device->server_socket, (struct sockaddr *) &addr,
+                           &addr_len)) {
+        perror("Fake device: listen");
+        goto error_close_socket;
+    }
+    device->port = ntohs(addr.sin_port);
+
+    return true;
+
+error_close_socket:
+    close(device->server_socket);
+error_free_audio:
+    avcodec_free_context(&device->audio_ctx);
+error_free_video:
+    avcodec_free_context(&device->video_ctx);
+error_destroy_mutex:
+    pthread_mutex_destroy(&device->mutex);
+
+    return false;
+}
+
+bool
+fake_device_start(struct fake_device *device) {
+    return !pthread_create(&device->thread, NULL, run_device, device);
+}
+
+void
+fake_device_stop(struct fake_device *device) {
+    atomic_store(&device->stopped, true);
+
+    // Wake up the blocking calls
+    shutdown(device->server_socket, SHUT_RDWR);
+
+    pthread_mutex_lock(&device->mutex);
+    int sockets[] = {
+        device->video_socket,
+        device->audio_socket,
+        device->control_socket,
+    };
+    for (size_t i = 0; i < ARRAY_LEN(sockets); ++i) {
+        if (sockets[i] != -1) {
+            shutdown(sockets[i], SHUT_RDWR);
+        }
+    }
+    pthread_mutex_unlock(&device->mutex);
+}
+
+void
+fake_device_join(struct fake_device *device) {
+    pthread_join(device->thread, NULL);
+    if (device->video_started) {
+        pthread_join(device->video_thread, NULL);
+    }
+    if (device->audio_started) {
+        pthread_join(device->audio_thread, NULL);
+    }
+}
+
+void
+fake_device_destroy(struct fake_device *device) {
+    int sockets[] = {
+        device->video_socket,
+        device->audio_socket,
+        device->control_socket,
+        device->server_socket,
+    };
+    for (size_t i = 0; i < ARRAY_LEN(sockets); ++i) {
+        if (sockets[i] != -1) {
+            close(sockets[i]);
+        }
+    }
+
+    pthread_mutex_destroy(&device->mutex);
+    free(device->control_ticks);
+    avcodec_free_context(&device->audio_ctx);
+    avcodec_free_context(&device->video_ctx);
+}
+
+unsigned
+fake_device_get_control_ticks(struct fake_device *device, sc_tick *ticks,
+                              unsigned max) {
+    pthread_mutex_lock(&device->mutex);
+    unsigned count = device->control_count;
+    unsigned n = count < max ? count : max;
+    memcpy(ticks, device->control_ticks, n * sizeof(*ticks));
+    pthread_mutex_unlock(&device->mutex);
+    return count;
+}
@@ -0,0 +1,102 @@
+#ifndef FAKE_DEVICE_H
+#define FAKE_DEVICE_H
+
+#include "common.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <libavcodec/avcodec.h>
+
+#include "util/tick.h"
+
+/**
+ * Emulate the device side of the scrcpy protocol over local TCP, as if the
+ * server was reached through "adb forward" (--force-adb-forward or
+ * --tunnel-host/--tunnel-port): the client connects to 127.0.0.1:port once
+ * per socket (video, audio, control, in this order).
+ *
+ * The first socket receives the dummy byte and the device meta (name), then
+ * each stream socket receives its codec id, the video session header and the
+ * packets of a synthetic stream encoded with libavcodec in real time (an
+ * animated pattern for the video, a tone in Opus for the audio). The
+ * streams end (EOS) after the requested duration.
+ *
+ * The arrival time of every control message is recorded, and SET_CLIPBOARD
+ * requests with a sequence are acknowledged like on a real device, so that
+ * the client can measure the input latency and round-trip.
+ */
+struct fake_device_params {
+    const char *device_name;
+    bool video;
+    bool audio;
+    bool control;
+    uint16_t width;
+    uint16_t height;
+    unsigned fps;
+    unsigned duration_ms;
+};
+
+struct fake_device {
+    struct fake_device_params params;
+
+    int server_socket;
+    uint16_t port;
+
+    int video_socket;
+    int audio_socket;
+    int control_socket;
+
+    pthread_t thread;
+    pthread_t video_thread;
+    pthread_t audio_thread;
+    bool video_started;
+    bool audio_started;
+
+    atomic_bool stopped;
+
+    AVCodecContext *video_ctx;
+    uint32_t video_codec_id; // raw codec id of the protocol (e.g. "h264")
+    AVCodecContext *audio_ctx;
+
+    // Written by the stream threads, read after fake_device_join()
+    unsigned video_frames;
+    uint64_t video_bytes;
+    sc_tick video_encode_time;
+    unsigned audio_packets;
+
+    // Control messages, protected by the mutex
+    pthread_mutex_t mutex;
+    sc_tick *control_ticks; // arrival time of each control message
+    unsigned control_count;
+    unsigned control_capacity;
+    unsigned acks;
+};
+
+// Open the encoders and listen on a free local port (device->port)
+bool
+fake_device_init(struct fake_device *device,
+                 const struct fake_device_params *params);
+
+// Accept the client connections and start streaming
+bool
+fake_device_start(struct fake_device *device);
+
+// Stop streaming and disconnect the client
+void
+fake_device_stop(struct fake_device *device);
+
+void
+fake_device_join(struct fake_device *device);
+
+void
+fake_device_destroy(struct fake_device *device);
+
+// Copy the arrival times of the control messages received so far (at most
+// max), return the total number of messages received
+unsigned
+fake_device_get_control_ticks(struct fake_device *device, sc_tick *ticks,
+                              unsigned max);
+
+#endif
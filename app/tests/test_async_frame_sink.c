@@ -0,0 +1,342 @@
+#include "common.h"
+
+#include <assert.h>
+#include <string.h>
+#include <libavutil/frame.h>
+
+#include "async_frame_sink.h"
+#include "trait/frame_source.h"
+#include "util/thread.h"
+
+#define MAX_EVENTS 64
+
+// A frame sink recording the received frames (by pts) and sessions (as -width)
+// which can block in push() until it is released
+struct test_sink {
+    struct sc_frame_sink frame_sink; // frame sink trait
+
+    sc_mutex mutex;
+    sc_cond cond;
+    bool blocked;
+    bool fail;
+    bool opened;
+    bool closed;
+    unsigned pushes_entered;
+
+    int64_t events[MAX_EVENTS];
+    unsigned event_count;
+};
+
+#define DOWNCAST(SINK) container_of(SINK, struct test_sink, frame_sink)
+
+static bool
+test_sink_open(struct sc_frame_sink *sink, const AVCodecContext *ctx,
+               const struct sc_stream_session *session) {
+    (void) ctx;
+    (void) session;
+    struct test_sink *ts = DOWNCAST(sink);
+    ts->opened = true;
+    return true;
+}
+
+static void
+test_sink_close(struct sc_frame_sink *sink) {
+    struct test_sink *ts = DOWNCAST(sink);
+    ts->closed = true;
+}
+
+static bool
+test_sink_push(struct sc_frame_sink *sink, const AVFrame *frame) {
+    struct test_sink *ts = DOWNCAST(sink);
+
+    sc_mutex_lock(&ts->mutex);
+    ++ts->pushes_entered;
+    sc_cond_broadcast(&ts->cond);
+    while (ts->blocked) {
+        sc_cond_wait(&ts->cond, &ts->mutex);
+    }
+    assert(ts->event_count < MAX_EVENTS);
+    ts->events[ts->event_count++] = frame->pts;
+    bool fail = ts->fail;
+    sc_cond_broadcast(&ts->cond);
+    sc_mutex_unlock(&ts->mutex);
+
+    return !fail;
+}
+
+static bool
+test_sink_push_session(struct sc_frame_sink *sink,
+                       const struct sc_stream_session *session) {
+    struct test_sink *ts = DOWNCAST(sink);
+
+    sc_mutex_lock(&ts->mutex);
+    assert(ts->event_count < MAX_EVENTS);
+    ts->events[ts->event_count++] = -(int64_t) session->video.width;
+    sc_mutex_unlock(&ts->mutex);
+
+    return true;
+}
+
+static void
+test_sink_init(struct test_sink *ts) {
+    static const struct sc_frame_sink_ops ops = {
+        .open = test_sink_open,
+        .close = test_sink_close,
+        .push = test_sink_push,
+        .push_session = test_sink_push_session,
+    };
+
+    memset(ts, 0, sizeof(*ts));
+    ts->frame_sink.ops = &ops;
+
+    bool ok = sc_mutex_init(&ts->mutex);
+    assert(ok);
+    ok = sc_cond_init(&ts->cond);
+    assert(ok);
+    (void) ok;
+}
+
+static void
+test_sink_destroy(struct test_sink *ts) {
+    sc_cond_destroy(&ts->cond);
+    sc_mutex_destroy(&ts->mutex);
+}
+
+static void
+test_sink_set_blocked(struct test_sink *ts, bool blocked) {
+    sc_mutex_lock(&ts->mutex);
+    ts->blocked = blocked;
+    sc_cond_broadcast(&ts->cond);
+    sc_mutex_unlock(&ts->mutex);
+}
+
+static void
+test_sink_wait_entered(struct test_sink *ts, unsigned count) {
+    sc_mutex_lock(&ts->mutex);
+    while (ts->pushes_entered < count) {
+        sc_cond_wait(&ts->cond, &ts->mutex);
+    }
+    sc_mutex_unlock(&ts->mutex);
+}
+
+static void
+test_sink_wait_events(struct test_sink *ts, unsigned count) {
+    sc_mutex_lock(&ts->mutex);
+    while (ts->event_count < count) {
+        sc_cond_wait(&ts->cond, &ts->mutex);
+    }
+    sc_mutex_unlock(&ts->mutex);
+}
+
+static AVFrame *
+make_frame(void) {
+    AVFrame *frame = av_frame_alloc();
+    assert(frame);
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = 16;
+    frame->height = 16;
+    int r = av_frame_get_buffer(frame, 0);
+    assert(!r);
+    (void) r;
+    return frame;
+}
+
+static void
+push_frame(struct sc_frame_sink *sink, AVFrame *frame, int64_t pts) {
+    frame->pts = pts;
+    bool ok = sink->ops->push(sink, frame);
+    assert(ok);
+    (void) ok;
+}
+
+static void
+test_async_policy(enum sc_async_frame_sink_policy policy, unsigned capacity,
+                  const int64_t *expected, unsigned expected_count) {
+    struct test_sink ts;
+    test_sink_init(&ts);
+
+    struct sc_async_frame_sink async;
+    sc_async_frame_sink_init(&async, "test", &ts.frame_sink, policy,
+                             capacity);
+    struct sc_frame_sink *sink = &async.frame_sink;
+
+    bool ok = sink->ops->open(sink, NULL, NULL);
+    assert(ok);
+    (void) ok;
+    assert(ts.opened);
+
+    AVFrame *frame = make_frame();
+
+    // Block the wrapped sink on the first frame
+    test_sink_set_blocked(&ts, true);
+    push_frame(sink, frame, 1);
+    test_sink_wait_entered(&ts, 1);
+
+    // The source is never blocked by the slow sink
+    for (int64_t pts = 2; pts <= 10; ++pts) {
+        push_frame(sink, frame, pts);
+    }
+
+    uint64_t pushed;
+    uint64_t dropped;
+    sc_async_frame_sink_get_stats(&async, &pushed, &dropped);
+    assert(pushed == 10);
+    assert(dropped == 10 - expected_count);
+
+    test_sink_set_blocked(&ts, false);
+    test_sink_wait_events(&ts, expected_count);
+
+    sink->ops->close(sink);
+    assert(ts.closed);
+
+    assert(ts.event_count == expected_count);
+    for (unsigned i = 0; i < expected_count; ++i) {
+        assert(ts.events[i] == expected[i]);
+    }
+
+    av_frame_free(&frame);
+    test_sink_destroy(&ts);
+}
+
+static void
+test_async_latest(void) {
+    static const int64_t expected[] = {1, 10};
+    test_async_policy(SC_ASYNC_FRAME_SINK_POLICY_LATEST, 0, expected,
+                      ARRAY_LEN(expected));
+}
+
+static void
+test_async_fifo(void) {
+    static const int64_t expected[] = {1, 7, 8, 9, 10};
+    test_async_policy(SC_ASYNC_FRAME_SINK_POLICY_FIFO, 4, expected,
+                      ARRAY_LEN(expected));
+}
+
+static void
+test_async_session(void) {
+    struct test_sink ts;
+    test_sink_init(&ts);
+
+    struct sc_async_frame_sink async;
+    sc_async_frame_sink_init(&async, "test", &ts.frame_sink,
+                             SC_ASYNC_FRAME_SINK_POLICY_LATEST, 0);
+    struct sc_frame_sink *sink = &async.frame_sink;
+
+    bool ok = sink->ops->open(sink, NULL, NULL);
+    assert(ok);
+
+    AVFrame *frame = make_frame();
+
+    test_sink_set_blocked(&ts, true);
+    push_frame(sink, frame, 1);
+    test_sink_wait_entered(&ts, 1);
+
+    struct sc_stream_session session = {
+        .video = {.width = 1080, .height = 2400},
+    };
+    ok = sink->ops->push_session(sink, &session);
+    assert(ok);
+    (void) ok;
+
+    // Frame 2 is dropped, but its session must be delivered before frame 3
+    push_frame(sink, frame, 2);
+    push_frame(sink, frame, 3);
+
+    test_sink_set_blocked(&ts, false);
+    test_sink_wait_events(&ts, 3);
+    sink->ops->close(sink);
+
+    assert(ts.event_count == 3);
+    assert(ts.events[0] == 1);
+    assert(ts.events[1] == -1080);
+    assert(ts.events[2] == 3);
+
+    av_frame_free(&frame);
+    test_sink_destroy(&ts);
+}
+
+static void
+test_async_error(void) {
+    struct test_sink ts;
+    test_sink_init(&ts);
+    ts.fail = true;
+
+    struct sc_async_frame_sink async;
+    sc_async_frame_sink_init(&async, "test", &ts.frame_sink,
+                             SC_ASYNC_FRAME_SINK_POLICY_LATEST, 0);
+    struct sc_frame_sink *sink = &async.frame_sink;
+
+    bool ok = sink->ops->open(sink, NULL, NULL);
+    assert(ok);
+
+    AVFrame *frame = make_frame();
+    push_frame(sink, frame, 1);
+    test_sink_wait_events(&ts, 1);
+
+    // The error is reported to the source on a next push (as soon as the
+    // adapter thread has handled it)
+    frame->pts = 2;
+    while (sink->ops->push(sink, frame)) {
+        sc_mutex_lock(&ts.mutex);
+        sc_mutex_unlock(&ts.mutex);
+    }
+    (void) ok;
+
+    sink->ops->close(sink);
+
+    av_frame_free(&frame);
+    test_sink_destroy(&ts);
+}
+
+static void
+test_source_many_sinks(void) {
+    // More sinks than the previous fixed limit
+    struct test_sink sinks[5];
+
+    struct sc_frame_source source;
+    sc_frame_source_init(&source);
+    for (unsigned i = 0; i < ARRAY_LEN(sinks); ++i) {
+        test_sink_init(&sinks[i]);
+        sc_frame_source_add_sink(&source, &sinks[i].frame_sink);
+    }
+    assert(source.sink_count == ARRAY_LEN(sinks));
+
+    bool ok = sc_frame_source_sinks_open(&source, NULL, NULL);
+    assert(ok);
+
+    AVFrame *frame = make_frame();
+    frame->pts = 42;
+    ok = sc_frame_source_sinks_push(&source, frame);
+    assert(ok);
+    (void) ok;
+
+    sc_frame_source_sinks_close(&source);
+
+    unsigned i = 0;
+    sc_frame_source_foreach_sink(&source, sink) {
+        assert(sink == &sinks[i].frame_sink);
+        ++i;
+    }
+    assert(i == ARRAY_LEN(sinks));
+
+    for (unsigned i = 0; i < ARRAY_LEN(sinks); ++i) {
+        assert(sinks[i].opened && sinks[i].closed);
+        assert(sinks[i].event_count == 1 && sinks[i].events[0] == 42);
+        test_sink_destroy(&sinks[i]);
+    }
+
+    av_frame_free(&frame);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_async_latest();
+    test_async_fifo();
+    test_async_session();
+    test_async_error();
+    test_source_many_sinks();
+
+    return 0;
+}
@@ -0,0 +1,229 @@
+#include "common.h"
+
+#include <assert.h>
+
+#include "catchup.h"
+
+#define FRAME_INTERVAL 16666
+#define THRESHOLD SC_TICK_FROM_MS(300)
+
+static void
+on_request_key_frame(struct sc_catchup *catchup, void *userdata) {
+    (void) catchup;
+    unsigned *requests = userdata;
+    ++*requests;
+}
+
+static const struct sc_catchup_callbacks cbs = {
+    .on_request_key_frame = on_request_key_frame,
+};
+
+static void test_catchup_on_time(void) {
+    unsigned requests = 0;
+    struct sc_catchup catchup;
+    sc_catchup_init(&catchup, THRESHOLD, &cbs, &requests);
+
+    // The device and client clocks are not synchronized
+    sc_tick offset = SC_TICK_FROM_SEC(1000);
+    for (int64_t pts = 0; pts < 1000 * FRAME_INTERVAL; pts += FRAME_INTERVAL) {
+        // Some jitter, below the threshold
+        sc_tick jitter = (pts / FRAME_INTERVAL) % 3 * SC_TICK_FROM_MS(40);
+        sc_catchup_set_pending(&catchup, 1000);
+        enum sc_catchup_action action =
+            sc_catchup_push(&catchup, pts, 10000, false,
+                            pts + offset + jitter);
+        assert(action == SC_CATCHUP_ACTION_DECODE);
+    }
+
+    assert(!catchup.stats.ref_only);
+    assert(!catchup.stats.drops);
+    assert(!requests);
+
+    sc_catchup_destroy(&catchup);
+}
+
+static void test_catchup_lag(void) {
+    unsigned requests = 0;
+    struct sc_catchup catchup;
+    sc_catchup_init(&catchup, THRESHOLD, &cbs, &requests);
+
+    int64_t pts = 0;
+    for (; pts < 100 * FRAME_INTERVAL; pts += FRAME_INTERVAL) {
+        enum sc_catchup_action action =
+            sc_catchup_push(&catchup, pts, 10000, false, pts);
+        assert(action == SC_CATCHUP_ACTION_DECODE);
+    }
+
+    // The decoder stalls, then each packet is decoded later and later
+    sc_tick now = pts + SC_TICK_FROM_MS(400);
+    enum sc_catchup_action action =
+        sc_catchup_push(&catchup, pts, 10000, false, now);
+    assert(action == SC_CATCHUP_ACTION_DECODE_REF_ONLY);
+    assert(catchup.stats.ref_only == 1);
+
+    // Skipping the non-reference frames is not sufficient
+    pts += FRAME_INTERVAL;
+    now = pts + SC_TICK_FROM_MS(700);
+    action = sc_catchup_push(&catchup, pts, 10000, false, now);
+    assert(action == SC_CATCHUP_ACTION_DROP);
+    assert(catchup.stats.drops == 1);
+    assert(requests == 1);
+
+    // Key frames are not requested on every packet
+    pts += FRAME_INTERVAL;
+    action = sc_catchup_push(&catchup, pts, 10000, false, now + 1000);
+    assert(action == SC_CATCHUP_ACTION_DROP);
+    assert(requests == 1);
+
+    // Requested again if it does not arrive
+    pts += FRAME_INTERVAL;
+    now += SC_TICK_FROM_SEC(1);
+    action = sc_catchup_push(&catchup, pts, 10000, false, now);
+    assert(action == SC_CATCHUP_ACTION_DROP);
+    assert(requests == 2);
+    assert(catchup.stats.dropped_packets == 3);
+
+    // The requested key frame is received on time
+    pts = now;
+    action = sc_catchup_push(&catchup, pts, 10000, true, now);
+    assert(action == SC_CATCHUP_ACTION_DECODE);
+
+    pts += FRAME_INTERVAL;
+    action = sc_catchup_push(&catchup, pts, 10000, false, pts);
+    assert(action == SC_CATCHUP_ACTION_DECODE);
+
+    assert(catchup.stats.ref_only == 1);
+    assert(catchup.stats.drops == 1);
+    assert(catchup.stats.key_frame_requests == 2);
+
+    sc_catchup_destroy(&catchup);
+}
+
+static void test_catchup_pending(void) {
+    struct sc_catchup catchup;
+    // Key frames cannot be requested
+    sc_catchup_init(&catchup, THRESHOLD, NULL, NULL);
+
+    int64_t pts = 0;
+    for (; pts < 100 * FRAME_INTERVAL; pts += FRAME_INTERVAL) {
+        sc_catchup_set_pending(&catchup, 0);
+        enum sc_catchup_action action =
+            sc_catchup_push(&catchup, pts, 10000, false, pts);
+        assert(action == SC_CATCHUP_ACTION_DECODE);
+    }
+
+    // 30 packets waiting in the socket (500 ms)
+    sc_catchup_set_pending(&catchup, 30 * 10000);
+    enum sc_catchup_action action =
+        sc_catchup_push(&catchup, pts, 10000, false, pts);
+    assert(action == SC_CATCHUP_ACTION_DECODE_REF_ONLY);
+
+    // 60 packets waiting (1 s)
+    pts += FRAME_INTERVAL;
+    sc_catchup_set_pending(&catchup, 60 * 10000);
+    action = sc_catchup_push(&catchup, pts, 10000, false, pts);
+    assert(action == SC_CATCHUP_ACTION_DROP);
+    assert(!catchup.stats.key_frame_requests);
+
+    // A late key frame: keep catching up
+    pts += FRAME_INTERVAL;
+    sc_catchup_set_pending(&catchup, 40 * 10000);
+    action = sc_catchup_push(&catchup, pts, 10000, true, pts);
+    assert(action == SC_CATCHUP_ACTION_DECODE_REF_ONLY);
+
+    // Caught up
+    pts += FRAME_INTERVAL;
+    sc_catchup_set_pending(&catchup, 0);
+    action = sc_catchup_push(&catchup, pts, 10000, false, pts);
+    assert(action == SC_CATCHUP_ACTION_DECODE);
+
+    sc_catchup_destroy(&catchup);
+}
+
+static void test_catchup_network_delay(void) {
+    unsigned requests = 0;
+    struct sc_catchup catchup;
+    sc_catchup_init(&catchup, THRESHOLD, &cbs, &requests);
+
+    int64_t pts = 0;
+    for (; pts < 100 * FRAME_INTERVAL; pts += FRAME_INTERVAL) {
+        sc_catchup_set_pending(&catchup, 0);
+        sc_catchup_push(&catchup, pts, 10000, false, pts);
+    }
+
+    // The packets are late, but nothing is waiting to be decoded: dropping
+    // frames would not help
+    for (; pts < 200 * FRAME_INTERVAL; pts += FRAME_INTERVAL) {
+        sc_catchup_set_pending(&catchup, 0);
+        enum sc_catchup_action action =
+            sc_catchup_push(&catchup, pts, 10000, false,
+                            pts + SC_TICK_FROM_SEC(1));
+        assert(action == SC_CATCHUP_ACTION_DECODE);
+    }
+
+    assert(!catchup.stats.ref_only);
+    assert(!requests);
+
+    sc_catchup_destroy(&catchup);
+}
+
+static void
+on_request_key_frame_device(struct sc_catchup *catchup, void *userdata) {
+    (void) catchup;
+    bool *key_frame_requested = userdata;
+    *key_frame_requested = true;
+}
+
+static void test_catchup_network_delay_unknown_pending(void) {
+    static const struct sc_catchup_callbacks device_cbs = {
+        .on_request_key_frame = on_request_key_frame_device,
+    };
+
+    bool key_frame_requested = false;
+    struct sc_catchup catchup;
+    sc_catchup_init(&catchup, THRESHOLD, &device_cbs, &key_frame_requested);
+
+    // The pending bytes are never reported (reactor mode or replay), and the
+    // decoder keeps up: each packet is pushed on arrival
+    sc_tick delay = 0;
+    unsigned late_decoded = 0;
+    for (unsigned i = 0; i < 3000; ++i) {
+        int64_t pts = (int64_t) i * FRAME_INTERVAL;
+        if (i == 100) {
+            // The network delay increases, and stays high
+            delay = SC_TICK_FROM_MS(400);
+        }
+
+        // The device produces a key frame on request
+        bool key_frame = !i || key_frame_requested;
+        key_frame_requested = false;
+
+        enum sc_catchup_action action =
+            sc_catchup_push(&catchup, pts, 10000, key_frame, pts + delay);
+        if (i >= 200) {
+            assert(action == SC_CATCHUP_ACTION_DECODE);
+            ++late_decoded;
+        }
+    }
+
+    assert(late_decoded == 2800);
+    assert(catchup.stats.ref_only == 1);
+    assert(catchup.stats.drops <= 1);
+    assert(catchup.stats.dropped_packets < 10);
+    assert(catchup.stats.key_frame_requests <= 1);
+
+    sc_catchup_destroy(&catchup);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_catchup_on_time();
+    test_catchup_lag();
+    test_catchup_pending();
+    test_catchup_network_delay();
+    test_catchup_network_delay_unknown_pending();
+
+    return 0;
+}
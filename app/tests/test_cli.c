@@ -121,6 +121,164 @@ static void test_options2(void) {
     assert(opts->record_format == SC_RECORD_FORMAT_MP4);
 }
 
+static void test_video_decoder_options(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    assert(args.opts.video_decoder_threads == 0);
+    assert(args.opts.video_decoder_thread_type
+            == SC_DECODER_THREAD_TYPE_SLICE);
+    assert(!args.opts.video_decoder_hwaccel);
+
+    char *argv[] = {
+        "scrcpy",
+        "--video-decoder-threads=4",
+        "--video-decoder-thread-type=frame",
+        "--video-decoder-hwaccel=vaapi",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+
+    const struct scrcpy_options *opts = &args.opts;
+    assert(opts->video_decoder_threads == 4);
+    assert(opts->video_decoder_thread_type == SC_DECODER_THREAD_TYPE_FRAME);
+    assert(!strcmp(opts->video_decoder_hwaccel, "vaapi"));
+
+    char *argv2[] = {
+        "scrcpy",
+        "--video-decoder-hwaccel=none",
+    };
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv2), argv2);
+    assert(ok);
+    assert(!opts->video_decoder_hwaccel);
+}
+
+static void test_stream_capture_options(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--replay-stream=/tmp/session",
+        "--replay-stream-max-speed",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+
+    const struct scrcpy_options *opts = &args.opts;
+    assert(!strcmp(opts->replay_stream, "/tmp/session"));
+    assert(opts->replay_stream_max_speed);
+    // No device to control
+    assert(!opts->control);
+
+    args.opts = scrcpy_options_default;
+    char *argv2[] = {
+        "scrcpy",
+        "--replay-stream=/tmp/session",
+        "--capture-stream=/tmp/other",
+    };
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv2), argv2);
+    assert(!ok);
+
+    args.opts = scrcpy_options_default;
+    char *argv3[] = {
+        "scrcpy",
+        "--replay-stream-max-speed",
+    };
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv3), argv3);
+    assert(!ok);
+}
+
+static void test_latency_stats_options(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    char *argv[] = {
+        "scrcpy",
+        "--latency-stats",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+    assert(args.opts.latency_stats);
+    assert(args.opts.latency_stats_interval == SC_TICK_FROM_SEC(10));
+
+    args.opts = scrcpy_options_default;
+    char *argv2[] = {
+        "scrcpy",
+        "--latency-stats=0",
+    };
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv2), argv2);
+    assert(ok);
+    assert(args.opts.latency_stats);
+    assert(!args.opts.latency_stats_interval);
+
+    // Nothing to measure without video playback
+    args.opts = scrcpy_options_default;
+    char *argv3[] = {
+        "scrcpy",
+        "--latency-stats=5",
+        "--no-video-playback",
+    };
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv3), argv3);
+    assert(ok);
+    assert(!args.opts.latency_stats);
+}
+
+static void test_video_catch_up_options(void) {
+    struct scrcpy_cli_args args = {
+        .opts = scrcpy_options_default,
+        .help = false,
+        .version = false,
+    };
+
+    assert(!args.opts.video_catch_up);
+
+    char *argv[] = {
+        "scrcpy",
+        "--video-catch-up",
+    };
+
+    bool ok = scrcpy_parse_args(&args, ARRAY_LEN(argv), argv);
+    assert(ok);
+    assert(args.opts.video_catch_up == SC_TICK_FROM_MS(300));
+
+    args.opts = scrcpy_options_default;
+    char *argv2[] = {
+        "scrcpy",
+        "--video-catch-up=1000",
+    };
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv2), argv2);
+    assert(ok);
+    assert(args.opts.video_catch_up == SC_TICK_FROM_SEC(1));
+
+    args.opts = scrcpy_options_default;
+    char *argv3[] = {
+        "scrcpy",
+        "--video-catch-up=0",
+    };
+
+    ok = scrcpy_parse_args(&args, ARRAY_LEN(argv3), argv3);
+    assert(!ok);
+}
+
 static void test_parse_shortcut_mods(void) {
     uint8_t mods;
     bool ok;
@@ -157,6 +315,10 @@ int main(int argc, char *argv[]) {
     test_flag_help();
     test_options();
     test_options2();
+    test_video_decoder_options();
+    test_stream_capture_options();
+    test_latency_stats_options();
+    test_video_catch_up_options();
     test_parse_shortcut_mods();
     return 0;
 }
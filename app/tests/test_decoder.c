@@ -0,0 +1,317 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+
+#include "decoder.h"
+#include "trait/frame_source.h"
+
+#define WIDTH 320
+#define HEIGHT 240
+#define FRAME_COUNT 16
+#define THREADS 2
+
+// Encoders tried in order, the first one available is used (the native
+// mpeg2video and mpeg4 encoders are available in any FFmpeg build)
+static const enum AVCodecID test_codecs[] = {
+    AV_CODEC_ID_H264,
+    AV_CODEC_ID_MPEG2VIDEO,
+    AV_CODEC_ID_MPEG4,
+};
+
+// The encoded stream, decoded once per decoder configuration
+static struct {
+    enum AVCodecID codec_id;
+    AVPacket *packets[FRAME_COUNT * 2];
+    unsigned count;
+} stream;
+
+// A frame sink (not accepting hardware frames) checking the received frames
+struct test_sink {
+    struct sc_frame_sink frame_sink; // frame sink trait
+    bool opened;
+    bool closed;
+    unsigned frames;
+    int64_t last_pts;
+};
+
+#define DOWNCAST(SINK) container_of(SINK, struct test_sink, frame_sink)
+
+static bool
+test_sink_open(struct sc_frame_sink *sink, const AVCodecContext *ctx,
+               const struct sc_stream_session *session) {
+    (void) ctx;
+    struct test_sink *ts = DOWNCAST(sink);
+    assert(session->video.width == WIDTH);
+    assert(session->video.height == HEIGHT);
+    ts->opened = true;
+    return true;
+}
+
+static void
+test_sink_close(struct sc_frame_sink *sink) {
+    struct test_sink *ts = DOWNCAST(sink);
+    ts->closed = true;
+}
+
+static bool
+test_sink_push(struct sc_frame_sink *sink, const AVFrame *frame) {
+    struct test_sink *ts = DOWNCAST(sink);
+
+    // Hardware frames must have been downloaded to YUV420P
+    assert(!frame->hw_frames_ctx);
+    assert(frame->format == AV_PIX_FMT_YUV420P);
+    assert(frame->width == WIDTH);
+    assert(frame->height == HEIGHT);
+    assert(frame->data[0] && frame->data[1] && frame->data[2]);
+    assert(frame->pts > ts->last_pts);
+
+    ts->last_pts = frame->pts;
+    ++ts->frames;
+    return true;
+}
+
+static void
+test_sink_init(struct test_sink *ts) {
+    static const struct sc_frame_sink_ops ops = {
+        .open = test_sink_open,
+        .close = test_sink_close,
+        .push = test_sink_push,
+    };
+
+    memset(ts, 0, sizeof(*ts));
+    ts->frame_sink.ops = &ops;
+    ts->last_pts = -1;
+}
+
+static AVCodecContext *
+open_encoder(void) {
+    for (size_t i = 0; i < ARRAY_LEN(test_codecs); ++i) {
+        const AVCodec *codec = avcodec_find_encoder(test_codecs[i]);
+        if (!codec) {
+            continue;
+        }
+
+        AVCodecContext *ctx = avcodec_alloc_context3(codec);
+        assert(ctx);
+        ctx->width = WIDTH;
+        ctx->height = HEIGHT;
+        ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+        ctx->time_base = (AVRational) {1, 60};
+        ctx->framerate = (AVRational) {60, 1};
+        ctx->bit_rate = 1000000;
+        ctx->gop_size = FRAME_COUNT;
+        ctx->max_b_frames = 0;
+        // Several slices per frame, to exercise slice threading
+        ctx->slices = 4;
+
+        if (avcodec_open2(ctx, codec, NULL) < 0) {
+            avcodec_free_context(&ctx);
+            continue;
+        }
+
+        return ctx;
+    }
+
+    return NULL;
+}
+
+static void
+collect_packets(AVCodecContext *ctx, const AVFrame *frame) {
+    AVPacket *packet = av_packet_alloc();
+    assert(packet);
+
+    int ret = avcodec_send_frame(ctx, frame);
+    assert(!ret);
+    (void) ret;
+
+    while (!avcodec_receive_packet(ctx, packet)) {
+        assert(stream.count < ARRAY_LEN(stream.packets));
+        // Not a config packet for the decoder
+        assert(packet->pts != AV_NOPTS_VALUE);
+        stream.packets[stream.count++] = av_packet_clone(packet);
+        av_packet_unref(packet);
+    }
+
+    av_packet_free(&packet);
+}
+
+// Encode a moving gradient, with the in-band headers (like a device stream)
+static bool
+encode_stream(void) {
+    AVCodecContext *ctx = open_encoder();
+    if (!ctx) {
+        return false;
+    }
+
+    stream.codec_id = ctx->codec_id;
+
+    AVFrame *frame = av_frame_alloc();
+    assert(frame);
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = WIDTH;
+    frame->height = HEIGHT;
+    int r = av_frame_get_buffer(frame, 0);
+    assert(!r);
+    (void) r;
+
+    for (int i = 0; i < FRAME_COUNT; ++i) {
+        r = av_frame_make_writable(frame);
+        assert(!r);
+
+        for (int y = 0; y < HEIGHT; ++y) {
+            for (int x = 0; x < WIDTH; ++x) {
+                frame->data[0][y * frame->linesize[0] + x] = x + y + i * 8;
+            }
+        }
+        for (int y = 0; y < HEIGHT / 2; ++y) {
+            memset(&frame->data[1][y * frame->linesize[1]], 128, WIDTH / 2);
+            memset(&frame->data[2][y * frame->linesize[2]], 128, WIDTH / 2);
+        }
+        frame->pts = i;
+
+        collect_packets(ctx, frame);
+    }
+
+    // Flush the encoder
+    collect_packets(ctx, NULL);
+
+    av_frame_free(&frame);
+    avcodec_free_context(&ctx);
+
+    return stream.count > 0;
+}
+
+// Open the codec context like the demuxer does
+static AVCodecContext *
+open_demuxer_context(void) {
+    const AVCodec *codec = avcodec_find_decoder(stream.codec_id);
+    assert(codec);
+
+    AVCodecContext *ctx = avcodec_alloc_context3(codec);
+    assert(ctx);
+    ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    ctx->width = WIDTH;
+    ctx->height = HEIGHT;
+    ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+
+    int r = avcodec_open2(ctx, codec, NULL);
+    assert(!r);
+    (void) r;
+
+    return ctx;
+}
+
+static void
+test_decode(const struct sc_decoder_params *params) {
+    AVCodecContext *ctx = open_demuxer_context();
+
+    struct sc_decoder decoder;
+    sc_decoder_init(&decoder, "test", params);
+
+    struct test_sink sink;
+    test_sink_init(&sink);
+    sc_frame_source_add_sink(&decoder.frame_source, &sink.frame_sink);
+
+    struct sc_stream_session session = {
+        .video = {
+            .width = WIDTH,
+            .height = HEIGHT,
+        },
+    };
+
+    struct sc_packet_sink *packet_sink = &decoder.packet_sink;
+    bool ok = packet_sink->ops->open(packet_sink, ctx, &session);
+    assert(ok);
+    assert(sink.opened);
+
+    for (unsigned i = 0; i < stream.count; ++i) {
+        ok = packet_sink->ops->push(packet_sink, stream.packets[i]);
+        assert(ok);
+    }
+    (void) ok;
+
+    packet_sink->ops->close(packet_sink);
+    assert(sink.closed);
+
+    // The decoder is never flushed: with frame threading, the last frames
+    // (one per additional thread) may still be in the decoder on close
+    unsigned expected = FRAME_COUNT;
+    if (params && params->thread_type == SC_DECODER_THREAD_TYPE_FRAME) {
+        expected -= params->threads;
+    }
+    assert(sink.frames >= expected);
+    assert(sink.frames <= FRAME_COUNT);
+    (void) expected;
+
+    avcodec_free_context(&ctx);
+}
+
+static void test_decode_demuxer_context(void) {
+    // Decode with the demuxer context (no params)
+    test_decode(NULL);
+}
+
+static void test_decode_slice_threads(void) {
+    struct sc_decoder_params params = {
+        .threads = THREADS,
+        .thread_type = SC_DECODER_THREAD_TYPE_SLICE,
+    };
+    test_decode(&params);
+}
+
+static void test_decode_frame_threads(void) {
+    struct sc_decoder_params params = {
+        .threads = THREADS,
+        .thread_type = SC_DECODER_THREAD_TYPE_FRAME,
+    };
+    test_decode(&params);
+}
+
+static void test_decode_hwaccel_fallback(void) {
+    // An unknown device type must fallback to software decoding
+    struct sc_decoder_params params = {
+        .threads = THREADS,
+        .thread_type = SC_DECODER_THREAD_TYPE_SLICE,
+        .hwaccel = "nonexistent",
+    };
+    test_decode(&params);
+}
+
+static void test_decode_hwaccel_auto(void) {
+    // Without any hardware decoder (e.g. on CI), this falls back to software
+    // decoding; otherwise, the sink receives the downloaded YUV420P frames
+    struct sc_decoder_params params = {
+        .threads = THREADS,
+        .thread_type = SC_DECODER_THREAD_TYPE_SLICE,
+        .hwaccel = "auto",
+    };
+    test_decode(&params);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    if (!encode_stream()) {
+        // Do not fail on an FFmpeg build without any suitable encoder
+        fprintf(stderr, "No video encoder available, skipping decoder "
+                        "tests\n");
+        return 0;
+    }
+
+    test_decode_demuxer_context();
+    test_decode_slice_threads();
+    test_decode_frame_threads();
+    test_decode_hwaccel_fallback();
+    test_decode_hwaccel_auto();
+
+    for (unsigned i = 0; i < stream.count; ++i) {
+        av_packet_free(&stream.packets[i]);
+    }
+
+    return 0;
+}
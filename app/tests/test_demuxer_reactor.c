@@ -0,0 +1,338 @@
+#include "common.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <libavcodec/avcodec.h>
+
+#include "demuxer.h"
+#include "util/binary.h"
+#include "util/reactor.h"
+#include "util/worker_pool.h"
+
+// Several fake devices streaming at the same time, demuxed on a single
+// reactor thread (or one thread per device)
+#define DEVICES 6
+#define PACKETS 2000
+// Larger than the demuxer receive buffer, so that the payload is received in
+// several reactor callbacks
+#define LARGE_PACKET_SIZE (300 * 1024)
+
+struct stream {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+};
+
+static void
+stream_append(struct stream *stream, const void *data, size_t len) {
+    if (stream->size + len > stream->capacity) {
+        stream->capacity = (stream->size + len) * 2;
+        stream->data = realloc(stream->data, stream->capacity);
+        assert(stream->data);
+    }
+    memcpy(stream->data + stream->size, data, len);
+    stream->size += len;
+}
+
+static void
+stream_append_packet(struct stream *stream, uint64_t pts_flags, uint32_t len,
+                     uint8_t value) {
+    uint8_t header[12];
+    sc_write64be(header, pts_flags);
+    sc_write32be(&header[8], len);
+    stream_append(stream, header, sizeof(header));
+
+    uint8_t payload[4096];
+    memset(payload, value, sizeof(payload));
+    while (len) {
+        uint32_t chunk = len < sizeof(payload) ? len : sizeof(payload);
+        stream_append(stream, payload, chunk);
+        len -= chunk;
+    }
+}
+
+static void
+stream_append_session(struct stream *stream, uint32_t width,
+                      uint32_t height) {
+    uint8_t session[12] = {0x80};
+    sc_write32be(&session[4], width);
+    sc_write32be(&session[8], height);
+    stream_append(stream, session, sizeof(session));
+}
+
+// The payload bytes of packet i are all (i & 0xFF), its pts is i * 1000
+static void
+make_stream(struct stream *stream, bool video) {
+    uint8_t codec_id[4];
+    sc_write32be(codec_id, video ? 0x68323634 /* "h264" */
+                                 : 0x6f707573 /* "opus" */);
+    stream_append(stream, codec_id, sizeof(codec_id));
+
+    if (video) {
+        stream_append_session(stream, 1080, 2400);
+        // Config packet, merged into the next packet
+        stream_append_packet(stream, UINT64_C(1) << 62, 32, 0xFF);
+    }
+
+    for (unsigned i = 0; i < PACKETS; ++i) {
+        uint64_t pts_flags = (uint64_t) i * 1000;
+        uint32_t len = 100 + (i * 37) % 3000;
+        if (video && i % 500 == 0) {
+            pts_flags |= UINT64_C(1) << 61;
+            len = LARGE_PACKET_SIZE;
+        }
+        if (video && i == PACKETS / 2) {
+            // Rotation
+            stream_append_session(stream, 2400, 1080);
+        }
+        stream_append_packet(stream, pts_flags, len, i & 0xFF);
+    }
+}
+
+struct writer {
+    pthread_t thread;
+    int fd;
+    const struct stream *stream;
+};
+
+static void *
+run_writer(void *data) {
+    struct writer *writer = data;
+    const uint8_t *p = writer->stream->data;
+    size_t remaining = writer->stream->size;
+    while (remaining) {
+        // Small writes, so that the headers are split across reads
+        size_t chunk = remaining < 7919 ? remaining : 7919;
+        ssize_t w = send(writer->fd, p, chunk, MSG_NOSIGNAL);
+        if (w <= 0) {
+            break;
+        }
+        p += w;
+        remaining -= w;
+    }
+
+    // End of stream
+    shutdown(writer->fd, SHUT_WR);
+    return NULL;
+}
+
+struct test_device {
+    struct sc_demuxer demuxer;
+    struct sc_packet_sink packet_sink; // packet sink trait
+    struct writer writer;
+    int fds[2];
+    bool video;
+    bool slow;
+
+    // Only accessed by the sink callbacks (serialized)
+    bool opened;
+    bool closed;
+    unsigned packets;
+    unsigned sessions;
+    int64_t last_pts;
+    bool error;
+
+    enum sc_demuxer_status status;
+    bool ended;
+};
+
+#define DOWNCAST(SINK) container_of(SINK, struct test_device, packet_sink)
+
+static bool
+test_sink_open(struct sc_packet_sink *sink, AVCodecContext *ctx,
+               const struct sc_stream_session *session) {
+    (void) ctx;
+    struct test_device *device = DOWNCAST(sink);
+    if (device->opened || device->video != !!session) {
+        device->error = true;
+    }
+    if (session && session->video.width != 1080) {
+        device->error = true;
+    }
+    device->opened = true;
+    return true;
+}
+
+static void
+test_sink_close(struct sc_packet_sink *sink) {
+    struct test_device *device = DOWNCAST(sink);
+    device->closed = true;
+}
+
+static bool
+test_sink_push(struct sc_packet_sink *sink, const AVPacket *packet) {
+    struct test_device *device = DOWNCAST(sink);
+
+    if (packet->pts == AV_NOPTS_VALUE) {
+        // Config packet
+        return true;
+    }
+
+    // In order, none missing
+    int64_t expected_pts = (int64_t) device->packets * 1000;
+    uint8_t expected_value = device->packets & 0xFF;
+    if (!device->opened || packet->pts != expected_pts
+            || packet->data[packet->size - 1] != expected_value) {
+        device->error = true;
+    }
+
+    bool key = device->video && device->packets % 500 == 0;
+    if (key != !!(packet->flags & AV_PKT_FLAG_KEY)) {
+        device->error = true;
+    }
+
+    device->last_pts = packet->pts;
+    ++device->packets;
+
+    if (device->slow && device->packets % 64 == 0) {
+        // Slower than the stream: the demuxer must stop reading
+        usleep(1000);
+    }
+
+    return true;
+}
+
+static bool
+test_sink_push_session(struct sc_packet_sink *sink,
+                       const struct sc_stream_session *session) {
+    struct test_device *device = DOWNCAST(sink);
+    if (device->packets != PACKETS / 2 || session->video.width != 2400) {
+        device->error = true;
+    }
+    ++device->sessions;
+    return true;
+}
+
+static void
+on_demuxer_ended(struct sc_demuxer *demuxer, enum sc_demuxer_status status,
+                 void *userdata) {
+    (void) demuxer;
+    struct test_device *device = userdata;
+    device->status = status;
+    device->ended = true;
+}
+
+static void
+test_devices(struct sc_reactor *reactor, struct sc_worker_pool *pool,
+             struct stream streams[2]) {
+    static struct test_device devices[DEVICES];
+    memset(devices, 0, sizeof(devices));
+
+    static const struct sc_packet_sink_ops ops = {
+        .open = test_sink_open,
+        .close = test_sink_close,
+        .push = test_sink_push,
+        .push_session = test_sink_push_session,
+    };
+    static const struct sc_demuxer_callbacks cbs = {
+        .on_ended = on_demuxer_ended,
+    };
+
+    for (unsigned i = 0; i < DEVICES; ++i) {
+        struct test_device *device = &devices[i];
+        device->video = i % 2;
+        device->slow = i == 1;
+        device->packet_sink.ops = &ops;
+
+        int r = socketpair(AF_UNIX, SOCK_STREAM, 0, device->fds);
+        assert(!r);
+        (void) r;
+
+        sc_demuxer_init(&device->demuxer, "test", device->fds[0], &cbs,
+                        device);
+        sc_packet_source_add_sink(&device->demuxer.packet_source,
+                                  &device->packet_sink);
+
+        bool ok = reactor
+                ? sc_demuxer_start_reactor(&device->demuxer, reactor, pool)
+                : sc_demuxer_start(&device->demuxer);
+        assert(ok);
+        (void) ok;
+    }
+
+    for (unsigned i = 0; i < DEVICES; ++i) {
+        struct test_device *device = &devices[i];
+        device->writer.fd = device->fds[1];
+        device->writer.stream = &streams[device->video];
+        int r = pthread_create(&device->writer.thread, NULL, run_writer,
+                               &device->writer);
+        assert(!r);
+        (void) r;
+    }
+
+    for (unsigned i = 0; i < DEVICES; ++i) {
+        struct test_device *device = &devices[i];
+        sc_demuxer_join(&device->demuxer);
+        // Unblock the writer if the demuxer stopped early
+        shutdown(device->fds[0], SHUT_RDWR);
+        pthread_join(device->writer.thread, NULL);
+        close(device->fds[0]);
+        close(device->fds[1]);
+
+        assert(device->ended);
+        assert(device->status == SC_DEMUXER_STATUS_EOS);
+        assert(device->opened);
+        assert(device->closed);
+        assert(!device->error);
+        assert(device->packets == PACKETS);
+        assert(device->sessions == (device->video ? 1 : 0));
+    }
+}
+
+static void
+test_reactor(struct stream streams[2]) {
+    struct sc_reactor reactor;
+    bool ok = sc_reactor_init(&reactor);
+    if (!ok) {
+        // Not supported on this platform, the callers use the fallback
+        return;
+    }
+
+    ok = sc_reactor_start(&reactor);
+    assert(ok);
+
+    // Fewer workers than devices
+    struct sc_worker_pool pool;
+    ok = sc_worker_pool_init(&pool, 2);
+    assert(ok);
+    ok = sc_worker_pool_start(&pool);
+    assert(ok);
+
+    test_devices(&reactor, &pool, streams);
+
+    sc_reactor_stop(&reactor);
+    sc_reactor_join(&reactor);
+    sc_reactor_destroy(&reactor);
+
+    sc_worker_pool_stop(&pool);
+    sc_worker_pool_join(&pool);
+    sc_worker_pool_destroy(&pool);
+
+    (void) ok;
+}
+
+static void
+test_thread_fallback(struct stream streams[2]) {
+    test_devices(NULL, NULL, streams);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    struct stream streams[2] = {0};
+    make_stream(&streams[0], false);
+    make_stream(&streams[1], true);
+
+    test_reactor(streams);
+    test_thread_fallback(streams);
+
+    free(streams[0].data);
+    free(streams[1].data);
+
+    return 0;
+}
@@ -0,0 +1,289 @@
+#include "common.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "../../linkandroid/src/event_coalescer.h"
+#include "../../linkandroid/src/websocket_client.h"
+#include "util/thread.h"
+#include "util/tick.h"
+
+#define MAX_EVENTS 64
+
+// Never elapses during a test (the pending events are flushed explicitly)
+#define LONG_WINDOW_MS 60000
+
+// The events "sent" to the WebSocket server
+static struct {
+    sc_mutex mutex;
+    sc_cond cond;
+    struct sc_control_msg msgs[MAX_EVENTS];
+    uint16_t widths[MAX_EVENTS];
+    unsigned count;
+} sent;
+
+// Replaces the real client: the events are recorded (they are sent from the
+// coalescer thread when the window expires)
+void
+la_websocket_client_send_event(struct la_websocket_client *client,
+                               const struct sc_control_msg *msg,
+                               uint16_t device_width, uint16_t device_height) {
+    (void) client;
+    (void) device_height;
+
+    sc_mutex_lock(&sent.mutex);
+    assert(sent.count < MAX_EVENTS);
+    sent.msgs[sent.count] = *msg;
+    sent.widths[sent.count] = device_width;
+    ++sent.count;
+    sc_cond_signal(&sent.cond);
+    sc_mutex_unlock(&sent.mutex);
+}
+
+static unsigned
+sent_count(void) {
+    sc_mutex_lock(&sent.mutex);
+    unsigned count = sent.count;
+    sc_mutex_unlock(&sent.mutex);
+    return count;
+}
+
+static void
+sent_reset(void) {
+    sc_mutex_lock(&sent.mutex);
+    sent.count = 0;
+    sc_mutex_unlock(&sent.mutex);
+}
+
+static struct sc_control_msg
+touch(enum android_motionevent_action action, uint64_t pointer_id, int32_t x) {
+    struct sc_control_msg msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT;
+    msg.inject_touch_event.action = action;
+    msg.inject_touch_event.pointer_id = pointer_id;
+    msg.inject_touch_event.position.point.x = x;
+    msg.inject_touch_event.pressure = 1.f;
+    return msg;
+}
+
+static struct sc_control_msg
+scroll(int32_t x, float hscroll, float vscroll) {
+    struct sc_control_msg msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT;
+    msg.inject_scroll_event.position.point.x = x;
+    msg.inject_scroll_event.hscroll = hscroll;
+    msg.inject_scroll_event.vscroll = vscroll;
+    return msg;
+}
+
+static struct sc_control_msg
+key(enum android_keycode keycode) {
+    struct sc_control_msg msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = SC_CONTROL_MSG_TYPE_INJECT_KEYCODE;
+    msg.inject_keycode.action = AKEY_EVENT_ACTION_DOWN;
+    msg.inject_keycode.keycode = keycode;
+    return msg;
+}
+
+static void
+push(struct la_event_coalescer *coalescer, struct sc_control_msg msg) {
+    la_event_coalescer_push(coalescer, &msg, 1080, 2400);
+}
+
+static void
+assert_touch(unsigned i, enum android_motionevent_action action,
+             uint64_t pointer_id, int32_t x) {
+    const struct sc_control_msg *msg = &sent.msgs[i];
+    assert(msg->type == SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT);
+    assert(msg->inject_touch_event.action == action);
+    assert(msg->inject_touch_event.pointer_id == pointer_id);
+    assert(msg->inject_touch_event.position.point.x == x);
+    (void) msg;
+}
+
+static void
+assert_scroll(unsigned i, int32_t x, float hscroll, float vscroll) {
+    const struct sc_control_msg *msg = &sent.msgs[i];
+    assert(msg->type == SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT);
+    assert(msg->inject_scroll_event.position.point.x == x);
+    assert(msg->inject_scroll_event.hscroll == hscroll);
+    assert(msg->inject_scroll_event.vscroll == vscroll);
+    (void) msg;
+}
+
+static void test_disabled(void) {
+    sent_reset();
+
+    struct la_event_coalescer coalescer;
+    bool ok = la_event_coalescer_init(&coalescer, NULL, 0);
+    assert(ok);
+    (void) ok;
+
+    // Every event is forwarded immediately
+    push(&coalescer, touch(AMOTION_EVENT_ACTION_MOVE, 1, 10));
+    push(&coalescer, touch(AMOTION_EVENT_ACTION_MOVE, 1, 20));
+    push(&coalescer, scroll(5, 0, 1));
+    assert(sent_count() == 3);
+    assert_touch(0, AMOTION_EVENT_ACTION_MOVE, 1, 10);
+    assert_touch(1, AMOTION_EVENT_ACTION_MOVE, 1, 20);
+    assert_scroll(2, 5, 0, 1);
+
+    struct la_event_coalescer_stats stats;
+    la_event_coalescer_get_stats(&coalescer, &stats);
+    assert(stats.forwarded == 3);
+    assert(!stats.merged_moves);
+    assert(!stats.merged_scrolls);
+
+    la_event_coalescer_destroy(&coalescer);
+}
+
+static void test_merge_moves(void) {
+    sent_reset();
+
+    struct la_event_coalescer coalescer;
+    bool ok = la_event_coalescer_init(&coalescer, NULL, LONG_WINDOW_MS);
+    assert(ok);
+    (void) ok;
+
+    push(&coalescer, touch(AMOTION_EVENT_ACTION_DOWN, 1, 0));
+    assert(sent_count() == 1);
+
+    // Only the last position of each pointer is kept
+    push(&coalescer, touch(AMOTION_EVENT_ACTION_MOVE, 1, 10));
+    push(&coalescer, touch(AMOTION_EVENT_ACTION_MOVE, 2, 100));
+    push(&coalescer, touch(AMOTION_EVENT_ACTION_MOVE, 1, 20));
+    push(&coalescer, touch(AMOTION_EVENT_ACTION_MOVE, 1, 30));
+    push(&coalescer, touch(AMOTION_EVENT_ACTION_MOVE, 2, 200));
+    assert(sent_count() == 1);
+
+    // The UP event flushes the pending moves first
+    push(&coalescer, touch(AMOTION_EVENT_ACTION_UP, 1, 30));
+    assert(sent_count() == 4);
+    assert_touch(0, AMOTION_EVENT_ACTION_DOWN, 1, 0);
+    assert_touch(1, AMOTION_EVENT_ACTION_MOVE, 1, 30);
+    assert_touch(2, AMOTION_EVENT_ACTION_MOVE, 2, 200);
+    assert_touch(3, AMOTION_EVENT_ACTION_UP, 1, 30);
+
+    struct la_event_coalescer_stats stats;
+    la_event_coalescer_get_stats(&coalescer, &stats);
+    assert(stats.forwarded == 4);
+    assert(stats.merged_moves == 3);
+    assert(!stats.merged_scrolls);
+
+    la_event_coalescer_destroy(&coalescer);
+}
+
+static void test_merge_scrolls(void) {
+    sent_reset();
+
+    struct la_event_coalescer coalescer;
+    bool ok = la_event_coalescer_init(&coalescer, NULL, LONG_WINDOW_MS);
+    assert(ok);
+    (void) ok;
+
+    // The deltas are accumulated, at the last position
+    push(&coalescer, scroll(1, 1, 0));
+    push(&coalescer, scroll(2, 0, 2));
+    push(&coalescer, scroll(3, 0.5f, 1));
+    assert(!sent_count());
+
+    // A key event flushes the pending scroll first; the horizontal and
+    // vertical deltas are sent separately
+    push(&coalescer, key(AKEYCODE_A));
+    assert(sent_count() == 3);
+    assert_scroll(0, 3, 1.5f, 0);
+    assert_scroll(1, 3, 0, 3);
+    assert(sent.msgs[2].type == SC_CONTROL_MSG_TYPE_INJECT_KEYCODE);
+    assert(sent.msgs[2].inject_keycode.keycode == AKEYCODE_A);
+
+    struct la_event_coalescer_stats stats;
+    la_event_coalescer_get_stats(&coalescer, &stats);
+    assert(stats.forwarded == 3);
+    assert(!stats.merged_moves);
+    assert(stats.merged_scrolls == 2);
+
+    la_event_coalescer_destroy(&coalescer);
+}
+
+static void test_device_size_change(void) {
+    sent_reset();
+
+    struct la_event_coalescer coalescer;
+    bool ok = la_event_coalescer_init(&coalescer, NULL, LONG_WINDOW_MS);
+    assert(ok);
+    (void) ok;
+
+    // The coordinates are relative to the device size: the moves for
+    // different sizes are not merged
+    struct sc_control_msg msg = touch(AMOTION_EVENT_ACTION_MOVE, 1, 10);
+    la_event_coalescer_push(&coalescer, &msg, 1080, 2400);
+    msg = touch(AMOTION_EVENT_ACTION_MOVE, 1, 20);
+    la_event_coalescer_push(&coalescer, &msg, 2400, 1080);
+    assert(sent_count() == 1);
+    assert_touch(0, AMOTION_EVENT_ACTION_MOVE, 1, 10);
+    assert(sent.widths[0] == 1080);
+
+    // The pending events are not lost on destroy
+    la_event_coalescer_destroy(&coalescer);
+    assert(sent_count() == 2);
+    assert_touch(1, AMOTION_EVENT_ACTION_MOVE, 1, 20);
+    assert(sent.widths[1] == 2400);
+}
+
+static void test_window(void) {
+    sent_reset();
+
+    struct la_event_coalescer coalescer;
+    bool ok = la_event_coalescer_init(&coalescer, NULL, 20);
+    assert(ok);
+    (void) ok;
+
+    sc_tick start = sc_tick_now();
+    push(&coalescer, touch(AMOTION_EVENT_ACTION_MOVE, 1, 10));
+    push(&coalescer, touch(AMOTION_EVENT_ACTION_MOVE, 1, 20));
+
+    // Flushed by the coalescer thread once the window expires
+    sc_tick deadline = start + SC_TICK_FROM_SEC(5);
+    sc_mutex_lock(&sent.mutex);
+    while (!sent.count && sc_tick_now() < deadline) {
+        sc_cond_timedwait(&sent.cond, &sent.mutex, deadline);
+    }
+    unsigned count = sent.count;
+    sc_mutex_unlock(&sent.mutex);
+
+    assert(count == 1);
+    (void) count;
+    assert(sc_tick_now() - start >= SC_TICK_FROM_MS(20));
+    assert_touch(0, AMOTION_EVENT_ACTION_MOVE, 1, 20);
+
+    // The next events start a new window
+    push(&coalescer, touch(AMOTION_EVENT_ACTION_MOVE, 1, 30));
+    la_event_coalescer_destroy(&coalescer);
+    assert(sent_count() == 2);
+    assert_touch(1, AMOTION_EVENT_ACTION_MOVE, 1, 30);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    bool ok = sc_mutex_init(&sent.mutex);
+    assert(ok);
+    ok = sc_cond_init(&sent.cond);
+    assert(ok);
+    (void) ok;
+
+    test_disabled();
+    test_merge_moves();
+    test_merge_scrolls();
+    test_device_size_change();
+    test_window();
+
+    sc_cond_destroy(&sent.cond);
+    sc_mutex_destroy(&sent.mutex);
+
+    return 0;
+}
@@ -0,0 +1,193 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "control_msg.h"
+#include "../../linkandroid/src/event_json.h"
+
+static void
+assert_json(const struct sc_control_msg *msg, const char *expected) {
+    char buf[1024];
+    size_t len = la_event_json_serialize(msg, 0x1a2b3c4d, 1080, 2400, buf,
+                                         sizeof(buf));
+    assert(len == strlen(expected));
+    assert(!memcmp(buf, expected, len));
+    (void) len;
+    (void) expected;
+}
+
+static void test_serialize_key(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_KEYCODE,
+        .inject_keycode = {
+            .action = AKEY_EVENT_ACTION_DOWN,
+            .keycode = AKEYCODE_ENTER,
+            .repeat = 5,
+            .metastate = AMETA_SHIFT_ON | AMETA_SHIFT_LEFT_ON,
+        },
+    };
+
+    assert_json(&msg, "{\"type\":\"key\",\"id\":\"1a2b3c4d\","
+                      "\"data\":{\"action\":\"down\",\"keycode\":66,"
+                      "\"repeat\":5,\"metastate\":65,"
+                      "\"width\":1080,\"height\":2400}}");
+}
+
+static void test_serialize_touch(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT,
+        .inject_touch_event = {
+            .action = AMOTION_EVENT_ACTION_MOVE,
+            .pointer_id = UINT64_C(0xFFFFFFFFFFFFFFFE),
+            .position = {
+                .screen_size = {1080, 2400},
+                .point = {-3, 1234},
+            },
+            .pressure = 0.5f,
+        },
+    };
+
+    assert_json(&msg, "{\"type\":\"touch_move\",\"id\":\"1a2b3c4d\","
+                      "\"data\":{\"pointer_id\":\"18446744073709551614\","
+                      "\"x\":-3,\"y\":1234,\"pressure\":0.500000,"
+                      "\"width\":1080,\"height\":2400}}");
+
+    // Hover events are not forwarded
+    msg.inject_touch_event.action = AMOTION_EVENT_ACTION_HOVER_MOVE;
+    char buf[16];
+    size_t len = la_event_json_serialize(&msg, 1, 1080, 2400, buf,
+                                         sizeof(buf));
+    assert(!len);
+    (void) len;
+}
+
+static void test_serialize_scroll(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT,
+        .inject_scroll_event = {
+            .position = {
+                .screen_size = {1080, 2400},
+                .point = {260, 1026},
+            },
+            .hscroll = 0,
+            .vscroll = -1.5f,
+        },
+    };
+
+    assert_json(&msg, "{\"type\":\"scroll_v\",\"id\":\"1a2b3c4d\","
+                      "\"data\":{\"x\":260,\"y\":1026,\"vscroll\":-1.500000,"
+                      "\"width\":1080,\"height\":2400}}");
+
+    msg.inject_scroll_event.hscroll = 2;
+    assert_json(&msg, "{\"type\":\"scroll_h\",\"id\":\"1a2b3c4d\","
+                      "\"data\":{\"x\":260,\"y\":1026,\"hscroll\":2.000000,"
+                      "\"width\":1080,\"height\":2400}}");
+}
+
+static void test_serialize_text_escaped(void) {
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_TEXT,
+        .inject_text = {
+            .text = "a\"b\\c\nd\te\x01 héllo",
+        },
+    };
+
+    assert_json(&msg, "{\"type\":\"text\",\"id\":\"1a2b3c4d\","
+                      "\"data\":{\"text\":\"a\\\"b\\\\c\\nd\\te\\u0001 héllo\","
+                      "\"width\":1080,\"height\":2400}}");
+}
+
+static void test_serialize_long_text(void) {
+    // Much longer than the previous 512-byte limit
+    size_t text_len = 5000;
+    char *text = malloc(text_len + 1);
+    assert(text);
+    memset(text, 'x', text_len);
+    text[text_len] = '\0';
+
+    struct sc_control_msg msg = {
+        .type = SC_CONTROL_MSG_TYPE_INJECT_TEXT,
+        .inject_text = {
+            .text = text,
+        },
+    };
+
+    // The required size is returned even if the buffer is too small
+    char small[64];
+    size_t len = la_event_json_serialize(&msg, 1, 1080, 2400, small,
+                                         sizeof(small));
+    assert(len > text_len);
+    assert(!memcmp(small, "{\"type\":\"text\",\"id\":\"00000001\"", 30));
+
+    char *buf = malloc(len);
+    assert(buf);
+    size_t len2 = la_event_json_serialize(&msg, 1, 1080, 2400, buf, len);
+    assert(len2 == len);
+    (void) len2;
+
+    const char *suffix = "\",\"width\":1080,\"height\":2400}}";
+    size_t suffix_len = strlen(suffix);
+    assert(!memcmp(buf + len - suffix_len, suffix, suffix_len));
+    assert(buf[len - suffix_len - 1] == 'x');
+    (void) suffix_len;
+
+    free(buf);
+    free(text);
+}
+
+static void test_writer_int(void) {
+    char buf[64];
+    struct la_json_writer w;
+    la_json_writer_init(&w, buf, sizeof(buf));
+
+    la_json_writer_int(&w, 0);
+    la_json_writer_literal(&w, ",");
+    la_json_writer_int(&w, INT64_MIN);
+    la_json_writer_literal(&w, ",");
+    la_json_writer_uint(&w, UINT64_MAX);
+
+    const char *expected = "0,-9223372036854775808,18446744073709551615";
+    assert(w.len == strlen(expected));
+    assert(!memcmp(buf, expected, w.len));
+    (void) expected;
+}
+
+static void test_writer_float(void) {
+    static const float values[] = {
+        0, 1, -1, 0.5f, 1.0f / 3, -2.75f, 0.0078125f, 0.0234375f, -0.0000001f,
+        123456.789f, 16.0f, -16.0f, 1e-7f, 3.4e10f,
+    };
+
+    for (size_t i = 0; i < ARRAY_LEN(values); ++i) {
+        char expected[64];
+        int len = snprintf(expected, sizeof(expected), "%.6f", values[i]);
+        assert(len > 0);
+
+        char buf[64];
+        struct la_json_writer w;
+        la_json_writer_init(&w, buf, sizeof(buf));
+        la_json_writer_float(&w, values[i]);
+
+        assert(w.len == (size_t) len);
+        assert(!memcmp(buf, expected, len));
+        (void) len;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_serialize_key();
+    test_serialize_touch();
+    test_serialize_scroll();
+    test_serialize_text_escaped();
+    test_serialize_long_text();
+    test_writer_int();
+    test_writer_float();
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+#include "util/histogram.h"
+
+static void test_histogram_exact(void) {
+    struct sc_histogram hist;
+    sc_histogram_init(&hist);
+
+    assert(sc_histogram_percentile(&hist, 50) == 0);
+
+    // Small values are recorded exactly
+    for (unsigned i = 1; i <= 20; ++i) {
+        sc_histogram_record(&hist, i);
+    }
+
+    assert(hist.count == 20);
+    assert(hist.max == 20);
+    assert(sc_histogram_percentile(&hist, 0) == 1);
+    assert(sc_histogram_percentile(&hist, 50) == 10);
+    assert(sc_histogram_percentile(&hist, 95) == 19);
+    assert(sc_histogram_percentile(&hist, 100) == 20);
+}
+
+static void test_histogram_precision(void) {
+    struct sc_histogram hist;
+
+    uint64_t values[] = {32, 33, 100, 1000, 16666, 123456, 5000000,
+                         UINT32_MAX};
+    for (size_t i = 0; i < ARRAY_LEN(values); ++i) {
+        sc_histogram_init(&hist);
+        uint64_t value = values[i];
+        sc_histogram_record(&hist, value);
+        // Capped to the max, so a single value is exact
+        assert(sc_histogram_percentile(&hist, 50) == value);
+
+        // Another value in the same bucket is never underestimated, and the
+        // relative error is bounded
+        sc_histogram_record(&hist, value + 1);
+        uint64_t p = sc_histogram_percentile(&hist, 0);
+        assert(p >= value);
+        assert(p - value <= value / SC_HISTOGRAM_SUB_BUCKETS);
+    }
+}
+
+static void test_histogram_saturate(void) {
+    struct sc_histogram hist;
+    sc_histogram_init(&hist);
+
+    sc_histogram_record(&hist, UINT64_C(1) << 40);
+    assert(hist.count == 1);
+    assert(hist.max == UINT64_C(1) << 40);
+    assert(sc_histogram_percentile(&hist, 99) == UINT32_MAX);
+}
+
+static void test_histogram_percentiles(void) {
+    struct sc_histogram hist;
+    sc_histogram_init(&hist);
+
+    // 1..10000 µs
+    for (unsigned i = 1; i <= 10000; ++i) {
+        sc_histogram_record(&hist, i);
+    }
+
+    uint64_t p50 = sc_histogram_percentile(&hist, 50);
+    uint64_t p99 = sc_histogram_percentile(&hist, 99);
+    assert(p50 >= 5000 && p50 <= 5000 + 5000 / SC_HISTOGRAM_SUB_BUCKETS);
+    assert(p99 >= 9900 && p99 <= 10000);
+
+    sc_histogram_init(&hist);
+    assert(!hist.count);
+    assert(sc_histogram_percentile(&hist, 99) == 0);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_histogram_exact();
+    test_histogram_precision();
+    test_histogram_saturate();
+    test_histogram_percentiles();
+    return 0;
+}
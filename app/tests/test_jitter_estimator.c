@@ -0,0 +1,118 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+#include "clock.h"
+#include "jitter_estimator.h"
+
+#define FRAME_US 16667 // 60 fps
+
+struct trace {
+    struct sc_clock clock;
+    struct sc_jitter_estimator je;
+    uint32_t seed;
+    unsigned index;
+};
+
+static void
+trace_init(struct trace *trace, sc_tick min_delay, sc_tick max_delay) {
+    sc_clock_init(&trace->clock);
+    sc_jitter_estimator_init(&trace->je, min_delay, max_delay);
+    trace->seed = 42;
+    trace->index = 0;
+}
+
+// Deterministic pseudo-random value in [0, max]
+static sc_tick
+trace_random(struct trace *trace, sc_tick max) {
+    trace->seed = trace->seed * 1103515245 + 12345;
+    return (sc_tick) ((trace->seed >> 8) % (max + 1));
+}
+
+// Simulate the arrival of count frames, each delayed by a random transit time
+// in [base, base + jitter], as the video regulator does
+static void
+trace_run(struct trace *trace, unsigned count, sc_tick jitter) {
+    // Arbitrary offset between the device and the computer clocks
+    const sc_tick offset = SC_TICK_FROM_SEC(1000);
+    const sc_tick base = SC_TICK_FROM_MS(5);
+
+    for (unsigned i = 0; i < count; ++i) {
+        sc_tick pts = (sc_tick) trace->index++ * FRAME_US;
+        sc_tick now = pts + offset + base + trace_random(trace, jitter);
+        sc_jitter_estimator_push(&trace->je, &trace->clock, now, pts);
+        sc_clock_update(&trace->clock, now, pts);
+    }
+}
+
+static void test_converge(void) {
+    struct trace trace;
+    trace_init(&trace, 0, SC_TICK_FROM_MS(500));
+
+    // The arrival jitter is 40 ms (+/- 20 ms around the mean)
+    trace_run(&trace, 600, SC_TICK_FROM_MS(40));
+    sc_tick delay = trace.je.delay;
+    assert(delay > SC_TICK_FROM_MS(12) && delay < SC_TICK_FROM_MS(24));
+
+    // Once converged, few frames are late
+    uint64_t late = trace.je.late;
+    trace_run(&trace, 600, SC_TICK_FROM_MS(40));
+    assert(trace.je.late - late < 600 / 10);
+
+    // And the delay is stable
+    assert(trace.je.delay > SC_TICK_FROM_MS(12)
+            && trace.je.delay < SC_TICK_FROM_MS(24));
+    (void) delay;
+    (void) late;
+}
+
+static void test_adapt(void) {
+    struct trace trace;
+    trace_init(&trace, 0, SC_TICK_FROM_MS(500));
+
+    // Low jitter
+    trace_run(&trace, 300, SC_TICK_FROM_MS(4));
+    sc_tick low_delay = trace.je.delay;
+    assert(low_delay < SC_TICK_FROM_MS(4));
+
+    // The jitter increases, the delay must increase quickly (in less than one
+    // second)
+    trace_run(&trace, 60, SC_TICK_FROM_MS(100));
+    sc_tick high_delay = trace.je.delay;
+    assert(high_delay > SC_TICK_FROM_MS(30));
+
+    // Then the jitter decreases again, the delay decreases slowly
+    trace_run(&trace, 30, SC_TICK_FROM_MS(4));
+    assert(trace.je.delay > high_delay / 2);
+
+    trace_run(&trace, 900, SC_TICK_FROM_MS(4));
+    assert(trace.je.delay < SC_TICK_FROM_MS(4));
+    (void) low_delay;
+    (void) high_delay;
+}
+
+static void test_bounds(void) {
+    struct trace trace;
+    trace_init(&trace, SC_TICK_FROM_MS(10), SC_TICK_FROM_MS(50));
+
+    // No jitter at all
+    trace_run(&trace, 300, 0);
+    assert(trace.je.delay == SC_TICK_FROM_MS(10));
+
+    // Huge jitter
+    trace_run(&trace, 300, SC_TICK_FROM_SEC(1));
+    assert(trace.je.delay == SC_TICK_FROM_MS(50));
+    assert(trace.je.frames == 600);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_converge();
+    test_adapt();
+    test_bounds();
+
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include "common.h"
+
+#include <assert.h>
+
+#include "latency_stats.h"
+
+static void test_latency_stats_stages(void) {
+    struct sc_latency_stats stats;
+    bool ok = sc_latency_stats_init(&stats, 0);
+    assert(ok);
+
+    for (int64_t pts = 0; pts < 100 * 16666; pts += 16666) {
+        sc_latency_stats_on_received(&stats, pts);
+        sc_latency_stats_on_decoded(&stats, pts);
+        sc_latency_stats_on_pushed(&stats, pts);
+        sc_latency_stats_on_presented(&stats, pts);
+    }
+
+    struct sc_latency_stats_summary summaries[SC_LATENCY_STAGE_COUNT];
+    sc_latency_stats_get(&stats, summaries);
+    for (unsigned i = 0; i < SC_LATENCY_STAGE_COUNT; ++i) {
+        assert(summaries[i].count == 100);
+        assert(summaries[i].p50 <= summaries[i].p95);
+        assert(summaries[i].p95 <= summaries[i].p99);
+        assert(summaries[i].p99 <= summaries[i].max);
+    }
+
+    sc_latency_stats_destroy(&stats);
+}
+
+static void test_latency_stats_incomplete(void) {
+    struct sc_latency_stats stats;
+    bool ok = sc_latency_stats_init(&stats, 0);
+    assert(ok);
+
+    // Unknown frames are ignored
+    sc_latency_stats_on_decoded(&stats, 42);
+    sc_latency_stats_on_presented(&stats, 42);
+
+    // A skipped frame is decoded, but never presented
+    sc_latency_stats_on_received(&stats, 1000);
+    sc_latency_stats_on_decoded(&stats, 1000);
+    sc_latency_stats_on_pushed(&stats, 1000);
+
+    sc_latency_stats_on_received(&stats, 2000);
+    sc_latency_stats_on_decoded(&stats, 2000);
+    sc_latency_stats_on_pushed(&stats, 2000);
+    sc_latency_stats_on_presented(&stats, 2000);
+    // Presented again (e.g. on resume), counted once
+    sc_latency_stats_on_presented(&stats, 2000);
+
+    // Too old, overwritten by more recent frames
+    sc_latency_stats_on_received(&stats, 3000);
+    for (int64_t pts = 4000; pts < 4000 + SC_LATENCY_STATS_FRAMES; ++pts) {
+        sc_latency_stats_on_received(&stats, pts);
+    }
+    sc_latency_stats_on_decoded(&stats, 3000);
+
+    struct sc_latency_stats_summary summaries[SC_LATENCY_STAGE_COUNT];
+    sc_latency_stats_get(&stats, summaries);
+    assert(summaries[SC_LATENCY_STAGE_NETWORK].count
+                == 3 + SC_LATENCY_STATS_FRAMES);
+    assert(summaries[SC_LATENCY_STAGE_DECODE].count == 2);
+    assert(summaries[SC_LATENCY_STAGE_BUFFER].count == 2);
+    assert(summaries[SC_LATENCY_STAGE_RENDER].count == 1);
+    assert(summaries[SC_LATENCY_STAGE_TOTAL].count == 1);
+
+    sc_latency_stats_destroy(&stats);
+}
+
+static void test_latency_stats_network_jitter(void) {
+    struct sc_latency_stats stats;
+    bool ok = sc_latency_stats_init(&stats, 0);
+    assert(ok);
+
+    // The second packet arrives (at least) 1 second later than expected from
+    // its PTS
+    sc_latency_stats_on_received(&stats, SC_TICK_FROM_SEC(1));
+    sc_latency_stats_on_received(&stats, 0);
+
+    struct sc_latency_stats_summary summaries[SC_LATENCY_STAGE_COUNT];
+    sc_latency_stats_get(&stats, summaries);
+    struct sc_latency_stats_summary *network =
+        &summaries[SC_LATENCY_STAGE_NETWORK];
+    assert(network->count == 2);
+    assert(network->p50 == 0);
+    assert(network->max >= SC_TICK_FROM_SEC(1));
+
+    sc_latency_stats_destroy(&stats);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_latency_stats_stages();
+    test_latency_stats_incomplete();
+    test_latency_stats_network_jitter();
+    return 0;
+}
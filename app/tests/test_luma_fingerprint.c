@@ -0,0 +1,127 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../../linkandroid/src/luma_fingerprint.h"
+
+#define WIDTH 360
+#define HEIGHT 800
+#define LINESIZE 384
+
+static uint32_t seed = 42;
+
+static uint8_t
+random_byte(void) {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+}
+
+static uint8_t *
+create_image(void) {
+    uint8_t *luma = malloc(LINESIZE * HEIGHT);
+    assert(luma);
+    // Smooth content (as a UI), with some texture
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < LINESIZE; ++x) {
+            luma[y * LINESIZE + x] = (x + y) / 8 + (random_byte() & 7);
+        }
+    }
+    return luma;
+}
+
+static void test_identical(void) {
+    uint8_t *luma = create_image();
+
+    struct la_luma_fingerprint a;
+    struct la_luma_fingerprint b;
+    la_luma_fingerprint_compute(&a, luma, LINESIZE, WIDTH, HEIGHT);
+    la_luma_fingerprint_compute(&b, luma, LINESIZE, WIDTH, HEIGHT);
+    assert(la_luma_fingerprint_equals(&a, &b));
+
+    // The cells are the mean luma
+    uint8_t uniform[64 * 64];
+    for (int i = 0; i < 64 * 64; ++i) {
+        uniform[i] = 200;
+    }
+    la_luma_fingerprint_compute(&a, uniform, 64, 64, 64);
+    for (int i = 0; i < LA_LUMA_FINGERPRINT_SIZE * LA_LUMA_FINGERPRINT_SIZE;
+            ++i) {
+        assert(a.cells[i] == 200);
+    }
+
+    free(luma);
+}
+
+static void test_noise(void) {
+    uint8_t *luma = create_image();
+
+    struct la_luma_fingerprint a;
+    la_luma_fingerprint_compute(&a, luma, LINESIZE, WIDTH, HEIGHT);
+
+    // Encoding noise of +/- 1 on every pixel
+    for (int i = 0; i < LINESIZE * HEIGHT; ++i) {
+        int noise = (int) (random_byte() % 3) - 1;
+        int value = luma[i] + noise;
+        luma[i] = value < 0 ? 0 : value > 255 ? 255 : value;
+    }
+
+    struct la_luma_fingerprint b;
+    la_luma_fingerprint_compute(&b, luma, LINESIZE, WIDTH, HEIGHT);
+    assert(la_luma_fingerprint_equals(&a, &b));
+
+    free(luma);
+}
+
+static void test_small_change(void) {
+    uint8_t *luma = create_image();
+
+    struct la_luma_fingerprint a;
+    la_luma_fingerprint_compute(&a, luma, LINESIZE, WIDTH, HEIGHT);
+
+    // A clock digit changes (8x12 pixels)
+    for (int y = 10; y < 22; ++y) {
+        for (int x = 300; x < 308; ++x) {
+            luma[y * LINESIZE + x] ^= 0x80;
+        }
+    }
+
+    struct la_luma_fingerprint b;
+    la_luma_fingerprint_compute(&b, luma, LINESIZE, WIDTH, HEIGHT);
+    assert(!la_luma_fingerprint_equals(&a, &b));
+
+    // The size changes (rotation)
+    la_luma_fingerprint_compute(&b, luma, LINESIZE, HEIGHT / 4, WIDTH);
+    assert(!la_luma_fingerprint_equals(&a, &b));
+
+    free(luma);
+}
+
+static void test_tiny_image(void) {
+    // Smaller than the grid
+    uint8_t luma[5 * 3] = {
+        10, 20, 30, 40, 50,
+        10, 20, 30, 40, 50,
+        10, 20, 30, 40, 50,
+    };
+
+    struct la_luma_fingerprint a;
+    struct la_luma_fingerprint b;
+    la_luma_fingerprint_compute(&a, luma, 5, 5, 3);
+    luma[4] = 255;
+    la_luma_fingerprint_compute(&b, luma, 5, 5, 3);
+    assert(!la_luma_fingerprint_equals(&a, &b));
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_identical();
+    test_noise();
+    test_small_change();
+    test_tiny_image();
+
+    return 0;
+}
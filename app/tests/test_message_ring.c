@@ -0,0 +1,169 @@
+#include "common.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../../linkandroid/src/message_ring.h"
+
+#define HEADROOM 16
+
+static void test_message_ring_simple(void) {
+    struct la_message_ring ring;
+    bool ok = la_message_ring_init(&ring, 4, 32, HEADROOM);
+    assert(ok);
+
+    assert(!la_message_ring_peek(&ring));
+    assert(la_message_ring_depth(&ring) == 0);
+
+    ok = la_message_ring_push(&ring, "ab", 2, "cdef", 4, false);
+    assert(ok);
+    ok = la_message_ring_push(&ring, NULL, 0, "xyz", 3, true);
+    assert(ok);
+    assert(la_message_ring_depth(&ring) == 2);
+
+    struct la_message_slot *slot = la_message_ring_peek(&ring);
+    assert(slot);
+    assert(slot->len == 6);
+    assert(!slot->binary);
+    assert(!memcmp(la_message_slot_payload(&ring, slot), "abcdef", 6));
+    la_message_ring_pop(&ring);
+
+    slot = la_message_ring_peek(&ring);
+    assert(slot);
+    assert(slot->len == 3);
+    assert(slot->binary);
+    assert(!memcmp(la_message_slot_payload(&ring, slot), "xyz", 3));
+    la_message_ring_pop(&ring);
+
+    assert(!la_message_ring_peek(&ring));
+    assert(la_message_ring_depth(&ring) == 0);
+
+    la_message_ring_destroy(&ring);
+}
+
+static void test_message_ring_full(void) {
+    struct la_message_ring ring;
+    bool ok = la_message_ring_init(&ring, 3, 8, HEADROOM);
+    assert(ok);
+
+    for (int i = 0; i < 3; ++i) {
+        ok = la_message_ring_push(&ring, NULL, 0, "msg", 3, false);
+        assert(ok);
+    }
+
+    // Full: the new message is dropped
+    ok = la_message_ring_push(&ring, NULL, 0, "new", 3, false);
+    assert(!ok);
+    assert(atomic_load(&ring.dropped) == 1);
+    assert(atomic_load(&ring.pushed) == 3);
+    assert(atomic_load(&ring.max_depth) == 3);
+    assert(la_message_ring_depth(&ring) == 3);
+
+    la_message_ring_pop(&ring);
+    ok = la_message_ring_push(&ring, NULL, 0, "new", 3, false);
+    assert(ok);
+
+    la_message_ring_destroy(&ring);
+}
+
+static void test_message_ring_large(void) {
+    struct la_message_ring ring;
+    bool ok = la_message_ring_init(&ring, 2, 8, HEADROOM);
+    assert(ok);
+
+    char data[100];
+    for (size_t i = 0; i < sizeof(data); ++i) {
+        data[i] = i;
+    }
+
+    // Larger than the slot size
+    ok = la_message_ring_push(&ring, "hdr", 3, data, sizeof(data), true);
+    assert(ok);
+
+    struct la_message_slot *slot = la_message_ring_peek(&ring);
+    assert(slot);
+    assert(slot->large);
+    assert(slot->len == 3 + sizeof(data));
+    uint8_t *payload = la_message_slot_payload(&ring, slot);
+    assert(!memcmp(payload, "hdr", 3));
+    assert(!memcmp(payload + 3, data, sizeof(data)));
+    la_message_ring_pop(&ring);
+
+    // Oversized buffers are released on pop
+    assert(!slot->large);
+
+    la_message_ring_destroy(&ring);
+}
+
+#define STRESS_COUNT 200000
+
+static void *stress_producer(void *arg) {
+    struct la_message_ring *ring = arg;
+
+    for (uint32_t i = 0; i < STRESS_COUNT; ++i) {
+        char msg[64];
+        // Some messages exceed the slot size
+        int len = snprintf(msg, sizeof(msg), i % 7 ? "%u" : "%u-large-message",
+                           (unsigned) i);
+        while (!la_message_ring_push(ring, NULL, 0, msg, len, i % 2)) {
+            // Full, let the consumer run
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+static void test_message_ring_stress(void) {
+    struct la_message_ring ring;
+    bool ok = la_message_ring_init(&ring, 16, 8, HEADROOM);
+    assert(ok);
+
+    pthread_t producer;
+    int r = pthread_create(&producer, NULL, stress_producer, &ring);
+    assert(!r);
+    (void) r;
+
+    // Messages must be received in order, without loss or corruption
+    uint32_t received = 0;
+    while (received < STRESS_COUNT) {
+        struct la_message_slot *slot = la_message_ring_peek(&ring);
+        if (!slot) {
+            sched_yield();
+            continue;
+        }
+
+        char expected[64];
+        int len = snprintf(expected, sizeof(expected),
+                           received % 7 ? "%u" : "%u-large-message",
+                           (unsigned) received);
+        assert(slot->len == (size_t) len);
+        assert(slot->binary == (received % 2));
+        assert(!memcmp(la_message_slot_payload(&ring, slot), expected, len));
+        la_message_ring_pop(&ring);
+        ++received;
+    }
+
+    pthread_join(producer, NULL);
+
+    assert(!la_message_ring_peek(&ring));
+    assert(atomic_load(&ring.pushed) == STRESS_COUNT);
+    assert(atomic_load(&ring.max_depth) <= 16);
+
+    la_message_ring_destroy(&ring);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_message_ring_simple();
+    test_message_ring_full();
+    test_message_ring_large();
+    test_message_ring_stress();
+
+    return 0;
+}
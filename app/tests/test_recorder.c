@@ -0,0 +1,262 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+
+#include "recorder.h"
+
+#define FRAME_US 100000 // 10 fps
+#define GOP 10
+#define OPUS_FRAME_US 20000
+
+struct record_result {
+    bool ended;
+    bool success;
+};
+
+static void
+on_ended(struct sc_recorder *recorder, bool success, void *userdata) {
+    (void) recorder;
+    struct record_result *result = userdata;
+    result->ended = true;
+    result->success = success;
+}
+
+static const struct sc_recorder_callbacks cbs = {
+    .on_ended = on_ended,
+};
+
+static void
+push_packet(struct sc_packet_sink *sink, const uint8_t *data, int size,
+            int64_t pts, bool key) {
+    AVPacket *packet = av_packet_alloc();
+    assert(packet);
+    int r = av_new_packet(packet, size);
+    assert(!r);
+    (void) r;
+    memcpy(packet->data, data, size);
+
+    packet->pts = pts;
+    packet->dts = pts;
+    if (key) {
+        packet->flags |= AV_PKT_FLAG_KEY;
+    }
+
+    bool ok = sink->ops->push(sink, packet);
+    assert(ok);
+    (void) ok;
+
+    av_packet_free(&packet);
+}
+
+static void
+record_end(struct sc_recorder *recorder, struct sc_packet_sink *sink,
+           struct record_result *result) {
+    // Closing the sink stops the recorder, the pending packets are written
+    sink->ops->close(sink);
+    sc_recorder_join(recorder);
+    sc_recorder_destroy(recorder);
+
+    assert(result->ended);
+    assert(result->success);
+}
+
+struct file_info {
+    unsigned packets;
+    bool first_key; // the first packet is a key frame
+    int64_t first_pts; // in microseconds
+    bool fragmented; // the file contains a movie fragment
+};
+
+static bool
+file_contains(const char *filename, const char *tag) {
+    FILE *file = fopen(filename, "rb");
+    assert(file);
+
+    size_t tag_len = strlen(tag);
+    size_t matched = 0;
+    bool found = false;
+    int c;
+    while (!found && (c = fgetc(file)) != EOF) {
+        matched = c == tag[matched] ? matched + 1 : (c == tag[0]);
+        found = matched == tag_len;
+    }
+
+    fclose(file);
+    return found;
+}
+
+static bool
+read_file(const char *filename, struct file_info *info) {
+    AVFormatContext *ctx = NULL;
+    if (avformat_open_input(&ctx, filename, NULL, NULL) < 0) {
+        return false;
+    }
+
+    AVPacket *packet = av_packet_alloc();
+    assert(packet);
+
+    info->packets = 0;
+    info->first_key = false;
+    while (av_read_frame(ctx, packet) >= 0) {
+        if (!info->packets) {
+            info->first_key = packet->flags & AV_PKT_FLAG_KEY;
+            AVStream *stream = ctx->streams[packet->stream_index];
+            info->first_pts = av_rescale_q(packet->pts, stream->time_base,
+                                           AV_TIME_BASE_Q);
+        }
+        ++info->packets;
+        av_packet_unref(packet);
+    }
+
+    av_packet_free(&packet);
+    avformat_close_input(&ctx);
+
+    info->fragmented = file_contains(filename, "moof");
+    return true;
+}
+
+static void
+remove_file(const char *filename) {
+    int r = remove(filename);
+    assert(!r);
+    (void) r;
+}
+
+static void test_segments(void) {
+    struct record_result result = {0};
+    struct sc_recorder recorder;
+    bool ok = sc_recorder_init(&recorder, "test_recorder.mkv",
+                               SC_RECORD_FORMAT_MKV, true, false,
+                               SC_ORIENTATION_0, SC_TICK_FROM_SEC(1), false,
+                               &cbs, &result);
+    assert(ok);
+    ok = sc_recorder_start(&recorder);
+    assert(ok);
+
+    AVCodecContext *ctx = avcodec_alloc_context3(NULL);
+    assert(ctx);
+    ctx->codec_type = AVMEDIA_TYPE_VIDEO;
+    // VP8 has no config packet, the packets can be muxed as is
+    ctx->codec_id = AV_CODEC_ID_VP8;
+    ctx->width = 64;
+    ctx->height = 64;
+
+    struct sc_packet_sink *sink = &recorder.video_packet_sink;
+    ok = sink->ops->open(sink, ctx, NULL);
+    assert(ok);
+    (void) ok;
+
+    // 3.5 seconds, a key frame every second
+    static const uint8_t data[32] = {0};
+    for (unsigned i = 0; i < 35; ++i) {
+        push_packet(sink, data, sizeof(data), (int64_t) i * FRAME_US,
+                    i % GOP == 0);
+    }
+
+    record_end(&recorder, sink, &result);
+    avcodec_free_context(&ctx);
+
+    // A new segment is started on each key frame (once the duration is
+    // reached), every segment is a complete file
+    static const unsigned expected_packets[] = {10, 10, 10, 5};
+    for (unsigned i = 0; i < ARRAY_LEN(expected_packets); ++i) {
+        char filename[32];
+        snprintf(filename, sizeof(filename), "test_recorder-%03u.mkv", i);
+
+        struct file_info info;
+        bool read = read_file(filename, &info);
+        assert(read);
+        (void) read;
+        assert(info.packets == expected_packets[i]);
+        assert(info.first_key);
+        // Each segment starts at 0, not at its offset in the recording
+        assert(info.first_pts == 0);
+
+        remove_file(filename);
+    }
+
+    FILE *file = fopen("test_recorder-004.mkv", "rb");
+    assert(!file);
+    (void) file;
+}
+
+static void test_fragmented(void) {
+    struct record_result result = {0};
+    struct sc_recorder recorder;
+    bool ok = sc_recorder_init(&recorder, "test_recorder.m4a",
+                               SC_RECORD_FORMAT_M4A, false, true,
+                               SC_ORIENTATION_0, SC_TICK_FROM_MS(500), true,
+                               &cbs, &result);
+    assert(ok);
+    ok = sc_recorder_start(&recorder);
+    assert(ok);
+
+    AVCodecContext *ctx = avcodec_alloc_context3(NULL);
+    assert(ctx);
+    ctx->codec_type = AVMEDIA_TYPE_AUDIO;
+    ctx->codec_id = AV_CODEC_ID_OPUS;
+#ifdef SCRCPY_LAVU_HAS_CHLAYOUT
+    ctx->ch_layout = (AVChannelLayout) AV_CHANNEL_LAYOUT_STEREO;
+#else
+    ctx->channel_layout = AV_CH_LAYOUT_STEREO;
+    ctx->channels = 2;
+#endif
+    ctx->sample_rate = 48000;
+
+    struct sc_packet_sink *sink = &recorder.audio_packet_sink;
+    ok = sink->ops->open(sink, ctx, NULL);
+    assert(ok);
+    (void) ok;
+
+    // The config packet is the OpusHead (stereo, 312 samples of pre-skip,
+    // 48kHz, no gain, mapping family 0)
+    static const uint8_t opus_head[] = {
+        'O', 'p', 'u', 's', 'H', 'e', 'a', 'd',
+        1, 2, 0x38, 0x01, 0x80, 0xBB, 0x00, 0x00, 0x00, 0x00, 0,
+    };
+    push_packet(sink, opus_head, sizeof(opus_head), AV_NOPTS_VALUE, false);
+
+    // 1 second of 20 ms packets (TOC byte: CELT fullband 20 ms, stereo, one
+    // frame)
+    uint8_t data[16] = {0xFC};
+    for (unsigned i = 0; i < 50; ++i) {
+        push_packet(sink, data, sizeof(data), (int64_t) i * OPUS_FRAME_US,
+                    false);
+    }
+
+    record_end(&recorder, sink, &result);
+    avcodec_free_context(&ctx);
+
+    // Without video, a new segment is started on the first packet once the
+    // duration is reached
+    for (unsigned i = 0; i < 2; ++i) {
+        char filename[32];
+        snprintf(filename, sizeof(filename), "test_recorder-%03u.m4a", i);
+
+        struct file_info info;
+        bool read = read_file(filename, &info);
+        assert(read);
+        (void) read;
+        assert(info.packets == 25);
+        assert(info.fragmented);
+        // Up to the Opus pre-skip
+        assert(llabs(info.first_pts) < OPUS_FRAME_US);
+
+        remove_file(filename);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_segments();
+    test_fragmented();
+
+    return 0;
+}
@@ -0,0 +1,343 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+
+#include "replay_buffer.h"
+
+#define FRAME_US 100000 // 10 fps
+#define GOP 10
+#define PACKET_SIZE 100
+// The memory retained by a packet allocated by av_new_packet()
+#define PACKET_BYTES (PACKET_SIZE + AV_INPUT_BUFFER_PADDING_SIZE)
+
+struct dump_result {
+    bool called;
+    bool success;
+    char filename[64];
+};
+
+static void
+on_dumped(struct sc_replay_buffer *replay, const char *filename, bool success,
+          void *userdata) {
+    (void) replay;
+    struct dump_result *result = userdata;
+    result->called = true;
+    result->success = success;
+    snprintf(result->filename, sizeof(result->filename), "%s", filename);
+}
+
+static const struct sc_replay_buffer_callbacks cbs = {
+    .on_dumped = on_dumped,
+};
+
+static AVCodecContext *
+open_sink(struct sc_packet_sink *sink, enum AVMediaType type,
+          enum AVCodecID codec_id) {
+    AVCodecContext *ctx = avcodec_alloc_context3(NULL);
+    assert(ctx);
+    ctx->codec_type = type;
+    ctx->codec_id = codec_id;
+    if (type == AVMEDIA_TYPE_VIDEO) {
+        ctx->width = 64;
+        ctx->height = 64;
+    }
+
+    bool ok = sink->ops->open(sink, ctx, NULL);
+    assert(ok);
+    (void) ok;
+    return ctx;
+}
+
+static void
+push_packet(struct sc_packet_sink *sink, int64_t pts, bool key) {
+    AVPacket *packet = av_packet_alloc();
+    assert(packet);
+    int r = av_new_packet(packet, PACKET_SIZE);
+    assert(!r);
+    (void) r;
+    memset(packet->data, 0, PACKET_SIZE);
+
+    packet->pts = pts;
+    packet->dts = pts;
+    if (key) {
+        packet->flags |= AV_PKT_FLAG_KEY;
+    }
+
+    bool ok = sink->ops->push(sink, packet);
+    assert(ok);
+    (void) ok;
+
+    av_packet_free(&packet);
+}
+
+// Push count video frames (a key frame every GOP frames)
+static void
+push_video(struct sc_packet_sink *sink, unsigned first, unsigned count) {
+    for (unsigned i = first; i < first + count; ++i) {
+        push_packet(sink, (int64_t) i * FRAME_US, i % GOP == 0);
+    }
+}
+
+static void
+init_replay(struct sc_replay_buffer *replay, bool video, bool audio,
+            sc_tick max_duration, size_t max_bytes) {
+    const struct sc_replay_buffer_params params = {
+        .video = video,
+        .audio = audio,
+        .max_duration = max_duration,
+        .max_bytes = max_bytes,
+        .orientation = SC_ORIENTATION_0,
+    };
+    bool ok = sc_replay_buffer_init(replay, &params, &cbs);
+    assert(ok);
+    (void) ok;
+}
+
+static void
+assert_window(struct sc_replay_buffer *replay, sc_tick expected_duration,
+              size_t expected_packets) {
+    sc_tick duration;
+    size_t bytes;
+    sc_replay_buffer_get_window(replay, &duration, &bytes);
+    assert(duration == expected_duration);
+    assert(bytes == expected_packets * PACKET_BYTES);
+    (void) duration;
+    (void) bytes;
+    (void) expected_duration;
+    (void) expected_packets;
+}
+
+static void test_window_duration(void) {
+    struct sc_replay_buffer replay;
+    init_replay(&replay, true, false, SC_TICK_FROM_SEC(1), SIZE_MAX);
+    struct sc_packet_sink *sink = &replay.video_packet_sink;
+    AVCodecContext *ctx = open_sink(sink, AVMEDIA_TYPE_VIDEO,
+                                    AV_CODEC_ID_H264);
+
+    // Config packet
+    push_packet(sink, AV_NOPTS_VALUE, false);
+
+    // The window must start on a key frame
+    push_video(sink, 1, 3);
+    assert_window(&replay, 0, 0);
+
+    // 5 seconds
+    push_video(sink, 10, 40);
+
+    // The window still covers 1 second without the GOP starting at 2.0 s
+    // (4.9 - 3.0 >= 1), but not without the GOP starting at 3.0 s
+    assert_window(&replay, SC_TICK_FROM_MS(1900), 20);
+
+    // Until the next key frame, the window grows
+    push_video(sink, 50, 5);
+    assert_window(&replay, SC_TICK_FROM_MS(1400), 15);
+    push_video(sink, 55, 5);
+    assert_window(&replay, SC_TICK_FROM_MS(1900), 20);
+    push_video(sink, 60, 1);
+    assert_window(&replay, SC_TICK_FROM_MS(1000), 11);
+
+    sink->ops->close(sink);
+    sc_replay_buffer_destroy(&replay);
+    avcodec_free_context(&ctx);
+}
+
+static void test_window_size(void) {
+    struct sc_replay_buffer replay;
+    init_replay(&replay, true, false, SC_TICK_FROM_SEC(100),
+                25 * PACKET_BYTES);
+    struct sc_packet_sink *sink = &replay.video_packet_sink;
+    AVCodecContext *ctx = open_sink(sink, AVMEDIA_TYPE_VIDEO,
+                                    AV_CODEC_ID_H264);
+
+    push_video(sink, 0, 25);
+    assert_window(&replay, SC_TICK_FROM_MS(2400), 25);
+
+    // The oldest GOP is dropped as soon as the limit is exceeded
+    push_video(sink, 25, 1);
+    assert_window(&replay, SC_TICK_FROM_MS(1500), 16);
+
+    push_video(sink, 26, 24);
+    assert_window(&replay, SC_TICK_FROM_MS(1900), 20);
+
+    sink->ops->close(sink);
+    sc_replay_buffer_destroy(&replay);
+    avcodec_free_context(&ctx);
+}
+
+static void test_gop_too_large(void) {
+    struct sc_replay_buffer replay;
+    init_replay(&replay, true, false, SC_TICK_FROM_SEC(100),
+                5 * PACKET_BYTES);
+    struct sc_packet_sink *sink = &replay.video_packet_sink;
+    AVCodecContext *ctx = open_sink(sink, AVMEDIA_TYPE_VIDEO,
+                                    AV_CODEC_ID_H264);
+
+    push_video(sink, 0, 5);
+    assert_window(&replay, SC_TICK_FROM_MS(400), 5);
+
+    // The GOP does not fit, everything is dropped until the next key frame
+    push_video(sink, 5, 1);
+    assert_window(&replay, 0, 0);
+    push_video(sink, 6, 4);
+    assert_window(&replay, 0, 0);
+
+    push_video(sink, 10, 2);
+    assert_window(&replay, SC_TICK_FROM_MS(100), 2);
+
+    sink->ops->close(sink);
+    sc_replay_buffer_destroy(&replay);
+    avcodec_free_context(&ctx);
+}
+
+static void test_audio_trimmed(void) {
+    struct sc_replay_buffer replay;
+    init_replay(&replay, true, true, SC_TICK_FROM_SEC(1), SIZE_MAX);
+    struct sc_packet_sink *video_sink = &replay.video_packet_sink;
+    struct sc_packet_sink *audio_sink = &replay.audio_packet_sink;
+    AVCodecContext *video_ctx = open_sink(video_sink, AVMEDIA_TYPE_VIDEO,
+                                          AV_CODEC_ID_H264);
+    AVCodecContext *audio_ctx = open_sink(audio_sink, AVMEDIA_TYPE_AUDIO,
+                                          AV_CODEC_ID_OPUS);
+
+    // Audio packets of 20 ms, pushed in the same order as the demuxers would
+    for (unsigned i = 0; i < 50; ++i) {
+        push_video(video_sink, i, 1);
+        for (unsigned j = 0; j < FRAME_US / 20000; ++j) {
+            int64_t pts = (int64_t) i * FRAME_US + j * 20000;
+            push_packet(audio_sink, pts, true);
+        }
+    }
+
+    // The video window starts at 3.0 s, the audio packets before are dropped
+    struct sc_replay_buffer_queue *audio_queue = &replay.audio_stream.queue;
+    assert(sc_vecdeque_size(audio_queue) == 100);
+    assert(audio_queue->data[audio_queue->origin]->pts
+            == SC_TICK_FROM_SEC(3));
+
+    sc_tick duration;
+    size_t bytes;
+    sc_replay_buffer_get_window(&replay, &duration, &bytes);
+    assert(duration == SC_TICK_FROM_MS(1900));
+    assert(bytes == (20 + 100) * PACKET_BYTES);
+    (void) duration;
+    (void) bytes;
+
+    audio_sink->ops->close(audio_sink);
+    video_sink->ops->close(video_sink);
+    sc_replay_buffer_destroy(&replay);
+    avcodec_free_context(&audio_ctx);
+    avcodec_free_context(&video_ctx);
+}
+
+static void test_dump_rejected(void) {
+    struct sc_replay_buffer replay;
+    init_replay(&replay, true, false, SC_TICK_FROM_SEC(1), SIZE_MAX);
+    struct sc_packet_sink *sink = &replay.video_packet_sink;
+    AVCodecContext *ctx = open_sink(sink, AVMEDIA_TYPE_VIDEO,
+                                    AV_CODEC_ID_VP8);
+
+    struct dump_result result = {0};
+
+    // Nothing to dump
+    bool ok = sc_replay_buffer_dump(&replay, "test_replay_buffer.mkv",
+                                    &result);
+    assert(!ok);
+
+    push_video(sink, 0, 5);
+
+    // Unsupported format
+    ok = sc_replay_buffer_dump(&replay, "test_replay_buffer.avi", &result);
+    assert(!ok);
+
+    // Stopped
+    sc_replay_buffer_stop(&replay);
+    ok = sc_replay_buffer_dump(&replay, "test_replay_buffer.mkv", &result);
+    assert(!ok);
+    (void) ok;
+
+    sc_replay_buffer_join(&replay);
+    assert(!result.called);
+
+    sink->ops->close(sink);
+    sc_replay_buffer_destroy(&replay);
+    avcodec_free_context(&ctx);
+}
+
+static unsigned
+count_packets(const char *filename) {
+    AVFormatContext *ctx = NULL;
+    int r = avformat_open_input(&ctx, filename, NULL, NULL);
+    assert(!r);
+    (void) r;
+
+    AVPacket *packet = av_packet_alloc();
+    assert(packet);
+
+    unsigned count = 0;
+    while (av_read_frame(ctx, packet) >= 0) {
+        ++count;
+        av_packet_unref(packet);
+    }
+
+    av_packet_free(&packet);
+    avformat_close_input(&ctx);
+    return count;
+}
+
+static void test_dump(void) {
+    struct sc_replay_buffer replay;
+    init_replay(&replay, true, false, SC_TICK_FROM_SEC(1), SIZE_MAX);
+    struct sc_packet_sink *sink = &replay.video_packet_sink;
+    // VP8 has no config packet, the stream can be muxed as is
+    AVCodecContext *ctx = open_sink(sink, AVMEDIA_TYPE_VIDEO,
+                                    AV_CODEC_ID_VP8);
+
+    push_video(sink, 0, 50);
+    assert_window(&replay, SC_TICK_FROM_MS(1900), 20);
+
+    const char *filename = "test_replay_buffer.mkv";
+    struct dump_result result = {0};
+    bool ok = sc_replay_buffer_dump(&replay, filename, &result);
+    assert(ok);
+    (void) ok;
+
+    // The source is not blocked while the file is written
+    push_video(sink, 50, 5);
+
+    sc_replay_buffer_stop(&replay);
+    sc_replay_buffer_join(&replay);
+    assert(result.called);
+    assert(result.success);
+    assert(!strcmp(result.filename, filename));
+
+    // Only the window at the time of the request
+    unsigned count = count_packets(filename);
+    assert(count == 20);
+    (void) count;
+
+    int r = remove(filename);
+    assert(!r);
+    (void) r;
+
+    sink->ops->close(sink);
+    sc_replay_buffer_destroy(&replay);
+    avcodec_free_context(&ctx);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_window_duration();
+    test_window_size();
+    test_gop_too_large();
+    test_audio_trimmed();
+    test_dump_rejected();
+    test_dump();
+
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util/stream_capture.h"
+
+static char *
+create_temp_file(void) {
+    char *path = strdup("/tmp/scrcpy_test_capture_XXXXXX");
+    assert(path);
+    int fd = mkstemp(path);
+    assert(fd != -1);
+    close(fd);
+    return path;
+}
+
+static void test_capture_replay(void) {
+    char *path = create_temp_file();
+
+    uint8_t payload[300];
+    for (size_t i = 0; i < sizeof(payload); ++i) {
+        payload[i] = i;
+    }
+
+    struct sc_stream_capture capture;
+    bool ok = sc_stream_capture_init(&capture, path, "Pixel", sc_tick_now());
+    assert(ok);
+    sc_stream_capture_write(&capture, "hello", 5);
+    sc_stream_capture_write(&capture, payload, sizeof(payload));
+    assert(capture.bytes == 5 + sizeof(payload));
+    sc_stream_capture_destroy(&capture);
+
+    struct sc_stream_replay replay;
+    ok = sc_stream_replay_init(&replay, path, true);
+    assert(ok);
+    assert(!strcmp(replay.device_name, "Pixel"));
+    sc_stream_replay_start(&replay, sc_tick_now());
+
+    uint8_t buf[1000];
+    // Partial read of the first chunk
+    ssize_t r = sc_stream_replay_read(&replay, buf, 3);
+    assert(r == 3);
+    assert(!memcmp(buf, "hel", 3));
+
+    // Never read across chunks, like the original receives
+    r = sc_stream_replay_read(&replay, buf, sizeof(buf));
+    assert(r == 2);
+    assert(!memcmp(buf, "lo", 2));
+
+    r = sc_stream_replay_read(&replay, buf, sizeof(buf));
+    assert(r == sizeof(payload));
+    assert(!memcmp(buf, payload, sizeof(payload)));
+
+    // end of stream
+    r = sc_stream_replay_read(&replay, buf, sizeof(buf));
+    assert(r == 0);
+
+    sc_stream_replay_destroy(&replay);
+
+    unlink(path);
+    free(path);
+}
+
+static void test_replay_original_speed(void) {
+    char *path = create_temp_file();
+
+    sc_tick start = sc_tick_now();
+    struct sc_stream_capture capture;
+    bool ok = sc_stream_capture_init(&capture, path, "Pixel", start);
+    assert(ok);
+    sc_stream_capture_write(&capture, "a", 1);
+    // Arrived (at least) 50 ms after the capture start
+    capture.start -= SC_TICK_FROM_MS(50);
+    sc_stream_capture_write(&capture, "b", 1);
+    sc_stream_capture_destroy(&capture);
+
+    struct sc_stream_replay replay;
+    ok = sc_stream_replay_init(&replay, path, false);
+    assert(ok);
+
+    sc_tick replay_start = sc_tick_now();
+    sc_stream_replay_start(&replay, replay_start);
+
+    char c;
+    ssize_t r = sc_stream_replay_read(&replay, &c, 1);
+    assert(r == 1 && c == 'a');
+
+    r = sc_stream_replay_read(&replay, &c, 1);
+    assert(r == 1 && c == 'b');
+    assert(sc_tick_now() - replay_start >= SC_TICK_FROM_MS(50));
+
+    sc_stream_replay_destroy(&replay);
+
+    // A replay waiting for the next chunk can be interrupted
+    ok = sc_stream_replay_init(&replay, path, false);
+    assert(ok);
+    sc_stream_replay_start(&replay, sc_tick_now() + SC_TICK_FROM_SEC(60));
+    sc_stream_replay_interrupt(&replay);
+    r = sc_stream_replay_read(&replay, &c, 1);
+    assert(r == -1);
+    sc_stream_replay_destroy(&replay);
+
+    unlink(path);
+    free(path);
+}
+
+static void test_replay_invalid(void) {
+    char *path = create_temp_file();
+
+    FILE *file = fopen(path, "wb");
+    assert(file);
+    fputs("not a capture", file);
+    fclose(file);
+
+    struct sc_stream_replay replay;
+    bool ok = sc_stream_replay_init(&replay, path, true);
+    assert(!ok);
+
+    unlink(path);
+    ok = sc_stream_replay_init(&replay, path, true);
+    assert(!ok);
+
+    free(path);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_capture_replay();
+    test_replay_original_speed();
+    test_replay_invalid();
+    return 0;
+}
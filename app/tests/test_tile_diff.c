@@ -0,0 +1,159 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../linkandroid/src/tile_diff.h"
+
+static uint32_t seed = 42;
+
+static uint8_t
+random_byte(void) {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+}
+
+static uint64_t
+naive_sad(const uint8_t *a, int a_linesize, const uint8_t *b, int b_linesize,
+          int width, int height) {
+    uint64_t sad = 0;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int d = a[y * a_linesize + x] - b[y * b_linesize + x];
+            sad += d < 0 ? -d : d;
+        }
+    }
+    return sad;
+}
+
+static void test_sad(void) {
+    // Sizes not multiple of the SIMD width, and rows longer than the NEON
+    // accumulator flush period
+    static const int sizes[][2] = {
+        {1, 1}, {15, 3}, {16, 16}, {17, 5}, {63, 7}, {2100, 3},
+    };
+
+    for (size_t i = 0; i < ARRAY_LEN(sizes); ++i) {
+        int width = sizes[i][0];
+        int height = sizes[i][1];
+        int a_linesize = width + 7;
+        int b_linesize = width + 13;
+        uint8_t *a = malloc(a_linesize * height);
+        uint8_t *b = malloc(b_linesize * height);
+        assert(a && b);
+
+        for (int j = 0; j < a_linesize * height; ++j) {
+            a[j] = random_byte();
+        }
+        for (int j = 0; j < b_linesize * height; ++j) {
+            b[j] = random_byte();
+        }
+
+        uint64_t sad = la_tile_diff_sad(a, a_linesize, b, b_linesize, width,
+                                        height);
+        assert(sad == naive_sad(a, a_linesize, b, b_linesize, width, height));
+        assert(!la_tile_diff_sad(a, a_linesize, a, a_linesize, width, height));
+        (void) sad;
+
+        free(a);
+        free(b);
+    }
+
+    // Maximal differences
+    uint8_t zeros[64] = {0};
+    uint8_t ones[64];
+    memset(ones, 0xFF, sizeof(ones));
+    assert(la_tile_diff_sad(zeros, 0, ones, 0, 64, 1000) == 64 * 1000 * 255);
+}
+
+static void test_changed_tiles(void) {
+    // Source 200x150, preview at 50% (100x75): 2x2 tiles
+    const int src_width = 200;
+    const int src_height = 150;
+    uint8_t *luma = malloc(src_width * src_height);
+    assert(luma);
+    for (int i = 0; i < src_width * src_height; ++i) {
+        luma[i] = random_byte();
+    }
+
+    struct la_tile_diff td;
+    la_tile_diff_init(&td);
+    bool ok = la_tile_diff_configure(&td, src_width, src_height, 100, 75);
+    assert(ok);
+    (void) ok;
+    assert(td.cols == 2 && td.rows == 2);
+
+    // No reference: all the tiles have changed
+    unsigned count = la_tile_diff_compute(&td, luma, src_width);
+    assert(count == 4);
+    la_tile_diff_commit(&td, luma, src_width, false);
+
+    // Nothing changed
+    count = la_tile_diff_compute(&td, luma, src_width);
+    assert(count == 0);
+
+    // Small noise (as produced by the video encoding) is ignored
+    for (int i = 0; i < src_width * src_height; i += 3) {
+        luma[i] ^= 1;
+    }
+    count = la_tile_diff_compute(&td, luma, src_width);
+    assert(count == 0);
+
+    // A small change (8x8 source pixels) in the bottom-right tile
+    for (int y = 140; y < 148; ++y) {
+        for (int x = 180; x < 188; ++x) {
+            luma[y * src_width + x] += 128;
+        }
+    }
+    count = la_tile_diff_compute(&td, luma, src_width);
+    assert(count == 1);
+    assert(td.changed[0] == 3);
+
+    int x, y, w, h;
+    la_tile_diff_get_rect(&td, td.changed[0], &x, &y, &w, &h);
+    assert(x == 64 && y == 64 && w == 36 && h == 11);
+    (void) x; (void) y; (void) w; (void) h;
+
+    // Once sent, the tile is not reported anymore
+    la_tile_diff_commit(&td, luma, src_width, false);
+    count = la_tile_diff_compute(&td, luma, src_width);
+    assert(count == 0);
+
+    // A change on the border between two tiles is reported in both (the
+    // scaling filter mixes the source pixels around the border)
+    for (int y = 10; y < 20; ++y) {
+        luma[y * src_width + 127] += 128;
+        luma[y * src_width + 128] += 128;
+    }
+    count = la_tile_diff_compute(&td, luma, src_width);
+    assert(count == 2);
+    assert(td.changed[0] == 0 && td.changed[1] == 1);
+
+    // After invalidation, all the tiles are reported
+    la_tile_diff_invalidate(&td);
+    count = la_tile_diff_compute(&td, luma, src_width);
+    assert(count == 4);
+    la_tile_diff_commit(&td, luma, src_width, true);
+    count = la_tile_diff_compute(&td, luma, src_width);
+    assert(count == 0);
+
+    // A new geometry invalidates the reference
+    ok = la_tile_diff_configure(&td, src_height, src_width, 75, 100);
+    assert(ok);
+    assert(td.cols == 2 && td.rows == 2 && !td.has_ref);
+
+    la_tile_diff_destroy(&td);
+    free(luma);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_sad();
+    test_changed_tiles();
+
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "util/thread.h"
+#include "util/trace.h"
+
+static char *
+create_temp_file(void) {
+    char *path = strdup("/tmp/scrcpy_test_trace_XXXXXX");
+    assert(path);
+    int fd = mkstemp(path);
+    assert(fd != -1);
+    close(fd);
+    return path;
+}
+
+static char *
+read_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    assert(file);
+    char *data = NULL;
+    size_t len = 0;
+    char buf[4096];
+    size_t r;
+    while ((r = fread(buf, 1, sizeof(buf), file))) {
+        data = realloc(data, len + r + 1);
+        assert(data);
+        memcpy(data + len, buf, r);
+        len += r;
+    }
+    fclose(file);
+    assert(data);
+    data[len] = '\0';
+    return data;
+}
+
+static unsigned
+count_occurrences(const char *s, const char *pattern) {
+    unsigned count = 0;
+    while ((s = strstr(s, pattern))) {
+        ++count;
+        ++s;
+    }
+    return count;
+}
+
+static int
+run_thread(void *data) {
+    (void) data;
+    for (unsigned i = 0; i < 10; ++i) {
+        sc_tick start = sc_trace_begin();
+        sc_trace_end("work", start);
+    }
+    return 0;
+}
+
+static void test_trace(void) {
+    char *path = create_temp_file();
+
+    // Disabled: nothing is recorded
+    assert(!sc_trace_enabled);
+    sc_tick start = sc_trace_begin();
+    assert(!start);
+    sc_trace_end("ignored", start);
+
+    // The file is created immediately
+    bool ok = sc_trace_init("/nonexistent/scrcpy/trace.json");
+    assert(!ok);
+    assert(!sc_trace_enabled);
+
+    ok = sc_trace_init(path);
+    assert(ok);
+
+    sc_thread thread;
+    ok = sc_thread_create(&thread, run_thread, "test_trace", NULL);
+    assert(ok);
+
+    start = sc_trace_begin();
+    sc_trace_counter("queue", 42);
+    sc_trace_end("main span", start);
+
+    sc_thread_join(&thread, NULL);
+
+    sc_trace_destroy();
+    assert(!sc_trace_enabled);
+
+    char *json = read_file(path);
+    assert(!strncmp(json, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 39));
+    assert(!strcmp(json + strlen(json) - 4, "\n]}\n"));
+    assert(count_occurrences(json, "\"name\":\"work\",\"ph\":\"X\"") == 10);
+    assert(count_occurrences(json, "\"name\":\"main span\",\"ph\":\"X\"") == 1);
+    assert(count_occurrences(json, "\"name\":\"queue\",\"ph\":\"C\"") == 1);
+    assert(count_occurrences(json, "\"value\":42") == 1);
+    assert(!strstr(json, "ignored"));
+    // One track per thread
+    assert(count_occurrences(json, "\"thread_name\"") == 2);
+
+    free(json);
+    unlink(path);
+    free(path);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_trace();
+    return 0;
+}
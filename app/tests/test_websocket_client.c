@@ -0,0 +1,311 @@
+#include "common.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <libwebsockets.h>
+
+#include "../../linkandroid/src/websocket_client.h"
+
+// Stress the client output queue against a local libwebsockets server
+
+#define PRODUCERS 4
+#define MESSAGES_PER_PRODUCER 5000
+#define TIMEOUT_MS 10000
+#define LARGE_MESSAGES 3
+#define LARGE_SIZE (1024 * 1024)
+
+struct test_server {
+    struct lws_context *context;
+    pthread_t thread;
+    atomic_bool stopped;
+
+    // Written by the server thread only
+    atomic_uint received;
+    atomic_uint large_received;
+    atomic_bool error;
+    int next_seq[PRODUCERS];
+    size_t msg_offset; // position in the current (possibly fragmented) message
+    bool msg_large;
+};
+
+static struct test_server server;
+
+static int
+server_callback(struct lws *wsi, enum lws_callback_reasons reason,
+                void *user, void *in, size_t len) {
+    (void) user;
+
+    if (reason != LWS_CALLBACK_RECEIVE) {
+        return 0;
+    }
+
+    const uint8_t *data = in;
+    bool final = lws_is_final_fragment(wsi);
+
+    if (server.msg_offset == 0 && len && data[0] == LA_BINARY_MSG_TYPE_PREVIEW) {
+        server.msg_large = true;
+    }
+
+    if (server.msg_large) {
+        // The image data must be received unaltered, whatever the fragments
+        for (size_t i = 0; i < len; ++i) {
+            size_t pos = server.msg_offset + i;
+            if (pos >= LA_PREVIEW_HEADER_SIZE) {
+                uint8_t expected = (pos - LA_PREVIEW_HEADER_SIZE) * 7;
+                if (data[i] != expected) {
+                    atomic_store(&server.error, true);
+                    break;
+                }
+            }
+        }
+        server.msg_offset += len;
+
+        if (final) {
+            if (server.msg_offset != LA_PREVIEW_HEADER_SIZE + LARGE_SIZE) {
+                atomic_store(&server.error, true);
+            }
+            server.msg_offset = 0;
+            server.msg_large = false;
+            atomic_fetch_add(&server.large_received, 1);
+        }
+        return 0;
+    }
+
+    if (!final) {
+        // Events are never fragmented
+        atomic_store(&server.error, true);
+        return 0;
+    }
+
+    char msg[128];
+    if (len >= sizeof(msg)) {
+        atomic_store(&server.error, true);
+        return 0;
+    }
+    memcpy(msg, in, len);
+    msg[len] = '\0';
+
+    int producer;
+    int seq;
+    int r = sscanf(msg, "{\"type\":\"stress\",\"producer\":%d,\"seq\":%d}",
+                   &producer, &seq);
+    if (r != 2 || producer < 0 || producer >= PRODUCERS) {
+        atomic_store(&server.error, true);
+        return 0;
+    }
+
+    // Messages may be dropped, but never reordered or duplicated
+    if (seq < server.next_seq[producer]) {
+        atomic_store(&server.error, true);
+    }
+    server.next_seq[producer] = seq + 1;
+
+    atomic_fetch_add(&server.received, 1);
+    return 0;
+}
+
+static struct lws_protocols server_protocols[] = {
+    {
+        .name = "default",
+        .callback = server_callback,
+        .rx_buffer_size = 4096,
+    },
+    {0}, // terminator
+};
+
+static void *
+run_server(void *arg) {
+    (void) arg;
+
+    while (!atomic_load(&server.stopped)) {
+        lws_service(server.context, 50);
+    }
+
+    return NULL;
+}
+
+static int
+start_server(void) {
+    memset(&server, 0, sizeof(server));
+
+    struct lws_context_creation_info info;
+    memset(&info, 0, sizeof(info));
+    info.port = 0; // random port
+    info.iface = "127.0.0.1";
+    info.protocols = server_protocols;
+    info.gid = -1;
+    info.uid = -1;
+
+    lws_set_log_level(LLL_ERR, NULL);
+
+    server.context = lws_create_context(&info);
+    assert(server.context);
+
+    int port = lws_get_vhost_listen_port(lws_get_vhost_by_name(server.context,
+                                                               "default"));
+    assert(port > 0);
+
+    atomic_init(&server.stopped, false);
+    atomic_init(&server.received, 0);
+    atomic_init(&server.large_received, 0);
+    atomic_init(&server.error, false);
+
+    int r = pthread_create(&server.thread, NULL, run_server, NULL);
+    assert(!r);
+    (void) r;
+
+    return port;
+}
+
+static void
+stop_server(void) {
+    atomic_store(&server.stopped, true);
+    lws_cancel_service(server.context);
+    pthread_join(server.thread, NULL);
+    lws_context_destroy(server.context);
+}
+
+static void
+sleep_ms(long ms) {
+    struct timespec ts = {ms / 1000, (ms % 1000) * 1000000};
+    nanosleep(&ts, NULL);
+}
+
+struct producer {
+    struct la_websocket_client *client;
+    int id;
+};
+
+static void *
+run_producer(void *arg) {
+    struct producer *p = arg;
+
+    for (int i = 0; i < MESSAGES_PER_PRODUCER; ++i) {
+        char msg[128];
+        snprintf(msg, sizeof(msg),
+                 "{\"type\":\"stress\",\"producer\":%d,\"seq\":%d}", p->id, i);
+        // May fail if the queue is full
+        la_websocket_client_send(p->client, msg);
+    }
+
+    return NULL;
+}
+
+static struct la_websocket_client *
+connect_client(int port) {
+    char url[64];
+    snprintf(url, sizeof(url), "ws://127.0.0.1:%d/", port);
+    struct la_websocket_client *client =
+        la_websocket_client_init(url, NULL, NULL);
+    assert(client);
+
+    for (int i = 0; i < TIMEOUT_MS / 10; ++i) {
+        if (la_websocket_client_is_connected(client)) {
+            break;
+        }
+        sleep_ms(10);
+    }
+    assert(la_websocket_client_is_connected(client));
+
+    return client;
+}
+
+static void test_websocket_client_stress(void) {
+    int port = start_server();
+    struct la_websocket_client *client = connect_client(port);
+
+    pthread_t threads[PRODUCERS];
+    struct producer producers[PRODUCERS];
+    for (int i = 0; i < PRODUCERS; ++i) {
+        producers[i].client = client;
+        producers[i].id = i;
+        int r = pthread_create(&threads[i], NULL, run_producer, &producers[i]);
+        assert(!r);
+        (void) r;
+    }
+    for (int i = 0; i < PRODUCERS; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // Wait for the queue to be drained and received by the server
+    struct la_websocket_client_stats stats;
+    for (int i = 0; i < TIMEOUT_MS / 10; ++i) {
+        la_websocket_client_get_stats(client, &stats);
+        if (!stats.queue_depth
+                && atomic_load(&server.received) == stats.sent) {
+            break;
+        }
+        sleep_ms(10);
+    }
+
+    la_websocket_client_get_stats(client, &stats);
+    printf("queued: %" PRIu32 ", sent: %" PRIu32 ", dropped: %" PRIu32
+           ", max depth: %" PRIu32 "\n",
+           stats.queued, stats.sent, stats.dropped, stats.max_queue_depth);
+
+    assert(!stats.queue_depth);
+    assert(stats.queued + stats.dropped == PRODUCERS * MESSAGES_PER_PRODUCER);
+    assert(stats.sent == stats.queued);
+    assert(stats.max_queue_depth > 0);
+    assert(atomic_load(&server.received) == stats.sent);
+    assert(!atomic_load(&server.error));
+
+    la_websocket_client_destroy(client);
+    stop_server();
+}
+
+static void test_websocket_client_large(void) {
+    int port = start_server();
+    struct la_websocket_client *client = connect_client(port);
+
+    static uint8_t image[LARGE_SIZE];
+    for (size_t i = 0; i < LARGE_SIZE; ++i) {
+        image[i] = i * 7;
+    }
+
+    // Each message is sent in several fragments, possibly over several
+    // writable callbacks
+    for (int i = 0; i < LARGE_MESSAGES; ++i) {
+        bool ok = la_websocket_client_send_preview_binary(client,
+                                                          NULL,
+                                                          LA_PREVIEW_FORMAT_PNG,
+                                                          1920, 1080, 0,
+                                                          image, LARGE_SIZE);
+        assert(ok);
+        (void) ok;
+    }
+
+    for (int i = 0; i < TIMEOUT_MS / 10; ++i) {
+        if (atomic_load(&server.large_received) == LARGE_MESSAGES) {
+            break;
+        }
+        sleep_ms(10);
+    }
+
+    assert(atomic_load(&server.large_received) == LARGE_MESSAGES);
+    assert(!atomic_load(&server.error));
+
+    struct la_websocket_client_stats stats;
+    la_websocket_client_get_stats(client, &stats);
+    assert(stats.sent == LARGE_MESSAGES);
+    assert(!stats.queued_bytes);
+    assert(!la_websocket_client_is_backpressured(client));
+
+    la_websocket_client_destroy(client);
+    stop_server();
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_websocket_client_stress();
+    test_websocket_client_large();
+
+    return 0;
+}
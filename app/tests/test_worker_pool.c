@@ -0,0 +1,219 @@
+#include "common.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "util/thread.h"
+#include "util/tick.h"
+#include "util/worker_pool.h"
+
+#define STRANDS 8
+#define JOBS_PER_STRAND 1000
+
+struct test_strand {
+    struct sc_strand strand;
+    // Only accessed from the jobs of the strand (serialized)
+    unsigned executed;
+    bool out_of_order;
+    bool concurrent;
+    bool running;
+};
+
+struct test_job {
+    struct test_strand *ts;
+    unsigned index;
+};
+
+static void
+run_job(void *userdata) {
+    struct test_job *job = userdata;
+    struct test_strand *ts = job->ts;
+
+    if (ts->running) {
+        ts->concurrent = true;
+    }
+    ts->running = true;
+
+    if (job->index != ts->executed) {
+        ts->out_of_order = true;
+    }
+    ++ts->executed;
+
+    ts->running = false;
+}
+
+static void test_strands_order(void) {
+    struct sc_worker_pool pool;
+    bool ok = sc_worker_pool_init(&pool, 4);
+    assert(ok);
+    ok = sc_worker_pool_start(&pool);
+    assert(ok);
+
+    static struct test_strand strands[STRANDS];
+    static struct test_job jobs[STRANDS][JOBS_PER_STRAND];
+
+    memset(strands, 0, sizeof(strands));
+    for (unsigned i = 0; i < STRANDS; ++i) {
+        sc_strand_init(&strands[i].strand, &pool);
+    }
+
+    // Interleave the jobs of all the strands
+    for (unsigned j = 0; j < JOBS_PER_STRAND; ++j) {
+        for (unsigned i = 0; i < STRANDS; ++i) {
+            jobs[i][j].ts = &strands[i];
+            jobs[i][j].index = j;
+            ok = sc_strand_post(&strands[i].strand, run_job, &jobs[i][j]);
+            assert(ok);
+        }
+    }
+
+    for (unsigned i = 0; i < STRANDS; ++i) {
+        // Waits for all the jobs of the strand
+        sc_strand_destroy(&strands[i].strand);
+        assert(strands[i].executed == JOBS_PER_STRAND);
+        assert(!strands[i].out_of_order);
+        assert(!strands[i].concurrent);
+    }
+
+    sc_worker_pool_stop(&pool);
+    sc_worker_pool_join(&pool);
+    sc_worker_pool_destroy(&pool);
+
+    (void) ok;
+}
+
+struct test_timers {
+    sc_mutex mutex;
+    sc_cond cond;
+    int order[3];
+    unsigned count;
+};
+
+struct test_timer {
+    struct sc_worker_timer timer;
+    struct test_timers *tt;
+    int id;
+};
+
+static void
+run_timer(void *userdata) {
+    struct test_timer *t = userdata;
+    struct test_timers *tt = t->tt;
+
+    sc_mutex_lock(&tt->mutex);
+    assert(tt->count < 3);
+    tt->order[tt->count++] = t->id;
+    sc_cond_signal(&tt->cond);
+    sc_mutex_unlock(&tt->mutex);
+}
+
+static void test_timers(void) {
+    struct sc_worker_pool pool;
+    bool ok = sc_worker_pool_init(&pool, 1);
+    assert(ok);
+    ok = sc_worker_pool_start(&pool);
+    assert(ok);
+
+    struct test_timers tt = {0};
+    ok = sc_mutex_init(&tt.mutex);
+    assert(ok);
+    ok = sc_cond_init(&tt.cond);
+    assert(ok);
+
+    struct test_timer timers[4];
+    for (int i = 0; i < 4; ++i) {
+        timers[i].tt = &tt;
+        timers[i].id = i;
+        sc_worker_timer_init(&timers[i].timer, run_timer, &timers[i]);
+    }
+
+    // Scheduled out of order, executed by deadline
+    sc_tick now = sc_tick_now();
+    sc_worker_pool_schedule(&pool, &timers[0].timer, now + SC_TICK_FROM_MS(60));
+    sc_worker_pool_schedule(&pool, &timers[1].timer, now + SC_TICK_FROM_MS(20));
+    sc_worker_pool_schedule(&pool, &timers[2].timer, now + SC_TICK_FROM_MS(40));
+    sc_worker_pool_schedule(&pool, &timers[3].timer, now + SC_TICK_FROM_MS(30));
+
+    // A pending timer is never executed once canceled
+    ok = sc_worker_pool_cancel(&pool, &timers[3].timer);
+    assert(ok);
+    ok = sc_worker_pool_cancel(&pool, &timers[3].timer);
+    assert(!ok);
+
+    sc_mutex_lock(&tt.mutex);
+    while (tt.count < 3) {
+        sc_cond_wait(&tt.cond, &tt.mutex);
+    }
+    sc_mutex_unlock(&tt.mutex);
+
+    // Executed, not pending anymore
+    assert(sc_tick_now() >= now + SC_TICK_FROM_MS(60));
+    ok = sc_worker_pool_cancel(&pool, &timers[0].timer);
+    assert(!ok);
+
+    assert(tt.order[0] == 1);
+    assert(tt.order[1] == 2);
+    assert(tt.order[2] == 0);
+
+    sc_worker_pool_stop(&pool);
+    sc_worker_pool_join(&pool);
+    sc_worker_pool_destroy(&pool);
+
+    sc_cond_destroy(&tt.cond);
+    sc_mutex_destroy(&tt.mutex);
+
+    (void) ok;
+}
+
+static void
+post_again(void *userdata) {
+    struct test_job *job = userdata;
+    struct test_strand *ts = job->ts;
+
+    ++ts->executed;
+    if (job->index) {
+        // Post the next job from a job
+        --job->index;
+        bool ok = sc_strand_post(&ts->strand, post_again, job);
+        assert(ok);
+        (void) ok;
+    }
+}
+
+static void test_post_from_job(void) {
+    struct sc_worker_pool pool;
+    bool ok = sc_worker_pool_init(&pool, 2);
+    assert(ok);
+    ok = sc_worker_pool_start(&pool);
+    assert(ok);
+
+    struct test_strand ts = {0};
+    sc_strand_init(&ts.strand, &pool);
+
+    struct test_job job = {
+        .ts = &ts,
+        .index = 99,
+    };
+    ok = sc_strand_post(&ts.strand, post_again, &job);
+    assert(ok);
+
+    sc_strand_destroy(&ts.strand);
+    assert(ts.executed == 100);
+
+    sc_worker_pool_stop(&pool);
+    sc_worker_pool_join(&pool);
+    sc_worker_pool_destroy(&pool);
+
+    (void) ok;
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_strands_order();
+    test_timers();
+    test_post_from_job();
+
+    return 0;
+}
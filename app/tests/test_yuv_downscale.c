@@ -0,0 +1,347 @@
+#include "common.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+
+#include "../../linkandroid/src/yuv_downscale.h"
+
+// Minimum PSNR compared to swscale (its bilinear filter is smoother than the
+// box filter, so the images are close but not identical): 28 dB, i.e. a mean
+// squared error of 255^2 / 10^(28 / 10)
+#define MAX_MSE 103.0
+
+static uint32_t seed = 42;
+
+static uint8_t
+random_byte(void) {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 16;
+}
+
+// Screen-like content in limited range: flat bars, cards, gradients, text
+static AVFrame *
+make_frame(int width, int height) {
+    AVFrame *frame = av_frame_alloc();
+    assert(frame);
+
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = width;
+    frame->height = height;
+    frame->color_range = AVCOL_RANGE_MPEG;
+    int r = av_frame_get_buffer(frame, 32);
+    assert(!r);
+    (void) r;
+
+    for (int y = 0; y < height; ++y) {
+        uint8_t *line = frame->data[0] + y * frame->linesize[0];
+        for (int x = 0; x < width; ++x) {
+            int v;
+            if (y < height / 10) {
+                v = 40;
+            } else if ((y / 200) % 2 && x > width / 16 && x < width * 15 / 16) {
+                v = 220;
+            } else {
+                v = 16 + (x + y) / 20 % 200;
+            }
+            if (y % 200 > 80 && y % 200 < 110 && x % 24 < 12 && x < width / 2) {
+                v = 30;
+            }
+            line[x] = v + (random_byte() & 3);
+        }
+    }
+    for (int p = 1; p < 3; ++p) {
+        for (int y = 0; y < (height + 1) / 2; ++y) {
+            uint8_t *line = frame->data[p] + y * frame->linesize[p];
+            for (int x = 0; x < (width + 1) / 2; ++x) {
+                line[x] = 128 + ((p == 1 ? x : y) / 8 % 64) - 32;
+            }
+        }
+    }
+
+    return frame;
+}
+
+static uint8_t
+naive_box(const uint8_t *src, int linesize, int src_width, int src_height,
+          int width, int height, int col, int row) {
+    int x0 = (int64_t) col * src_width / width;
+    int x1 = (int64_t) (col + 1) * src_width / width;
+    int y0 = (int64_t) row * src_height / height;
+    int y1 = (int64_t) (row + 1) * src_height / height;
+    uint32_t sum = 0;
+    for (int y = y0; y < y1; ++y) {
+        for (int x = x0; x < x1; ++x) {
+            sum += src[y * linesize + x];
+        }
+    }
+    uint32_t count = (x1 - x0) * (y1 - y0);
+    return (sum + count / 2) / count;
+}
+
+static void test_box_exact(void) {
+    static const int sizes[][4] = {
+        {17, 9, 17, 9},
+        {37, 23, 5, 7},
+        {64, 64, 32, 32},
+        {1080, 2400, 216, 480},
+        {1440, 3200, 144, 320},
+        {1439, 3199, 11, 13},
+    };
+
+    for (size_t i = 0; i < ARRAY_LEN(sizes); ++i) {
+        int src_width = sizes[i][0];
+        int src_height = sizes[i][1];
+        int width = sizes[i][2];
+        int height = sizes[i][3];
+
+        AVFrame *src = make_frame(src_width, src_height);
+        AVFrame *dst = av_frame_alloc();
+        assert(dst);
+        dst->format = AV_PIX_FMT_YUV420P;
+        dst->width = width;
+        dst->height = height;
+        int r = av_frame_get_buffer(dst, 32);
+        assert(!r);
+        (void) r;
+
+        // Same range: no conversion, the result is exactly the box average
+        struct la_yuv_downscale ds;
+        bool ok = la_yuv_downscale_init(&ds, src_width, src_height, false,
+                                        width, height,
+                                        LA_YUV_DOWNSCALE_YUV420P, false);
+        assert(ok);
+        (void) ok;
+        la_yuv_downscale_process(&ds, (const uint8_t *const *) src->data,
+                                 src->linesize, dst->data, dst->linesize);
+
+        for (int p = 0; p < 3; ++p) {
+            int sw = p ? (src_width + 1) / 2 : src_width;
+            int sh = p ? (src_height + 1) / 2 : src_height;
+            int w = p ? (width + 1) / 2 : width;
+            int h = p ? (height + 1) / 2 : height;
+            for (int y = 0; y < h; ++y) {
+                for (int x = 0; x < w; ++x) {
+                    uint8_t expected = naive_box(src->data[p],
+                                                 src->linesize[p], sw, sh,
+                                                 w, h, x, y);
+                    assert(dst->data[p][y * dst->linesize[p] + x]
+                            == expected);
+                    (void) expected;
+                }
+            }
+        }
+
+        la_yuv_downscale_destroy(&ds);
+        av_frame_free(&dst);
+        av_frame_free(&src);
+    }
+}
+
+static void test_supported(void) {
+    assert(la_yuv_downscale_supported(1440, 3200, 144, 320));
+    assert(la_yuv_downscale_supported(1080, 2400, 1080, 2400));
+    // Upscale
+    assert(!la_yuv_downscale_supported(100, 100, 101, 100));
+    // Too many rows for the 16-bit accumulator
+    assert(la_yuv_downscale_supported(1000, 2570, 1, 10));
+    assert(!la_yuv_downscale_supported(1000, 2580, 1, 10));
+}
+
+static void test_rgb_gray(void) {
+    // Uniform gray levels, limited range: black (16), white (235), middle
+    static const uint8_t levels[][2] = {{16, 0}, {235, 255}, {126, 128}};
+
+    for (size_t i = 0; i < ARRAY_LEN(levels); ++i) {
+        uint8_t luma[4 * 4];
+        uint8_t chroma[2 * 2];
+        for (int j = 0; j < 16; ++j) {
+            luma[j] = levels[i][0];
+        }
+        for (int j = 0; j < 4; ++j) {
+            chroma[j] = 128;
+        }
+
+        struct la_yuv_downscale ds;
+        bool ok = la_yuv_downscale_init(&ds, 4, 4, false, 2, 2,
+                                        LA_YUV_DOWNSCALE_RGB24, true);
+        assert(ok);
+        (void) ok;
+
+        const uint8_t *src[3] = {luma, chroma, chroma};
+        const int src_linesize[3] = {4, 2, 2};
+        uint8_t rgb[2 * 2 * 3];
+        uint8_t *dst[3] = {rgb, NULL, NULL};
+        const int dst_linesize[3] = {2 * 3, 0, 0};
+        la_yuv_downscale_process(&ds, src, src_linesize, dst, dst_linesize);
+
+        for (int j = 0; j < 2 * 2 * 3; ++j) {
+            assert(abs(rgb[j] - levels[i][1]) <= 1);
+        }
+
+        la_yuv_downscale_destroy(&ds);
+    }
+}
+
+static uint8_t
+reference_rgb(double value) {
+    return value < 0 ? 0 : value > 255 ? 255 : (uint8_t) (value + 0.5);
+}
+
+static void test_rgb_random(void) {
+    // Not a multiple of the SIMD width, to test the scalar tail too
+    const int width = 37;
+    const int height = 5;
+    uint8_t luma[37 * 5];
+    uint8_t u[19 * 3];
+    uint8_t v[19 * 3];
+    for (size_t i = 0; i < sizeof(luma); ++i) {
+        luma[i] = random_byte();
+    }
+    for (size_t i = 0; i < sizeof(u); ++i) {
+        u[i] = random_byte();
+        v[i] = random_byte();
+    }
+
+    for (int full_range = 0; full_range < 2; ++full_range) {
+        struct la_yuv_downscale ds;
+        bool ok = la_yuv_downscale_init(&ds, width, height, full_range,
+                                        width, height,
+                                        LA_YUV_DOWNSCALE_RGB24, true);
+        assert(ok);
+        (void) ok;
+
+        const uint8_t *src[3] = {luma, u, v};
+        const int src_linesize[3] = {width, 19, 19};
+        uint8_t rgb[37 * 5 * 3];
+        uint8_t *dst[3] = {rgb, NULL, NULL};
+        const int dst_linesize[3] = {width * 3, 0, 0};
+        la_yuv_downscale_process(&ds, src, src_linesize, dst, dst_linesize);
+
+        // BT.601
+        double y_scale = full_range ? 1.0 : 255.0 / 219.0;
+        double c_scale = full_range ? 1.0 : 255.0 / 224.0;
+        int y_offset = full_range ? 0 : 16;
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                double l = (luma[y * width + x] - y_offset) * y_scale;
+                double cb = (u[y / 2 * 19 + x / 2] - 128) * c_scale;
+                double cr = (v[y / 2 * 19 + x / 2] - 128) * c_scale;
+                uint8_t expected[3] = {
+                    reference_rgb(l + 1.402 * cr),
+                    reference_rgb(l - 0.344136 * cb - 0.714136 * cr),
+                    reference_rgb(l + 1.772 * cb),
+                };
+                for (int c = 0; c < 3; ++c) {
+                    assert(abs(rgb[(y * width + x) * 3 + c] - expected[c])
+                            <= 2);
+                }
+            }
+        }
+
+        la_yuv_downscale_destroy(&ds);
+    }
+}
+
+// Mean squared error (the PSNR is 10 * log10(255^2 / mse))
+static double
+mse(const uint8_t *a, int a_linesize, const uint8_t *b, int b_linesize,
+    int width, int height) {
+    double sse = 0;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int d = a[y * a_linesize + x] - b[y * b_linesize + x];
+            sse += d * d;
+        }
+    }
+    return sse / ((double) width * height);
+}
+
+// Compare to swscale configured as the preview encoder did
+static void test_psnr(enum AVPixelFormat dst_format, bool dst_full_range) {
+    const int src_width = 1440;
+    const int src_height = 3200;
+    static const int ratios[] = {10, 25, 50, 100};
+
+    AVFrame *src = make_frame(src_width, src_height);
+
+    for (size_t i = 0; i < ARRAY_LEN(ratios); ++i) {
+        int width = src_width * ratios[i] / 100;
+        int height = src_height * ratios[i] / 100;
+
+        AVFrame *expected = av_frame_alloc();
+        AVFrame *actual = av_frame_alloc();
+        assert(expected && actual);
+        expected->format = actual->format = dst_format;
+        expected->width = actual->width = width;
+        expected->height = actual->height = height;
+        int r = av_frame_get_buffer(expected, 32);
+        assert(!r);
+        r = av_frame_get_buffer(actual, 32);
+        assert(!r);
+        (void) r;
+
+        struct SwsContext *sws =
+            sws_getContext(src_width, src_height, AV_PIX_FMT_YUV420P, width,
+                           height, dst_format, SWS_BILINEAR, NULL, NULL, NULL);
+        assert(sws);
+        const int *coefs = sws_getCoefficients(SWS_CS_DEFAULT);
+        sws_setColorspaceDetails(sws, coefs, 0, coefs, dst_full_range, 0,
+                                 1 << 16, 1 << 16);
+        sws_scale(sws, (const uint8_t *const *) src->data, src->linesize, 0,
+                  src_height, expected->data, expected->linesize);
+        sws_freeContext(sws);
+
+        enum la_yuv_downscale_output output =
+            dst_format == AV_PIX_FMT_RGB24 ? LA_YUV_DOWNSCALE_RGB24
+                                           : LA_YUV_DOWNSCALE_YUV420P;
+        struct la_yuv_downscale ds;
+        bool ok = la_yuv_downscale_init(&ds, src_width, src_height, false,
+                                        width, height, output,
+                                        dst_full_range);
+        assert(ok);
+        (void) ok;
+        la_yuv_downscale_process(&ds, (const uint8_t *const *) src->data,
+                                 src->linesize, actual->data,
+                                 actual->linesize);
+        la_yuv_downscale_destroy(&ds);
+
+        int planes = output == LA_YUV_DOWNSCALE_RGB24 ? 1 : 3;
+        for (int p = 0; p < planes; ++p) {
+            int w = output == LA_YUV_DOWNSCALE_RGB24 ? width * 3
+                  : p ? (width + 1) / 2 : width;
+            int h = p ? (height + 1) / 2 : height;
+            double value = mse(expected->data[p], expected->linesize[p],
+                               actual->data[p], actual->linesize[p], w, h);
+            printf("%s ratio=%d%% plane %d: MSE %.2f\n",
+                   av_get_pix_fmt_name(dst_format), ratios[i], p, value);
+            assert(value <= MAX_MSE);
+            (void) value;
+        }
+
+        av_frame_free(&expected);
+        av_frame_free(&actual);
+    }
+
+    av_frame_free(&src);
+}
+
+int main(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+
+    test_box_exact();
+    test_supported();
+    test_rgb_gray();
+    test_rgb_random();
+    // JPEG previews: full-range YUV 4:2:0
+    test_psnr(AV_PIX_FMT_YUV420P, true);
+    // PNG previews
+    test_psnr(AV_PIX_FMT_RGB24, true);
+
+    return 0;
+}
@@ -0,0 +1,270 @@
+#include "event_coalescer.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#include "websocket_client.h"
+#include "../../app/src/util/log.h"
+
+static void la_event_coalescer_forward(struct la_event_coalescer *coalescer,
+                                       const struct sc_control_msg *msg,
+                                       uint16_t device_width,
+                                       uint16_t device_height)
+{
+    la_websocket_client_send_event(coalescer->ws_client, msg, device_width,
+                                   device_height);
+    ++coalescer->stats.forwarded;
+}
+
+// Send the pending events (called with the mutex locked)
+static void la_event_coalescer_flush(struct la_event_coalescer *coalescer)
+{
+    uint16_t width = coalescer->device_width;
+    uint16_t height = coalescer->device_height;
+
+    for (unsigned i = 0; i < coalescer->move_count; ++i)
+    {
+        la_event_coalescer_forward(coalescer, &coalescer->moves[i], width,
+                                   height);
+    }
+    coalescer->move_count = 0;
+
+    if (coalescer->has_scroll)
+    {
+        // A scroll event is serialized either as horizontal or vertical, send
+        // the accumulated deltas separately
+        struct sc_control_msg *scroll = &coalescer->scroll;
+        float hscroll = scroll->inject_scroll_event.hscroll;
+        float vscroll = scroll->inject_scroll_event.vscroll;
+        if (hscroll != 0)
+        {
+            scroll->inject_scroll_event.vscroll = 0;
+            la_event_coalescer_forward(coalescer, scroll, width, height);
+        }
+        if (vscroll != 0 || hscroll == 0)
+        {
+            scroll->inject_scroll_event.hscroll = 0;
+            scroll->inject_scroll_event.vscroll = vscroll;
+            la_event_coalescer_forward(coalescer, scroll, width, height);
+        }
+        coalescer->has_scroll = false;
+    }
+
+    coalescer->deadline = 0;
+}
+
+static bool la_event_coalescer_is_move(const struct sc_control_msg *msg)
+{
+    return msg->type == SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT
+        && msg->inject_touch_event.action == AMOTION_EVENT_ACTION_MOVE;
+}
+
+// Merge a touch move event (called with the mutex locked)
+static void la_event_coalescer_add_move(struct la_event_coalescer *coalescer,
+                                        const struct sc_control_msg *msg)
+{
+    uint64_t pointer_id = msg->inject_touch_event.pointer_id;
+    for (unsigned i = 0; i < coalescer->move_count; ++i)
+    {
+        if (coalescer->moves[i].inject_touch_event.pointer_id == pointer_id)
+        {
+            // Only the last position matters
+            coalescer->moves[i] = *msg;
+            ++coalescer->stats.merged_moves;
+            return;
+        }
+    }
+
+    if (coalescer->move_count == LA_EVENT_COALESCER_MAX_POINTERS)
+    {
+        la_event_coalescer_flush(coalescer);
+    }
+
+    coalescer->moves[coalescer->move_count++] = *msg;
+}
+
+// Merge a scroll event (called with the mutex locked)
+static void la_event_coalescer_add_scroll(struct la_event_coalescer *coalescer,
+                                          const struct sc_control_msg *msg)
+{
+    if (!coalescer->has_scroll)
+    {
+        coalescer->scroll = *msg;
+        coalescer->has_scroll = true;
+        return;
+    }
+
+    struct sc_control_msg *scroll = &coalescer->scroll;
+    float hscroll = scroll->inject_scroll_event.hscroll
+                  + msg->inject_scroll_event.hscroll;
+    float vscroll = scroll->inject_scroll_event.vscroll
+                  + msg->inject_scroll_event.vscroll;
+
+    // Keep the last position and buttons state
+    *scroll = *msg;
+    scroll->inject_scroll_event.hscroll = hscroll;
+    scroll->inject_scroll_event.vscroll = vscroll;
+    ++coalescer->stats.merged_scrolls;
+}
+
+static int run_event_coalescer(void *data)
+{
+    struct la_event_coalescer *coalescer = data;
+
+    sc_mutex_lock(&coalescer->mutex);
+
+    for (;;)
+    {
+        while (!coalescer->stopped
+               && (!coalescer->deadline || sc_tick_now() < coalescer->deadline))
+        {
+            if (coalescer->deadline)
+            {
+                sc_cond_timedwait(&coalescer->cond, &coalescer->mutex,
+                                  coalescer->deadline);
+            }
+            else
+            {
+                sc_cond_wait(&coalescer->cond, &coalescer->mutex);
+            }
+        }
+
+        if (coalescer->stopped)
+        {
+            break;
+        }
+
+        la_event_coalescer_flush(coalescer);
+    }
+
+    sc_mutex_unlock(&coalescer->mutex);
+
+    return 0;
+}
+
+bool la_event_coalescer_init(struct la_event_coalescer *coalescer,
+                             struct la_websocket_client *ws_client,
+                             uint32_t window_ms)
+{
+    coalescer->ws_client = ws_client;
+    coalescer->window = SC_TICK_FROM_MS(window_ms);
+    coalescer->stopped = false;
+    coalescer->move_count = 0;
+    coalescer->has_scroll = false;
+    coalescer->device_width = 0;
+    coalescer->device_height = 0;
+    coalescer->deadline = 0;
+    memset(&coalescer->stats, 0, sizeof(coalescer->stats));
+
+    bool ok = sc_mutex_init(&coalescer->mutex);
+    if (!ok)
+    {
+        return false;
+    }
+
+    ok = sc_cond_init(&coalescer->cond);
+    if (!ok)
+    {
+        sc_mutex_destroy(&coalescer->mutex);
+        return false;
+    }
+
+    if (coalescer->window)
+    {
+        ok = sc_thread_create(&coalescer->thread, run_event_coalescer,
+                              "la-coalescer", coalescer);
+        if (!ok)
+        {
+            LOGE("Could not start event coalescer thread");
+            sc_cond_destroy(&coalescer->cond);
+            sc_mutex_destroy(&coalescer->mutex);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void la_event_coalescer_destroy(struct la_event_coalescer *coalescer)
+{
+    sc_mutex_lock(&coalescer->mutex);
+    coalescer->stopped = true;
+    sc_cond_signal(&coalescer->cond);
+    sc_mutex_unlock(&coalescer->mutex);
+
+    if (coalescer->window)
+    {
+        sc_thread_join(&coalescer->thread, NULL);
+    }
+
+    // Do not lose the last events
+    la_event_coalescer_flush(coalescer);
+
+    LOGI("LinkAndroid events: %" PRIu32 " forwarded, %" PRIu32
+         " moves merged, %" PRIu32 " scrolls merged",
+         coalescer->stats.forwarded, coalescer->stats.merged_moves,
+         coalescer->stats.merged_scrolls);
+
+    sc_cond_destroy(&coalescer->cond);
+    sc_mutex_destroy(&coalescer->mutex);
+}
+
+void la_event_coalescer_push(struct la_event_coalescer *coalescer,
+                             const struct sc_control_msg *msg,
+                             uint16_t device_width, uint16_t device_height)
+{
+    sc_mutex_lock(&coalescer->mutex);
+
+    bool pending = coalescer->move_count || coalescer->has_scroll;
+    if (pending && (device_width != coalescer->device_width
+                    || device_height != coalescer->device_height))
+    {
+        // The coordinates are relative to the device size
+        la_event_coalescer_flush(coalescer);
+        pending = false;
+    }
+
+    bool is_move = la_event_coalescer_is_move(msg);
+    bool is_scroll = msg->type == SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT;
+
+    if (!coalescer->window || (!is_move && !is_scroll))
+    {
+        // Flush on any other event (touch down/up, key...) to keep the order
+        if (pending)
+        {
+            la_event_coalescer_flush(coalescer);
+        }
+        la_event_coalescer_forward(coalescer, msg, device_width,
+                                   device_height);
+        sc_mutex_unlock(&coalescer->mutex);
+        return;
+    }
+
+    if (is_move)
+    {
+        la_event_coalescer_add_move(coalescer, msg);
+    }
+    else
+    {
+        la_event_coalescer_add_scroll(coalescer, msg);
+    }
+
+    coalescer->device_width = device_width;
+    coalescer->device_height = device_height;
+
+    if (!coalescer->deadline)
+    {
+        coalescer->deadline = sc_tick_now() + coalescer->window;
+        sc_cond_signal(&coalescer->cond);
+    }
+
+    sc_mutex_unlock(&coalescer->mutex);
+}
+
+void la_event_coalescer_get_stats(struct la_event_coalescer *coalescer,
+                                  struct la_event_coalescer_stats *stats)
+{
+    sc_mutex_lock(&coalescer->mutex);
+    *stats = coalescer->stats;
+    sc_mutex_unlock(&coalescer->mutex);
+}
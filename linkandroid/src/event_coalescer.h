@@ -0,0 +1,99 @@
+#ifndef LA_EVENT_COALESCER_H
+#define LA_EVENT_COALESCER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../../app/src/control_msg.h"
+#include "../../app/src/util/thread.h"
+#include "../../app/src/util/tick.h"
+
+struct la_websocket_client;
+
+// Maximum number of pointers with a pending move event
+#define LA_EVENT_COALESCER_MAX_POINTERS 10
+
+struct la_event_coalescer_stats
+{
+    uint32_t forwarded;      // Events sent to the WebSocket server
+    uint32_t merged_moves;   // Touch move events replaced by a newer one
+    uint32_t merged_scrolls; // Scroll events accumulated into another one
+};
+
+/**
+ * Input event coalescer
+ *
+ * Forwards control messages to the WebSocket server, merging the events
+ * received within a short window:
+ *  - consecutive touch move events of the same pointer are replaced by the
+ *    last one;
+ *  - scroll deltas are accumulated (at the last position).
+ *
+ * Any other event (touch down/up, key, text...) first flushes the pending
+ * events, so that the order is preserved. Pending events are also flushed
+ * when the window expires.
+ */
+struct la_event_coalescer
+{
+    struct la_websocket_client *ws_client;
+    sc_tick window; // 0 if disabled (events are forwarded immediately)
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    bool stopped;
+
+    // Pending events (protected by mutex)
+    struct sc_control_msg moves[LA_EVENT_COALESCER_MAX_POINTERS];
+    unsigned move_count;
+    struct sc_control_msg scroll;
+    bool has_scroll;
+    uint16_t device_width;  // Device size of the pending events
+    uint16_t device_height;
+    sc_tick deadline; // Flush time of the pending events (0 if none)
+
+    struct la_event_coalescer_stats stats;
+};
+
+/**
+ * Initialize an event coalescer and start its thread (if enabled)
+ *
+ * @param coalescer Event coalescer instance
+ * @param ws_client WebSocket client the events are forwarded to
+ * @param window_ms Coalescing window in milliseconds (0 to disable)
+ * @return true on success, false on failure
+ */
+bool la_event_coalescer_init(struct la_event_coalescer *coalescer,
+                             struct la_websocket_client *ws_client,
+                             uint32_t window_ms);
+
+/**
+ * Flush the pending events, stop the thread and release resources
+ *
+ * @param coalescer Event coalescer instance
+ */
+void la_event_coalescer_destroy(struct la_event_coalescer *coalescer);
+
+/**
+ * Forward a control message to the WebSocket server (possibly delayed and
+ * merged with the next ones)
+ *
+ * @param coalescer Event coalescer instance
+ * @param msg Control message (copied if needed)
+ * @param device_width Device screen width
+ * @param device_height Device screen height
+ */
+void la_event_coalescer_push(struct la_event_coalescer *coalescer,
+                             const struct sc_control_msg *msg,
+                             uint16_t device_width, uint16_t device_height);
+
+/**
+ * Get the coalescing counters
+ *
+ * @param coalescer Event coalescer instance
+ * @param stats Counters to fill
+ */
+void la_event_coalescer_get_stats(struct la_event_coalescer *coalescer,
+                                  struct la_event_coalescer_stats *stats);
+
+#endif
@@ -0,0 +1,290 @@
+#include "event_json.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../../app/src/control_msg.h"
+
+void la_json_writer_raw(struct la_json_writer *w, const char *s, size_t len)
+{
+    if (w->len < w->size)
+    {
+        size_t avail = w->size - w->len;
+        memcpy(w->buf + w->len, s, len < avail ? len : avail);
+    }
+    w->len += len;
+}
+
+static inline void la_json_writer_char(struct la_json_writer *w, char c)
+{
+    if (w->len < w->size)
+    {
+        w->buf[w->len] = c;
+    }
+    ++w->len;
+}
+
+void la_json_writer_string(struct la_json_writer *w, const char *s)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    la_json_writer_char(w, '"');
+
+    const char *run = s; // Start of the characters not escaped yet
+    for (; *s; ++s)
+    {
+        unsigned char c = *s;
+        if (c >= 0x20 && c != '"' && c != '\\')
+        {
+            continue;
+        }
+
+        la_json_writer_raw(w, run, s - run);
+        run = s + 1;
+
+        switch (c)
+        {
+        case '"':
+            la_json_writer_literal(w, "\\\"");
+            break;
+        case '\\':
+            la_json_writer_literal(w, "\\\\");
+            break;
+        case '\b':
+            la_json_writer_literal(w, "\\b");
+            break;
+        case '\f':
+            la_json_writer_literal(w, "\\f");
+            break;
+        case '\n':
+            la_json_writer_literal(w, "\\n");
+            break;
+        case '\r':
+            la_json_writer_literal(w, "\\r");
+            break;
+        case '\t':
+            la_json_writer_literal(w, "\\t");
+            break;
+        default:
+        {
+            char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+            la_json_writer_raw(w, esc, sizeof(esc));
+            break;
+        }
+        }
+    }
+    la_json_writer_raw(w, run, s - run);
+
+    la_json_writer_char(w, '"');
+}
+
+void la_json_writer_uint(struct la_json_writer *w, uint64_t value)
+{
+    char digits[20];
+    size_t i = sizeof(digits);
+    do
+    {
+        digits[--i] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+
+    la_json_writer_raw(w, &digits[i], sizeof(digits) - i);
+}
+
+void la_json_writer_int(struct la_json_writer *w, int64_t value)
+{
+    if (value < 0)
+    {
+        la_json_writer_char(w, '-');
+        // Negate as unsigned to support INT64_MIN
+        la_json_writer_uint(w, -(uint64_t)value);
+    }
+    else
+    {
+        la_json_writer_uint(w, value);
+    }
+}
+
+void la_json_writer_float(struct la_json_writer *w, float value)
+{
+    // A float has a 24-bit mantissa, so value * 10^6 (20 bits) is exact in a
+    // double, and can be rounded like printf (half to even)
+    double scaled = (double)value * 1000000;
+    if (!(scaled > -1e15 && scaled < 1e15))
+    {
+        // Out of range, infinite or NaN
+        char tmp[64];
+        int len = snprintf(tmp, sizeof(tmp), "%.6f", value);
+        if (len > 0)
+        {
+            la_json_writer_raw(w, tmp, (size_t)len < sizeof(tmp)
+                                           ? (size_t)len : sizeof(tmp) - 1);
+        }
+        return;
+    }
+
+    bool negative = scaled < 0;
+    if (negative)
+    {
+        scaled = -scaled;
+    }
+    uint64_t units = (uint64_t)scaled;
+    double frac = scaled - (double)units;
+    if (frac > 0.5 || (frac == 0.5 && (units & 1)))
+    {
+        ++units;
+    }
+
+    if (negative)
+    {
+        // printf keeps the sign of negative values rounded to zero
+        la_json_writer_char(w, '-');
+    }
+    la_json_writer_uint(w, units / 1000000);
+
+    char decimals[7] = {'.'};
+    uint32_t rem = units % 1000000;
+    for (int i = 6; i > 0; --i)
+    {
+        decimals[i] = '0' + rem % 10;
+        rem /= 10;
+    }
+    la_json_writer_raw(w, decimals, sizeof(decimals));
+}
+
+void la_json_writer_id(struct la_json_writer *w, uint32_t id)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    char s[10];
+    s[0] = '"';
+    for (int i = 0; i < 8; ++i)
+    {
+        s[8 - i] = hex[(id >> (4 * i)) & 0xF];
+    }
+    s[9] = '"';
+    la_json_writer_raw(w, s, sizeof(s));
+}
+
+// Write the beginning of an event: {"type":"<type>","id":"<id>","data":{
+static void la_event_json_begin(struct la_json_writer *w, const char *type,
+                                uint32_t id)
+{
+    la_json_writer_literal(w, "{\"type\":\"");
+    la_json_writer_raw(w, type, strlen(type));
+    la_json_writer_literal(w, "\",\"id\":");
+    la_json_writer_id(w, id);
+    la_json_writer_literal(w, ",\"data\":{");
+}
+
+// Write the end of an event: ,"width":<w>,"height":<h>}}
+static void la_event_json_end(struct la_json_writer *w, uint16_t device_width,
+                              uint16_t device_height)
+{
+    la_json_writer_literal(w, ",\"width\":");
+    la_json_writer_uint(w, device_width);
+    la_json_writer_literal(w, ",\"height\":");
+    la_json_writer_uint(w, device_height);
+    la_json_writer_literal(w, "}}");
+}
+
+size_t la_event_json_serialize(const struct sc_control_msg *msg, uint32_t id,
+                               uint16_t device_width, uint16_t device_height,
+                               char *buf, size_t size)
+{
+    struct la_json_writer w;
+    la_json_writer_init(&w, buf, size);
+
+    switch (msg->type)
+    {
+    case SC_CONTROL_MSG_TYPE_INJECT_KEYCODE:
+    {
+        bool down = msg->inject_keycode.action == AKEY_EVENT_ACTION_DOWN;
+        la_event_json_begin(&w, "key", id);
+        la_json_writer_literal(&w, "\"action\":");
+        if (down)
+        {
+            la_json_writer_literal(&w, "\"down\"");
+        }
+        else
+        {
+            la_json_writer_literal(&w, "\"up\"");
+        }
+        la_json_writer_literal(&w, ",\"keycode\":");
+        la_json_writer_int(&w, msg->inject_keycode.keycode);
+        la_json_writer_literal(&w, ",\"repeat\":");
+        la_json_writer_int(&w, (int)msg->inject_keycode.repeat);
+        la_json_writer_literal(&w, ",\"metastate\":");
+        la_json_writer_int(&w, (int)msg->inject_keycode.metastate);
+        break;
+    }
+    case SC_CONTROL_MSG_TYPE_INJECT_TEXT:
+        la_event_json_begin(&w, "text", id);
+        la_json_writer_literal(&w, "\"text\":");
+        la_json_writer_string(&w, msg->inject_text.text);
+        break;
+    case SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT:
+    {
+        const char *type;
+        switch (msg->inject_touch_event.action)
+        {
+        case AMOTION_EVENT_ACTION_DOWN:
+            type = "touch_down";
+            break;
+        case AMOTION_EVENT_ACTION_UP:
+            type = "touch_up";
+            break;
+        case AMOTION_EVENT_ACTION_MOVE:
+            type = "touch_move";
+            break;
+        default:
+            // Unsupported touch actions (e.g. hover events)
+            return 0;
+        }
+
+        la_event_json_begin(&w, type, id);
+        // The pointer id is a string to avoid JavaScript precision issues
+        la_json_writer_literal(&w, "\"pointer_id\":\"");
+        la_json_writer_uint(&w, msg->inject_touch_event.pointer_id);
+        // Absolute pixel coordinates (integers)
+        la_json_writer_literal(&w, "\",\"x\":");
+        la_json_writer_int(&w,
+                           (int)msg->inject_touch_event.position.point.x);
+        la_json_writer_literal(&w, ",\"y\":");
+        la_json_writer_int(&w,
+                           (int)msg->inject_touch_event.position.point.y);
+        la_json_writer_literal(&w, ",\"pressure\":");
+        la_json_writer_float(&w, msg->inject_touch_event.pressure);
+        break;
+    }
+    case SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT:
+    {
+        // Either horizontal or vertical scroll
+        bool horizontal = msg->inject_scroll_event.hscroll != 0;
+        la_event_json_begin(&w, horizontal ? "scroll_h" : "scroll_v", id);
+        la_json_writer_literal(&w, "\"x\":");
+        la_json_writer_int(&w,
+                           (int)msg->inject_scroll_event.position.point.x);
+        la_json_writer_literal(&w, ",\"y\":");
+        la_json_writer_int(&w,
+                           (int)msg->inject_scroll_event.position.point.y);
+        if (horizontal)
+        {
+            la_json_writer_literal(&w, ",\"hscroll\":");
+            la_json_writer_float(&w, msg->inject_scroll_event.hscroll);
+        }
+        else
+        {
+            la_json_writer_literal(&w, ",\"vscroll\":");
+            la_json_writer_float(&w, msg->inject_scroll_event.vscroll);
+        }
+        break;
+    }
+    default:
+        // Unsupported message types
+        return 0;
+    }
+
+    la_event_json_end(&w, device_width, device_height);
+    return w.len;
+}
@@ -0,0 +1,75 @@
+#ifndef LA_EVENT_JSON_H
+#define LA_EVENT_JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct sc_control_msg;
+
+/**
+ * Streaming JSON writer into a caller-provided buffer
+ *
+ * Like snprintf(), the writer never overflows the buffer but keeps counting
+ * the bytes that would have been written, so that the caller can retry with
+ * a buffer of the required size. No NUL terminator is written.
+ */
+struct la_json_writer
+{
+    char *buf;
+    size_t size; // Buffer capacity
+    size_t len;  // Bytes written (or that would have been written)
+};
+
+static inline void la_json_writer_init(struct la_json_writer *w, char *buf,
+                                       size_t size)
+{
+    w->buf = buf;
+    w->size = size;
+    w->len = 0;
+}
+
+void la_json_writer_raw(struct la_json_writer *w, const char *s, size_t len);
+
+/**
+ * Write a string literal (without escaping)
+ */
+#define la_json_writer_literal(w, s) la_json_writer_raw(w, s, sizeof(s) - 1)
+
+/**
+ * Write a quoted and escaped JSON string (UTF-8 is written as is)
+ */
+void la_json_writer_string(struct la_json_writer *w, const char *s);
+
+void la_json_writer_int(struct la_json_writer *w, int64_t value);
+
+void la_json_writer_uint(struct la_json_writer *w, uint64_t value);
+
+/**
+ * Write a number with 6 decimals (same output as "%.6f")
+ */
+void la_json_writer_float(struct la_json_writer *w, float value);
+
+/**
+ * Write a message id as a quoted 8-digit hex string
+ */
+void la_json_writer_id(struct la_json_writer *w, uint32_t id);
+
+/**
+ * Serialize a control message forwarded to the WebSocket server
+ *
+ * @param msg Control message
+ * @param id Message id
+ * @param device_width Device screen width
+ * @param device_height Device screen height
+ * @param buf Output buffer (may be NULL if size is 0)
+ * @param size Output buffer capacity
+ * @return The JSON length (which may exceed size, then the output is
+ *         truncated and must be serialized again into a larger buffer), or
+ *         0 if the message type is not forwarded
+ */
+size_t la_event_json_serialize(const struct sc_control_msg *msg, uint32_t id,
+                               uint16_t device_width, uint16_t device_height,
+                               char *buf, size_t size);
+
+#endif
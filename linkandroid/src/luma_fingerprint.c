@@ -0,0 +1,121 @@
+#include "luma_fingerprint.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+# include <emmintrin.h>
+# define LA_LUMA_FINGERPRINT_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+# define LA_LUMA_FINGERPRINT_NEON
+#endif
+
+// Only one row out of LA_LUMA_FINGERPRINT_ROW_STEP is read
+#define LA_LUMA_FINGERPRINT_ROW_STEP 2
+// Maximum difference of a cell between two identical images
+#define LA_LUMA_FINGERPRINT_TOLERANCE 2
+
+#define N LA_LUMA_FINGERPRINT_SIZE
+
+// Sum count consecutive bytes
+static uint32_t la_luma_sum(const uint8_t *data, int count)
+{
+    uint32_t sum = 0;
+    int x = 0;
+
+#if defined(LA_LUMA_FINGERPRINT_SSE2)
+    // The sum of absolute differences with zero is the horizontal sum
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    for (; x + 16 <= count; x += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + x));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+    }
+    sum = (uint32_t)_mm_cvtsi128_si32(acc)
+        + (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#elif defined(LA_LUMA_FINGERPRINT_NEON)
+    uint32x4_t acc = vdupq_n_u32(0);
+    for (; x + 16 <= count; x += 16)
+    {
+        acc = vpadalq_u16(acc, vpaddlq_u8(vld1q_u8(data + x)));
+    }
+    uint64x2_t acc64 = vpaddlq_u32(acc);
+    sum = (uint32_t)(vgetq_lane_u64(acc64, 0) + vgetq_lane_u64(acc64, 1));
+#endif
+
+    for (; x < count; ++x)
+    {
+        sum += data[x];
+    }
+
+    return sum;
+}
+
+void la_luma_fingerprint_compute(struct la_luma_fingerprint *fp,
+                                 const uint8_t *luma, int linesize,
+                                 int width, int height)
+{
+    assert(width > 0 && height > 0);
+
+    // Cell boundaries
+    int xs[N + 1];
+    for (int i = 0; i <= N; ++i)
+    {
+        xs[i] = (int)((int64_t)i * width / N);
+    }
+
+    fp->width = width;
+    fp->height = height;
+
+    uint64_t sums[N];
+    for (int row = 0; row < N; ++row)
+    {
+        int y0 = (int)((int64_t)row * height / N);
+        int y1 = (int)((int64_t)(row + 1) * height / N);
+
+        for (int col = 0; col < N; ++col)
+        {
+            sums[col] = 0;
+        }
+
+        int lines = 0;
+        for (int y = y0; y < y1; y += LA_LUMA_FINGERPRINT_ROW_STEP)
+        {
+            const uint8_t *line = luma + (size_t)y * linesize;
+            for (int col = 0; col < N; ++col)
+            {
+                sums[col] += la_luma_sum(line + xs[col],
+                                         xs[col + 1] - xs[col]);
+            }
+            ++lines;
+        }
+
+        for (int col = 0; col < N; ++col)
+        {
+            // Empty cells if the image is smaller than the grid
+            uint64_t count = (uint64_t)lines * (xs[col + 1] - xs[col]);
+            fp->cells[row * N + col] = count ? sums[col] / count : 0;
+        }
+    }
+}
+
+bool la_luma_fingerprint_equals(const struct la_luma_fingerprint *a,
+                                const struct la_luma_fingerprint *b)
+{
+    if (a->width != b->width || a->height != b->height)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < N * N; ++i)
+    {
+        if (abs(a->cells[i] - b->cells[i]) > LA_LUMA_FINGERPRINT_TOLERANCE)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
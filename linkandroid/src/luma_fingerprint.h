@@ -0,0 +1,42 @@
+#ifndef LA_LUMA_FINGERPRINT_H
+#define LA_LUMA_FINGERPRINT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The fingerprint is a grid of N x N cells
+#define LA_LUMA_FINGERPRINT_SIZE 32
+
+/**
+ * Perceptual fingerprint of an image
+ *
+ * The luma plane is downsampled to a small grid of cells, each cell being the
+ * mean luma of the pixels it covers. Two images are visually identical if
+ * their cells are almost equal: the noise of the video encoding (e.g. when
+ * the device encoder repeats a frame) is ignored, while a change of a few
+ * dozen pixels (a clock digit) is detected.
+ *
+ * It is cheap to compute (a few SIMD additions per pixel, on half the rows),
+ * much cheaper than encoding an image.
+ */
+struct la_luma_fingerprint
+{
+    int width;  // Source width (0 if none)
+    int height; // Source height
+    uint8_t cells[LA_LUMA_FINGERPRINT_SIZE * LA_LUMA_FINGERPRINT_SIZE];
+};
+
+/**
+ * Compute the fingerprint of an 8-bit luma plane
+ */
+void la_luma_fingerprint_compute(struct la_luma_fingerprint *fp,
+                                 const uint8_t *luma, int linesize,
+                                 int width, int height);
+
+/**
+ * Check whether two fingerprints are visually identical
+ */
+bool la_luma_fingerprint_equals(const struct la_luma_fingerprint *a,
+                                const struct la_luma_fingerprint *b);
+
+#endif
@@ -0,0 +1,191 @@
+#include "message_ring.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../app/src/util/log.h"
+
+bool la_message_ring_init(struct la_message_ring *ring, uint32_t capacity,
+                          size_t slot_size, size_t headroom)
+{
+    assert(capacity);
+    assert(slot_size);
+
+    // The actual capacity is (alloc_size - 1) so that head == tail is
+    // non-ambiguous
+    ring->alloc_size = capacity + 1;
+    ring->slot_size = slot_size;
+    ring->headroom = headroom;
+
+    ring->slots = calloc(ring->alloc_size, sizeof(*ring->slots));
+    if (!ring->slots)
+    {
+        LOG_OOM();
+        return false;
+    }
+
+    size_t stride = headroom + slot_size;
+    ring->slab = malloc(ring->alloc_size * stride);
+    if (!ring->slab)
+    {
+        LOG_OOM();
+        free(ring->slots);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < ring->alloc_size; ++i)
+    {
+        ring->slots[i].slab = ring->slab + i * stride;
+    }
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->pushed, 0);
+    atomic_init(&ring->dropped, 0);
+    atomic_init(&ring->max_depth, 0);
+
+    return true;
+}
+
+void la_message_ring_destroy(struct la_message_ring *ring)
+{
+    for (uint32_t i = 0; i < ring->alloc_size; ++i)
+    {
+        free(ring->slots[i].large);
+    }
+    free(ring->slab);
+    free(ring->slots);
+}
+
+uint8_t *la_message_ring_reserve(struct la_message_ring *ring, size_t len)
+{
+    // Only the writer thread can write head, so memory_order_relaxed is
+    // sufficient
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    // The tail cursor is updated after the message is consumed by the reader
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if ((head + 1) % ring->alloc_size == tail)
+    {
+        // Full: drop the new message, the queued ones are sent first
+        uint32_t dropped =
+            atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+        atomic_store_explicit(&ring->dropped, dropped + 1,
+                              memory_order_relaxed);
+        return NULL;
+    }
+
+    // The slot between tail and head is owned by the writer
+    struct la_message_slot *slot = &ring->slots[head];
+
+    // Release a previous reservation which has not been committed
+    free(slot->large);
+    slot->large = NULL;
+
+    if (len <= ring->slot_size)
+    {
+        return slot->slab + ring->headroom;
+    }
+
+    slot->large = malloc(ring->headroom + len);
+    if (!slot->large)
+    {
+        LOG_OOM();
+        return NULL;
+    }
+
+    return slot->large + ring->headroom;
+}
+
+void la_message_ring_commit(struct la_message_ring *ring, size_t len,
+                            bool binary)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    struct la_message_slot *slot = &ring->slots[head];
+    assert(len <= ring->slot_size || slot->large);
+    slot->len = len;
+    slot->binary = binary;
+
+    // Publish the message
+    uint32_t new_head = (head + 1) % ring->alloc_size;
+    assert(new_head != tail);
+    atomic_store_explicit(&ring->head, new_head, memory_order_release);
+
+    uint32_t pushed = atomic_load_explicit(&ring->pushed, memory_order_relaxed);
+    atomic_store_explicit(&ring->pushed, pushed + 1, memory_order_relaxed);
+
+    // The reader may only have consumed messages meanwhile
+    uint32_t depth = (ring->alloc_size + new_head - tail) % ring->alloc_size;
+    uint32_t max_depth =
+        atomic_load_explicit(&ring->max_depth, memory_order_relaxed);
+    if (depth > max_depth)
+    {
+        atomic_store_explicit(&ring->max_depth, depth, memory_order_relaxed);
+    }
+}
+
+bool la_message_ring_push(struct la_message_ring *ring,
+                          const void *prefix, size_t prefix_len,
+                          const void *data, size_t data_len, bool binary)
+{
+    size_t len = prefix_len + data_len;
+    uint8_t *payload = la_message_ring_reserve(ring, len);
+    if (!payload)
+    {
+        return false;
+    }
+
+    if (prefix_len)
+    {
+        memcpy(payload, prefix, prefix_len);
+    }
+    memcpy(payload + prefix_len, data, data_len);
+
+    la_message_ring_commit(ring, len, binary);
+    return true;
+}
+
+struct la_message_slot *la_message_ring_peek(struct la_message_ring *ring)
+{
+    // Only the reader thread can write tail without synchronization, so
+    // memory_order_relaxed is sufficient
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    // The head cursor is updated after the message is written to the slot
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (head == tail)
+    {
+        return NULL;
+    }
+
+    return &ring->slots[tail];
+}
+
+void la_message_ring_pop(struct la_message_ring *ring)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    assert(tail != atomic_load_explicit(&ring->head, memory_order_acquire));
+
+    struct la_message_slot *slot = &ring->slots[tail];
+    if (slot->large)
+    {
+        free(slot->large);
+        slot->large = NULL;
+    }
+
+    // Give the slot back to the writer
+    uint32_t new_tail = (tail + 1) % ring->alloc_size;
+    atomic_store_explicit(&ring->tail, new_tail, memory_order_release);
+}
+
+uint32_t la_message_ring_depth(struct la_message_ring *ring)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    return (ring->alloc_size + head - tail) % ring->alloc_size;
+}
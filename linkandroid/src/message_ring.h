@@ -0,0 +1,153 @@
+#ifndef LA_MESSAGE_RING_H
+#define LA_MESSAGE_RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Message slot
+ *
+ * Each slot owns a preallocated slab buffer of headroom + slot_size bytes.
+ * Messages larger than slot_size (e.g. preview images) are stored in a
+ * dedicated heap buffer, released when the message is popped.
+ */
+struct la_message_slot
+{
+    uint8_t *slab;  // Preallocated buffer (headroom + slot_size bytes)
+    uint8_t *large; // Heap buffer for oversized messages (or NULL)
+    size_t len;     // Payload length (excluding headroom)
+    bool binary;
+};
+
+/**
+ * Bounded single-producer single-consumer message ring
+ *
+ * The writer and the reader may run concurrently without any lock. If
+ * several threads produce messages, the caller must serialize them.
+ *
+ * Every payload is preceded by headroom bytes (e.g. LWS_PRE), so that it can
+ * be written in place by libwebsockets.
+ */
+struct la_message_ring
+{
+    struct la_message_slot *slots;
+    uint8_t *slab; // Single allocation shared by all the slots
+    uint32_t alloc_size; // in slots
+    size_t slot_size;
+    size_t headroom;
+
+    atomic_uint_least32_t head; // writer cursor, in slots
+    atomic_uint_least32_t tail; // reader cursor, in slots
+    // empty: tail == head
+    // full: ((head + 1) % alloc_size) == tail
+
+    // Counters (written by the writer only)
+    atomic_uint_least32_t pushed;
+    atomic_uint_least32_t dropped;
+    atomic_uint_least32_t max_depth;
+};
+
+/**
+ * Initialize a message ring
+ *
+ * @param ring Message ring instance
+ * @param capacity Maximum number of queued messages
+ * @param slot_size Payload size of the preallocated slot buffers
+ * @param headroom Number of bytes reserved before each payload
+ * @return true on success, false on failure
+ */
+bool la_message_ring_init(struct la_message_ring *ring, uint32_t capacity,
+                          size_t slot_size, size_t headroom);
+
+/**
+ * Destroy a message ring (the pending messages are discarded)
+ *
+ * @param ring Message ring instance
+ */
+void la_message_ring_destroy(struct la_message_ring *ring);
+
+/**
+ * Queue a message made of a prefix followed by data (writer only)
+ *
+ * If the ring is full, the message is dropped (and counted).
+ *
+ * @param ring Message ring instance
+ * @param prefix Message prefix (may be NULL if prefix_len is 0)
+ * @param prefix_len Prefix length
+ * @param data Message data
+ * @param data_len Data length
+ * @param binary Binary message flag (stored as is)
+ * @return true if the message has been queued, false if it has been dropped
+ */
+bool la_message_ring_push(struct la_message_ring *ring,
+                          const void *prefix, size_t prefix_len,
+                          const void *data, size_t data_len, bool binary);
+
+/**
+ * Reserve the next slot to write a message of at most len bytes in place
+ * (writer only)
+ *
+ * The message is queued only once committed. Calling this function again
+ * before committing reserves the same slot (e.g. with a larger size).
+ *
+ * If the ring is full, the message is dropped (and counted).
+ *
+ * @param ring Message ring instance
+ * @param len Maximum payload length
+ * @return Payload buffer (preceded by the headroom), or NULL on failure
+ */
+uint8_t *la_message_ring_reserve(struct la_message_ring *ring, size_t len);
+
+/**
+ * Queue the message written in the reserved slot (writer only)
+ *
+ * @param ring Message ring instance
+ * @param len Actual payload length (at most the reserved length)
+ * @param binary Binary message flag (stored as is)
+ */
+void la_message_ring_commit(struct la_message_ring *ring, size_t len,
+                            bool binary);
+
+/**
+ * Return the oldest queued message, or NULL if the ring is empty (reader
+ * only)
+ *
+ * The slot remains valid until la_message_ring_pop() is called.
+ *
+ * @param ring Message ring instance
+ * @return Oldest message slot, or NULL
+ */
+struct la_message_slot *la_message_ring_peek(struct la_message_ring *ring);
+
+/**
+ * Remove the oldest queued message (reader only)
+ *
+ * @param ring Message ring instance
+ */
+void la_message_ring_pop(struct la_message_ring *ring);
+
+/**
+ * Return the number of queued messages (may be called from any thread)
+ *
+ * @param ring Message ring instance
+ * @return Queue depth
+ */
+uint32_t la_message_ring_depth(struct la_message_ring *ring);
+
+/**
+ * Return the payload of a message
+ *
+ * @param ring Message ring instance
+ * @param slot Message slot returned by la_message_ring_peek()
+ * @return Pointer to the payload of the message
+ */
+static inline uint8_t *la_message_slot_payload(const struct la_message_ring *ring,
+                                               const struct la_message_slot *slot)
+{
+    uint8_t *buffer = slot->large ? slot->large : slot->slab;
+    return buffer + ring->headroom;
+}
+
+#endif
@@ -0,0 +1,470 @@
+#include "preview_encoder.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/dict.h>
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+
+#include "../../app/src/util/log.h"
+
+// Base64 encoding table
+static const char base64_chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Base64 encode function
+static char *base64_encode(const unsigned char *data, size_t input_length)
+{
+    size_t output_length = 4 * ((input_length + 2) / 3);
+    char *encoded_data = malloc(output_length + 1);
+    if (!encoded_data)
+    {
+        return NULL;
+    }
+
+    for (size_t i = 0, j = 0; i < input_length;)
+    {
+        uint32_t octet_a = i < input_length ? data[i++] : 0;
+        uint32_t octet_b = i < input_length ? data[i++] : 0;
+        uint32_t octet_c = i < input_length ? data[i++] : 0;
+
+        uint32_t triple = (octet_a << 16) + (octet_b << 8) + octet_c;
+
+        encoded_data[j++] = base64_chars[(triple >> 18) & 0x3F];
+        encoded_data[j++] = base64_chars[(triple >> 12) & 0x3F];
+        encoded_data[j++] = base64_chars[(triple >> 6) & 0x3F];
+        encoded_data[j++] = base64_chars[triple & 0x3F];
+    }
+
+    // Add padding
+    for (size_t i = 0; i < (3 - input_length % 3) % 3; i++)
+    {
+        encoded_data[output_length - 1 - i] = '=';
+    }
+
+    encoded_data[output_length] = '\0';
+    return encoded_data;
+}
+
+const char *la_preview_format_name(enum la_preview_format format)
+{
+    switch (format)
+    {
+    case LA_PREVIEW_FORMAT_JPEG:
+        return "jpeg";
+    case LA_PREVIEW_FORMAT_WEBP:
+        return "webp";
+    default:
+        return "png";
+    }
+}
+
+static const AVCodec *la_preview_find_encoder(enum la_preview_format format)
+{
+    switch (format)
+    {
+    case LA_PREVIEW_FORMAT_JPEG:
+        return avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+    case LA_PREVIEW_FORMAT_WEBP:
+        // Only provided if FFmpeg is built with libwebp. Not looked up by
+        // codec id: the first WebP encoder is libwebp_anim, which outputs a
+        // packet only when flushed (and keeps all the frames until then)
+        return avcodec_find_encoder_by_name("libwebp");
+    default:
+        return avcodec_find_encoder(AV_CODEC_ID_PNG);
+    }
+}
+
+// Release the session (codec context, scaler and frame buffer)
+static void la_preview_encoder_close_session(struct la_preview_encoder *enc)
+{
+    avcodec_free_context(&enc->codec_ctx);
+    if (enc->use_downscale)
+    {
+        la_yuv_downscale_destroy(&enc->downscale);
+        enc->use_downscale = false;
+    }
+    sws_freeContext(enc->sws_ctx);
+    enc->sws_ctx = NULL;
+    av_frame_unref(enc->frame);
+    enc->src_width = 0;
+    enc->src_height = 0;
+}
+
+// Configure the codec context for the image format, return the options to
+// pass to avcodec_open2()
+static AVDictionary *la_preview_configure_codec(AVCodecContext *ctx,
+                                                enum la_preview_format format,
+                                                uint8_t quality)
+{
+    AVDictionary *opts = NULL;
+
+    switch (format)
+    {
+    case LA_PREVIEW_FORMAT_JPEG:
+    {
+        // Full-range YUV 4:2:0, as expected by JPEG decoders
+        ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+        ctx->color_range = AVCOL_RANGE_JPEG;
+        // Map quality 1-100 to qscale 31-2 (lower is better)
+        int qscale = 2 + (100 - quality) * 29 / 99;
+        ctx->flags |= AV_CODEC_FLAG_QSCALE;
+        ctx->global_quality = qscale * FF_QP2LAMBDA;
+        break;
+    }
+    case LA_PREVIEW_FORMAT_WEBP:
+    {
+        // Lossy WebP is limited-range YUV 4:2:0
+        ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+        ctx->color_range = AVCOL_RANGE_MPEG;
+        char value[4];
+        snprintf(value, sizeof(value), "%u", quality);
+        av_dict_set(&opts, "quality", value, 0);
+        break;
+    }
+    default:
+        ctx->pix_fmt = AV_PIX_FMT_RGB24; // PNG works well with RGB24
+        ctx->compression_level = 3;      // Balanced compression
+        break;
+    }
+
+    return opts;
+}
+
+// Use the fast downscaler if it supports the conversion
+static bool la_preview_encoder_init_downscale(struct la_preview_encoder *enc,
+                                              const AVFrame *src_frame,
+                                              enum AVPixelFormat dst_format,
+                                              bool dst_range)
+{
+    if (src_frame->format != AV_PIX_FMT_YUV420P
+        && src_frame->format != AV_PIX_FMT_YUVJ420P)
+    {
+        return false;
+    }
+
+    enum la_yuv_downscale_output output;
+    if (dst_format == AV_PIX_FMT_YUV420P)
+    {
+        output = LA_YUV_DOWNSCALE_YUV420P;
+    }
+    else if (dst_format == AV_PIX_FMT_RGB24)
+    {
+        output = LA_YUV_DOWNSCALE_RGB24;
+    }
+    else
+    {
+        return false;
+    }
+
+    bool src_range = src_frame->color_range == AVCOL_RANGE_JPEG
+                  || src_frame->format == AV_PIX_FMT_YUVJ420P;
+    enc->use_downscale =
+        la_yuv_downscale_init(&enc->downscale, src_frame->width,
+                              src_frame->height, src_range, enc->frame->width,
+                              enc->frame->height, output, dst_range);
+    return enc->use_downscale;
+}
+
+// (Re)create the session for the given source geometry
+static bool la_preview_encoder_open_session(struct la_preview_encoder *enc,
+                                            const AVFrame *src_frame,
+                                            enum la_preview_format format,
+                                            uint8_t ratio,
+                                            uint8_t quality)
+{
+    la_preview_encoder_close_session(enc);
+
+    // Calculate scaled dimensions based on ratio (1-100)
+    int width = (src_frame->width * ratio) / 100;
+    int height = (src_frame->height * ratio) / 100;
+
+    // Ensure minimum dimensions
+    if (width < 1) width = 1;
+    if (height < 1) height = 1;
+
+    enum la_preview_format image_format = format;
+    const AVCodec *codec = la_preview_find_encoder(image_format);
+    if (!codec && image_format == LA_PREVIEW_FORMAT_WEBP)
+    {
+        LOGW("WebP encoder not available (FFmpeg built without libwebp), "
+             "falling back to PNG");
+        image_format = LA_PREVIEW_FORMAT_PNG;
+        codec = la_preview_find_encoder(image_format);
+    }
+    if (!codec)
+    {
+        LOGE("%s codec not found", la_preview_format_name(image_format));
+        return false;
+    }
+
+    LOGD("Preview encode: original=%dx%d, ratio=%d%%, scaled=%dx%d, "
+         "format=%s, quality=%u",
+         src_frame->width, src_frame->height, ratio, width, height,
+         la_preview_format_name(image_format), quality);
+
+    enc->codec_ctx = avcodec_alloc_context3(codec);
+    if (!enc->codec_ctx)
+    {
+        LOG_OOM();
+        return false;
+    }
+
+    enc->codec_ctx->width = width;
+    enc->codec_ctx->height = height;
+    enc->codec_ctx->time_base = (AVRational){1, 1};
+
+    AVDictionary *opts =
+        la_preview_configure_codec(enc->codec_ctx, image_format, quality);
+    int ret = avcodec_open2(enc->codec_ctx, codec, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+    {
+        LOGE("Failed to open %s codec", la_preview_format_name(image_format));
+        goto error;
+    }
+
+    enum AVPixelFormat dst_format = enc->codec_ctx->pix_fmt;
+    int src_range = src_frame->color_range == AVCOL_RANGE_JPEG;
+    int dst_range = enc->codec_ctx->color_range == AVCOL_RANGE_JPEG;
+
+    // A decoded YUV 4:2:0 frame at ratio 100 can be given to the JPEG/WebP
+    // encoder directly if its color range matches
+    bool passthrough = width == src_frame->width
+                    && height == src_frame->height
+                    && src_frame->format == dst_format
+                    && dst_format != AV_PIX_FMT_RGB24
+                    && src_range == dst_range;
+    if (!passthrough)
+    {
+        enc->frame->format = dst_format;
+        enc->frame->width = width;
+        enc->frame->height = height;
+
+        if (av_frame_get_buffer(enc->frame, 32) < 0)
+        {
+            LOGE("Failed to allocate preview frame buffer");
+            goto error;
+        }
+
+        if (la_preview_encoder_init_downscale(enc, src_frame, dst_format,
+                                              dst_range))
+        {
+            LOGD("Preview scaled by the fast YUV downscaler");
+        }
+        else
+        {
+            enc->sws_ctx = sws_getContext(src_frame->width, src_frame->height,
+                                          src_frame->format,
+                                          width, height, dst_format,
+                                          SWS_BILINEAR, NULL, NULL, NULL);
+            if (!enc->sws_ctx)
+            {
+                LOGE("Failed to create swscale context");
+                goto error;
+            }
+
+            const int *coefs = sws_getCoefficients(SWS_CS_DEFAULT);
+            sws_setColorspaceDetails(enc->sws_ctx, coefs, src_range, coefs,
+                                     dst_range, 0, 1 << 16, 1 << 16);
+        }
+    }
+
+    enc->src_width = src_frame->width;
+    enc->src_height = src_frame->height;
+    enc->src_format = src_frame->format;
+    enc->src_range = src_frame->color_range;
+    enc->ratio = ratio;
+    enc->format = format;
+    enc->quality = quality;
+    enc->image_format = image_format;
+    enc->width = width;
+    enc->height = height;
+
+    return true;
+
+error:
+    la_preview_encoder_close_session(enc);
+    return false;
+}
+
+static bool la_preview_encoder_session_matches(struct la_preview_encoder *enc,
+                                               const AVFrame *src_frame,
+                                               enum la_preview_format format,
+                                               uint8_t ratio,
+                                               uint8_t quality)
+{
+    return enc->src_width == src_frame->width
+        && enc->src_height == src_frame->height
+        && enc->src_format == src_frame->format
+        && enc->src_range == (int)src_frame->color_range
+        && enc->ratio == ratio
+        && enc->format == format
+        && enc->quality == quality;
+}
+
+bool la_preview_encoder_init(struct la_preview_encoder *enc)
+{
+    memset(enc, 0, sizeof(*enc));
+
+    enc->frame = av_frame_alloc();
+    if (!enc->frame)
+    {
+        LOG_OOM();
+        return false;
+    }
+
+    enc->packet = av_packet_alloc();
+    if (!enc->packet)
+    {
+        LOG_OOM();
+        av_frame_free(&enc->frame);
+        return false;
+    }
+
+    return true;
+}
+
+bool la_preview_encoder_prepare(struct la_preview_encoder *enc,
+                                const AVFrame *src_frame,
+                                enum la_preview_format format,
+                                uint8_t ratio,
+                                uint8_t quality)
+{
+    if (!src_frame || src_frame->width <= 0 || src_frame->height <= 0)
+    {
+        return false;
+    }
+
+    if (la_preview_encoder_session_matches(enc, src_frame, format, ratio,
+                                           quality))
+    {
+        return true;
+    }
+
+    return la_preview_encoder_open_session(enc, src_frame, format, ratio,
+                                           quality);
+}
+
+const AVFrame *la_preview_encoder_scale(struct la_preview_encoder *enc,
+                                        const AVFrame *src_frame,
+                                        enum la_preview_format format,
+                                        uint8_t ratio,
+                                        uint8_t quality)
+{
+    if (!la_preview_encoder_prepare(enc, src_frame, format, ratio, quality))
+    {
+        return NULL;
+    }
+
+    if (!enc->sws_ctx && !enc->use_downscale)
+    {
+        return src_frame;
+    }
+
+    // The encoder may still reference the buffer of the previous preview
+    if (av_frame_make_writable(enc->frame) < 0)
+    {
+        LOGE("Failed to make preview frame writable");
+        return NULL;
+    }
+
+    if (enc->use_downscale)
+    {
+        la_yuv_downscale_process(&enc->downscale,
+                                 (const uint8_t *const *)src_frame->data,
+                                 src_frame->linesize, enc->frame->data,
+                                 enc->frame->linesize);
+    }
+    else
+    {
+        sws_scale(enc->sws_ctx,
+                  (const uint8_t *const *)src_frame->data,
+                  src_frame->linesize,
+                  0, src_frame->height,
+                  enc->frame->data,
+                  enc->frame->linesize);
+    }
+
+    return enc->frame;
+}
+
+const AVPacket *la_preview_encoder_encode_frame(struct la_preview_encoder *enc,
+                                                const AVFrame *frame)
+{
+    assert(enc->codec_ctx);
+    assert(frame->width == enc->width && frame->height == enc->height);
+
+    // Release the previous image
+    av_packet_unref(enc->packet);
+
+    int ret = avcodec_send_frame(enc->codec_ctx, frame);
+    if (ret < 0)
+    {
+        LOGE("Error sending frame for encoding: %d", ret);
+        return NULL;
+    }
+
+    ret = avcodec_receive_packet(enc->codec_ctx, enc->packet);
+    if (ret < 0)
+    {
+        LOGE("Error receiving packet from encoder: %d", ret);
+        return NULL;
+    }
+
+    return enc->packet;
+}
+
+const AVPacket *la_preview_encoder_encode(struct la_preview_encoder *enc,
+                                          const AVFrame *src_frame,
+                                          enum la_preview_format format,
+                                          uint8_t ratio,
+                                          uint8_t quality)
+{
+    const AVFrame *frame = la_preview_encoder_scale(enc, src_frame, format,
+                                                    ratio, quality);
+    if (!frame)
+    {
+        return NULL;
+    }
+
+    return la_preview_encoder_encode_frame(enc, frame);
+}
+
+void la_preview_encoder_destroy(struct la_preview_encoder *enc)
+{
+    la_preview_encoder_close_session(enc);
+    av_packet_free(&enc->packet);
+    av_frame_free(&enc->frame);
+}
+
+char *la_preview_make_data_url(enum la_preview_format format,
+                               const uint8_t *data, size_t size)
+{
+    char *base64_data = base64_encode(data, size);
+    if (!base64_data)
+    {
+        return NULL;
+    }
+
+    // Prepend data:image/<format>;base64, prefix
+    char prefix[32];
+    int prefix_len = snprintf(prefix, sizeof(prefix),
+                              "data:image/%s;base64,",
+                              la_preview_format_name(format));
+    size_t base64_len = strlen(base64_data);
+    char *prefixed_data = malloc(prefix_len + base64_len + 1);
+    if (!prefixed_data)
+    {
+        free(base64_data);
+        return NULL;
+    }
+    memcpy(prefixed_data, prefix, prefix_len);
+    memcpy(prefixed_data + prefix_len, base64_data, base64_len + 1);
+    free(base64_data);
+
+    return prefixed_data;
+}
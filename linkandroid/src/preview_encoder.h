@@ -0,0 +1,166 @@
+#ifndef LA_PREVIEW_ENCODER_H
+#define LA_PREVIEW_ENCODER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "yuv_downscale.h"
+
+// forward declarations
+typedef struct AVCodecContext AVCodecContext;
+typedef struct AVFrame AVFrame;
+typedef struct AVPacket AVPacket;
+struct SwsContext;
+
+// The values are sent as-is in binary preview messages
+enum la_preview_format
+{
+    LA_PREVIEW_FORMAT_PNG = 0,
+    LA_PREVIEW_FORMAT_JPEG = 1,
+    LA_PREVIEW_FORMAT_WEBP = 2,
+};
+
+#define LA_PREVIEW_DEFAULT_QUALITY 80
+
+/**
+ * Long-lived preview encoder session
+ *
+ * The codec context, scaler and frame/packet buffers are kept across
+ * previews, and rebuilt only when the session geometry (source size, source
+ * pixel format, ratio, image format or quality) changes.
+ */
+struct la_preview_encoder
+{
+    AVCodecContext *codec_ctx;
+    // YUV 4:2:0 sources are scaled by the fast downscaler when possible,
+    // other sources (or upscales) by swscale
+    bool use_downscale;
+    struct la_yuv_downscale downscale;
+    struct SwsContext *sws_ctx; // NULL if not used
+    AVFrame *frame;   // Scaled frame given to the encoder
+    AVPacket *packet; // Last encoded image
+
+    // Session geometry (the codec context is valid only if src_width != 0)
+    int src_width;
+    int src_height;
+    int src_format;
+    int src_range;
+    uint8_t ratio;
+    enum la_preview_format format; // Requested format
+    uint8_t quality;
+    enum la_preview_format image_format; // Actual format of the images
+    int width;  // Scaled width
+    int height; // Scaled height
+};
+
+/**
+ * Return the image format name ("png", "jpeg" or "webp"), which is also the
+ * MIME subtype
+ */
+const char *la_preview_format_name(enum la_preview_format format);
+
+/**
+ * Initialize a preview encoder (the session is created on first encode)
+ *
+ * @param enc Preview encoder instance
+ * @return true on success, false on failure
+ */
+bool la_preview_encoder_init(struct la_preview_encoder *enc);
+
+/**
+ * Encode a frame
+ *
+ * JPEG and WebP are encoded from YUV 4:2:0 (no RGB conversion). If the WebP
+ * encoder (libwebp) is not available, PNG is used instead: the actual format
+ * is available in enc->image_format after the call.
+ *
+ * The returned packet is owned by the encoder and remains valid until the
+ * next call to la_preview_encoder_encode() or la_preview_encoder_destroy().
+ *
+ * @param enc Preview encoder instance
+ * @param src_frame Decoded frame (any format supported by swscale)
+ * @param format Image format
+ * @param ratio Preview resolution ratio (1-100, 100 = original)
+ * @param quality Image quality (1-100, ignored for PNG)
+ * @return the encoded image, or NULL on failure
+ */
+const AVPacket *la_preview_encoder_encode(struct la_preview_encoder *enc,
+                                          const AVFrame *src_frame,
+                                          enum la_preview_format format,
+                                          uint8_t ratio,
+                                          uint8_t quality);
+
+/**
+ * (Re)create the session for a frame if needed, without scaling it
+ *
+ * Once it returns true, enc->width, enc->height and enc->image_format are
+ * valid for this frame, so that the caller may decide whether to scale and
+ * encode it at all.
+ *
+ * @param enc Preview encoder instance
+ * @param src_frame Decoded frame (any format supported by swscale)
+ * @param format Image format
+ * @param ratio Preview resolution ratio (1-100, 100 = original)
+ * @param quality Image quality (1-100, ignored for PNG)
+ * @return true on success, false on failure
+ */
+bool la_preview_encoder_prepare(struct la_preview_encoder *enc,
+                                const AVFrame *src_frame,
+                                enum la_preview_format format,
+                                uint8_t ratio,
+                                uint8_t quality);
+
+/**
+ * Scale a frame to the session geometry, without encoding it
+ *
+ * The session is (re)created if needed, so that enc->width, enc->height and
+ * enc->image_format are valid after the call.
+ *
+ * The returned frame is either src_frame itself (if it can be encoded as is)
+ * or a frame owned by the encoder, valid until the next call.
+ *
+ * @param enc Preview encoder instance
+ * @param src_frame Decoded frame (any format supported by swscale)
+ * @param format Image format
+ * @param ratio Preview resolution ratio (1-100, 100 = original)
+ * @param quality Image quality (1-100, ignored for PNG)
+ * @return the frame to encode, or NULL on failure
+ */
+const AVFrame *la_preview_encoder_scale(struct la_preview_encoder *enc,
+                                        const AVFrame *src_frame,
+                                        enum la_preview_format format,
+                                        uint8_t ratio,
+                                        uint8_t quality);
+
+/**
+ * Encode a frame returned by la_preview_encoder_scale()
+ *
+ * The frame may also be any frame with the same size and pixel format.
+ *
+ * @param enc Preview encoder instance
+ * @param frame Frame to encode
+ * @return the encoded image, or NULL on failure
+ */
+const AVPacket *la_preview_encoder_encode_frame(struct la_preview_encoder *enc,
+                                                const AVFrame *frame);
+
+/**
+ * Encode an image as a data URL ("data:image/<format>;base64,...")
+ *
+ * @param format Image format
+ * @param data Image data
+ * @param size Image size in bytes
+ * @return the data URL (to be released by free()), or NULL on failure
+ */
+char *la_preview_make_data_url(enum la_preview_format format,
+                               const uint8_t *data, size_t size);
+
+/**
+ * Destroy preview encoder and free resources
+ *
+ * @param enc Preview encoder instance
+ */
+void la_preview_encoder_destroy(struct la_preview_encoder *enc);
+
+#endif
@@ -1,518 +1,889 @@
-#define _DEFAULT_SOURCE
-
 #include "preview_sender.h"
 
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 #include <SDL3/SDL.h>
 #include <libavcodec/avcodec.h>
+#include <libavutil/hwcontext.h>
 #include <libavutil/imgutils.h>
-#include <libswscale/swscale.h>
+#include <libavutil/pixdesc.h>
 
 #include "websocket_client.h"
-#include "../../app/src/screen.h"
 #include "../../app/src/util/log.h"
+#include "../../app/src/util/trace.h"
+
+/** Downcast frame_sink to la_preview_sender */
+#define DOWNCAST(SINK) container_of(SINK, struct la_preview_sender, frame_sink)
 
-// Base64 encoding table
-static const char base64_chars[] =
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static uint64_t la_preview_sender_timestamp_ms(void)
+{
+    SDL_Time now = 0;
+    SDL_GetCurrentTime(&now);
+    return now > 0 ? (uint64_t)now / 1000000 : 0;
+}
 
-// Base64 encode function
-static char *base64_encode(const unsigned char *data, size_t input_length)
+// Send an encoded full image to the WebSocket server
+static bool la_preview_sender_send_image(struct la_preview_sender *sender,
+                                         const AVPacket *image)
 {
-    size_t output_length = 4 * ((input_length + 2) / 3);
-    char *encoded_data = malloc(output_length + 1);
-    if (!encoded_data)
+    // May differ from the requested format (WebP fallback)
+    enum la_preview_format image_format = sender->encoder.image_format;
+    const char *format_name = la_preview_format_name(image_format);
+    size_t image_size = image->size;
+
+    if (sender->binary)
     {
-        return NULL;
+        bool sent = la_websocket_client_send_preview_binary(
+            sender->ws_client, sender->serial, image_format,
+            sender->encoder.width, sender->encoder.height,
+            la_preview_sender_timestamp_ms(), image->data, image_size);
+        if (sent)
+        {
+            LOGD("Binary preview sent to server (%s, size: %zu bytes)",
+                 format_name, image_size);
+        }
+        else
+        {
+            LOGW("Failed to send preview to server");
+        }
+        return sent;
     }
 
-    for (size_t i = 0, j = 0; i < input_length;)
+    char *prefixed_data = la_preview_make_data_url(image_format, image->data,
+                                                   image_size);
+    if (!prefixed_data)
     {
-        uint32_t octet_a = i < input_length ? data[i++] : 0;
-        uint32_t octet_b = i < input_length ? data[i++] : 0;
-        uint32_t octet_c = i < input_length ? data[i++] : 0;
-
-        uint32_t triple = (octet_a << 16) + (octet_b << 8) + octet_c;
-
-        encoded_data[j++] = base64_chars[(triple >> 18) & 0x3F];
-        encoded_data[j++] = base64_chars[(triple >> 12) & 0x3F];
-        encoded_data[j++] = base64_chars[(triple >> 6) & 0x3F];
-        encoded_data[j++] = base64_chars[triple & 0x3F];
+        LOGE("Failed to base64 encode image data");
+        return false;
     }
 
-    // Add padding
-    for (size_t i = 0; i < (3 - input_length % 3) % 3; i++)
+    // Send to WebSocket server
+    bool sent = la_websocket_client_send_preview(sender->ws_client,
+                                                 sender->serial,
+                                                 prefixed_data,
+                                                 format_name);
+    if (sent)
     {
-        encoded_data[output_length - 1 - i] = '=';
+        LOGD("Preview sent to server (%s, size: %zu bytes)", format_name,
+             image_size);
+    }
+    else
+    {
+        LOGW("Failed to send preview to server");
     }
 
-    encoded_data[output_length] = '\0';
-    return encoded_data;
+    free(prefixed_data);
+    return sent;
 }
 
-// Encode AVFrame directly to PNG (without going through SDL)
-static bool encode_avframe_to_png(const AVFrame *src_frame,
-                                  uint8_t ratio,
-                                  unsigned char **out_data,
-                                  size_t *out_size)
+// The changed tiles are detected on the luma plane of the decoded frame
+static bool la_preview_sender_can_diff(const AVFrame *frame)
 {
-    if (!src_frame || !out_data || !out_size)
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+    return desc
+        && !(desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL
+                            | AV_PIX_FMT_FLAG_HWACCEL))
+        && desc->comp[0].plane == 0
+        && desc->comp[0].depth == 8
+        && desc->comp[0].step == 1;
+}
+
+// Clear the cells [from, to) of the atlas (the cells not covered by a tile
+// are encoded too: keep them uniform)
+static void la_preview_sender_clear_cells(AVFrame *atlas, unsigned cols,
+                                          unsigned from, unsigned to)
+{
+    enum AVPixelFormat format = atlas->format;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    int planes = av_pix_fmt_count_planes(format);
+
+    for (unsigned i = from; i < to; ++i)
     {
-        return false;
+        int atlas_x = (i % cols) * LA_TILE_SIZE;
+        int atlas_y = (i / cols) * LA_TILE_SIZE;
+
+        for (int p = 0; p < planes; ++p)
+        {
+            bool chroma = p == 1 || p == 2;
+            int shift = chroma ? desc->log2_chroma_h : 0;
+            int dst_x = av_image_get_linesize(format, atlas_x, p);
+            int bytes = av_image_get_linesize(format, LA_TILE_SIZE, p);
+            uint8_t *data = atlas->data[p]
+                          + (atlas_y >> shift) * atlas->linesize[p] + dst_x;
+            for (int line = 0; line < LA_TILE_SIZE >> shift; ++line)
+            {
+                memset(data + line * atlas->linesize[p], 0, bytes);
+            }
+        }
     }
+}
 
-    int orig_width = src_frame->width;
-    int orig_height = src_frame->height;
-    
-    // Calculate scaled dimensions based on ratio (1-100)
-    int scaled_width = (orig_width * ratio) / 100;
-    int scaled_height = (orig_height * ratio) / 100;
-    
-    // Ensure minimum dimensions
-    if (scaled_width < 1) scaled_width = 1;
-    if (scaled_height < 1) scaled_height = 1;
-    
-    static bool first_log = true;
-    if (first_log)
-    {
-        LOGI("Preview encode: original=%dx%d, ratio=%d%%, scaled=%dx%d",
-             orig_width, orig_height, ratio, scaled_width, scaled_height);
-        first_log = false;
+// Allocate the atlas and the tile positions for the current grid
+//
+// Their size does not depend on the number of changed tiles, so that they
+// (and the tiles encoder session) are reused across tiles messages: the atlas
+// has the columns of the grid, and enough rows for the largest tiles message
+// (beyond half of the tiles, a full image is sent instead).
+static bool la_preview_sender_prepare_atlas(struct la_preview_sender *sender,
+                                            enum AVPixelFormat format)
+{
+    struct la_tile_diff *td = &sender->tile_diff;
+    unsigned cols = td->cols;
+    unsigned max_tiles = (unsigned)(td->cols * td->rows) / 2;
+    unsigned rows = (max_tiles + cols - 1) / cols;
+    int width = cols * LA_TILE_SIZE;
+    int height = rows * LA_TILE_SIZE;
+
+    AVFrame *atlas = sender->atlas;
+    if (atlas->width == width && atlas->height == height
+        && atlas->format == format)
+    {
+        if (av_frame_make_writable(atlas) < 0)
+        {
+            // The encoder may still reference the previous buffer
+            LOGE("Failed to make preview tiles frame writable");
+            return false;
+        }
+        return true;
     }
 
-    // Find PNG encoder
-    const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_PNG);
-    if (!codec)
+    uint16_t *positions = realloc(sender->tile_positions,
+                                  2 * max_tiles * sizeof(*positions));
+    if (!positions)
     {
-        LOGE("PNG codec not found");
+        LOG_OOM();
         return false;
     }
+    sender->tile_positions = positions;
 
-    AVCodecContext *codec_ctx = avcodec_alloc_context3(codec);
-    if (!codec_ctx)
+    av_frame_unref(atlas);
+    atlas->format = format;
+    atlas->width = width;
+    atlas->height = height;
+    if (av_frame_get_buffer(atlas, 32) < 0)
     {
-        LOGE("Failed to allocate codec context");
+        LOGE("Failed to allocate preview tiles frame");
+        av_frame_unref(atlas);
         return false;
     }
 
-    codec_ctx->width = scaled_width;
-    codec_ctx->height = scaled_height;
-    codec_ctx->pix_fmt = AV_PIX_FMT_RGB24; // PNG works well with RGB24
-    codec_ctx->time_base = (AVRational){1, 1};
-    codec_ctx->compression_level = 3; // Balanced compression
+    la_preview_sender_clear_cells(atlas, cols, 0, cols * rows);
+    sender->atlas_filled = 0;
+    return true;
+}
 
-    if (avcodec_open2(codec_ctx, codec, NULL) < 0)
-    {
-        LOGE("Failed to open PNG codec");
-        avcodec_free_context(&codec_ctx);
-        return false;
-    }
+// Copy the changed tiles of the scaled frame into the atlas, and fill their
+// positions
+static bool la_preview_sender_pack_tiles(struct la_preview_sender *sender,
+                                         const AVFrame *scaled)
+{
+    struct la_tile_diff *td = &sender->tile_diff;
+    unsigned count = td->changed_count;
+    assert(count);
+    // Otherwise, a full image is sent
+    assert(count * 2 <= (unsigned)(td->cols * td->rows));
 
-    // Allocate frame for encoding
-    AVFrame *rgb_frame = av_frame_alloc();
-    if (!rgb_frame)
+    if (!la_preview_sender_prepare_atlas(sender, scaled->format))
     {
-        LOGE("Failed to allocate RGB frame");
-        avcodec_free_context(&codec_ctx);
         return false;
     }
 
-    rgb_frame->format = codec_ctx->pix_fmt;
-    rgb_frame->width = scaled_width;
-    rgb_frame->height = scaled_height;
+    AVFrame *atlas = sender->atlas;
+    uint16_t *positions = sender->tile_positions;
+    unsigned cols = td->cols;
 
-    if (av_frame_get_buffer(rgb_frame, 32) < 0)
-    {
-        LOGE("Failed to allocate RGB frame buffer");
-        av_frame_free(&rgb_frame);
-        avcodec_free_context(&codec_ctx);
-        return false;
-    }
+    // Same color range as the scaled frame, so that it is encoded as is
+    atlas->color_range = sender->encoder.codec_ctx->color_range;
 
-    // Use swscale to convert and scale
-    struct SwsContext *sws_ctx = sws_getContext(
-        orig_width, orig_height, src_frame->format,
-        scaled_width, scaled_height, AV_PIX_FMT_RGB24,
-        SWS_BILINEAR, NULL, NULL, NULL);
+    enum AVPixelFormat format = scaled->format;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    int planes = av_pix_fmt_count_planes(format);
 
-    if (!sws_ctx)
+    for (unsigned i = 0; i < count; ++i)
     {
-        LOGE("Failed to create swscale context");
-        av_frame_free(&rgb_frame);
-        avcodec_free_context(&codec_ctx);
-        return false;
-    }
+        int x, y, w, h;
+        la_tile_diff_get_rect(td, td->changed[i], &x, &y, &w, &h);
+        int atlas_x = (i % cols) * LA_TILE_SIZE;
+        int atlas_y = (i / cols) * LA_TILE_SIZE;
 
-    sws_scale(sws_ctx,
-              (const uint8_t *const *)src_frame->data,
-              src_frame->linesize,
-              0, orig_height,
-              rgb_frame->data,
-              rgb_frame->linesize);
+        for (int p = 0; p < planes; ++p)
+        {
+            // The tile positions are multiples of LA_TILE_SIZE, so they are
+            // exact in the subsampled chroma planes
+            bool chroma = p == 1 || p == 2;
+            int shift = chroma ? desc->log2_chroma_h : 0;
+            int src_x = av_image_get_linesize(format, x, p);
+            int dst_x = av_image_get_linesize(format, atlas_x, p);
+            int bytes = av_image_get_linesize(format, w, p);
+            av_image_copy_plane(atlas->data[p]
+                                    + (atlas_y >> shift) * atlas->linesize[p]
+                                    + dst_x,
+                                atlas->linesize[p],
+                                scaled->data[p]
+                                    + (y >> shift) * scaled->linesize[p]
+                                    + src_x,
+                                scaled->linesize[p],
+                                bytes, AV_CEIL_RSHIFT(h, shift));
+        }
 
-    sws_freeContext(sws_ctx);
+        positions[2 * i] = x / LA_TILE_SIZE;
+        positions[2 * i + 1] = y / LA_TILE_SIZE;
+    }
 
-    // Encode frame to PNG
-    AVPacket *pkt = av_packet_alloc();
-    if (!pkt)
+    // Clear the tiles of the previous message which are not overwritten
+    if (count < sender->atlas_filled)
     {
-        LOGE("Failed to allocate packet");
-        av_frame_free(&rgb_frame);
-        avcodec_free_context(&codec_ctx);
-        return false;
+        la_preview_sender_clear_cells(atlas, cols, count,
+                                      sender->atlas_filled);
     }
+    sender->atlas_filled = count;
 
-    int ret = avcodec_send_frame(codec_ctx, rgb_frame);
-    av_frame_free(&rgb_frame);
+    return true;
+}
 
-    if (ret < 0)
-    {
-        LOGE("Error sending frame for encoding");
-        av_packet_free(&pkt);
-        avcodec_free_context(&codec_ctx);
-        return false;
-    }
+// Encode and send the changed tiles, return true if they have been sent
+static bool la_preview_sender_send_tiles(struct la_preview_sender *sender,
+                                         const AVFrame *scaled)
+{
+    struct la_tile_diff *td = &sender->tile_diff;
 
-    ret = avcodec_receive_packet(codec_ctx, pkt);
-    if (ret < 0)
+    if (!la_preview_sender_pack_tiles(sender, scaled))
     {
-        LOGE("Error receiving packet from encoder");
-        av_packet_free(&pkt);
-        avcodec_free_context(&codec_ctx);
         return false;
     }
 
-    // Copy encoded data
-    *out_size = pkt->size;
-    *out_data = malloc(pkt->size);
-    if (!*out_data)
+    // The atlas is already scaled, and in the actual image format
+    enum la_preview_format image_format = sender->encoder.image_format;
+    const AVPacket *image = la_preview_encoder_encode(&sender->tile_encoder,
+                                                      sender->atlas,
+                                                      image_format, 100,
+                                                      sender->quality);
+    if (!image)
     {
-        LOGE("Failed to allocate output buffer");
-        av_packet_free(&pkt);
-        avcodec_free_context(&codec_ctx);
+        LOGW("Failed to encode preview tiles");
         return false;
     }
-    memcpy(*out_data, pkt->data, pkt->size);
-
-    av_packet_free(&pkt);
-    avcodec_free_context(&codec_ctx);
 
-    return true;
-}
+    struct la_preview_tiles tiles = {
+        .format = image_format,
+        .width = sender->encoder.width,
+        .height = sender->encoder.height,
+        .tile_size = LA_TILE_SIZE,
+        .count = td->changed_count,
+        .columns = td->cols,
+        .positions = sender->tile_positions,
+        .timestamp_ms = la_preview_sender_timestamp_ms(),
+        .serial = sender->serial,
+    };
 
-// Capture frame from SDL renderer and encode to PNG (DEPRECATED - kept for fallback)
-static bool capture_and_encode_png(SDL_Renderer *renderer,
-                                   const SDL_Rect *rect,
-                                   uint8_t ratio,
-                                   unsigned char **out_data,
-                                   size_t *out_size)
-{
-    int width = rect->w;
-    int height = rect->h;
-    
-    // Calculate scaled dimensions based on ratio (1-100)
-    int scaled_width = (width * ratio) / 100;
-    int scaled_height = (height * ratio) / 100;
-    
-    // Ensure minimum dimensions
-    if (scaled_width < 1) scaled_width = 1;
-    if (scaled_height < 1) scaled_height = 1;
-    
-    static bool first_log = true;
-    if (first_log) {
-        LOGI("Preview capture: original=%dx%d, ratio=%d%%, scaled=%dx%d",
-             width, height, ratio, scaled_width, scaled_height);
-        first_log = false;
-    }
-
-    // Read pixels from renderer (SDL3 creates the surface directly)
-    SDL_Surface *surface = SDL_RenderReadPixels(renderer, rect);
-    if (!surface)
-    {
-        LOGE("Failed to read pixels from renderer: %s", SDL_GetError());
-        return false;
+    bool sent;
+    if (sender->binary)
+    {
+        sent = la_websocket_client_send_preview_tiles_binary(
+            sender->ws_client, &tiles, image->data, image->size);
     }
-    
-    // Create scaled surface if ratio != 100
-    SDL_Surface *final_surface = surface;
-    if (ratio != 100)
+    else
     {
-        final_surface = SDL_CreateSurface(scaled_width, scaled_height, SDL_PIXELFORMAT_ARGB8888);
-        if (!final_surface)
+        char *data_url = la_preview_make_data_url(image_format, image->data,
+                                                  image->size);
+        if (!data_url)
         {
-            LOGE("Failed to create scaled surface: %s", SDL_GetError());
-            SDL_DestroySurface(surface);
+            LOGE("Failed to base64 encode image data");
             return false;
         }
-        
-        // Scale the surface using SDL_BlitSurfaceScaled
-        SDL_Rect dst_rect = {0, 0, scaled_width, scaled_height};
-        if (!SDL_BlitSurfaceScaled(surface, NULL, final_surface, &dst_rect, SDL_SCALEMODE_LINEAR))
+        sent = la_websocket_client_send_preview_tiles(sender->ws_client,
+                                                      &tiles, data_url);
+        free(data_url);
+    }
+
+    if (sent)
+    {
+        LOGD("Preview tiles sent to server (%u tiles, size: %d bytes)",
+             td->changed_count, image->size);
+    }
+    else
+    {
+        LOGW("Failed to send preview tiles to server");
+    }
+
+    return sent;
+}
+
+// Encode a frame and send it to the WebSocket server, return true if a
+// preview has been sent
+//
+// In tiles mode, full forces a full image.
+static bool la_preview_sender_send(struct la_preview_sender *sender,
+                                   const AVFrame *frame, bool full)
+{
+    if (!sender->tiles || !la_preview_sender_can_diff(frame))
+    {
+        // Encode frame (reusing the encoder session)
+        const AVPacket *image = la_preview_encoder_encode(&sender->encoder,
+                                                          frame,
+                                                          sender->format,
+                                                          sender->ratio,
+                                                          sender->quality);
+        if (!image)
         {
-            LOGE("Failed to scale surface: %s", SDL_GetError());
-            SDL_DestroySurface(final_surface);
-            SDL_DestroySurface(surface);
+            LOGW("Failed to encode preview frame");
             return false;
         }
-        
-        // Free original surface, we only need the scaled one
-        SDL_DestroySurface(surface);
-    }
 
-    // Encode to PNG using libavcodec with scaled dimensions
-    const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_PNG);
-    if (!codec)
-    {
-        LOGE("PNG codec not found");
-        SDL_DestroySurface(final_surface);
-        return false;
+        return la_preview_sender_send_image(sender, image);
     }
 
-    AVCodecContext *codec_ctx = avcodec_alloc_context3(codec);
-    if (!codec_ctx)
+    // The preview geometry is needed for the tiles, but the frame is scaled
+    // only once it is known to have changed
+    if (!la_preview_encoder_prepare(&sender->encoder, frame, sender->format,
+                                    sender->ratio, sender->quality))
     {
-        LOGE("Failed to allocate codec context");
-        SDL_DestroySurface(final_surface);
+        LOGW("Failed to encode preview frame");
         return false;
     }
 
-    codec_ctx->width = scaled_width;
-    codec_ctx->height = scaled_height;
-    codec_ctx->pix_fmt = AV_PIX_FMT_RGBA;
-    codec_ctx->time_base = (AVRational){1, 1};
-    codec_ctx->compression_level = 3; // 0-9: 0=no compression, 9=max compression, 3=balanced
+    struct la_tile_diff *td = &sender->tile_diff;
+    const uint8_t *luma = frame->data[0];
+    int linesize = frame->linesize[0];
 
-    if (avcodec_open2(codec_ctx, codec, NULL) < 0)
+    bool diff = la_tile_diff_configure(td, frame->width, frame->height,
+                                       sender->encoder.width,
+                                       sender->encoder.height);
+    if (!diff)
     {
-        LOGE("Failed to open codec");
-        avcodec_free_context(&codec_ctx);
-        SDL_DestroySurface(final_surface);
-        return false;
+        LOGW("Could not compare preview tiles, sending full images");
     }
 
-    AVFrame *frame = av_frame_alloc();
-    if (!frame)
+    sc_tick now = sc_tick_now();
+    bool keyframe = full || !diff || !td->has_ref
+                 || now >= sender->next_keyframe;
+    if (!keyframe)
     {
-        LOGE("Failed to allocate frame");
-        avcodec_free_context(&codec_ctx);
-        SDL_DestroySurface(final_surface);
-        return false;
-    }
+        unsigned count = la_tile_diff_compute(td, luma, linesize);
+        if (!count)
+        {
+            ++sender->unchanged;
+            LOGD("Preview unchanged, not sent");
+            return false;
+        }
 
-    frame->format = codec_ctx->pix_fmt;
-    frame->width = codec_ctx->width;
-    frame->height = codec_ctx->height;
+        // Beyond half of the tiles, a full image is not larger
+        keyframe = count * 2 > (unsigned)(td->cols * td->rows);
+    }
 
-    if (av_frame_get_buffer(frame, 32) < 0)
+    const AVFrame *scaled = la_preview_encoder_scale(&sender->encoder, frame,
+                                                     sender->format,
+                                                     sender->ratio,
+                                                     sender->quality);
+    if (!scaled)
     {
-        LOGE("Failed to allocate frame buffer");
-        av_frame_free(&frame);
-        avcodec_free_context(&codec_ctx);
-        SDL_DestroySurface(final_surface);
+        LOGW("Failed to encode preview frame");
         return false;
     }
 
-    // Copy SDL surface data to AVFrame (using scaled dimensions)
-    for (int y = 0; y < scaled_height; y++)
+    if (keyframe)
     {
-        memcpy(frame->data[0] + y * frame->linesize[0],
-               (uint8_t *)final_surface->pixels + y * final_surface->pitch,
-               scaled_width * 4);
-    }
+        const AVPacket *image =
+            la_preview_encoder_encode_frame(&sender->encoder, scaled);
+        if (!image)
+        {
+            LOGW("Failed to encode preview frame");
+            return false;
+        }
 
-    SDL_DestroySurface(final_surface);
+        bool sent = la_preview_sender_send_image(sender, image);
+        if (sent && diff)
+        {
+            la_tile_diff_commit(td, luma, linesize, true);
+            sender->next_keyframe =
+                now + SC_TICK_FROM_MS(sender->keyframe_interval_ms);
+            ++sender->keyframes;
+        }
+        return sent;
+    }
 
-    // Encode frame
-    AVPacket *pkt = av_packet_alloc();
-    if (!pkt)
+    if (!la_preview_sender_send_tiles(sender, scaled))
     {
-        LOGE("Failed to allocate packet");
-        av_frame_free(&frame);
-        avcodec_free_context(&codec_ctx);
+        // The server may have lost these tiles: resynchronize with a full
+        // image
+        la_tile_diff_invalidate(td);
         return false;
     }
 
-    int ret = avcodec_send_frame(codec_ctx, frame);
-    if (ret < 0)
+    la_tile_diff_commit(td, luma, linesize, false);
+    ++sender->tile_updates;
+    sender->tiles_sent += td->changed_count;
+    return true;
+}
+
+// Consume the pending frame into sender->frame if a preview may be sent now
+//
+// Must be called with the mutex locked, once a frame is pending and the
+// interval elapsed. Return false if the pending frame must be kept for the
+// next interval.
+static bool la_preview_sender_consume(struct la_preview_sender *sender)
+{
+    sc_mutex_assert(&sender->mutex);
+    assert(sender->has_frame);
+
+    sender->next_preview = sc_tick_now()
+                         + SC_TICK_FROM_MS(sender->interval_ms);
+
+    if (!la_websocket_client_is_connected(sender->ws_client))
     {
-        LOGE("Error sending frame for encoding");
-        av_packet_free(&pkt);
-        av_frame_free(&frame);
-        avcodec_free_context(&codec_ctx);
+        // A new connection starts with a full image
+        la_tile_diff_invalidate(&sender->tile_diff);
+        sender->fingerprint.width = 0;
+        // Keep the pending frame, it will be sent once connected
         return false;
     }
 
-    ret = avcodec_receive_packet(codec_ctx, pkt);
-    if (ret < 0)
+    if (la_websocket_client_is_backpressured(sender->ws_client))
     {
-        LOGE("Error receiving packet from encoder");
-        av_packet_free(&pkt);
-        av_frame_free(&frame);
-        avcodec_free_context(&codec_ctx);
+        // The previous previews are not sent yet: do not even encode this
+        // one, retry with the latest frame on the next interval
+        ++sender->skipped;
+        LOGD("Preview skipped (WebSocket backpressure)");
         return false;
     }
 
-    // Copy encoded data
-    *out_size = pkt->size;
-    *out_data = malloc(pkt->size);
-    if (!*out_data)
+    sender->has_frame = false;
+    sc_frame_buffer_consume(&sender->fb, sender->frame);
+    return true;
+}
+
+// Encode and send the consumed frame (without the mutex locked)
+static void la_preview_sender_process(struct la_preview_sender *sender)
+{
+    const AVFrame *frame = sender->frame;
+    if (sender->frame->hw_frames_ctx)
     {
-        LOGE("Failed to allocate output buffer");
-        av_packet_free(&pkt);
-        av_frame_free(&frame);
-        avcodec_free_context(&codec_ctx);
-        return false;
+        // Hardware frame: download it only now that it will be encoded
+        int r = av_hwframe_transfer_data(sender->sw_frame, sender->frame, 0);
+        if (r < 0)
+        {
+            LOGW("Could not download hardware frame for preview");
+            av_frame_unref(sender->frame);
+            return;
+        }
+        av_frame_copy_props(sender->sw_frame, sender->frame);
+        frame = sender->sw_frame;
+    }
+
+    // Skip the previews visually identical to the last one sent, except once
+    // per max staleness period (heartbeat)
+    struct la_luma_fingerprint fingerprint;
+    bool heartbeat = false;
+    bool has_fingerprint = sender->max_staleness_ms
+                        && la_preview_sender_can_diff(frame);
+    if (has_fingerprint)
+    {
+        la_luma_fingerprint_compute(&fingerprint, frame->data[0],
+                                    frame->linesize[0], frame->width,
+                                    frame->height);
+        if (sender->fingerprint.width
+            && la_luma_fingerprint_equals(&fingerprint, &sender->fingerprint))
+        {
+            sc_tick max_staleness = SC_TICK_FROM_MS(sender->max_staleness_ms);
+            if (sc_tick_now() < sender->last_sent + max_staleness)
+            {
+                ++sender->static_skipped;
+                LOGD("Preview skipped (screen unchanged)");
+                av_frame_unref(sender->sw_frame);
+                av_frame_unref(sender->frame);
+                return;
+            }
+            heartbeat = true;
+        }
     }
-    memcpy(*out_data, pkt->data, pkt->size);
 
-    av_packet_free(&pkt);
-    av_frame_free(&frame);
-    avcodec_free_context(&codec_ctx);
-
-    return true;
+    // The heartbeat is a full image, even in tiles mode
+    sc_tick trace_start = sc_trace_begin();
+    bool sent = la_preview_sender_send(sender, frame, heartbeat);
+    sc_trace_end("preview encode", trace_start);
+    if (sent)
+    {
+        sender->last_sent = sc_tick_now();
+        if (has_fingerprint)
+        {
+            sender->fingerprint = fingerprint;
+        }
+        else
+        {
+            sender->fingerprint.width = 0;
+        }
+    }
+    av_frame_unref(sender->sw_frame);
+    av_frame_unref(sender->frame);
 }
 
-// Preview sender thread function
-static void *preview_sender_thread(void *arg)
+static int run_preview_sender(void *data)
 {
-    struct la_preview_sender *sender = (struct la_preview_sender *)arg;
+    struct la_preview_sender *sender = data;
 
     LOGI("LinkAndroid preview sender thread started (interval: %u ms)",
          sender->interval_ms);
 
-    while (sender->running)
+    for (;;)
     {
-        // Wait for the interval
-        usleep(sender->interval_ms * 1000);
+        sc_mutex_lock(&sender->mutex);
 
-        if (!sender->running)
+        // Wait for a new frame, and for the interval since the last preview
+        // (frames received meanwhile replace the pending one)
+        while (!sender->stopped
+               && (!sender->has_frame || sc_tick_now() < sender->next_preview))
         {
-            break;
+            if (sender->has_frame)
+            {
+                sc_cond_timedwait(&sender->cond, &sender->mutex,
+                                  sender->next_preview);
+            }
+            else
+            {
+                sc_cond_wait(&sender->cond, &sender->mutex);
+            }
         }
 
-        // Check if WebSocket is connected
-        if (!la_websocket_client_is_connected(sender->ws_client))
+        if (sender->stopped)
         {
-            continue;
+            sc_mutex_unlock(&sender->mutex);
+            break;
         }
 
-        // Check if screen has a frame available
-        if (!sender->screen || !sender->screen->frame)
-        {
-            continue;
-        }
+        bool consumed = la_preview_sender_consume(sender);
+        sc_mutex_unlock(&sender->mutex);
 
-        // Get the current frame (original resolution)
-        AVFrame *frame = sender->screen->frame;
-        if (frame->width <= 0 || frame->height <= 0)
+        if (consumed)
         {
-            continue;
+            la_preview_sender_process(sender);
         }
+    }
 
-        // Encode frame directly from AVFrame (original resolution)
-        unsigned char *png_data = NULL;
-        size_t png_size = 0;
+    LOGI("LinkAndroid preview sender thread stopped");
+    return 0;
+}
 
-        if (!encode_avframe_to_png(frame, sender->ratio, &png_data, &png_size))
-        {
-            LOGW("Failed to encode frame to PNG");
-            continue;
-        }
+// Schedule the timer job for the pending frame (pool mode)
+static void la_preview_sender_schedule(struct la_preview_sender *sender)
+{
+    sc_mutex_assert(&sender->mutex);
+    assert(sender->pool);
 
-        // Base64 encode
-        char *base64_data = base64_encode(png_data, png_size);
-        free(png_data);
+    sc_tick now = sc_tick_now();
+    sc_tick deadline = sender->next_preview > now ? sender->next_preview : now;
+    sender->scheduled = true;
+    sc_worker_pool_schedule(sender->pool, &sender->timer, deadline);
+}
 
-        if (!base64_data)
-        {
-            LOGE("Failed to base64 encode image data");
-            continue;
-        }
+// Timer job (pool mode): the equivalent of one iteration of the sender thread
+static void run_preview_job(void *userdata)
+{
+    struct la_preview_sender *sender = userdata;
 
-        // Prepend data:image/png;base64, prefix
-        size_t prefix_len = strlen("data:image/png;base64,");
-        size_t base64_len = strlen(base64_data);
-        char *prefixed_data = malloc(prefix_len + base64_len + 1);
-        if (!prefixed_data)
-        {
-            LOGE("Failed to allocate memory for prefixed data");
-            free(base64_data);
-            continue;
-        }
-        strcpy(prefixed_data, "data:image/png;base64,");
-        strcat(prefixed_data, base64_data);
-        free(base64_data);
+    sc_mutex_lock(&sender->mutex);
+    assert(sender->scheduled && sender->has_frame);
 
-        // Send to WebSocket server
-        bool sent = la_websocket_client_send_preview(sender->ws_client,
-                                                     prefixed_data, "png");
-        if (sent)
+    if (sender->stopped)
+    {
+        sender->scheduled = false;
+        sc_cond_signal(&sender->cond);
+        sc_mutex_unlock(&sender->mutex);
+        return;
+    }
+
+    if (!la_preview_sender_consume(sender))
+    {
+        // Retry on the next interval
+        la_preview_sender_schedule(sender);
+        sc_mutex_unlock(&sender->mutex);
+        return;
+    }
+
+    sc_mutex_unlock(&sender->mutex);
+
+    la_preview_sender_process(sender);
+
+    sc_mutex_lock(&sender->mutex);
+    if (sender->has_frame && !sender->stopped)
+    {
+        // A frame has been received meanwhile
+        la_preview_sender_schedule(sender);
+    }
+    else
+    {
+        sender->scheduled = false;
+        sc_cond_signal(&sender->cond);
+    }
+    sc_mutex_unlock(&sender->mutex);
+}
+
+static bool la_preview_sender_open(struct la_preview_sender *sender)
+{
+    bool ok = sc_frame_buffer_init(&sender->fb);
+    if (!ok)
+    {
+        return false;
+    }
+
+    ok = sc_mutex_init(&sender->mutex);
+    if (!ok)
+    {
+        goto error_frame_buffer_destroy;
+    }
+
+    ok = sc_cond_init(&sender->cond);
+    if (!ok)
+    {
+        goto error_mutex_destroy;
+    }
+
+    sender->frame = av_frame_alloc();
+    if (!sender->frame)
+    {
+        LOG_OOM();
+        goto error_cond_destroy;
+    }
+
+    sender->sw_frame = av_frame_alloc();
+    if (!sender->sw_frame)
+    {
+        LOG_OOM();
+        goto error_av_frame_free;
+    }
+
+    sender->atlas = av_frame_alloc();
+    if (!sender->atlas)
+    {
+        LOG_OOM();
+        goto error_av_sw_frame_free;
+    }
+
+    sender->has_frame = false;
+    sender->stopped = false;
+    sender->scheduled = false;
+    sender->next_preview = 0;
+    sender->skipped = 0;
+
+    sender->fingerprint.width = 0;
+    sender->last_sent = 0;
+    sender->static_skipped = 0;
+
+    la_tile_diff_init(&sender->tile_diff);
+    sender->tile_positions = NULL;
+    sender->atlas_filled = 0;
+    sender->next_keyframe = 0;
+    sender->keyframes = 0;
+    sender->tile_updates = 0;
+    sender->tiles_sent = 0;
+    sender->unchanged = 0;
+
+    if (sender->pool)
+    {
+        sc_worker_timer_init(&sender->timer, run_preview_job, sender);
+        LOGI("LinkAndroid preview sender started on worker pool (interval: "
+             "%u ms)", sender->interval_ms);
+        return true;
+    }
+
+    ok = sc_thread_create(&sender->thread, run_preview_sender,
+                          "la-preview", sender);
+    if (!ok)
+    {
+        LOGE("Could not start preview sender thread");
+        goto error_av_atlas_free;
+    }
+
+    return true;
+
+error_av_atlas_free:
+    av_frame_free(&sender->atlas);
+error_av_sw_frame_free:
+    av_frame_free(&sender->sw_frame);
+error_av_frame_free:
+    av_frame_free(&sender->frame);
+error_cond_destroy:
+    sc_cond_destroy(&sender->cond);
+error_mutex_destroy:
+    sc_mutex_destroy(&sender->mutex);
+error_frame_buffer_destroy:
+    sc_frame_buffer_destroy(&sender->fb);
+
+    return false;
+}
+
+static void la_preview_sender_close(struct la_preview_sender *sender)
+{
+    sc_mutex_lock(&sender->mutex);
+    sender->stopped = true;
+    sc_cond_signal(&sender->cond);
+    if (sender->pool)
+    {
+        if (sender->scheduled
+            && sc_worker_pool_cancel(sender->pool, &sender->timer))
         {
-            LOGD("Preview sent to server (size: %zu bytes)", png_size);
+            sender->scheduled = false;
         }
-        else
+        // Wait for the timer job currently running, if any
+        while (sender->scheduled)
         {
-            LOGW("Failed to send preview to server");
+            sc_cond_wait(&sender->cond, &sender->mutex);
         }
+    }
+    sc_mutex_unlock(&sender->mutex);
 
-        free(prefixed_data);
+    if (!sender->pool)
+    {
+        sc_thread_join(&sender->thread, NULL);
     }
 
-    LOGI("LinkAndroid preview sender thread stopped");
-    return NULL;
+    if (sender->skipped)
+    {
+        LOGI("LinkAndroid previews skipped due to backpressure: %" PRIu32,
+             sender->skipped);
+    }
+
+    if (sender->max_staleness_ms)
+    {
+        LOGI("LinkAndroid previews skipped (screen unchanged): %" PRIu32,
+             sender->static_skipped);
+    }
+
+    if (sender->tiles)
+    {
+        LOGI("LinkAndroid preview tiles: %" PRIu32 " full images, %" PRIu32
+             " tiles updates (%" PRIu32 " tiles), %" PRIu32 " unchanged",
+             sender->keyframes, sender->tile_updates, sender->tiles_sent,
+             sender->unchanged);
+    }
+
+    la_tile_diff_destroy(&sender->tile_diff);
+    free(sender->tile_positions);
+    av_frame_free(&sender->atlas);
+    av_frame_free(&sender->sw_frame);
+    av_frame_free(&sender->frame);
+    sc_cond_destroy(&sender->cond);
+    sc_mutex_destroy(&sender->mutex);
+    sc_frame_buffer_destroy(&sender->fb);
 }
 
-bool la_preview_sender_init(struct la_preview_sender *sender,
-                            struct la_websocket_client *ws_client,
-                            struct sc_screen *screen,
-                            uint32_t interval_ms,
-                            uint8_t ratio)
+static bool la_preview_sender_push(struct la_preview_sender *sender,
+                                   const AVFrame *frame)
 {
-    if (!sender || !ws_client || !screen || interval_ms == 0 || ratio < 1 || ratio > 100)
+    sc_mutex_lock(&sender->mutex);
+    // Only keep a reference to the frame, it is encoded later (if at all)
+    bool ok = sc_frame_buffer_push(&sender->fb, frame);
+    if (!ok)
     {
+        sc_mutex_unlock(&sender->mutex);
         return false;
     }
 
-    sender->ws_client = ws_client;
-    sender->screen = screen;
-    sender->interval_ms = interval_ms;
-    sender->ratio = ratio;
-    sender->running = false;
-    sender->thread_started = false;
+    sender->has_frame = true;
+    if (!sender->pool)
+    {
+        sc_cond_signal(&sender->cond);
+    }
+    else if (!sender->scheduled && !sender->stopped)
+    {
+        la_preview_sender_schedule(sender);
+    }
+    sc_mutex_unlock(&sender->mutex);
 
     return true;
 }
 
-bool la_preview_sender_start(struct la_preview_sender *sender)
+static bool la_preview_frame_sink_open(struct sc_frame_sink *sink,
+                                       const AVCodecContext *ctx,
+                                       const struct sc_stream_session *session)
 {
-    if (!sender || sender->running)
+    (void)ctx;
+    (void)session;
+
+    struct la_preview_sender *sender = DOWNCAST(sink);
+    return la_preview_sender_open(sender);
+}
+
+static void la_preview_frame_sink_close(struct sc_frame_sink *sink)
+{
+    struct la_preview_sender *sender = DOWNCAST(sink);
+    la_preview_sender_close(sender);
+}
+
+static bool la_preview_frame_sink_push(struct sc_frame_sink *sink,
+                                       const AVFrame *frame)
+{
+    struct la_preview_sender *sender = DOWNCAST(sink);
+    return la_preview_sender_push(sender, frame);
+}
+
+bool la_preview_sender_init(struct la_preview_sender *sender,
+                            struct la_websocket_client *ws_client,
+                            const struct la_preview_sender_params *params)
+{
+    if (!sender || !ws_client || !params
+        || params->interval_ms == 0 || params->ratio < 1 || params->ratio > 100
+        || params->quality < 1 || params->quality > 100)
+    {
+        return false;
+    }
+
+    if (params->tiles && params->keyframe_interval_ms == 0)
     {
         return false;
     }
 
-    sender->running = true;
+    if (!la_preview_encoder_init(&sender->encoder))
+    {
+        return false;
+    }
 
-    if (pthread_create(&sender->thread, NULL, preview_sender_thread, sender) != 0)
+    if (!la_preview_encoder_init(&sender->tile_encoder))
     {
-        LOGE("Failed to create preview sender thread");
-        sender->running = false;
+        la_preview_encoder_destroy(&sender->encoder);
         return false;
     }
 
-    sender->thread_started = true;
+    sender->ws_client = ws_client;
+    sender->interval_ms = params->interval_ms;
+    sender->ratio = params->ratio;
+    sender->binary = params->binary;
+    sender->format = params->format;
+    sender->quality = params->quality;
+    sender->tiles = params->tiles;
+    sender->keyframe_interval_ms = params->keyframe_interval_ms;
+    sender->max_staleness_ms = params->max_staleness_ms;
+    sender->serial = params->serial;
+    sender->pool = params->pool;
+
+    static const struct sc_frame_sink_ops ops = {
+        .open = la_preview_frame_sink_open,
+        .close = la_preview_frame_sink_close,
+        .push = la_preview_frame_sink_push,
+        // Hardware frames are downloaded by the sender thread, only for the
+        // frames actually encoded
+        .accept_hw_frames = true,
+    };
+
+    sender->frame_sink.ops = &ops;
+
     return true;
 }
 
-void la_preview_sender_stop(struct la_preview_sender *sender)
+enum la_preview_format
+la_preview_format_from_option(enum sc_linkandroid_preview_format format)
 {
-    if (!sender)
+    switch (format)
     {
-        return;
+        case SC_LINKANDROID_PREVIEW_FORMAT_JPEG:
+            return LA_PREVIEW_FORMAT_JPEG;
+        case SC_LINKANDROID_PREVIEW_FORMAT_WEBP:
+            return LA_PREVIEW_FORMAT_WEBP;
+        default:
+            return LA_PREVIEW_FORMAT_PNG;
     }
-
-    sender->running = false;
 }
 
 void la_preview_sender_destroy(struct la_preview_sender *sender)
@@ -522,18 +893,8 @@ void la_preview_sender_destroy(struct la_preview_sender *sender)
         return;
     }
 
-    // Signal thread to stop
-    if (sender->running)
-    {
-        sender->running = false;
-    }
-
-    // Wait for thread to finish
-    if (sender->thread_started)
-    {
-        pthread_join(sender->thread, NULL);
-        sender->thread_started = false;
-    }
+    la_preview_encoder_destroy(&sender->tile_encoder);
+    la_preview_encoder_destroy(&sender->encoder);
 
     LOGI("LinkAndroid preview sender destroyed");
 }
@@ -3,56 +3,136 @@
 
 #include <stdbool.h>
 #include <stdint.h>
-#include <pthread.h>
+
+#include "luma_fingerprint.h"
+#include "preview_encoder.h"
+#include "tile_diff.h"
+#include "../../app/src/frame_buffer.h"
+#include "../../app/src/options.h"
+#include "../../app/src/trait/frame_sink.h"
+#include "../../app/src/util/thread.h"
+#include "../../app/src/util/worker_pool.h"
 
 struct la_websocket_client;
-struct sc_screen;
 
+struct la_preview_sender_params
+{
+    uint32_t interval_ms; // Preview interval in milliseconds
+    uint8_t ratio;        // Preview resolution ratio (1-100, 100 = original)
+    bool binary;          // Send binary messages instead of base64 JSON
+    enum la_preview_format format;
+    uint8_t quality;      // JPEG/WebP quality (1-100)
+    bool tiles;           // Send only the changed tiles
+    uint32_t keyframe_interval_ms; // Full image interval in tiles mode
+    // Maximum interval between two previews while the screen is visually
+    // unchanged (0 to send all the previews)
+    uint32_t max_staleness_ms;
+    // Device serial added to the messages in host mode (or NULL)
+    const char *serial;
+    // Run on the workers of this pool instead of a dedicated thread (or NULL)
+    struct sc_worker_pool *pool;
+};
+
+/**
+ * Preview sender
+ *
+ * Frame sink attached to the video decoder. It keeps its own reference to the
+ * last decoded frame, and its thread encodes and sends a preview only when a
+ * new frame has been received since the last one, at most once per interval.
+ *
+ * While the WebSocket client is backpressured, previews are skipped (not
+ * encoded at all) instead of being queued.
+ *
+ * In tiles mode, only the tiles which changed since the previous previews are
+ * encoded and sent (see tile_diff.h), packed in a single image. A full image
+ * (keyframe) is sent first, then periodically, and whenever the tiles would
+ * not be smaller (more than half of them changed).
+ *
+ * If max_staleness_ms is set, a preview visually identical to the last one
+ * sent (see luma_fingerprint.h) is not even encoded, unless the last one is
+ * older than max_staleness_ms: this heartbeat tells the server that the device
+ * is still alive.
+ *
+ * With a worker pool (host mode), there is no sender thread: each preview is
+ * encoded by a timer job of the pool, scheduled when a frame is received.
+ */
 struct la_preview_sender
 {
+    struct sc_frame_sink frame_sink; // frame sink trait
+
     struct la_websocket_client *ws_client;
-    struct sc_screen *screen;
     uint32_t interval_ms; // Preview interval in milliseconds
     uint8_t ratio;        // Preview resolution ratio (1-100, 100 = original)
-    bool running;
-    pthread_t thread;
-    bool thread_started;
+    bool binary;          // Send binary messages instead of base64 JSON
+    enum la_preview_format format;
+    uint8_t quality;      // JPEG/WebP quality (1-100)
+    struct la_preview_encoder encoder; // Reused across previews
+    bool tiles;           // Send only the changed tiles
+    uint32_t keyframe_interval_ms; // Full image interval in tiles mode
+    struct la_preview_encoder tile_encoder; // Encodes the tiles atlas
+    uint32_t max_staleness_ms; // Heartbeat of unchanged previews (0 = off)
+    const char *serial;   // Device serial in host mode (or NULL)
+
+    struct sc_frame_buffer fb;
+    sc_thread thread;
+    struct sc_worker_pool *pool; // NULL in thread mode
+    struct sc_worker_timer timer; // pool mode only
+    sc_mutex mutex;
+    sc_cond cond;
+    bool has_frame; // A new frame is pending in fb
+    bool stopped;
+    bool scheduled; // The timer is pending or running (pool mode)
+    sc_tick next_preview; // No preview before this time
+    uint32_t skipped; // Previews skipped due to WebSocket backpressure
+
+    // Owned by the sender thread (or the timer job in pool mode)
+    AVFrame *frame; // Frame being encoded
+    AVFrame *sw_frame; // Downloaded copy of a hardware frame
+
+    // Last preview sent
+    struct la_luma_fingerprint fingerprint; // width is 0 if unknown
+    sc_tick last_sent;
+    uint32_t static_skipped; // Previews skipped because nothing changed
+
+    // Tiles mode
+    struct la_tile_diff tile_diff;
+    AVFrame *atlas; // Changed tiles packed in a single frame (fixed size)
+    uint16_t *tile_positions; // [2 * max tiles], sized with the atlas
+    unsigned atlas_filled; // Cells of the atlas holding a tile
+    sc_tick next_keyframe;
+    uint32_t keyframes;     // Full images sent in tiles mode
+    uint32_t tile_updates;  // Tiles messages sent
+    uint32_t tiles_sent;    // Total number of tiles sent
+    uint32_t unchanged;     // Previews not sent because nothing changed
 };
 
 /**
  * Initialize preview sender
  *
+ * The sender thread is started when the frame sink is opened (on the first
+ * video stream), and stopped when it is closed. In pool mode, the pool must
+ * be running until the frame sink is closed.
+ *
  * @param sender Preview sender instance
  * @param ws_client WebSocket client for sending previews
- * @param screen Screen object to capture from
- * @param interval_ms Preview interval in milliseconds
- * @param ratio Preview resolution ratio (1-100, 100 = original)
+ * @param params Preview parameters
  * @return true on success, false on failure
  */
 bool la_preview_sender_init(struct la_preview_sender *sender,
                             struct la_websocket_client *ws_client,
-                            struct sc_screen *screen,
-                            uint32_t interval_ms,
-                            uint8_t ratio);
-
-/**
- * Start preview sender thread
- *
- * @param sender Preview sender instance
- * @return true on success, false on failure
- */
-bool la_preview_sender_start(struct la_preview_sender *sender);
+                            const struct la_preview_sender_params *params);
 
 /**
- * Stop preview sender thread
- *
- * @param sender Preview sender instance
+ * Convert the --linkandroid-preview-format option value
  */
-void la_preview_sender_stop(struct la_preview_sender *sender);
+enum la_preview_format
+la_preview_format_from_option(enum sc_linkandroid_preview_format format);
 
 /**
  * Destroy preview sender and free resources
  *
+ * The frame sink must be closed (i.e. the video decoder must be finished).
+ *
  * @param sender Preview sender instance
  */
 void la_preview_sender_destroy(struct la_preview_sender *sender);
@@ -0,0 +1,446 @@
+#include "screenshot.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/hwcontext.h>
+
+#include "../../app/src/util/log.h"
+
+// Requests received while the thread is busy are answered together
+#define LA_SCREENSHOT_MAX_PENDING 16
+
+/** Downcast frame_sink to la_screenshot */
+#define DOWNCAST(SINK) container_of(SINK, struct la_screenshot, frame_sink)
+
+static bool la_screenshot_params_equal(const struct la_screenshot_params *a,
+                                       const struct la_screenshot_params *b)
+{
+    return a->format == b->format
+        && a->quality == b->quality
+        && a->ratio == b->ratio
+        && a->max_size == b->max_size;
+}
+
+// Apply max_size to the requested ratio
+static uint8_t la_screenshot_get_ratio(const struct la_screenshot_params *params,
+                                       const AVFrame *frame)
+{
+    uint8_t ratio = params->ratio;
+    if (!params->max_size)
+    {
+        return ratio;
+    }
+
+    int size = frame->width > frame->height ? frame->width : frame->height;
+    if (size * ratio / 100 > params->max_size)
+    {
+        ratio = params->max_size * 100 / size;
+        if (ratio < 1)
+        {
+            ratio = 1;
+        }
+    }
+
+    return ratio;
+}
+
+// Encode the work frame, and keep the result as the last image
+static bool la_screenshot_encode(struct la_screenshot *screenshot,
+                                 const AVFrame *frame,
+                                 const struct la_screenshot_params *params)
+{
+    uint8_t ratio = la_screenshot_get_ratio(params, frame);
+    const AVPacket *packet = la_preview_encoder_encode(&screenshot->encoder,
+                                                       frame,
+                                                       params->format,
+                                                       ratio,
+                                                       params->quality);
+    if (!packet)
+    {
+        return false;
+    }
+
+    // May differ from the requested format (WebP fallback)
+    enum la_preview_format format = screenshot->encoder.image_format;
+    char *data_url = la_preview_make_data_url(format, packet->data,
+                                              packet->size);
+    if (!data_url)
+    {
+        LOG_OOM();
+        return false;
+    }
+
+    free(screenshot->image.data_url);
+    screenshot->image.format = format;
+    screenshot->image.width = screenshot->encoder.width;
+    screenshot->image.height = screenshot->encoder.height;
+    screenshot->image.pts = frame->pts;
+    screenshot->image.data_url = data_url;
+    screenshot->image_serial = screenshot->work_serial;
+    screenshot->image_params = *params;
+
+    LOGD("Screenshot encoded (%s, %dx%d, %d bytes)",
+         la_preview_format_name(format), screenshot->image.width,
+         screenshot->image.height, packet->size);
+
+    return true;
+}
+
+static void la_screenshot_answer(struct la_screenshot *screenshot,
+                                 struct la_screenshot_request *req,
+                                 const struct la_screenshot_image *image,
+                                 const char *error)
+{
+    screenshot->cbs->on_screenshot(screenshot, req->id, image, error,
+                                   screenshot->cbs_userdata);
+    free(req->id);
+    req->id = NULL;
+}
+
+static void la_screenshot_process(struct la_screenshot *screenshot,
+                                  struct la_screenshot_request *reqs,
+                                  size_t count, const AVFrame *frame)
+{
+    bool answered[LA_SCREENSHOT_MAX_PENDING] = {0};
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (answered[i])
+        {
+            continue;
+        }
+
+        const struct la_screenshot_params *params = &reqs[i].params;
+
+        const char *error = NULL;
+        if (!frame)
+        {
+            error = "no frame";
+        }
+        else if (screenshot->image_serial != screenshot->work_serial
+                 || !la_screenshot_params_equal(&screenshot->image_params,
+                                                params))
+        {
+            if (!la_screenshot_encode(screenshot, frame, params))
+            {
+                error = "encode failed";
+            }
+        }
+
+        const struct la_screenshot_image *image =
+            error ? NULL : &screenshot->image;
+
+        // Answer all the requests sharing the same parameters at once
+        struct la_screenshot_params key = *params;
+        for (size_t j = i; j < count; ++j)
+        {
+            if (!answered[j] && la_screenshot_params_equal(&reqs[j].params,
+                                                           &key))
+            {
+                la_screenshot_answer(screenshot, &reqs[j], image, error);
+                answered[j] = true;
+            }
+        }
+    }
+}
+
+static int run_screenshot(void *data)
+{
+    struct la_screenshot *screenshot = data;
+
+    for (;;)
+    {
+        sc_mutex_lock(&screenshot->mutex);
+
+        while (!screenshot->stopped
+               && sc_vecdeque_is_empty(&screenshot->queue))
+        {
+            sc_cond_wait(&screenshot->cond, &screenshot->mutex);
+        }
+
+        if (screenshot->stopped)
+        {
+            sc_mutex_unlock(&screenshot->mutex);
+            break;
+        }
+
+        struct la_screenshot_request reqs[LA_SCREENSHOT_MAX_PENDING];
+        size_t count = 0;
+        while (!sc_vecdeque_is_empty(&screenshot->queue))
+        {
+            assert(count < LA_SCREENSHOT_MAX_PENDING);
+            reqs[count++] = sc_vecdeque_pop(&screenshot->queue);
+        }
+
+        // Only take a new reference if the frame changed since the last
+        // requests (the previous image may be reused)
+        bool new_frame = screenshot->serial
+                      && screenshot->serial != screenshot->work_serial;
+        bool ok = true;
+        if (new_frame)
+        {
+            av_frame_unref(screenshot->work_frame);
+            ok = !av_frame_ref(screenshot->work_frame, screenshot->frame);
+            screenshot->work_serial = ok ? screenshot->serial : 0;
+        }
+
+        sc_mutex_unlock(&screenshot->mutex);
+
+        const AVFrame *frame = NULL;
+        if (ok && screenshot->work_serial)
+        {
+            frame = screenshot->work_frame;
+            if (frame->hw_frames_ctx)
+            {
+                // Hardware frame: download it once for all the requests
+                if (new_frame)
+                {
+                    av_frame_unref(screenshot->sw_frame);
+                    int r = av_hwframe_transfer_data(screenshot->sw_frame,
+                                                     frame, 0);
+                    if (r < 0)
+                    {
+                        LOGW("Could not download hardware frame for "
+                             "screenshot");
+                        av_frame_unref(screenshot->sw_frame);
+                        // Retry on the next request
+                        screenshot->work_serial = 0;
+                    }
+                    else
+                    {
+                        av_frame_copy_props(screenshot->sw_frame, frame);
+                    }
+                }
+                frame = screenshot->work_serial ? screenshot->sw_frame : NULL;
+            }
+        }
+
+        la_screenshot_process(screenshot, reqs, count, frame);
+    }
+
+    // Fail the requests received meanwhile
+    sc_mutex_lock(&screenshot->mutex);
+    while (!sc_vecdeque_is_empty(&screenshot->queue))
+    {
+        struct la_screenshot_request req = sc_vecdeque_pop(&screenshot->queue);
+        sc_mutex_unlock(&screenshot->mutex);
+        la_screenshot_answer(screenshot, &req, NULL, "stopped");
+        sc_mutex_lock(&screenshot->mutex);
+    }
+    sc_mutex_unlock(&screenshot->mutex);
+
+    return 0;
+}
+
+static bool la_screenshot_frame_sink_open(struct sc_frame_sink *sink,
+                                          const AVCodecContext *ctx,
+                                          const struct sc_stream_session *session)
+{
+    (void)ctx;
+    (void)session;
+
+    struct la_screenshot *screenshot = DOWNCAST(sink);
+
+    screenshot->stopped = false;
+
+    bool ok = sc_thread_create(&screenshot->thread, run_screenshot,
+                               "la-screenshot", screenshot);
+    if (!ok)
+    {
+        LOGE("Could not start screenshot thread");
+        return false;
+    }
+
+    sc_mutex_lock(&screenshot->mutex);
+    screenshot->running = true;
+    sc_mutex_unlock(&screenshot->mutex);
+
+    return true;
+}
+
+static void la_screenshot_frame_sink_close(struct sc_frame_sink *sink)
+{
+    struct la_screenshot *screenshot = DOWNCAST(sink);
+
+    sc_mutex_lock(&screenshot->mutex);
+    // Reject any new request
+    screenshot->running = false;
+    screenshot->stopped = true;
+    sc_cond_signal(&screenshot->cond);
+    sc_mutex_unlock(&screenshot->mutex);
+
+    sc_thread_join(&screenshot->thread, NULL);
+
+    av_frame_unref(screenshot->frame);
+    av_frame_unref(screenshot->work_frame);
+    av_frame_unref(screenshot->sw_frame);
+}
+
+static bool la_screenshot_frame_sink_push(struct sc_frame_sink *sink,
+                                          const AVFrame *frame)
+{
+    struct la_screenshot *screenshot = DOWNCAST(sink);
+
+    sc_mutex_lock(&screenshot->mutex);
+    // Only keep a reference to the frame, it is encoded only on request
+    av_frame_unref(screenshot->frame);
+    int r = av_frame_ref(screenshot->frame, frame);
+    if (r)
+    {
+        sc_mutex_unlock(&screenshot->mutex);
+        LOG_OOM();
+        return false;
+    }
+    ++screenshot->serial;
+    sc_mutex_unlock(&screenshot->mutex);
+
+    return true;
+}
+
+bool la_screenshot_init(struct la_screenshot *screenshot,
+                        const struct la_screenshot_callbacks *cbs,
+                        void *cbs_userdata)
+{
+    assert(cbs && cbs->on_screenshot);
+
+    bool ok = sc_mutex_init(&screenshot->mutex);
+    if (!ok)
+    {
+        return false;
+    }
+
+    ok = sc_cond_init(&screenshot->cond);
+    if (!ok)
+    {
+        goto error_mutex_destroy;
+    }
+
+    ok = la_preview_encoder_init(&screenshot->encoder);
+    if (!ok)
+    {
+        goto error_cond_destroy;
+    }
+
+    screenshot->frame = av_frame_alloc();
+    if (!screenshot->frame)
+    {
+        LOG_OOM();
+        goto error_encoder_destroy;
+    }
+
+    screenshot->work_frame = av_frame_alloc();
+    if (!screenshot->work_frame)
+    {
+        LOG_OOM();
+        goto error_frame_free;
+    }
+
+    screenshot->sw_frame = av_frame_alloc();
+    if (!screenshot->sw_frame)
+    {
+        LOG_OOM();
+        goto error_work_frame_free;
+    }
+
+    sc_vecdeque_init(&screenshot->queue);
+    screenshot->running = false;
+    screenshot->stopped = false;
+    screenshot->serial = 0;
+    screenshot->work_serial = 0;
+    memset(&screenshot->image, 0, sizeof(screenshot->image));
+    screenshot->image_serial = 0;
+    screenshot->cbs = cbs;
+    screenshot->cbs_userdata = cbs_userdata;
+
+    static const struct sc_frame_sink_ops ops = {
+        .open = la_screenshot_frame_sink_open,
+        .close = la_screenshot_frame_sink_close,
+        .push = la_screenshot_frame_sink_push,
+        // Hardware frames are downloaded only when a screenshot is requested
+        .accept_hw_frames = true,
+    };
+
+    screenshot->frame_sink.ops = &ops;
+
+    return true;
+
+error_work_frame_free:
+    av_frame_free(&screenshot->work_frame);
+error_frame_free:
+    av_frame_free(&screenshot->frame);
+error_encoder_destroy:
+    la_preview_encoder_destroy(&screenshot->encoder);
+error_cond_destroy:
+    sc_cond_destroy(&screenshot->cond);
+error_mutex_destroy:
+    sc_mutex_destroy(&screenshot->mutex);
+
+    return false;
+}
+
+bool la_screenshot_request(struct la_screenshot *screenshot,
+                           const char *request_id,
+                           const struct la_screenshot_params *params)
+{
+    struct la_screenshot_request req = {
+        .id = NULL,
+        .params = *params,
+    };
+
+    if (request_id)
+    {
+        req.id = strdup(request_id);
+        if (!req.id)
+        {
+            LOG_OOM();
+            return false;
+        }
+    }
+
+    sc_mutex_lock(&screenshot->mutex);
+
+    if (!screenshot->running)
+    {
+        sc_mutex_unlock(&screenshot->mutex);
+        free(req.id);
+        return false;
+    }
+
+    if (sc_vecdeque_size(&screenshot->queue) >= LA_SCREENSHOT_MAX_PENDING)
+    {
+        sc_mutex_unlock(&screenshot->mutex);
+        LOGW("Too many pending screenshot requests");
+        free(req.id);
+        return false;
+    }
+
+    bool ok = sc_vecdeque_push(&screenshot->queue, req);
+    if (!ok)
+    {
+        sc_mutex_unlock(&screenshot->mutex);
+        LOG_OOM();
+        free(req.id);
+        return false;
+    }
+
+    sc_cond_signal(&screenshot->cond);
+    sc_mutex_unlock(&screenshot->mutex);
+
+    return true;
+}
+
+void la_screenshot_destroy(struct la_screenshot *screenshot)
+{
+    assert(sc_vecdeque_is_empty(&screenshot->queue));
+    sc_vecdeque_destroy(&screenshot->queue);
+
+    free(screenshot->image.data_url);
+    av_frame_free(&screenshot->sw_frame);
+    av_frame_free(&screenshot->work_frame);
+    av_frame_free(&screenshot->frame);
+    la_preview_encoder_destroy(&screenshot->encoder);
+    sc_cond_destroy(&screenshot->cond);
+    sc_mutex_destroy(&screenshot->mutex);
+}
@@ -0,0 +1,123 @@
+#ifndef LA_SCREENSHOT_H
+#define LA_SCREENSHOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "preview_encoder.h"
+#include "../../app/src/trait/frame_sink.h"
+#include "../../app/src/util/thread.h"
+#include "../../app/src/util/vecdeque.h"
+
+struct la_screenshot_params
+{
+    enum la_preview_format format;
+    uint8_t quality;   // JPEG/WebP quality (1-100)
+    uint8_t ratio;     // Resolution ratio (1-100, 100 = original)
+    uint16_t max_size; // Maximum width and height (0 for no limit)
+};
+
+struct la_screenshot_request
+{
+    char *id; // Request id (owned, may be NULL)
+    struct la_screenshot_params params;
+};
+
+struct la_screenshot_queue SC_VECDEQUE(struct la_screenshot_request);
+
+// An encoded screenshot, shared by all the requests it answers
+struct la_screenshot_image
+{
+    enum la_preview_format format; // Actual format (WebP may fall back)
+    int width;
+    int height;
+    int64_t pts;    // Pts of the frame (in microseconds)
+    char *data_url; // "data:image/<format>;base64,..."
+};
+
+struct la_screenshot;
+
+struct la_screenshot_callbacks
+{
+    /**
+     * Called from the screenshot thread for every request
+     *
+     * On failure, image is NULL and error describes the reason.
+     */
+    void (*on_screenshot)(struct la_screenshot *screenshot,
+                          const char *request_id,
+                          const struct la_screenshot_image *image,
+                          const char *error, void *userdata);
+};
+
+/**
+ * On-demand screenshots
+ *
+ * Frame sink attached to the video decoder. It only keeps a reference to the
+ * last decoded frame (no copy, no encoding) until a screenshot is requested.
+ *
+ * The requests are handled by a separate thread, so that neither the caller
+ * (the WebSocket thread) nor the decoder are ever blocked by an encoding. All
+ * the pending requests for the same frame with the same parameters share a
+ * single encoding (the last image is also reused by the next requests, as
+ * long as no new frame has been decoded).
+ */
+struct la_screenshot
+{
+    struct sc_frame_sink frame_sink; // frame sink trait
+
+    sc_thread thread;
+    sc_mutex mutex;
+    sc_cond cond;
+    bool running; // The frame sink is open
+    bool stopped;
+
+    AVFrame *frame;  // Last decoded frame (protected by the mutex)
+    uint64_t serial; // Incremented on every new frame (0 if none)
+    struct la_screenshot_queue queue;
+
+    // Owned by the screenshot thread
+    AVFrame *work_frame; // Reference to the frame being encoded
+    AVFrame *sw_frame;   // Downloaded copy of a hardware frame
+    uint64_t work_serial;
+    struct la_preview_encoder encoder;
+    // The last image, and the key it was encoded for
+    struct la_screenshot_image image;
+    uint64_t image_serial; // 0 if none
+    struct la_screenshot_params image_params;
+
+    const struct la_screenshot_callbacks *cbs;
+    void *cbs_userdata;
+};
+
+/**
+ * Initialize the screenshot handler
+ *
+ * The thread is started when the frame sink is opened, and stopped when it is
+ * closed. Requests may be submitted at any time between init and destroy.
+ */
+bool la_screenshot_init(struct la_screenshot *screenshot,
+                        const struct la_screenshot_callbacks *cbs,
+                        void *cbs_userdata);
+
+/**
+ * Request a screenshot of the last decoded frame
+ *
+ * It never blocks on an encoding. The result is reported asynchronously via
+ * on_screenshot(). If false is returned (no video stream is running), the
+ * callback is not called.
+ *
+ * @param request_id Request id, copied (may be NULL)
+ */
+bool la_screenshot_request(struct la_screenshot *screenshot,
+                           const char *request_id,
+                           const struct la_screenshot_params *params);
+
+/**
+ * Destroy the screenshot handler
+ *
+ * The frame sink must be closed (i.e. the video decoder must be finished).
+ */
+void la_screenshot_destroy(struct la_screenshot *screenshot);
+
+#endif
@@ -0,0 +1,264 @@
+#include "tile_diff.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+# include <emmintrin.h>
+# define LA_TILE_DIFF_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+# define LA_TILE_DIFF_NEON
+#endif
+
+// The tiles are compared by blocks, so that a small change (a blinking cursor)
+// is not hidden by the size of the tile, while the noise of the video encoding
+// spread over the whole tile is ignored
+#define LA_TILE_DIFF_BLOCK 16
+// A block has changed if the mean absolute difference exceeds this value
+#define LA_TILE_DIFF_MEAN_THRESHOLD 4
+
+uint64_t la_tile_diff_sad(const uint8_t *a, int a_linesize,
+                          const uint8_t *b, int b_linesize,
+                          int width, int height)
+{
+    uint64_t sad = 0;
+
+#ifdef LA_TILE_DIFF_SSE2
+    // 2 x 64-bit partial sums, which never overflow
+    __m128i acc = _mm_setzero_si128();
+#endif
+
+    for (int y = 0; y < height; ++y)
+    {
+        const uint8_t *pa = a + (size_t)y * a_linesize;
+        const uint8_t *pb = b + (size_t)y * b_linesize;
+        int x = 0;
+
+#if defined(LA_TILE_DIFF_SSE2)
+        for (; x + 16 <= width; x += 16)
+        {
+            __m128i va = _mm_loadu_si128((const __m128i *)(pa + x));
+            __m128i vb = _mm_loadu_si128((const __m128i *)(pb + x));
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+        }
+#elif defined(LA_TILE_DIFF_NEON)
+        while (x + 16 <= width)
+        {
+            // Each 16-bit lane receives at most 2 * 255 per iteration: flush
+            // to 32-bit before it may overflow
+            uint16x8_t acc16 = vdupq_n_u16(0);
+            for (int i = 0; i < 64 && x + 16 <= width; ++i, x += 16)
+            {
+                uint8x16_t va = vld1q_u8(pa + x);
+                uint8x16_t vb = vld1q_u8(pb + x);
+                acc16 = vpadalq_u8(acc16, vabdq_u8(va, vb));
+            }
+            uint32x4_t acc32 = vpaddlq_u16(acc16);
+            uint64x2_t acc64 = vpaddlq_u32(acc32);
+            sad += vgetq_lane_u64(acc64, 0) + vgetq_lane_u64(acc64, 1);
+        }
+#endif
+
+        for (; x < width; ++x)
+        {
+            sad += pa[x] > pb[x] ? pa[x] - pb[x] : pb[x] - pa[x];
+        }
+    }
+
+#ifdef LA_TILE_DIFF_SSE2
+    uint64_t partial[2];
+    _mm_storeu_si128((__m128i *)partial, acc);
+    sad += partial[0] + partial[1];
+#endif
+
+    return sad;
+}
+
+void la_tile_diff_init(struct la_tile_diff *td)
+{
+    memset(td, 0, sizeof(*td));
+}
+
+static void la_tile_diff_free_buffers(struct la_tile_diff *td)
+{
+    free(td->src_x);
+    free(td->src_y);
+    free(td->ref);
+    free(td->changed);
+    td->src_x = NULL;
+    td->src_y = NULL;
+    td->ref = NULL;
+    td->changed = NULL;
+}
+
+// Compute the source range covered by the tile i along one dimension
+static void la_tile_diff_range(int i, int src_size, int size, int margin,
+                               int *src_begin, int *src_end)
+{
+    int begin = i * LA_TILE_SIZE;
+    int end = begin + LA_TILE_SIZE < size ? begin + LA_TILE_SIZE : size;
+    int b = (int)((int64_t)begin * src_size / size) - margin;
+    int e = (int)(((int64_t)end * src_size + size - 1) / size) + margin;
+    *src_begin = b > 0 ? b : 0;
+    *src_end = e < src_size ? e : src_size;
+}
+
+static void la_tile_diff_map(int *ranges, int count, int src_size, int size)
+{
+    // The scaling filter reads source pixels slightly outside the tile
+    int margin = (src_size + size - 1) / size;
+
+    for (int i = 0; i < count; ++i)
+    {
+        la_tile_diff_range(i, src_size, size, margin, &ranges[2 * i],
+                           &ranges[2 * i + 1]);
+    }
+}
+
+bool la_tile_diff_configure(struct la_tile_diff *td, int src_width,
+                            int src_height, int width, int height)
+{
+    assert(src_width > 0 && src_height > 0 && width > 0 && height > 0);
+
+    if (td->ref && td->src_width == src_width && td->src_height == src_height
+        && td->width == width && td->height == height)
+    {
+        return true;
+    }
+
+    la_tile_diff_free_buffers(td);
+    td->has_ref = false;
+    td->changed_count = 0;
+
+    int cols = (width + LA_TILE_SIZE - 1) / LA_TILE_SIZE;
+    int rows = (height + LA_TILE_SIZE - 1) / LA_TILE_SIZE;
+    if ((int64_t)cols * rows > UINT16_MAX)
+    {
+        // Tile indices are 16-bit
+        return false;
+    }
+
+    td->src_x = malloc(2 * cols * sizeof(*td->src_x));
+    td->src_y = malloc(2 * rows * sizeof(*td->src_y));
+    td->ref = malloc((size_t)src_width * src_height);
+    td->changed = malloc(cols * rows * sizeof(*td->changed));
+    if (!td->src_x || !td->src_y || !td->ref || !td->changed)
+    {
+        la_tile_diff_free_buffers(td);
+        return false;
+    }
+
+    td->src_width = src_width;
+    td->src_height = src_height;
+    td->width = width;
+    td->height = height;
+    td->cols = cols;
+    td->rows = rows;
+
+    la_tile_diff_map(td->src_x, cols, src_width, width);
+    la_tile_diff_map(td->src_y, rows, src_height, height);
+
+    return true;
+}
+
+static bool la_tile_diff_tile_changed(struct la_tile_diff *td,
+                                      const uint8_t *luma, int linesize,
+                                      int col, int row)
+{
+    int x0 = td->src_x[2 * col];
+    int x1 = td->src_x[2 * col + 1];
+    int y0 = td->src_y[2 * row];
+    int y1 = td->src_y[2 * row + 1];
+
+    for (int y = y0; y < y1; y += LA_TILE_DIFF_BLOCK)
+    {
+        int h = y1 - y < LA_TILE_DIFF_BLOCK ? y1 - y : LA_TILE_DIFF_BLOCK;
+        for (int x = x0; x < x1; x += LA_TILE_DIFF_BLOCK)
+        {
+            int w = x1 - x < LA_TILE_DIFF_BLOCK ? x1 - x : LA_TILE_DIFF_BLOCK;
+            uint64_t sad =
+                la_tile_diff_sad(luma + (size_t)y * linesize + x, linesize,
+                                 td->ref + (size_t)y * td->src_width + x,
+                                 td->src_width, w, h);
+            if (sad > (uint64_t)w * h * LA_TILE_DIFF_MEAN_THRESHOLD)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+unsigned la_tile_diff_compute(struct la_tile_diff *td, const uint8_t *luma,
+                              int linesize)
+{
+    assert(td->ref);
+
+    unsigned count = 0;
+    for (int row = 0; row < td->rows; ++row)
+    {
+        for (int col = 0; col < td->cols; ++col)
+        {
+            if (!td->has_ref
+                || la_tile_diff_tile_changed(td, luma, linesize, col, row))
+            {
+                td->changed[count++] = row * td->cols + col;
+            }
+        }
+    }
+
+    td->changed_count = count;
+    return count;
+}
+
+static void la_tile_diff_copy(struct la_tile_diff *td, const uint8_t *luma,
+                              int linesize, int x0, int x1, int y0, int y1)
+{
+    for (int y = y0; y < y1; ++y)
+    {
+        memcpy(td->ref + (size_t)y * td->src_width + x0,
+               luma + (size_t)y * linesize + x0, x1 - x0);
+    }
+}
+
+void la_tile_diff_commit(struct la_tile_diff *td, const uint8_t *luma,
+                         int linesize, bool full)
+{
+    assert(td->ref);
+
+    if (full)
+    {
+        la_tile_diff_copy(td, luma, linesize, 0, td->src_width, 0,
+                          td->src_height);
+        td->has_ref = true;
+        return;
+    }
+
+    // Without reference, all the tiles have been reported (and sent)
+    for (unsigned i = 0; i < td->changed_count; ++i)
+    {
+        int col = td->changed[i] % td->cols;
+        int row = td->changed[i] / td->cols;
+
+        // Only copy the area of the tile itself (without the margin): the
+        // neighbors not sent must still be compared to their old content
+        int x0, x1, y0, y1;
+        la_tile_diff_range(col, td->src_width, td->width, 0, &x0, &x1);
+        la_tile_diff_range(row, td->src_height, td->height, 0, &y0, &y1);
+        la_tile_diff_copy(td, luma, linesize, x0, x1, y0, y1);
+    }
+    td->has_ref = true;
+}
+
+void la_tile_diff_invalidate(struct la_tile_diff *td)
+{
+    td->has_ref = false;
+}
+
+void la_tile_diff_destroy(struct la_tile_diff *td)
+{
+    la_tile_diff_free_buffers(td);
+}
@@ -0,0 +1,119 @@
+#ifndef LA_TILE_DIFF_H
+#define LA_TILE_DIFF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Tile size, in preview (scaled) pixels
+#define LA_TILE_SIZE 64
+
+/**
+ * Dirty-region detection for the previews
+ *
+ * The preview is split into LA_TILE_SIZE x LA_TILE_SIZE tiles. A tile has
+ * changed if the sum of absolute differences (SAD) between the source luma
+ * (Y plane) covered by the tile and the reference exceeds a threshold.
+ *
+ * The reference is the luma of the tiles last sent (not of the last frame),
+ * so that slow changes accumulate until they are eventually sent.
+ *
+ * The comparison is done on the source (decoded) frame, before scaling, so
+ * that unchanged previews are detected without scaling nor encoding. The
+ * caller scales the whole frame, then encodes only the changed tiles.
+ */
+struct la_tile_diff
+{
+    // Geometry
+    int src_width;  // Source luma width
+    int src_height; // Source luma height
+    int width;      // Preview width
+    int height;     // Preview height
+    int cols;
+    int rows;
+
+    // Source area covered by each column and each row (in source pixels,
+    // including a margin for the scaling filter)
+    int *src_x; // [2 * cols], begin and end of each column
+    int *src_y; // [2 * rows], begin and end of each row
+
+    uint8_t *ref; // Reference luma (src_width x src_height)
+    bool has_ref;
+
+    // Changed tiles (tile indices, row-major), filled by
+    // la_tile_diff_compute()
+    uint16_t *changed; // [cols * rows]
+    unsigned changed_count;
+};
+
+/**
+ * Compute the sum of absolute differences of two 8-bit planes
+ *
+ * It uses SSE2 or NEON if available.
+ */
+uint64_t la_tile_diff_sad(const uint8_t *a, int a_linesize,
+                          const uint8_t *b, int b_linesize,
+                          int width, int height);
+
+void la_tile_diff_init(struct la_tile_diff *td);
+
+/**
+ * Set the geometry
+ *
+ * If it changed, the buffers are reallocated and the reference is invalidated.
+ *
+ * @param src_width Source luma width
+ * @param src_height Source luma height
+ * @param width Preview width
+ * @param height Preview height
+ * @return true on success, false on allocation failure
+ */
+bool la_tile_diff_configure(struct la_tile_diff *td, int src_width,
+                            int src_height, int width, int height);
+
+/**
+ * Detect the tiles which changed since the reference
+ *
+ * Without reference, all the tiles are reported.
+ *
+ * @param luma Source luma plane (src_width x src_height)
+ * @param linesize Source luma line size
+ * @return the number of changed tiles (td->changed_count)
+ */
+unsigned la_tile_diff_compute(struct la_tile_diff *td, const uint8_t *luma,
+                              int linesize);
+
+/**
+ * Update the reference once the tiles have been sent
+ *
+ * @param luma Source luma plane given to la_tile_diff_compute()
+ * @param linesize Source luma line size
+ * @param full Copy the whole plane (a full image has been sent) instead of
+ *             only the changed tiles
+ */
+void la_tile_diff_commit(struct la_tile_diff *td, const uint8_t *luma,
+                         int linesize, bool full);
+
+/**
+ * Invalidate the reference (the receiver may have lost some tiles), so that
+ * the next preview is a full image
+ */
+void la_tile_diff_invalidate(struct la_tile_diff *td);
+
+/**
+ * Get the position of a tile in the preview
+ */
+static inline void la_tile_diff_get_rect(const struct la_tile_diff *td,
+                                         unsigned index, int *x, int *y,
+                                         int *w, int *h)
+{
+    int col = index % td->cols;
+    int row = index / td->cols;
+    *x = col * LA_TILE_SIZE;
+    *y = row * LA_TILE_SIZE;
+    *w = td->width - *x < LA_TILE_SIZE ? td->width - *x : LA_TILE_SIZE;
+    *h = td->height - *y < LA_TILE_SIZE ? td->height - *y : LA_TILE_SIZE;
+}
+
+void la_tile_diff_destroy(struct la_tile_diff *td);
+
+#endif
@@ -2,6 +2,8 @@
 
 #include "websocket_client.h"
 
+#include <assert.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,19 +17,31 @@
 #endif
 
 #include "json/cJSON.h"
+#include "event_json.h"
+#include "message_ring.h"
 #include "../../app/src/control_msg.h"
+#include "../../app/src/util/binary.h"
 #include "../../app/src/util/log.h"
+#include "../../app/src/util/trace.h"
 #include "../../app/src/options.h"
 
 #define MAX_PAYLOAD_SIZE (2 * 1024 * 1024) // 2MB for preview images
 #define RECONNECT_DELAY_MS 3000
 
-struct message_node
-{
-    char *payload;
-    size_t len;
-    struct message_node *next;
-};
+// Output queue: events are small JSON messages, larger messages (previews)
+// get a dedicated buffer
+#define LA_WS_QUEUE_CAPACITY 256
+#define LA_WS_SLOT_SIZE 1024
+// Previews are dropped once the queue is half full, so that they never delay
+// (or cause the drop of) input events
+#define LA_WS_PREVIEW_MAX_DEPTH (LA_WS_QUEUE_CAPACITY / 2)
+// Maximum number of frames written per writable callback
+#define LA_WS_MAX_WRITES_PER_CALLBACK 32
+// Large messages are sent in several WebSocket frames, so that a slow link
+// never makes libwebsockets buffer a whole preview
+#define LA_WS_FRAGMENT_SIZE (32 * 1024)
+// Previews are skipped while more than this amount of data is queued
+#define LA_WS_BACKPRESSURE_BYTES (64 * 1024)
 
 struct la_websocket_client
 {
@@ -45,12 +59,18 @@ struct la_websocket_client
     struct lws_context *context;
     struct lws *wsi;
     pthread_mutex_t lock;
-    char send_buffer[LWS_PRE + MAX_PAYLOAD_SIZE];
 
-    int send_len;
-    // Output queue
-    struct message_node *queue_head;
-    struct message_node *queue_tail;
+    // Output queue, written by the producers (serialized by lock) and read
+    // by the service thread without locking
+    struct la_message_ring queue;
+    uint32_t previews_dropped; // protected by lock
+    atomic_uint_least32_t sent; // written by the service thread only
+    // Payload bytes queued and not completely sent yet
+    atomic_size_t queued_bytes;
+    // The socket could not accept more data on the last writable callback
+    atomic_bool choked;
+    // Bytes of the oldest queued message already sent (service thread only)
+    size_t send_offset;
 };
 
 // Forward declaration
@@ -174,55 +194,73 @@ static int websocket_callback(struct lws *wsi, enum lws_callback_reasons reason,
         break;
 
     case LWS_CALLBACK_CLIENT_WRITEABLE:
-        pthread_mutex_lock(&client->lock);
-
-        // Loop to send all queued messages (or as many as possible)
-        // Note: lws_write might return less than requested, or we might want to yield
-        // back to the event loop. For simplicity in this client, we try to send one by one.
-        // Ideally we should handle partial writes, but for small control messages
-        // full writes are expected.
-        if (client->queue_head)
+    {
+        // The service thread is the only reader of the queue, no lock needed
+        unsigned writes = 0;
+        bool choked = false;
+        struct la_message_slot *slot;
+        while ((slot = la_message_ring_peek(&client->queue)))
         {
-            struct message_node *node = client->queue_head;
-
-            // Payload was allocated with LWS_PRE padding
-            // node->payload points to the start of the allocation
-            // The actual data starts at node->payload + LWS_PRE
-            unsigned char *data_ptr = (unsigned char *)(node->payload + LWS_PRE);
-
-            int written = lws_write(wsi, data_ptr, node->len, LWS_WRITE_TEXT);
+            if (writes == LA_WS_MAX_WRITES_PER_CALLBACK
+                || (choked = lws_send_pipe_choked(wsi)))
+            {
+                // Resume on the next writable callback
+                lws_callback_on_writable(wsi);
+                break;
+            }
 
+            // Send the next fragment of the message. The LWS_PRE bytes
+            // before it (the headroom or the end of the previous fragment,
+            // already sent) are overwritten by the frame header.
+            unsigned char *payload =
+                la_message_slot_payload(&client->queue, slot);
+            size_t offset = client->send_offset;
+            size_t remaining = slot->len - offset;
+            size_t chunk = remaining < LA_WS_FRAGMENT_SIZE
+                         ? remaining : LA_WS_FRAGMENT_SIZE;
+            bool first = offset == 0;
+            bool last = chunk == remaining;
+
+            int wp = lws_write_ws_flags(slot->binary ? LWS_WRITE_BINARY
+                                                     : LWS_WRITE_TEXT,
+                                        first, last);
+            sc_tick trace_start = sc_trace_begin();
+            int written = lws_write(wsi, payload + offset, chunk, wp);
+            sc_trace_end("websocket write", trace_start);
             if (written < 0)
             {
+                // The frame may have been partially sent, the stream cannot
+                // be resumed: close the connection
                 LOGE("WebSocket write failed");
-                // On error, maybe we should clear queue or retry?
-                // For now, pop it to avoid infinite loop
-            }
-            else if ((size_t)written < node->len)
-            {
-                LOGE("WebSocket partial write: %d/%zu", written, node->len);
-                // In a robust implementation, we would adjust the node to send the rest later.
+                return -1;
             }
 
-            // Remove from queue
-            client->queue_head = node->next;
-            if (!client->queue_head)
+            // If the socket did not accept the whole frame, libwebsockets
+            // keeps the remaining bytes and sends them before anything else
+            // (lws_send_pipe_choked() returns true meanwhile)
+            ++writes;
+            if (!last)
             {
-                client->queue_tail = NULL;
+                client->send_offset += chunk;
+                continue;
             }
 
-            free(node->payload);
-            free(node);
+            client->send_offset = 0;
+            atomic_fetch_sub_explicit(&client->queued_bytes, slot->len,
+                                      memory_order_relaxed);
+            la_message_ring_pop(&client->queue);
 
-            // If there are more messages, schedule another write
-            if (client->queue_head)
-            {
-                lws_callback_on_writable(wsi);
-            }
+            uint32_t sent = atomic_load_explicit(&client->sent,
+                                                 memory_order_relaxed);
+            atomic_store_explicit(&client->sent, sent + 1,
+                                  memory_order_relaxed);
         }
-
-        pthread_mutex_unlock(&client->lock);
+        atomic_store_explicit(&client->choked, choked, memory_order_relaxed);
+        sc_trace_counter("websocket queued bytes",
+                         atomic_load_explicit(&client->queued_bytes,
+                                              memory_order_relaxed));
         break;
+    }
 
     case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
         LOGE("LinkAndroid WebSocket connection error: %s",
@@ -231,6 +269,8 @@ static int websocket_callback(struct lws *wsi, enum lws_callback_reasons reason,
         client->connected = false;
         client->wsi = NULL;
         pthread_mutex_unlock(&client->lock);
+        // A message interrupted in the middle must be sent from the start
+        client->send_offset = 0;
         break;
 
     case LWS_CALLBACK_CLIENT_CLOSED:
@@ -239,6 +279,7 @@ static int websocket_callback(struct lws *wsi, enum lws_callback_reasons reason,
         client->connected = false;
         client->wsi = NULL;
         pthread_mutex_unlock(&client->lock);
+        client->send_offset = 0;
         break;
 
     default:
@@ -343,7 +384,8 @@ static void *websocket_thread(void *arg)
         // Check if we have pending messages to send
         // This is safe because we are in the service thread
         pthread_mutex_lock(&client->lock);
-        if (client->connected && client->wsi && client->queue_head)
+        if (client->connected && client->wsi
+            && la_message_ring_depth(&client->queue))
         {
             // Request a write callback in the next service loop
             lws_callback_on_writable(client->wsi);
@@ -361,145 +403,27 @@ static void *websocket_thread(void *arg)
     return NULL;
 }
 
-// Generate a random hex message ID for request/response pairing
-// Thread-safe: uses a mutex-protected LCG if available, otherwise a simple counter
-static void
-generate_msg_id(char *buf, size_t buf_size) {
-    static pthread_mutex_t id_mutex = PTHREAD_MUTEX_INITIALIZER;
-    static uint32_t counter = 0;
-
-    pthread_mutex_lock(&id_mutex);
-    if (counter == 0) {
-        // Seed the counter with current time and lower bits of address for variety
-        counter = ((uint32_t)(time(NULL) & 0x7FFFFFFF) ^ (uint32_t)(uintptr_t)buf);
-        if (counter == 0) counter = 1;
-    }
-    // Advance with an LCG to generate pseudo-random sequence
-    counter = counter * 1103515245 + 12345;
-    uint32_t id = counter;
-    pthread_mutex_unlock(&id_mutex);
+// Message ID for request/response pairing (the first value is random)
+static atomic_uint_least32_t msg_id_counter;
 
-    snprintf(buf, buf_size, "%08x", id);
+static void
+seed_msg_ids(void) {
+    uint32_t zero = 0;
+    uint32_t seed = (uint32_t)(time(NULL) & 0x7FFFFFFF)
+                  ^ (uint32_t)(uintptr_t)&msg_id_counter;
+    // Only the first client seeds the counter
+    atomic_compare_exchange_strong(&msg_id_counter, &zero, seed);
 }
 
-// Helper function to serialize control message to JSON
-static char *
-serialize_event_to_json(const struct sc_control_msg *msg,
-                        uint16_t device_width,
-                        uint16_t device_height)
-{
-    // Allocate a buffer for JSON string (max 512 bytes should be enough)
-    char *json_str = malloc(512);
-    if (!json_str)
-    {
-        LOGE("Failed to allocate JSON buffer");
-        return NULL;
-    }
-
-    // Generate a unique message ID for request/response pairing
-    char id_str[9];
-    generate_msg_id(id_str, sizeof(id_str));
-
-    switch (msg->type)
-    {
-    case SC_CONTROL_MSG_TYPE_INJECT_KEYCODE:
-    {
-        const char *action = msg->inject_keycode.action == AKEY_EVENT_ACTION_DOWN
-                                 ? "down"
-                                 : "up";
-        snprintf(json_str, 512,
-                 "{\"type\":\"key\",\"id\":\"%s\","
-                 "\"data\":{\"action\":\"%s\","
-                 "\"keycode\":%d,\"repeat\":%d,\"metastate\":%d,"
-                 "\"width\":%u,\"height\":%u}}",
-                 id_str, action, msg->inject_keycode.keycode,
-                 msg->inject_keycode.repeat, msg->inject_keycode.metastate,
-                 device_width, device_height);
-        break;
-    }
-    case SC_CONTROL_MSG_TYPE_INJECT_TEXT:
-    {
-        // For text, we need to escape special characters
-        snprintf(json_str, 512,
-                 "{\"type\":\"text\",\"id\":\"%s\","
-                 "\"data\":{\"text\":\"%s\","
-                 "\"width\":%u,\"height\":%u}}",
-                 id_str, msg->inject_text.text, device_width, device_height);
-        break;
-    }
-    case SC_CONTROL_MSG_TYPE_INJECT_TOUCH_EVENT:
-    {
-        const char *type_str;
-        switch (msg->inject_touch_event.action)
-        {
-        case AMOTION_EVENT_ACTION_DOWN:
-            type_str = "touch_down";
-            break;
-        case AMOTION_EVENT_ACTION_UP:
-            type_str = "touch_up";
-            break;
-        case AMOTION_EVENT_ACTION_MOVE:
-            type_str = "touch_move";
-            break;
-        default:
-            // Skip unsupported touch actions (e.g., hover events action=7)
-            free(json_str);
-            return NULL;
-        }
-
-        // Convert pointer_id to string to avoid JavaScript precision issues
-        char pointer_id_str[32];
-        snprintf(pointer_id_str, sizeof(pointer_id_str), "%llu",
-                 (unsigned long long)msg->inject_touch_event.pointer_id);
-
-        // Use absolute pixel coordinates (integers)
-        int x = (int)msg->inject_touch_event.position.point.x;
-        int y = (int)msg->inject_touch_event.position.point.y;
-
-        snprintf(json_str, 512,
-                 "{\"type\":\"%s\",\"id\":\"%s\","
-                 "\"data\":{\"pointer_id\":\"%s\","
-                 "\"x\":%d,\"y\":%d,\"pressure\":%.6f,"
-                 "\"width\":%u,\"height\":%u}}",
-                 type_str, id_str, pointer_id_str,
-                 x, y, msg->inject_touch_event.pressure,
-                 device_width, device_height);
-        break;
-    }
-    case SC_CONTROL_MSG_TYPE_INJECT_SCROLL_EVENT:
-    {
-        // Use absolute pixel coordinates (integers)
-        int x = (int)msg->inject_scroll_event.position.point.x;
-        int y = (int)msg->inject_scroll_event.position.point.y;
-
-        // Determine if it's horizontal or vertical scroll
-        if (msg->inject_scroll_event.hscroll != 0)
-        {
-            snprintf(json_str, 512,
-                     "{\"type\":\"scroll_h\",\"id\":\"%s\","
-                     "\"data\":{\"x\":%d,\"y\":%d,"
-                     "\"hscroll\":%.6f,\"width\":%u,\"height\":%u}}",
-                     id_str, x, y, (float)msg->inject_scroll_event.hscroll,
-                     device_width, device_height);
-        }
-        else
-        {
-            snprintf(json_str, 512,
-                     "{\"type\":\"scroll_v\",\"id\":\"%s\","
-                     "\"data\":{\"x\":%d,\"y\":%d,"
-                     "\"vscroll\":%.6f,\"width\":%u,\"height\":%u}}",
-                     id_str, x, y, (float)msg->inject_scroll_event.vscroll,
-                     device_width, device_height);
-        }
-        break;
-    }
-    default:
-        // Skip unsupported message types
-        free(json_str);
-        return NULL;
-    }
+static uint32_t
+next_msg_id(void) {
+    return atomic_fetch_add_explicit(&msg_id_counter, 1, memory_order_relaxed);
+}
 
-    return json_str;
+// Generate a hex message ID (8 hex digits)
+static void
+generate_msg_id(char *buf, size_t buf_size) {
+    snprintf(buf, buf_size, "%08" PRIx32, next_msg_id());
 }
 
 bool la_websocket_deserialize_event(const char *json_str, struct sc_control_msg *msg)
@@ -684,10 +608,28 @@ la_websocket_client_init(const char *url, la_websocket_on_message_cb on_message,
     client->thread_started = false;
     client->context = NULL;
     client->wsi = NULL;
-    client->send_len = 0;
+    client->previews_dropped = 0;
+    atomic_init(&client->sent, 0);
+    atomic_init(&client->queued_bytes, 0);
+    atomic_init(&client->choked, false);
+    client->send_offset = 0;
+
+    if (!la_message_ring_init(&client->queue, LA_WS_QUEUE_CAPACITY,
+                              LA_WS_SLOT_SIZE, LWS_PRE))
+    {
+        LOGE("Failed to allocate WebSocket output queue");
+        free(client->protocol);
+        free(client->address);
+        free(client->path);
+        free(client->url);
+        free(client);
+        return NULL;
+    }
 
     pthread_mutex_init(&client->lock, NULL);
 
+    seed_msg_ids();
+
     LOGI("LinkAndroid WebSocket client initialized for: %s", url);
     LOGI("Parsed: %s://%s:%d%s", client->protocol, client->address,
          client->port, client->path);
@@ -701,6 +643,7 @@ la_websocket_client_init(const char *url, la_websocket_on_message_cb on_message,
         free(client->path);
         free(client->url);
         pthread_mutex_destroy(&client->lock);
+        la_message_ring_destroy(&client->queue);
         free(client);
         return NULL;
     }
@@ -711,77 +654,119 @@ la_websocket_client_init(const char *url, la_websocket_on_message_cb on_message,
     return client;
 }
 
-bool la_websocket_client_send(struct la_websocket_client *client, const char *json)
+// Queue a message made of a prefix followed by data (the prefix may be empty)
+//
+// Previews are dropped if the queue is already half full: a newer one will
+// follow anyway.
+static bool la_websocket_client_enqueue(struct la_websocket_client *client,
+                                        const void *prefix, size_t prefix_len,
+                                        const void *data, size_t data_len,
+                                        bool binary, bool preview)
 {
-    if (!client)
+    size_t len = prefix_len + data_len;
+    if (len > (preview ? MAX_PAYLOAD_SIZE : LA_WEBSOCKET_MAX_MESSAGE_SIZE))
     {
-        LOGD("WebSocket client is NULL");
+        LOGE("WebSocket payload too large: %zu bytes", len);
         return false;
     }
 
+    // The lock serializes the producers (the queue has a single writer)
     pthread_mutex_lock(&client->lock);
 
     if (!client->connected || !client->wsi)
     {
-        // Not connected, print to stdout as fallback
         pthread_mutex_unlock(&client->lock);
-        printf("[WebSocket Event] %s\n", json);
-        fflush(stdout);
         return false;
     }
 
-    size_t json_len = strlen(json);
-    if (json_len > MAX_PAYLOAD_SIZE)
+    if (preview
+        && la_message_ring_depth(&client->queue) >= LA_WS_PREVIEW_MAX_DEPTH)
     {
-        LOGE("JSON payload too large: %zu bytes", json_len);
+        ++client->previews_dropped;
         pthread_mutex_unlock(&client->lock);
         return false;
     }
 
-    // Allocate new node with padding for LWS
-    struct message_node *node = malloc(sizeof(struct message_node));
-    if (!node)
+    // Account for the message before it is visible to the service thread
+    atomic_fetch_add_explicit(&client->queued_bytes, len,
+                              memory_order_relaxed);
+
+    bool ok = la_message_ring_push(&client->queue, prefix, prefix_len,
+                                   data, data_len, binary);
+    if (!ok)
     {
-        LOGE("Failed to allocate message node");
+        atomic_fetch_sub_explicit(&client->queued_bytes, len,
+                                  memory_order_relaxed);
         pthread_mutex_unlock(&client->lock);
+        LOGD("WebSocket output queue full, message dropped");
         return false;
     }
 
-    // Allocate payload with LWS_PRE padding
-    node->payload = malloc(LWS_PRE + json_len + 1);
-    if (!node->payload)
+    // Wake up the service thread to handle the write request immediately
+    // (lws_callback_on_writable() must not be called from this thread)
+    if (client->context)
     {
-        LOGE("Failed to allocate message payload");
-        free(node);
-        pthread_mutex_unlock(&client->lock);
-        return false;
+        lws_cancel_service(client->context);
     }
 
-    node->len = json_len;
-    node->next = NULL;
+    pthread_mutex_unlock(&client->lock);
+
+    return true;
+}
 
-    // Copy data after padding
-    memcpy(node->payload + LWS_PRE, json, json_len);
-    node->payload[LWS_PRE + json_len] = '\0'; // Null terminate for debugging
+// Serialize an event directly into the next queue slot
+static bool la_websocket_client_enqueue_event(struct la_websocket_client *client,
+                                              const struct sc_control_msg *msg,
+                                              uint32_t id,
+                                              uint16_t device_width,
+                                              uint16_t device_height)
+{
+    // The lock serializes the producers (the queue has a single writer)
+    pthread_mutex_lock(&client->lock);
 
-    // Add to queue
-    if (client->queue_tail)
+    if (!client->connected || !client->wsi)
     {
-        client->queue_tail->next = node;
-        client->queue_tail = node;
+        pthread_mutex_unlock(&client->lock);
+        return false;
     }
-    else
+
+    struct la_message_ring *queue = &client->queue;
+    size_t size = queue->slot_size;
+    char *payload = (char *)la_message_ring_reserve(queue, size);
+    if (!payload)
     {
-        client->queue_head = node;
-        client->queue_tail = node;
+        pthread_mutex_unlock(&client->lock);
+        LOGD("WebSocket output queue full, event dropped");
+        return false;
     }
 
-    // LOGD("Sending WebSocket message: %s", json);
+    size_t len = la_event_json_serialize(msg, id, device_width, device_height,
+                                         payload, size);
+    if (!len)
+    {
+        // Message type not forwarded (nothing is committed)
+        pthread_mutex_unlock(&client->lock);
+        return false;
+    }
 
-    // Request write callback - REMOVED unsafe call from this thread
-    // lws_callback_on_writable(client->wsi);
+    if (len > size)
+    {
+        // Long text: serialize again into a buffer large enough
+        payload = (char *)la_message_ring_reserve(queue, len);
+        if (!payload)
+        {
+            pthread_mutex_unlock(&client->lock);
+            return false;
+        }
+        la_event_json_serialize(msg, id, device_width, device_height, payload,
+                                len);
+    }
 
-    // Wake up the service thread to handle the write request immediately
+    atomic_fetch_add_explicit(&client->queued_bytes, len,
+                              memory_order_relaxed);
+    la_message_ring_commit(queue, len, false);
+
+    // Wake up the service thread (see la_websocket_client_enqueue())
     if (client->context)
     {
         lws_cancel_service(client->context);
@@ -792,28 +777,76 @@ bool la_websocket_client_send(struct la_websocket_client *client, const char *js
     return true;
 }
 
+bool la_websocket_client_send(struct la_websocket_client *client, const char *json)
+{
+    if (!client)
+    {
+        LOGD("WebSocket client is NULL");
+        return false;
+    }
+
+    if (!la_websocket_client_is_connected(client))
+    {
+        // Not connected, print to stdout as fallback
+        printf("[WebSocket Event] %s\n", json);
+        fflush(stdout);
+        return false;
+    }
+
+    return la_websocket_client_enqueue(client, NULL, 0, json, strlen(json),
+                                       false, false);
+}
+
 void la_websocket_client_send_event(struct la_websocket_client *client,
                                     const struct sc_control_msg *msg,
                                     uint16_t device_width,
                                     uint16_t device_height)
 {
-    char *json = serialize_event_to_json(msg, device_width, device_height);
-    if (!json)
+    if (!client)
     {
-        // Message type not supported or serialization failed (e.g., hover events)
-        // Silently ignore unsupported events
-        // LOGD("WebSocket event serialization skipped for unsupported message type %d", msg->type);
+        LOGD("WebSocket client is NULL");
         return;
     }
 
-    bool sent = la_websocket_client_send(client, json);
-    if (!sent)
+    uint32_t id = next_msg_id();
+
+    if (la_websocket_client_is_connected(client))
     {
-        // Fallback: message was printed to stdout by la_websocket_client_send
-        LOGD("WebSocket send failed, event printed to stdout");
+        // Unsupported events (e.g. hover events) are silently ignored
+        la_websocket_client_enqueue_event(client, msg, id, device_width,
+                                          device_height);
+        return;
     }
 
-    free(json);
+    // Not connected, print to stdout as fallback
+    char buf[512];
+    char *json = buf;
+    size_t len = la_event_json_serialize(msg, id, device_width, device_height,
+                                         buf, sizeof(buf));
+    if (!len)
+    {
+        return;
+    }
+
+    if (len > sizeof(buf))
+    {
+        json = malloc(len);
+        if (!json)
+        {
+            LOG_OOM();
+            return;
+        }
+        la_event_json_serialize(msg, id, device_width, device_height, json,
+                                len);
+    }
+
+    printf("[WebSocket Event] %.*s\n", (int)len, json);
+    fflush(stdout);
+
+    if (json != buf)
+    {
+        free(json);
+    }
 }
 
 bool la_websocket_client_is_connected(struct la_websocket_client *client)
@@ -831,6 +864,7 @@ bool la_websocket_client_is_connected(struct la_websocket_client *client)
 }
 
 bool la_websocket_client_send_preview(struct la_websocket_client *client,
+                                      const char *serial,
                                       const char *image_data,
                                       const char *format)
 {
@@ -853,6 +887,10 @@ bool la_websocket_client_send_preview(struct la_websocket_client *client,
 
     cJSON_AddStringToObject(root, "type", "preview");
     cJSON_AddStringToObject(root, "id", id_str);
+    if (serial)
+    {
+        cJSON_AddStringToObject(root, "serial", serial);
+    }
     cJSON_AddStringToObject(root, "format", format);
     cJSON_AddStringToObject(root, "data", image_data);
 
@@ -865,12 +903,202 @@ bool la_websocket_client_send_preview(struct la_websocket_client *client,
         return false;
     }
 
-    bool sent = la_websocket_client_send(client, json);
+    bool sent = la_websocket_client_enqueue(client, NULL, 0, json,
+                                            strlen(json), false, true);
     free(json);
 
     return sent;
 }
 
+// Size of the serial field of the binary headers (0 if untagged)
+static size_t la_serial_field_size(const char *serial)
+{
+    return serial ? 1 + strlen(serial) : 0;
+}
+
+static void la_write_serial_field(uint8_t *buf, const char *serial)
+{
+    size_t len = strlen(serial);
+    assert(len <= UINT8_MAX);
+    buf[0] = len;
+    memcpy(&buf[1], serial, len);
+}
+
+bool la_websocket_client_send_preview_binary(struct la_websocket_client *client,
+                                             const char *serial,
+                                             enum la_preview_format format,
+                                             uint16_t width,
+                                             uint16_t height,
+                                             uint64_t timestamp_ms,
+                                             const uint8_t *image_data,
+                                             size_t image_size)
+{
+    if (!client || !image_data || (serial && strlen(serial) > UINT8_MAX))
+    {
+        return false;
+    }
+
+    uint8_t header[LA_PREVIEW_HEADER_SIZE + 1 + UINT8_MAX];
+    size_t header_size = LA_PREVIEW_HEADER_SIZE
+                       + la_serial_field_size(serial);
+    header[0] = LA_BINARY_MSG_TYPE_PREVIEW;
+    header[1] = format;
+    sc_write16be(&header[2], header_size);
+    sc_write32be(&header[4], next_msg_id());
+    sc_write16be(&header[8], width);
+    sc_write16be(&header[10], height);
+    sc_write64be(&header[12], timestamp_ms);
+    if (serial)
+    {
+        la_write_serial_field(&header[LA_PREVIEW_HEADER_SIZE], serial);
+    }
+
+    return la_websocket_client_enqueue(client, header, header_size,
+                                       image_data, image_size, true, true);
+}
+
+bool la_websocket_client_send_preview_tiles(struct la_websocket_client *client,
+                                            const struct la_preview_tiles *tiles,
+                                            const char *image_data)
+{
+    if (!client || !tiles || !image_data)
+    {
+        return false;
+    }
+
+    cJSON *root = cJSON_CreateObject();
+    if (!root)
+    {
+        LOGE("Failed to create JSON object for preview tiles");
+        return false;
+    }
+
+    char id_str[9];
+    generate_msg_id(id_str, sizeof(id_str));
+
+    cJSON_AddStringToObject(root, "type", "preview_tiles");
+    cJSON_AddStringToObject(root, "id", id_str);
+    if (tiles->serial)
+    {
+        cJSON_AddStringToObject(root, "serial", tiles->serial);
+    }
+    cJSON_AddStringToObject(root, "format",
+                            la_preview_format_name(tiles->format));
+    cJSON_AddStringToObject(root, "data", image_data);
+    cJSON_AddNumberToObject(root, "width", tiles->width);
+    cJSON_AddNumberToObject(root, "height", tiles->height);
+    cJSON_AddNumberToObject(root, "tileSize", tiles->tile_size);
+    cJSON_AddNumberToObject(root, "columns", tiles->columns);
+    cJSON *positions = cJSON_AddArrayToObject(root, "tiles");
+    for (unsigned i = 0; positions && i < 2u * tiles->count; ++i)
+    {
+        cJSON_AddItemToArray(positions,
+                             cJSON_CreateNumber(tiles->positions[i]));
+    }
+
+    char *json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+
+    if (!json)
+    {
+        LOGE("Failed to serialize preview tiles JSON");
+        return false;
+    }
+
+    bool sent = la_websocket_client_enqueue(client, NULL, 0, json,
+                                            strlen(json), false, true);
+    free(json);
+
+    return sent;
+}
+
+bool la_websocket_client_send_preview_tiles_binary(
+        struct la_websocket_client *client,
+        const struct la_preview_tiles *tiles,
+        const uint8_t *image_data, size_t image_size)
+{
+    if (!client || !tiles || !image_data
+        || (tiles->serial && strlen(tiles->serial) > UINT8_MAX))
+    {
+        return false;
+    }
+
+    size_t positions_end = LA_PREVIEW_TILES_HEADER_SIZE + 4 * tiles->count;
+    size_t header_size = positions_end + la_serial_field_size(tiles->serial);
+    if (header_size > UINT16_MAX)
+    {
+        return false;
+    }
+
+    uint8_t *header = malloc(header_size);
+    if (!header)
+    {
+        LOG_OOM();
+        return false;
+    }
+
+    header[0] = LA_BINARY_MSG_TYPE_PREVIEW_TILES;
+    header[1] = tiles->format;
+    sc_write16be(&header[2], header_size);
+    sc_write32be(&header[4], next_msg_id());
+    sc_write16be(&header[8], tiles->width);
+    sc_write16be(&header[10], tiles->height);
+    sc_write64be(&header[12], tiles->timestamp_ms);
+    sc_write16be(&header[20], tiles->tile_size);
+    sc_write16be(&header[22], tiles->count);
+    sc_write16be(&header[24], tiles->columns);
+    sc_write16be(&header[26], 0);
+    for (unsigned i = 0; i < 2u * tiles->count; ++i)
+    {
+        sc_write16be(&header[LA_PREVIEW_TILES_HEADER_SIZE + 2 * i],
+                     tiles->positions[i]);
+    }
+    if (tiles->serial)
+    {
+        la_write_serial_field(&header[positions_end], tiles->serial);
+    }
+
+    bool sent = la_websocket_client_enqueue(client, header, header_size,
+                                            image_data, image_size, true,
+                                            true);
+    free(header);
+
+    return sent;
+}
+
+bool la_websocket_client_is_backpressured(struct la_websocket_client *client)
+{
+    if (!client)
+    {
+        return false;
+    }
+
+    size_t queued_bytes = atomic_load_explicit(&client->queued_bytes,
+                                               memory_order_relaxed);
+    return queued_bytes > LA_WS_BACKPRESSURE_BYTES
+        || la_message_ring_depth(&client->queue) >= LA_WS_PREVIEW_MAX_DEPTH
+        || atomic_load_explicit(&client->choked, memory_order_relaxed);
+}
+
+void la_websocket_client_get_stats(struct la_websocket_client *client,
+                                   struct la_websocket_client_stats *stats)
+{
+    pthread_mutex_lock(&client->lock);
+    stats->previews_dropped = client->previews_dropped;
+    pthread_mutex_unlock(&client->lock);
+
+    struct la_message_ring *queue = &client->queue;
+    stats->queue_depth = la_message_ring_depth(queue);
+    stats->max_queue_depth =
+        atomic_load_explicit(&queue->max_depth, memory_order_relaxed);
+    stats->queued = atomic_load_explicit(&queue->pushed, memory_order_relaxed);
+    stats->dropped =
+        atomic_load_explicit(&queue->dropped, memory_order_relaxed);
+    stats->sent = atomic_load_explicit(&client->sent, memory_order_relaxed);
+    stats->queued_bytes = atomic_load_explicit(&client->queued_bytes,
+                                               memory_order_relaxed);
+}
+
 void la_websocket_client_destroy(struct la_websocket_client *client)
 {
     if (!client)
@@ -895,19 +1123,15 @@ void la_websocket_client_destroy(struct la_websocket_client *client)
         client->thread_started = false;
     }
 
-    // Clear output queue
-    pthread_mutex_lock(&client->lock);
-    struct message_node *node = client->queue_head;
-    while (node)
-    {
-        struct message_node *next = node->next;
-        free(node->payload);
-        free(node);
-        node = next;
-    }
-    client->queue_head = NULL;
-    client->queue_tail = NULL;
-    pthread_mutex_unlock(&client->lock);
+    struct la_websocket_client_stats stats;
+    la_websocket_client_get_stats(client, &stats);
+    LOGI("LinkAndroid WebSocket queue: %" PRIu32 " sent, %" PRIu32
+         " dropped, %" PRIu32 " previews dropped, max depth %" PRIu32,
+         stats.sent, stats.dropped, stats.previews_dropped,
+         stats.max_queue_depth);
+
+    // Clear output queue (the service thread is stopped)
+    la_message_ring_destroy(&client->queue);
 
     pthread_mutex_destroy(&client->lock);
 
@@ -4,9 +4,88 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include <stddef.h>
+
+#include "preview_encoder.h"
+
 struct la_websocket_client;
 struct sc_control_msg;
 
+/**
+ * Binary preview message (big-endian), followed by the raw image bytes:
+ *
+ *   offset  size  field
+ *   0       1     message type (LA_BINARY_MSG_TYPE_PREVIEW)
+ *   1       1     image format (enum la_preview_format)
+ *   2       2     header size in bytes (readers must skip unknown fields)
+ *   4       4     message id
+ *   8       2     image width
+ *   10      2     image height
+ *   12      8     capture timestamp (milliseconds since the Unix epoch)
+ *   20      1+n   device serial, only in host mode (1 byte length n, then n
+ *                 bytes, not null-terminated)
+ */
+#define LA_PREVIEW_HEADER_SIZE 20
+#define LA_BINARY_MSG_TYPE_PREVIEW 0x01
+
+/**
+ * Binary preview tiles message (big-endian), followed by the raw image bytes.
+ *
+ * Only the tiles of the preview which changed since the previous messages are
+ * sent, packed in a single image (the atlas): tile i is stored in the cell
+ * (i % atlas columns, i / atlas columns), each cell being tile size x tile
+ * size pixels. The tiles on the right and bottom edges of the preview are
+ * smaller than the cells (the rest of the cell is undefined).
+ *
+ *   offset  size  field
+ *   0       1     message type (LA_BINARY_MSG_TYPE_PREVIEW_TILES)
+ *   1       1     atlas image format (enum la_preview_format)
+ *   2       2     header size in bytes (28 + 4 * tile count, + 1 + serial
+ *                 length in host mode)
+ *   4       4     message id
+ *   8       2     preview width
+ *   10      2     preview height
+ *   12      8     capture timestamp (milliseconds since the Unix epoch)
+ *   20      2     tile size
+ *   22      2     tile count
+ *   24      2     atlas columns
+ *   26      2     reserved (0)
+ *   28      4*n   position of each tile in the preview, in tiles (2 bytes
+ *                 column, 2 bytes row)
+ *   28+4*n  1+m   device serial, only in host mode (as in
+ *                 LA_BINARY_MSG_TYPE_PREVIEW)
+ *
+ * The tiles apply to the last full preview (LA_BINARY_MSG_TYPE_PREVIEW).
+ */
+#define LA_PREVIEW_TILES_HEADER_SIZE 28
+#define LA_BINARY_MSG_TYPE_PREVIEW_TILES 0x02
+
+// Changed tiles of a preview (see LA_BINARY_MSG_TYPE_PREVIEW_TILES)
+struct la_preview_tiles
+{
+    enum la_preview_format format; // Atlas image format
+    uint16_t width;                // Preview width
+    uint16_t height;               // Preview height
+    uint16_t tile_size;
+    uint16_t count;
+    uint16_t columns;              // Atlas columns
+    const uint16_t *positions;     // [2 * count] column and row of each tile
+    uint64_t timestamp_ms;         // Capture timestamp (ms since the epoch)
+    const char *serial;            // Device serial in host mode (or NULL)
+};
+
+// Output queue counters
+struct la_websocket_client_stats
+{
+    uint32_t queue_depth;      // Messages currently queued
+    uint32_t max_queue_depth;  // Highest queue depth observed
+    uint32_t queued;           // Messages queued
+    uint32_t sent;             // Messages written to the socket
+    uint32_t dropped;          // Messages dropped because the queue was full
+    uint32_t previews_dropped; // Previews dropped to keep room for events
+    size_t queued_bytes;       // Payload bytes not completely sent yet
+};
+
 // Callback function type for receiving JSON events from WebSocket server
 typedef void (*la_websocket_on_message_cb)(const char *json, void *userdata);
 
@@ -22,6 +101,10 @@ struct la_websocket_client *
 la_websocket_client_init(const char *url, la_websocket_on_message_cb on_message, 
                          void *userdata);
 
+// Maximum size of a message which is not a preview (a full resolution
+// screenshot is sent as a base64 data URL in a JSON response)
+#define LA_WEBSOCKET_MAX_MESSAGE_SIZE (32 * 1024 * 1024)
+
 /**
  * Send JSON event to WebSocket server
  * 
@@ -69,15 +152,102 @@ la_websocket_client_is_connected(struct la_websocket_client *client);
  * Send image preview data to WebSocket server
  * 
  * @param client WebSocket client instance
+ * @param serial Device serial in host mode, added as a "serial" field (or
+ *               NULL)
  * @param image_data Base64-encoded image data (PNG or JPEG)
  * @param format Image format ("png" or "jpeg")
  * @return true on success, false on failure
  */
 bool
 la_websocket_client_send_preview(struct la_websocket_client *client,
+                                 const char *serial,
                                  const char *image_data,
                                  const char *format);
 
+/**
+ * Send image preview as a binary WebSocket message
+ *
+ * The image bytes are copied once, right after the LA_PREVIEW_HEADER_SIZE
+ * header, without any text encoding.
+ *
+ * @param client WebSocket client instance
+ * @param serial Device serial in host mode (or NULL)
+ * @param format Image format
+ * @param width Image width
+ * @param height Image height
+ * @param timestamp_ms Capture timestamp (milliseconds since the Unix epoch)
+ * @param image_data Encoded image
+ * @param image_size Encoded image size in bytes
+ * @return true on success, false on failure
+ */
+bool
+la_websocket_client_send_preview_binary(struct la_websocket_client *client,
+                                        const char *serial,
+                                        enum la_preview_format format,
+                                        uint16_t width,
+                                        uint16_t height,
+                                        uint64_t timestamp_ms,
+                                        const uint8_t *image_data,
+                                        size_t image_size);
+
+/**
+ * Send the changed tiles of a preview as JSON, the atlas being a base64 data
+ * URL:
+ *
+ *   {"type":"preview_tiles","id":..,"format":..,"data":"data:image/...",
+ *    "width":..,"height":..,"tileSize":..,"columns":..,
+ *    "tiles":[col0,row0,col1,row1,...]}
+ *
+ * In host mode, a "serial" field identifies the device.
+ *
+ * @param client WebSocket client instance
+ * @param tiles Tiles description
+ * @param image_data Atlas image as a data URL
+ * @return true on success, false on failure
+ */
+bool
+la_websocket_client_send_preview_tiles(struct la_websocket_client *client,
+                                       const struct la_preview_tiles *tiles,
+                                       const char *image_data);
+
+/**
+ * Send the changed tiles of a preview as a binary WebSocket message
+ *
+ * @param client WebSocket client instance
+ * @param tiles Tiles description
+ * @param image_data Encoded atlas image
+ * @param image_size Encoded atlas image size in bytes
+ * @return true on success, false on failure
+ */
+bool
+la_websocket_client_send_preview_tiles_binary(
+        struct la_websocket_client *client,
+        const struct la_preview_tiles *tiles,
+        const uint8_t *image_data, size_t image_size);
+
+/**
+ * Check if the output queue is backpressured
+ *
+ * This is the case when the data queued so far is not sent fast enough (slow
+ * link or slow server). Callers producing optional messages (e.g. previews)
+ * should skip them rather than queue more data.
+ *
+ * @param client WebSocket client instance (can be NULL)
+ * @return true if backpressured, false otherwise
+ */
+bool
+la_websocket_client_is_backpressured(struct la_websocket_client *client);
+
+/**
+ * Get the output queue counters
+ *
+ * @param client WebSocket client instance
+ * @param stats Counters to fill
+ */
+void
+la_websocket_client_get_stats(struct la_websocket_client *client,
+                              struct la_websocket_client_stats *stats);
+
 /**
  * Destroy WebSocket client and close connection
  * 
@@ -0,0 +1,508 @@
+#include "yuv_downscale.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+# include <emmintrin.h>
+# define LA_YUV_DOWNSCALE_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+# define LA_YUV_DOWNSCALE_NEON
+#endif
+
+// Precision of the YUV to RGB coefficients
+#define LA_YUV_DOWNSCALE_BITS 13
+
+// BT.601 (the swscale default colorspace)
+#define LA_KR 0.299
+#define LA_KB 0.114
+#define LA_KG (1.0 - LA_KR - LA_KB)
+
+static inline int la_chroma_size(int size)
+{
+    return (size + 1) / 2;
+}
+
+static inline uint8_t la_clip_uint8(int v)
+{
+    return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+// Largest number of source pixels covered by a destination pixel
+static int la_max_box(int src_size, int size)
+{
+    return (src_size + size - 1) / size;
+}
+
+bool la_yuv_downscale_supported(int src_width, int src_height, int width,
+                                int height)
+{
+    if (width <= 0 || height <= 0 || width > src_width || height > src_height)
+    {
+        return false;
+    }
+
+    return la_max_box(src_height, height) <= LA_YUV_DOWNSCALE_MAX_BOX_HEIGHT
+        && la_max_box(la_chroma_size(src_height), la_chroma_size(height))
+            <= LA_YUV_DOWNSCALE_MAX_BOX_HEIGHT;
+}
+
+// Add a source row to the vertical sums
+static void la_yuv_downscale_add_row(uint16_t *acc, const uint8_t *src,
+                                     int width)
+{
+    int x = 0;
+
+#if defined(LA_YUV_DOWNSCALE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + x));
+        __m128i lo = _mm_loadu_si128((const __m128i *)(acc + x));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(acc + x + 8));
+        lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+        hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+        _mm_storeu_si128((__m128i *)(acc + x), lo);
+        _mm_storeu_si128((__m128i *)(acc + x + 8), hi);
+    }
+#elif defined(LA_YUV_DOWNSCALE_NEON)
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8x16_t v = vld1q_u8(src + x);
+        vst1q_u16(acc + x, vaddw_u8(vld1q_u16(acc + x), vget_low_u8(v)));
+        vst1q_u16(acc + x + 8,
+                  vaddw_u8(vld1q_u16(acc + x + 8), vget_high_u8(v)));
+    }
+#endif
+
+    for (; x < width; ++x)
+    {
+        acc[x] += src[x];
+    }
+}
+
+// Compute the boundaries of the destination pixels along one dimension
+static int *la_yuv_downscale_map(int src_size, int size)
+{
+    int *bounds = malloc((size + 1) * sizeof(*bounds));
+    if (!bounds)
+    {
+        return NULL;
+    }
+
+    for (int i = 0; i <= size; ++i)
+    {
+        bounds[i] = (int)((int64_t)i * src_size / size);
+    }
+
+    return bounds;
+}
+
+// Multiplier to divide by count (see la_yuv_downscale_div()), or 0 if the
+// division must be used
+static inline uint64_t la_yuv_downscale_inverse(uint32_t count)
+{
+    // Exact for any numerator lower than 2^32 / count, i.e. up to 256 * count
+    // if count < 4096
+    return count < 4096 ? (UINT64_C(1) << 32) / count + 1 : 0;
+}
+
+// Rounded mean of count values
+static inline uint8_t la_yuv_downscale_div(uint32_t sum, uint32_t count,
+                                           uint64_t inverse)
+{
+    uint32_t n = sum + count / 2;
+    return inverse ? (n * inverse) >> 32 : n / count;
+}
+
+static void la_yuv_downscale_copy_plane(const uint8_t *src, int src_linesize,
+                                        uint8_t *dst, int dst_linesize,
+                                        int width, int height,
+                                        const uint8_t *lut)
+{
+    for (int y = 0; y < height; ++y)
+    {
+        const uint8_t *in = src + (size_t)y * src_linesize;
+        uint8_t *out = dst + (size_t)y * dst_linesize;
+        if (lut)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                out[x] = lut[in[x]];
+            }
+        }
+        else
+        {
+            memcpy(out, in, width);
+        }
+    }
+}
+
+// Downscale one plane, applying lut (if not NULL) to the result
+static void la_yuv_downscale_plane(struct la_yuv_downscale *ds,
+                                   const uint8_t *src, int src_linesize,
+                                   int src_width, int src_height,
+                                   uint8_t *dst, int dst_linesize,
+                                   int width, int height, const int *xs,
+                                   const uint8_t *lut)
+{
+    if (width == src_width && height == src_height)
+    {
+        la_yuv_downscale_copy_plane(src, src_linesize, dst, dst_linesize,
+                                    width, height, lut);
+        return;
+    }
+
+    uint16_t *acc = ds->acc;
+    // The columns are either box_width or box_width + 1 pixels wide
+    int box_width = src_width / width;
+
+    for (int row = 0; row < height; ++row)
+    {
+        int y0 = (int)((int64_t)row * src_height / height);
+        int y1 = (int)((int64_t)(row + 1) * src_height / height);
+
+        memset(acc, 0, src_width * sizeof(*acc));
+        for (int y = y0; y < y1; ++y)
+        {
+            la_yuv_downscale_add_row(acc, src + (size_t)y * src_linesize,
+                                     src_width);
+        }
+
+        uint32_t counts[2] = {
+            (uint32_t)(y1 - y0) * box_width,
+            (uint32_t)(y1 - y0) * (box_width + 1),
+        };
+        uint64_t inverses[2] = {
+            la_yuv_downscale_inverse(counts[0]),
+            la_yuv_downscale_inverse(counts[1]),
+        };
+
+        uint8_t *out = dst + (size_t)row * dst_linesize;
+        for (int col = 0; col < width; ++col)
+        {
+            uint32_t sum = 0;
+            for (int x = xs[col]; x < xs[col + 1]; ++x)
+            {
+                sum += acc[x];
+            }
+            int wide = xs[col + 1] - xs[col] != box_width;
+            uint8_t value =
+                la_yuv_downscale_div(sum, counts[wide], inverses[wide]);
+            out[col] = lut ? lut[value] : value;
+        }
+    }
+}
+
+static void la_yuv_downscale_init_luts(struct la_yuv_downscale *ds,
+                                       bool src_full_range,
+                                       bool dst_full_range)
+{
+    ds->luts = src_full_range != dst_full_range;
+    if (!ds->luts)
+    {
+        return;
+    }
+
+    for (int i = 0; i < 256; ++i)
+    {
+        if (dst_full_range)
+        {
+            ds->y_lut[i] = la_clip_uint8((int)((i - 16) * 255.0 / 219.0
+                                               + 128.5) - 128);
+            ds->uv_lut[i] = la_clip_uint8((int)((i - 128) * 255.0 / 224.0
+                                                + 128.5));
+        }
+        else
+        {
+            ds->y_lut[i] = (uint8_t)(i * 219.0 / 255.0 + 16.5);
+            ds->uv_lut[i] = (uint8_t)((i - 128) * 224.0 / 255.0 + 128.5);
+        }
+    }
+}
+
+static void la_yuv_downscale_init_coefs(struct la_yuv_downscale *ds,
+                                        bool src_full_range)
+{
+    double one = 1 << LA_YUV_DOWNSCALE_BITS;
+    double y_scale = src_full_range ? 1.0 : 255.0 / 219.0;
+    double c_scale = src_full_range ? 1.0 : 255.0 / 224.0;
+
+    ds->y_offset = src_full_range ? 0 : 16;
+    ds->y_coef = (int16_t)(y_scale * one + 0.5);
+    ds->v_r = (int16_t)(2 * (1 - LA_KR) * c_scale * one + 0.5);
+    ds->u_g = (int16_t)(2 * (1 - LA_KB) * LA_KB / LA_KG * c_scale * one + 0.5);
+    ds->v_g = (int16_t)(2 * (1 - LA_KR) * LA_KR / LA_KG * c_scale * one + 0.5);
+    ds->u_b = (int16_t)(2 * (1 - LA_KB) * c_scale * one + 0.5);
+}
+
+// The conversion is computed on 16 bits: the inputs are multiplied by 2^7, the
+// coefficients by 2^13, and the high 16 bits of the products (as
+// _mm_mulhi_epi16()) are the values multiplied by 2^4. The scalar and SIMD
+// versions give the same results.
+
+static inline int la_mulhi(int a, int b)
+{
+    return (a * b) >> 16;
+}
+
+#if defined(LA_YUV_DOWNSCALE_NEON)
+static inline int16x8_t la_mulhi_neon(int16x8_t a, int16_t b)
+{
+    int32x4_t lo = vmull_n_s16(vget_low_s16(a), b);
+    int32x4_t hi = vmull_n_s16(vget_high_s16(a), b);
+    return vcombine_s16(vshrn_n_s32(lo, 16), vshrn_n_s32(hi, 16));
+}
+#endif
+
+// Convert a row to RGB (the chroma is not interpolated)
+static void la_yuv_downscale_rgb_row(const struct la_yuv_downscale *ds,
+                                     const uint8_t *py, const uint8_t *pu,
+                                     const uint8_t *pv, uint8_t *out,
+                                     int width)
+{
+    int x = 0;
+
+#if defined(LA_YUV_DOWNSCALE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i y_offset = _mm_set1_epi16(ds->y_offset);
+    const __m128i c_offset = _mm_set1_epi16(128);
+    const __m128i round = _mm_set1_epi16(8);
+    const __m128i y_coef = _mm_set1_epi16(ds->y_coef);
+    const __m128i v_r = _mm_set1_epi16(ds->v_r);
+    const __m128i u_g = _mm_set1_epi16(ds->u_g);
+    const __m128i v_g = _mm_set1_epi16(ds->v_g);
+    const __m128i u_b = _mm_set1_epi16(ds->u_b);
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i vy = _mm_loadu_si128((const __m128i *)(py + x));
+        __m128i vu = _mm_loadl_epi64((const __m128i *)(pu + x / 2));
+        __m128i vv = _mm_loadl_epi64((const __m128i *)(pv + x / 2));
+        // Each chroma value covers 2 pixels
+        vu = _mm_unpacklo_epi8(vu, vu);
+        vv = _mm_unpacklo_epi8(vv, vv);
+
+        __m128i rgb[3][2];
+        for (int h = 0; h < 2; ++h)
+        {
+            __m128i l = h ? _mm_unpackhi_epi8(vy, zero)
+                          : _mm_unpacklo_epi8(vy, zero);
+            __m128i u = h ? _mm_unpackhi_epi8(vu, zero)
+                          : _mm_unpacklo_epi8(vu, zero);
+            __m128i v = h ? _mm_unpackhi_epi8(vv, zero)
+                          : _mm_unpacklo_epi8(vv, zero);
+            l = _mm_slli_epi16(_mm_sub_epi16(l, y_offset), 7);
+            u = _mm_slli_epi16(_mm_sub_epi16(u, c_offset), 7);
+            v = _mm_slli_epi16(_mm_sub_epi16(v, c_offset), 7);
+
+            l = _mm_add_epi16(_mm_mulhi_epi16(l, y_coef), round);
+            __m128i r = _mm_add_epi16(l, _mm_mulhi_epi16(v, v_r));
+            __m128i g = _mm_sub_epi16(l, _mm_mulhi_epi16(u, u_g));
+            g = _mm_sub_epi16(g, _mm_mulhi_epi16(v, v_g));
+            __m128i b = _mm_add_epi16(l, _mm_mulhi_epi16(u, u_b));
+            rgb[0][h] = _mm_srai_epi16(r, 4);
+            rgb[1][h] = _mm_srai_epi16(g, 4);
+            rgb[2][h] = _mm_srai_epi16(b, 4);
+        }
+
+        // SSE2 cannot interleave 3 channels efficiently
+        uint8_t channels[3][16];
+        for (int c = 0; c < 3; ++c)
+        {
+            _mm_storeu_si128((__m128i *)channels[c],
+                             _mm_packus_epi16(rgb[c][0], rgb[c][1]));
+        }
+        for (int i = 0; i < 16; ++i)
+        {
+            out[3 * (x + i)] = channels[0][i];
+            out[3 * (x + i) + 1] = channels[1][i];
+            out[3 * (x + i) + 2] = channels[2][i];
+        }
+    }
+#elif defined(LA_YUV_DOWNSCALE_NEON)
+    const int16x8_t y_offset = vdupq_n_s16(ds->y_offset);
+    const int16x8_t c_offset = vdupq_n_s16(128);
+    const int16x8_t round = vdupq_n_s16(8);
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8x16_t vy = vld1q_u8(py + x);
+        uint8x8_t vu = vld1_u8(pu + x / 2);
+        uint8x8_t vv = vld1_u8(pv + x / 2);
+        // Each chroma value covers 2 pixels
+        uint8x8x2_t uu = vzip_u8(vu, vu);
+        uint8x8x2_t vvv = vzip_u8(vv, vv);
+
+        uint8x8_t rgb[3][2];
+        for (int h = 0; h < 2; ++h)
+        {
+            int16x8_t l = vreinterpretq_s16_u16(
+                vmovl_u8(h ? vget_high_u8(vy) : vget_low_u8(vy)));
+            int16x8_t u = vreinterpretq_s16_u16(vmovl_u8(uu.val[h]));
+            int16x8_t v = vreinterpretq_s16_u16(vmovl_u8(vvv.val[h]));
+            l = vshlq_n_s16(vsubq_s16(l, y_offset), 7);
+            u = vshlq_n_s16(vsubq_s16(u, c_offset), 7);
+            v = vshlq_n_s16(vsubq_s16(v, c_offset), 7);
+
+            l = vaddq_s16(la_mulhi_neon(l, ds->y_coef), round);
+            int16x8_t r = vaddq_s16(l, la_mulhi_neon(v, ds->v_r));
+            int16x8_t g = vsubq_s16(l, la_mulhi_neon(u, ds->u_g));
+            g = vsubq_s16(g, la_mulhi_neon(v, ds->v_g));
+            int16x8_t b = vaddq_s16(l, la_mulhi_neon(u, ds->u_b));
+            rgb[0][h] = vqmovun_s16(vshrq_n_s16(r, 4));
+            rgb[1][h] = vqmovun_s16(vshrq_n_s16(g, 4));
+            rgb[2][h] = vqmovun_s16(vshrq_n_s16(b, 4));
+        }
+
+        uint8x16x3_t pixels;
+        for (int c = 0; c < 3; ++c)
+        {
+            pixels.val[c] = vcombine_u8(rgb[c][0], rgb[c][1]);
+        }
+        vst3q_u8(out + 3 * x, pixels);
+    }
+#endif
+
+    for (; x < width; ++x)
+    {
+        int l = la_mulhi((py[x] - ds->y_offset) * 128, ds->y_coef) + 8;
+        int u = (pu[x / 2] - 128) * 128;
+        int v = (pv[x / 2] - 128) * 128;
+        out[3 * x] = la_clip_uint8((l + la_mulhi(v, ds->v_r)) >> 4);
+        out[3 * x + 1] = la_clip_uint8(
+            (l - la_mulhi(u, ds->u_g) - la_mulhi(v, ds->v_g)) >> 4);
+        out[3 * x + 2] = la_clip_uint8((l + la_mulhi(u, ds->u_b)) >> 4);
+    }
+}
+
+// Convert YUV 4:2:0 planes to RGB
+static void la_yuv_downscale_to_rgb(struct la_yuv_downscale *ds,
+                                    const uint8_t *const planes[3],
+                                    const int linesize[3], uint8_t *dst,
+                                    int dst_linesize)
+{
+    for (int y = 0; y < ds->height; ++y)
+    {
+        la_yuv_downscale_rgb_row(ds, planes[0] + (size_t)y * linesize[0],
+                                 planes[1] + (size_t)(y / 2) * linesize[1],
+                                 planes[2] + (size_t)(y / 2) * linesize[2],
+                                 dst + (size_t)y * dst_linesize, ds->width);
+    }
+}
+
+bool la_yuv_downscale_init(struct la_yuv_downscale *ds, int src_width,
+                           int src_height, bool src_full_range, int width,
+                           int height, enum la_yuv_downscale_output output,
+                           bool dst_full_range)
+{
+    memset(ds, 0, sizeof(*ds));
+
+    if (!la_yuv_downscale_supported(src_width, src_height, width, height))
+    {
+        return false;
+    }
+
+    ds->src_width = src_width;
+    ds->src_height = src_height;
+    ds->width = width;
+    ds->height = height;
+    ds->output = output;
+
+    ds->acc = malloc(src_width * sizeof(*ds->acc));
+    ds->xs = la_yuv_downscale_map(src_width, width);
+    ds->chroma_xs = la_yuv_downscale_map(la_chroma_size(src_width),
+                                         la_chroma_size(width));
+    if (!ds->acc || !ds->xs || !ds->chroma_xs)
+    {
+        goto error;
+    }
+
+    if (output == LA_YUV_DOWNSCALE_RGB24)
+    {
+        size_t chroma_size =
+            (size_t)la_chroma_size(width) * la_chroma_size(height);
+        ds->tmp[0] = malloc((size_t)width * height);
+        ds->tmp[1] = malloc(chroma_size);
+        ds->tmp[2] = malloc(chroma_size);
+        if (!ds->tmp[0] || !ds->tmp[1] || !ds->tmp[2])
+        {
+            goto error;
+        }
+        la_yuv_downscale_init_coefs(ds, src_full_range);
+    }
+    else
+    {
+        la_yuv_downscale_init_luts(ds, src_full_range, dst_full_range);
+    }
+
+    return true;
+
+error:
+    la_yuv_downscale_destroy(ds);
+    return false;
+}
+
+void la_yuv_downscale_process(struct la_yuv_downscale *ds,
+                              const uint8_t *const src[3],
+                              const int src_linesize[3],
+                              uint8_t *const dst[3],
+                              const int dst_linesize[3])
+{
+    assert(ds->acc);
+
+    int src_chroma_width = la_chroma_size(ds->src_width);
+    int src_chroma_height = la_chroma_size(ds->src_height);
+    int chroma_width = la_chroma_size(ds->width);
+    int chroma_height = la_chroma_size(ds->height);
+
+    if (ds->output == LA_YUV_DOWNSCALE_RGB24)
+    {
+        if (ds->width == ds->src_width && ds->height == ds->src_height)
+        {
+            // Color conversion only
+            la_yuv_downscale_to_rgb(ds, src, src_linesize, dst[0],
+                                    dst_linesize[0]);
+            return;
+        }
+
+        la_yuv_downscale_plane(ds, src[0], src_linesize[0], ds->src_width,
+                               ds->src_height, ds->tmp[0], ds->width,
+                               ds->width, ds->height, ds->xs, NULL);
+        for (int p = 1; p < 3; ++p)
+        {
+            la_yuv_downscale_plane(ds, src[p], src_linesize[p],
+                                   src_chroma_width, src_chroma_height,
+                                   ds->tmp[p], chroma_width, chroma_width,
+                                   chroma_height, ds->chroma_xs, NULL);
+        }
+        const uint8_t *const tmp[3] = {ds->tmp[0], ds->tmp[1], ds->tmp[2]};
+        const int tmp_linesize[3] = {ds->width, chroma_width, chroma_width};
+        la_yuv_downscale_to_rgb(ds, tmp, tmp_linesize, dst[0],
+                                dst_linesize[0]);
+        return;
+    }
+
+    la_yuv_downscale_plane(ds, src[0], src_linesize[0], ds->src_width,
+                           ds->src_height, dst[0], dst_linesize[0], ds->width,
+                           ds->height, ds->xs, ds->luts ? ds->y_lut : NULL);
+    for (int p = 1; p < 3; ++p)
+    {
+        la_yuv_downscale_plane(ds, src[p], src_linesize[p], src_chroma_width,
+                               src_chroma_height, dst[p], dst_linesize[p],
+                               chroma_width, chroma_height, ds->chroma_xs,
+                               ds->luts ? ds->uv_lut : NULL);
+    }
+}
+
+void la_yuv_downscale_destroy(struct la_yuv_downscale *ds)
+{
+    free(ds->acc);
+    free(ds->xs);
+    free(ds->chroma_xs);
+    for (int p = 0; p < 3; ++p)
+    {
+        free(ds->tmp[p]);
+    }
+    memset(ds, 0, sizeof(*ds));
+}
@@ -0,0 +1,106 @@
+#ifndef LA_YUV_DOWNSCALE_H
+#define LA_YUV_DOWNSCALE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Maximum number of source rows averaged into one destination row (the
+// vertical sums are accumulated on 16 bits)
+#define LA_YUV_DOWNSCALE_MAX_BOX_HEIGHT 257
+
+enum la_yuv_downscale_output
+{
+    LA_YUV_DOWNSCALE_YUV420P,
+    LA_YUV_DOWNSCALE_RGB24,
+};
+
+/**
+ * Fast YUV 4:2:0 downscaler for the previews
+ *
+ * Each destination pixel is the mean of the source pixels it covers (box, or
+ * area, filter): for a destination size D and a source size S, the pixel i
+ * covers the source pixels [i * S / D, (i + 1) * S / D).
+ *
+ * The source rows are summed in a 16-bit accumulator (SSE2 or NEON if
+ * available), then the accumulator is summed horizontally for each
+ * destination pixel. Every source pixel is read only once, and the color
+ * conversion (range conversion or YUV to RGB, BT.601) is done at the
+ * destination size.
+ */
+struct la_yuv_downscale
+{
+    // Geometry
+    int src_width;
+    int src_height;
+    int width;
+    int height;
+    enum la_yuv_downscale_output output;
+
+    uint16_t *acc; // Vertical sums of a source row [src_width]
+    int *xs;       // Luma column boundaries [width + 1]
+    int *chroma_xs; // Chroma column boundaries [(width + 1) / 2 + 1]
+
+    // Downscaled planes in the source range (RGB24 output only)
+    uint8_t *tmp[3];
+
+    // Range conversion of the luma and chroma values (YUV420P output only)
+    bool luts; // false if the source and destination ranges are the same
+    uint8_t y_lut[256];
+    uint8_t uv_lut[256];
+
+    // Fixed-point (13 bits) YUV to RGB coefficients (RGB24 output only)
+    int16_t y_offset;
+    int16_t y_coef;
+    int16_t v_r;
+    int16_t u_g;
+    int16_t v_g;
+    int16_t u_b;
+};
+
+/**
+ * Tell whether a downscale is supported
+ *
+ * The destination must not be larger than the source, and a destination row
+ * must not cover more than LA_YUV_DOWNSCALE_MAX_BOX_HEIGHT source rows.
+ */
+bool la_yuv_downscale_supported(int src_width, int src_height, int width,
+                                int height);
+
+/**
+ * Initialize a downscaler
+ *
+ * @param src_width Source luma width
+ * @param src_height Source luma height
+ * @param src_full_range true if the source is full range (JPEG), false if it
+ *                       is limited range (MPEG)
+ * @param width Destination width
+ * @param height Destination height
+ * @param output Destination pixel format
+ * @param dst_full_range Range of the destination (YUV420P output only)
+ * @return true on success, false if the downscale is not supported or on
+ *         allocation failure
+ */
+bool la_yuv_downscale_init(struct la_yuv_downscale *ds, int src_width,
+                           int src_height, bool src_full_range, int width,
+                           int height, enum la_yuv_downscale_output output,
+                           bool dst_full_range);
+
+/**
+ * Downscale a YUV 4:2:0 image
+ *
+ * For RGB24 output, only dst[0] and dst_linesize[0] are used.
+ *
+ * @param src Source planes (Y, U, V)
+ * @param src_linesize Source line sizes
+ * @param dst Destination planes
+ * @param dst_linesize Destination line sizes
+ */
+void la_yuv_downscale_process(struct la_yuv_downscale *ds,
+                              const uint8_t *const src[3],
+                              const int src_linesize[3],
+                              uint8_t *const dst[3],
+                              const int dst_linesize[3]);
+
+void la_yuv_downscale_destroy(struct la_yuv_downscale *ds);
+
+#endif
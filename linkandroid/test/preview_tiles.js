@@ -0,0 +1,252 @@
+/**
+ * Reconstruction of the previews sent with --linkandroid-preview-tiles
+ *
+ * A full preview is followed by messages containing only the changed tiles,
+ * packed in a single image (the atlas). The tiles are drawn over the last
+ * full preview to get the current image.
+ *
+ * Only PNG previews are reconstructed (decoded with the built-in zlib, without
+ * any dependency): JPEG and WebP tiles are only reported.
+ */
+
+const zlib = require('zlib');
+
+const PNG_SIGNATURE = Buffer.from([0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a]);
+
+// Number of channels for each PNG color type (8-bit depth only)
+const PNG_CHANNELS = { 0: 1, 2: 3, 4: 2, 6: 4 };
+
+const CRC_TABLE = (() => {
+  const table = new Uint32Array(256);
+  for (let n = 0; n < 256; n++) {
+    let c = n;
+    for (let k = 0; k < 8; k++) {
+      c = c & 1 ? 0xedb88320 ^ (c >>> 1) : c >>> 1;
+    }
+    table[n] = c >>> 0;
+  }
+  return table;
+})();
+
+function crc32(buf) {
+  let c = 0xffffffff;
+  for (let i = 0; i < buf.length; i++) {
+    c = CRC_TABLE[(c ^ buf[i]) & 0xff] ^ (c >>> 8);
+  }
+  return (c ^ 0xffffffff) >>> 0;
+}
+
+function paeth(a, b, c) {
+  const p = a + b - c;
+  const pa = Math.abs(p - a);
+  const pb = Math.abs(p - b);
+  const pc = Math.abs(p - c);
+  return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+// Decode a non-interlaced 8-bit PNG into raw pixels
+function decodePng(buf) {
+  if (buf.length < 8 || !buf.subarray(0, 8).equals(PNG_SIGNATURE)) {
+    throw new Error('not a PNG image');
+  }
+
+  let width = 0;
+  let height = 0;
+  let channels = 0;
+  const idat = [];
+  for (let offset = 8; offset + 8 <= buf.length;) {
+    const length = buf.readUInt32BE(offset);
+    const type = buf.toString('ascii', offset + 4, offset + 8);
+    const data = buf.subarray(offset + 8, offset + 8 + length);
+    if (type === 'IHDR') {
+      width = data.readUInt32BE(0);
+      height = data.readUInt32BE(4);
+      channels = PNG_CHANNELS[data[9]];
+      if (data[8] !== 8 || !channels || data[12] !== 0) {
+        throw new Error('unsupported PNG format');
+      }
+    } else if (type === 'IDAT') {
+      idat.push(data);
+    } else if (type === 'IEND') {
+      break;
+    }
+    offset += 12 + length;
+  }
+
+  const raw = zlib.inflateSync(Buffer.concat(idat));
+  const stride = width * channels;
+  const pixels = Buffer.alloc(stride * height);
+  for (let y = 0; y < height; y++) {
+    const filter = raw[y * (stride + 1)];
+    const src = raw.subarray(y * (stride + 1) + 1, (y + 1) * (stride + 1));
+    const line = y * stride;
+    const prev = line - stride;
+    for (let x = 0; x < stride; x++) {
+      const a = x >= channels ? pixels[line + x - channels] : 0;
+      const b = y ? pixels[prev + x] : 0;
+      const c = y && x >= channels ? pixels[prev + x - channels] : 0;
+      let value = src[x];
+      switch (filter) {
+        case 1: value += a; break;
+        case 2: value += b; break;
+        case 3: value += (a + b) >> 1; break;
+        case 4: value += paeth(a, b, c); break;
+      }
+      pixels[line + x] = value & 0xff;
+    }
+  }
+
+  return { width, height, channels, pixels };
+}
+
+function pngChunk(type, data) {
+  const chunk = Buffer.alloc(12 + data.length);
+  chunk.writeUInt32BE(data.length, 0);
+  chunk.write(type, 4, 'ascii');
+  data.copy(chunk, 8);
+  chunk.writeUInt32BE(crc32(chunk.subarray(4, 8 + data.length)), 8 + data.length);
+  return chunk;
+}
+
+// Encode raw pixels (as returned by decodePng()) into a PNG image
+function encodePng(image) {
+  const colorTypes = { 1: 0, 2: 4, 3: 2, 4: 6 };
+  const ihdr = Buffer.alloc(13);
+  ihdr.writeUInt32BE(image.width, 0);
+  ihdr.writeUInt32BE(image.height, 4);
+  ihdr[8] = 8;
+  ihdr[9] = colorTypes[image.channels];
+
+  const stride = image.width * image.channels;
+  const raw = Buffer.alloc((stride + 1) * image.height);
+  for (let y = 0; y < image.height; y++) {
+    // Filter type 0 (none)
+    image.pixels.copy(raw, y * (stride + 1) + 1, y * stride, (y + 1) * stride);
+  }
+
+  return Buffer.concat([
+    PNG_SIGNATURE,
+    pngChunk('IHDR', ihdr),
+    pngChunk('IDAT', zlib.deflateSync(raw)),
+    pngChunk('IEND', Buffer.alloc(0)),
+  ]);
+}
+
+class PreviewCompositor {
+  constructor() {
+    this.image = null; // Decoded last full image (PNG only)
+  }
+
+  // A full preview replaces the current image
+  onPreview(preview) {
+    this.image = null;
+    if (preview.format === 'png') {
+      try {
+        this.image = decodePng(preview.image);
+      } catch (e) {
+        console.log(`[WARN] Could not decode preview: ${e.message}`);
+      }
+    }
+  }
+
+  // Draw the tiles over the current image, return the updated PNG image (or
+  // null if it cannot be reconstructed)
+  onTiles(tiles) {
+    if (tiles.format !== 'png') {
+      return null;
+    }
+    const image = this.image;
+    if (!image || image.width !== tiles.width || image.height !== tiles.height) {
+      console.log('[WARN] Preview tiles received without matching full preview');
+      return null;
+    }
+
+    let atlas;
+    try {
+      atlas = decodePng(tiles.image);
+    } catch (e) {
+      console.log(`[WARN] Could not decode preview tiles: ${e.message}`);
+      return null;
+    }
+    if (atlas.channels !== image.channels) {
+      console.log('[WARN] Preview tiles format mismatch');
+      return null;
+    }
+
+    const size = tiles.tileSize;
+    const channels = image.channels;
+    const count = tiles.positions.length / 2;
+    for (let i = 0; i < count; i++) {
+      const x = tiles.positions[2 * i] * size;
+      const y = tiles.positions[2 * i + 1] * size;
+      const atlasX = (i % tiles.columns) * size;
+      const atlasY = Math.floor(i / tiles.columns) * size;
+      const w = Math.min(size, image.width - x);
+      const h = Math.min(size, image.height - y);
+      for (let row = 0; row < h; row++) {
+        const src = ((atlasY + row) * atlas.width + atlasX) * channels;
+        const dst = ((y + row) * image.width + x) * channels;
+        atlas.pixels.copy(image.pixels, dst, src, src + w * channels);
+      }
+    }
+
+    return encodePng(image);
+  }
+}
+
+// Decode a binary preview tiles message (see linkandroid/src/websocket_client.h)
+const BINARY_MSG_TYPE_PREVIEW_TILES = 0x02;
+const PREVIEW_TILES_HEADER_MIN_SIZE = 28;
+
+function decodeBinaryPreviewTiles(buf, formats) {
+  if (buf.length < PREVIEW_TILES_HEADER_MIN_SIZE || buf[0] !== BINARY_MSG_TYPE_PREVIEW_TILES) {
+    return null;
+  }
+  const headerSize = buf.readUInt16BE(2);
+  const count = buf.readUInt16BE(22);
+  if (headerSize < PREVIEW_TILES_HEADER_MIN_SIZE + 4 * count || headerSize > buf.length) {
+    return null;
+  }
+  const positions = [];
+  for (let i = 0; i < 2 * count; i++) {
+    positions.push(buf.readUInt16BE(PREVIEW_TILES_HEADER_MIN_SIZE + 2 * i));
+  }
+  return {
+    id: buf.readUInt32BE(4).toString(16).padStart(8, '0'),
+    format: formats[buf[1]] || `unknown(${buf[1]})`,
+    width: buf.readUInt16BE(8),
+    height: buf.readUInt16BE(10),
+    timestamp: Number(buf.readBigUInt64BE(12)),
+    tileSize: buf.readUInt16BE(20),
+    columns: buf.readUInt16BE(24),
+    positions,
+    image: buf.subarray(headerSize),
+  };
+}
+
+// Decode a text preview tiles message:
+// {"type":"preview_tiles","data":"data:image/png;base64,...","tiles":[...],...}
+function decodeTextPreviewTiles(event) {
+  const match = /^data:image\/(\w+);base64,/.exec(event.data || '');
+  if (!match || !Array.isArray(event.tiles)) {
+    return null;
+  }
+  return {
+    id: event.id,
+    format: event.format || match[1],
+    width: event.width,
+    height: event.height,
+    tileSize: event.tileSize,
+    columns: event.columns,
+    positions: event.tiles,
+    image: Buffer.from(event.data.slice(match[0].length), 'base64'),
+  };
+}
+
+module.exports = {
+  PreviewCompositor,
+  decodePng,
+  encodePng,
+  decodeBinaryPreviewTiles,
+  decodeTextPreviewTiles,
+};
@@ -15,6 +15,11 @@
  */
 
 const { WebSocketServer } = require('ws');
+const {
+  PreviewCompositor,
+  decodeBinaryPreviewTiles,
+  decodeTextPreviewTiles,
+} = require('./preview_tiles');
 
 const PORT = 63006;
 const PATH = '/scrcpy';
@@ -26,6 +31,43 @@ const wss = new WebSocketServer({
   path: PATH
 });
 
+// Binary preview message header (see linkandroid/src/websocket_client.h)
+const BINARY_MSG_TYPE_PREVIEW = 0x01;
+const PREVIEW_HEADER_MIN_SIZE = 20;
+const PREVIEW_FORMATS = ['png', 'jpeg', 'webp'];
+
+// Decode a binary preview message: fixed big-endian header + raw image bytes
+function decodeBinaryPreview(buf) {
+  if (buf.length < PREVIEW_HEADER_MIN_SIZE || buf[0] !== BINARY_MSG_TYPE_PREVIEW) {
+    return null;
+  }
+  const headerSize = buf.readUInt16BE(2);
+  if (headerSize < PREVIEW_HEADER_MIN_SIZE || headerSize > buf.length) {
+    return null;
+  }
+  return {
+    id: buf.readUInt32BE(4).toString(16).padStart(8, '0'),
+    format: PREVIEW_FORMATS[buf[1]] || `unknown(${buf[1]})`,
+    width: buf.readUInt16BE(8),
+    height: buf.readUInt16BE(10),
+    timestamp: Number(buf.readBigUInt64BE(12)),
+    image: buf.subarray(headerSize),
+  };
+}
+
+// Decode a text preview message: {"type":"preview","data":"data:image/png;base64,..."}
+function decodeTextPreview(event) {
+  const match = /^data:image\/(\w+);base64,/.exec(event.data || '');
+  if (!match) {
+    return null;
+  }
+  return {
+    id: event.id,
+    format: event.format || match[1],
+    image: Buffer.from(event.data.slice(match[0].length), 'base64'),
+  };
+}
+
 // Generate a random 8-char hex message ID for request/response pairing
 function generateId() {
   return Array.from({ length: 8 }, () =>
@@ -142,18 +184,81 @@ wss.on('connection', (ws, req) => {
 
   }, 3000);
 
-  // Track the latest preview frame (PNG binary data)
+  // Track the latest preview frame (encoded image data)
   let latestPreviewFrame = null;
   let screenshotIndex = 0;
 
-  ws.on('message', (data) => {
+  // Reconstructs the previews sent with --linkandroid-preview-tiles
+  const compositor = new PreviewCompositor();
+
+  function onPreview(preview, transport) {
+    latestPreviewFrame = preview.image;
+    compositor.onPreview(preview);
+    const size = preview.width ? ` ${preview.width}x${preview.height}` : '';
+    const latency = preview.timestamp ? `, ${Date.now() - preview.timestamp} ms old` : '';
+    console.log(`\r[${new Date().toISOString()}] Preview frame received (${transport}, ${preview.format}${size}): ` +
+                `${(preview.image.length / 1024).toFixed(0)} KB${latency}`);
+  }
+
+  function onPreviewTiles(tiles, transport) {
+    const image = compositor.onTiles(tiles);
+    if (image) {
+      latestPreviewFrame = image;
+    }
+    const latency = tiles.timestamp ? `, ${Date.now() - tiles.timestamp} ms old` : '';
+    const count = tiles.positions.length / 2;
+    console.log(`\r[${new Date().toISOString()}] Preview tiles received (${transport}, ${tiles.format}): ` +
+                `${count} tiles, ${(tiles.image.length / 1024).toFixed(0)} KB` +
+                `${image ? ', reconstructed' : ''}${latency}`);
+  }
+
+  // Save the image of a screenshot response (falls back to the last preview)
+  function saveScreenshot(event) {
+    const fs = require('fs');
+    const path = require('path');
+    let image = null;
+    let ext = 'png';
+    if (event.data && event.data.success) {
+      const match = /^data:image\/(\w+);base64,(.*)$/.exec(event.data.image);
+      if (match) {
+        ext = match[1] === 'jpeg' ? 'jpg' : match[1];
+        image = Buffer.from(match[2], 'base64');
+      }
+    } else {
+      const error = event.data ? event.data.error : 'unknown';
+      console.log(`\n[WARN] Screenshot failed (${error}), using the last preview frame`);
+      image = latestPreviewFrame;
+      ext = image && image[0] === 0x89 ? 'png' : 'img';
+    }
+    if (!image) {
+      console.log('\n[INFO] No image available for the screenshot');
+      return;
+    }
+    screenshotIndex++;
+    const filename = `screenshot_${String(screenshotIndex).padStart(3, '0')}.${ext}`;
+    const filepath = path.join(process.cwd(), filename);
+    fs.writeFileSync(filepath, image);
+    const size = event.data && event.data.width ? ` ${event.data.width}x${event.data.height}` : '';
+    console.log(`\n[INFO] Screenshot saved: ${filepath}${size} (${(image.length / 1024).toFixed(0)} KB)`);
+  }
+
+  ws.on('message', (data, isBinary) => {
     // Detect binary messages (preview frames) vs text messages (JSON events)
-    if (data instanceof Buffer || data instanceof ArrayBuffer) {
+    if (isBinary) {
       const buf = Buffer.isBuffer(data) ? data : Buffer.from(data);
-      // Preview frames are PNG data (starting with PNG header \x89PNG)
+      const preview = decodeBinaryPreview(buf);
+      if (preview) {
+        onPreview(preview, 'binary');
+        return;
+      }
+      const tiles = decodeBinaryPreviewTiles(buf, PREVIEW_FORMATS);
+      if (tiles) {
+        onPreviewTiles(tiles, 'binary');
+        return;
+      }
+      // Legacy: raw PNG data (starting with PNG header \x89PNG)
       if (buf.length > 4 && buf[0] === 0x89 && buf[1] === 0x50 && buf[2] === 0x4E && buf[3] === 0x47) {
-        latestPreviewFrame = buf;
-        console.log(`\r[${new Date().toISOString()}] Preview frame received: ${(buf.length / 1024).toFixed(0)} KB`);
+        onPreview({ format: 'png', image: buf }, 'raw');
         return;
       }
       // Other binary data — ignore
@@ -163,6 +268,25 @@ wss.on('connection', (ws, req) => {
     try {
       const message = data.toString();
       const event = JSON.parse(message);
+      if (event.type === 'preview') {
+        const preview = decodeTextPreview(event);
+        if (preview) {
+          onPreview(preview, 'text');
+        }
+        return;
+      }
+      if (event.type === 'preview_tiles') {
+        const tiles = decodeTextPreviewTiles(event);
+        if (tiles) {
+          onPreviewTiles(tiles, 'text');
+        }
+        return;
+      }
+      // The image is not logged
+      if (event.type === 'screenshot') {
+        saveScreenshot(event);
+        return;
+      }
       // Log with color coding based on event type
       if (event.type !== 'panel_button_click') {
         // Avoid spamming the console with panel button click logs (they get their own section)
@@ -208,21 +332,10 @@ wss.on('connection', (ws, req) => {
           console.log('\n[INFO] Volume- button clicked → injecting KEYCODE_VOLUME_DOWN');
           sendKey(25); // KEYCODE_VOLUME_DOWN
         } else if (btnId === 'screenshot') {
-          const fs = require('fs');
-          const path = require('path');
-          if (latestPreviewFrame) {
-            screenshotIndex++;
-            const filename = `screenshot_${String(screenshotIndex).padStart(3, '0')}.png`;
-            const filepath = path.join(process.cwd(), filename);
-            fs.writeFileSync(filepath, latestPreviewFrame);
-            console.log(`\n[INFO] Screenshot saved: ${filepath} (${(latestPreviewFrame.length / 1024).toFixed(0)} KB)`);
-
-            // Also try to trigger an immediate preview capture by re-sending the panel config
-            // (this is a client-side trigger hint)
-          } else {
-            console.log(`\n[INFO] Screenshot button clicked but no preview frame available yet.
-  Preview frames are sent every second by scrcpy. Please wait for a preview frame first.`);
-          }
+          // Request a full-resolution screenshot of the last decoded frame
+          const id = generateId();
+          console.log(`\n[INFO] Screenshot button clicked → requesting screenshot (id=${id})`);
+          ws.send(JSON.stringify({ type: 'screenshot', id, data: { format: 'png' } }));
 
         // === Special buttons (custom server actions) ===
         } else if (btnId === 'quit') {